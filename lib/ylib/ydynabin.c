@@ -47,7 +47,7 @@ yerr_t ydynabin_expand(ydynabin_t *container, void *data, size_t len) {
 		// there is not enough room in the buffer
 		// create a larger buffer
 		sz = container->len + len;
-		sz = YDYNABIN_SIZE(len);
+		sz = YDYNABIN_SIZE(sz);
 		sz = YDYNABIN_RNDSZ(sz);
 		if ((ptr = YMALLOC(sz)) == NULL)
 			return (YENOMEM);
@@ -4,8 +4,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <syslog.h>
+#include <signal.h>
+#include <pthread.h>
 #include "ydefs.h"
 #include "ystr.h"
 #define YLOG_IS_YLOG
@@ -15,6 +19,83 @@
 ylog_main_t _ylog_gl = {NULL, YLOG_STDERR, NULL, NULL, NULL, NULL,
 			YLOG_WARN, 524288, NULL, LOG_DAEMON};
 
+/*
+** ylog_arg_t
+** Types of the arguments of a format string.
+*/
+typedef enum ylog_arg_e
+{
+  YLOG_ARG_NONE = 0,
+  YLOG_ARG_INT,
+  YLOG_ARG_UINT,
+  YLOG_ARG_CHAR,
+  YLOG_ARG_DOUBLE,
+  YLOG_ARG_LDOUBLE,
+  YLOG_ARG_STRING,
+  YLOG_ARG_POINTER,
+  YLOG_ARG_COUNT
+} ylog_arg_t;
+
+/*
+** ylog_entry_t
+** Asynchronous log entry. The arguments are copied one after the other;
+** strings are preceded by their length.
+*/
+typedef struct ylog_entry_s
+{
+  ylog_priority_t prio;
+  int line;
+  const char *file;
+  const char *funcname;
+  const char *format;
+  time_t time;
+  unsigned short len;
+  unsigned char args[YLOG_ASYNC_ARGS_SIZE];
+} ylog_entry_t;
+
+/*
+** ylog_ring_t
+** Ring of the asynchronous log entries of a thread. The tail is written by
+** the thread, the head by the background thread.
+*/
+typedef struct ylog_ring_s
+{
+  unsigned int head;
+  unsigned int tail;
+  unsigned long dropped;
+  unsigned long reported;
+  struct ylog_ring_s *next;
+  ylog_entry_t *entries;
+} ylog_ring_t;
+
+/* ****** asynchronous logs variables ******* */
+static ybool_t _ylog_async_on = YFALSE;
+static unsigned int _ylog_async_size = 0;
+static time_t _ylog_async_now = 0;
+static pthread_key_t _ylog_async_key;
+static pthread_mutex_t _ylog_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ylog_ring_t *_ylog_async_rings = NULL;
+static time_t _ylog_async_tm_time = 0;
+static struct tm _ylog_async_tm;
+
+/* ****** private functions ******* */
+static ybool_t ylog_output(ylog_priority_t prio, const char *text,
+			   struct tm *tm);
+static ybool_t ylog_async_write(ylog_priority_t prio, const char *file,
+				int line, const char *funcname,
+				const char *str, va_list plist);
+static ylog_ring_t *ylog_async_ring(void);
+static void *ylog_async_loop(void *param);
+static unsigned int ylog_async_flush(void);
+static void ylog_async_exit(void);
+static void ylog_async_format(ylog_entry_t *entry, char *buf, size_t size);
+static const char *ylog_spec(const char *pt, ylog_arg_t *type, int *mod,
+			     int *stars, int *precision);
+static ybool_t ylog_pack(unsigned char **pt, unsigned char *end,
+			 const void *data, size_t len);
+static ybool_t ylog_unpack(const unsigned char **pt,
+			   const unsigned char *end, void *data, size_t len);
+
 /*
 ** ylog_init()
 ** Initialize the global yLog structure. Can be used many times in
@@ -95,6 +176,37 @@ void ylog_set_handler(void (*f)(const char*))
   _ylog_gl.handler = f;
 }
 
+/*
+** ylog_set_async()
+** Switch to asynchronous logs, written by a background thread.
+*/
+ybool_t ylog_set_async(unsigned int ring_size)
+{
+  pthread_t tid;
+  sigset_t set, old;
+  int rc;
+
+  if (_ylog_async_on)
+    return (YTRUE);
+  for (_ylog_async_size = 1; _ylog_async_size < ring_size; )
+    _ylog_async_size <<= 1;
+  if (pthread_key_create(&_ylog_async_key, NULL))
+    return (YFALSE);
+  _ylog_async_now = time(NULL);
+  /* signal handlers must not run in the background thread, which could
+     hold the mutex when they exit */
+  sigfillset(&set);
+  pthread_sigmask(SIG_SETMASK, &set, &old);
+  rc = pthread_create(&tid, NULL, ylog_async_loop, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (rc)
+    return (YFALSE);
+  pthread_detach(tid);
+  atexit(ylog_async_exit);
+  __atomic_store_n(&_ylog_async_on, YTRUE, __ATOMIC_RELEASE);
+  return (YTRUE);
+}
+
 /*
 ** ylog_set_identname()
 ** Set the identity name used for syslog.
@@ -123,21 +235,89 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
 		   const char *funcname, const char *str, ...)
 {
   time_t current_time;
-  struct tm *tm;
+  struct tm tm;
   char *msg[] = {"DEBUG", "INFO", "NOTE", "WARN", "ERR", "CRIT"};
   va_list plist;
   char *tmpstr, *tmp2;
-  FILE *tmp_file;
-  ybool_t res = YTRUE;
-  int i;
+  ybool_t res;
 
   if (prio < _ylog_gl.prio)
     return (YFALSE);
   va_start(plist, str);
+  if (__atomic_load_n(&_ylog_async_on, __ATOMIC_ACQUIRE))
+    {
+      /* the entry is formatted and written by the background thread */
+      res = ylog_async_write(prio, file, line, funcname, str, plist);
+      va_end(plist);
+      return (res);
+    }
   current_time = time(NULL);
-  tm = localtime(&current_time);
+  localtime_r(&current_time, &tm);
   tmpstr = ys_new("");
   tmp2 = ys_new("");
+  /* create log string */
+  ys_printf(&tmpstr, "(%s|%d)[%s] %s: %s", file ? file : "", line,
+	    msg[(int)prio], funcname ? funcname : "", str ? str : "");
+  ys_vprintf(&tmp2, tmpstr, plist);
+  va_end(plist);
+  ys_del(&tmpstr);
+  res = ylog_output(prio, tmp2, &tm);
+  ys_del(&tmp2);
+  return (res);
+}
+
+/*
+** ylog_check_module()
+** Write a message to log, only the declared subsystems.
+*/
+ybool_t ylog_check_module(char *module)
+{
+  char *pt, c;
+
+  if (!module || !_ylog_gl.modules)
+    return (YTRUE);
+  if (!(pt = strstr(_ylog_gl.modules, module)))
+    return (YFALSE);
+  c = *(pt + strlen(module));
+  if (!IS_SPACE(c) && c != '\0' && c != ',' && c != ';' && c != ':')
+    return (YFALSE);
+  return (YTRUE);
+}
+
+/*
+** ylog_close()
+** Close a log session. If some ylog_write() are called after, they will be
+** redirected to standard output.
+*/
+void ylog_close(ylog_priority_t prio)
+{
+  if (__atomic_load_n(&_ylog_async_on, __ATOMIC_ACQUIRE))
+    ylog_async_flush();
+  YFREE(_ylog_gl.filename);
+  YFREE(_ylog_gl.modules);
+  YFREE(_ylog_gl.progname);
+  YFREE(_ylog_gl.identname);
+  if (_ylog_gl.setup & YLOG_FILE && _ylog_gl.file)
+    fclose(_ylog_gl.file);
+  _ylog_gl.facility = LOG_DAEMON;
+  _ylog_gl.handler = NULL;
+  _ylog_gl.setup = YLOG_STDERR;
+  _ylog_gl.file = stderr;
+  _ylog_gl.prio = prio;
+}
+
+/*
+** ylog_output()
+** Write a formatted log entry to the log destinations.
+*/
+static ybool_t ylog_output(ylog_priority_t prio, const char *text,
+			   struct tm *tm)
+{
+  char *tmpstr;
+  FILE *tmp_file;
+  ybool_t res = YTRUE;
+  int i;
+
   /* update log structure for consistency */
   if (_ylog_gl.setup & YLOG_FILE && !_ylog_gl.file)
     {
@@ -149,12 +329,6 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
       _ylog_gl.setup |= YLOG_STDERR;
       _ylog_gl.setup ^= YLOG_HANDLER;
     }
-  /* create log string */
-  ys_printf(&tmpstr, "(%s|%d)[%s] %s: %s", file ? file : "", line,
-	    msg[(int)prio], funcname ? funcname : "", str ? str : "");
-  ys_vprintf(&tmp2, tmpstr, plist);
-  va_end(plist);
-  ys_trunc(tmpstr);
   /* process output to syslog */
   if (_ylog_gl.setup & YLOG_SYSLOG)
     {
@@ -167,21 +341,17 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
 	     prio == YLOG_WARN ? LOG_WARNING :
 	     prio == YLOG_ERR ? LOG_ERR :
 	     prio == YLOG_CRIT ? LOG_CRIT : LOG_DEBUG,
-	     "%s", tmp2);
+	     "%s", text);
       closelog();
       if (_ylog_gl.setup == YLOG_SYSLOG)
-	{
-	  ys_del(&tmp2);
-	  ys_del(&tmpstr);
-	  return (YTRUE);
-	}
+	return (YTRUE);
     }
   /* create extended log string */
+  tmpstr = ys_new("");
   ys_printf(&tmpstr, "%04d-%02d-%02d %02d:%02d:%02d %s%s\n",
 	    tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 	    tm->tm_hour, tm->tm_min, tm->tm_sec,
-	    _ylog_gl.progname ? _ylog_gl.progname : "", tmp2);
-  ys_del(&tmp2);
+	    _ylog_gl.progname ? _ylog_gl.progname : "", text);
   /* process output to handler */
   if (_ylog_gl.setup & YLOG_HANDLER)
     _ylog_gl.handler(tmpstr);
@@ -199,7 +369,8 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
 	  _ylog_gl.setup ^= YLOG_FILE;
 	  YLOG_ADD(YLOG_ERR, "Problem to write log to file '%s'",
 		   _ylog_gl.filename);
-	  res = YFALSE;
+	  ys_del(&tmpstr);
+	  return (YFALSE);
 	}
       fflush(_ylog_gl.file);
       if (_ylog_gl.max_log_size)
@@ -213,7 +384,6 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
 	      _ylog_gl.file = 0;
 	      if (fclose(tmp_file))
 		YLOG_ADD(YLOG_WARN, "Unable to close file");
-	      tmpstr = ys_new("");
 	      /* search an usable file name */
 	      for (i = 0; ; ++i)
 		{
@@ -241,39 +411,455 @@ ybool_t ylog_write(ylog_priority_t prio, const char *file, int line,
 }
 
 /*
-** ylog_check_module()
-** Write a message to log, only the declared subsystems.
+** ylog_async_write()
+** Copy a log entry and its arguments into the ring of the current thread.
+** Nothing is formatted and no system call is done (except for the creation
+** of the ring, on the first log entry of the thread).
 */
-ybool_t ylog_check_module(char *module)
+static ybool_t ylog_async_write(ylog_priority_t prio, const char *file,
+				int line, const char *funcname,
+				const char *str, va_list plist)
 {
-  char *pt, c;
+  ylog_ring_t *ring;
+  ylog_entry_t *entry;
+  unsigned char *pt, *end;
+  const char *fmt, *s;
+  ylog_arg_t type;
+  unsigned short slen;
+  int mod, stars, precision, star;
+  unsigned int tail;
 
-  if (!module || !_ylog_gl.modules)
-    return (YTRUE);
-  if (!(pt = strstr(_ylog_gl.modules, module)))
-    return (YFALSE);
-  c = *(pt + strlen(module));
-  if (!IS_SPACE(c) && c != '\0' && c != ',' && c != ';' && c != ':')
+  if (!(ring = pthread_getspecific(_ylog_async_key)) &&
+      !(ring = ylog_async_ring()))
     return (YFALSE);
+  tail = ring->tail;
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >=
+      _ylog_async_size)
+    {
+      /* the ring is full: the entry is lost */
+      __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+      return (YFALSE);
+    }
+  entry = &ring->entries[tail & (_ylog_async_size - 1)];
+  entry->prio = prio;
+  entry->line = line;
+  entry->file = file;
+  entry->funcname = funcname;
+  entry->format = str;
+  entry->time = __atomic_load_n(&_ylog_async_now, __ATOMIC_RELAXED);
+  pt = entry->args;
+  end = entry->args + sizeof(entry->args);
+  /* copy the arguments, as described by the format string */
+  for (fmt = str; fmt && *fmt; ++fmt)
+    {
+      if (*fmt != '%')
+	continue;
+      fmt = ylog_spec(fmt, &type, &mod, &stars, &precision);
+      for (; stars > 0; --stars)
+	{
+	  star = va_arg(plist, int);
+	  ylog_pack(&pt, end, &star, sizeof(star));
+	  /* the precision is the last star */
+	  if (stars == 1 && precision == -2)
+	    precision = star;
+	}
+      if (type == YLOG_ARG_INT)
+	{
+	  long long v = mod == 'l' ? va_arg(plist, long) :
+	    mod == 'q' ? va_arg(plist, long long) :
+	    mod == 'j' ? (long long)va_arg(plist, intmax_t) :
+	    mod == 'z' ? (long long)va_arg(plist, ssize_t) :
+	    mod == 't' ? (long long)va_arg(plist, ptrdiff_t) :
+	    mod == 'H' ? (signed char)va_arg(plist, int) :
+	    mod == 'h' ? (short)va_arg(plist, int) : va_arg(plist, int);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      else if (type == YLOG_ARG_UINT)
+	{
+	  unsigned long long v = mod == 'l' ? va_arg(plist, unsigned long) :
+	    mod == 'q' ? va_arg(plist, unsigned long long) :
+	    mod == 'j' ? (unsigned long long)va_arg(plist, uintmax_t) :
+	    mod == 'z' ? (unsigned long long)va_arg(plist, size_t) :
+	    mod == 't' ? (unsigned long long)va_arg(plist, ptrdiff_t) :
+	    mod == 'H' ? (unsigned char)va_arg(plist, unsigned int) :
+	    mod == 'h' ? (unsigned short)va_arg(plist, unsigned int) :
+	    va_arg(plist, unsigned int);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      else if (type == YLOG_ARG_CHAR)
+	{
+	  int v = va_arg(plist, int);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      else if (type == YLOG_ARG_DOUBLE)
+	{
+	  double v = va_arg(plist, double);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      else if (type == YLOG_ARG_LDOUBLE)
+	{
+	  long double v = va_arg(plist, long double);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      else if (type == YLOG_ARG_STRING)
+	{
+	  /* strings are truncated, and their precision is respected */
+	  if (!(s = va_arg(plist, const char*)))
+	    s = "(null)";
+	  slen = (unsigned short)strnlen(s, (precision >= 0 &&
+					     precision < YLOG_ASYNC_STRING_MAX) ?
+					 (size_t)precision :
+					 YLOG_ASYNC_STRING_MAX);
+	  if (ylog_pack(&pt, end, &slen, sizeof(slen)))
+	    ylog_pack(&pt, end, s, slen);
+	}
+      else if (type == YLOG_ARG_POINTER || type == YLOG_ARG_COUNT)
+	{
+	  void *v = va_arg(plist, void*);
+	  ylog_pack(&pt, end, &v, sizeof(v));
+	}
+      if (!*fmt)
+	break;
+    }
+  entry->len = (unsigned short)(pt - entry->args);
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
   return (YTRUE);
 }
 
 /*
-** ylog_close()
-** Close a log session. If some ylog_write() are called after, they will be
-** redirected to standard output.
+** ylog_async_ring()
+** Create the ring of the current thread.
 */
-void ylog_close(ylog_priority_t prio)
+static ylog_ring_t *ylog_async_ring(void)
 {
-  YFREE(_ylog_gl.filename);
-  YFREE(_ylog_gl.modules);
-  YFREE(_ylog_gl.progname);
-  YFREE(_ylog_gl.identname);
-  if (_ylog_gl.setup & YLOG_FILE && _ylog_gl.file)
-    fclose(_ylog_gl.file);
-  _ylog_gl.facility = LOG_DAEMON;
-  _ylog_gl.handler = NULL;
-  _ylog_gl.setup = YLOG_STDERR;
-  _ylog_gl.file = stderr;
-  _ylog_gl.prio = prio;
+  ylog_ring_t *ring;
+
+  if (!(ring = YMALLOC(sizeof(ylog_ring_t))))
+    return (NULL);
+  if (!(ring->entries = YMALLOC(_ylog_async_size * sizeof(ylog_entry_t))))
+    {
+      YFREE(ring);
+      return (NULL);
+    }
+  pthread_setspecific(_ylog_async_key, ring);
+  /* lock-free insertion, the background thread could be writing an entry
+     of this thread (for instance an error of the log file) */
+  ring->next = __atomic_load_n(&_ylog_async_rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&_ylog_async_rings, &ring->next, ring,
+				      YFALSE, __ATOMIC_RELEASE,
+				      __ATOMIC_RELAXED))
+    ;
+  return (ring);
+}
+
+/*
+** ylog_async_loop()
+** Main loop of the background thread: update the cached time, and write
+** the log entries of all rings.
+*/
+static void *ylog_async_loop(void *param)
+{
+  struct timespec ts;
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = YLOG_ASYNC_SLEEP_MS * 1000000L;
+  for (; ; )
+    {
+      __atomic_store_n(&_ylog_async_now, time(NULL), __ATOMIC_RELAXED);
+      if (!ylog_async_flush())
+	nanosleep(&ts, NULL);
+    }
+  return (param);
+}
+
+/*
+** ylog_async_flush()
+** Format and write the waiting log entries of all rings. Return the number
+** of written entries.
+*/
+static unsigned int ylog_async_flush(void)
+{
+  char *msg[] = {"DEBUG", "INFO", "NOTE", "WARN", "ERR", "CRIT"};
+  char buf[YSTR_SIZE], text[YSTR_SIZE];
+  ylog_ring_t *ring;
+  ylog_entry_t *entry;
+  unsigned long dropped;
+  unsigned int head, nbr = 0;
+
+  pthread_mutex_lock(&_ylog_async_mutex);
+  for (ring = __atomic_load_n(&_ylog_async_rings, __ATOMIC_ACQUIRE); ring;
+       ring = ring->next)
+    {
+      head = ring->head;
+      for (; head != __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE); ++head)
+	{
+	  entry = &ring->entries[head & (_ylog_async_size - 1)];
+	  /* the date is computed once per second */
+	  if (entry->time != _ylog_async_tm_time)
+	    {
+	      _ylog_async_tm_time = entry->time;
+	      localtime_r(&_ylog_async_tm_time, &_ylog_async_tm);
+	    }
+	  ylog_async_format(entry, buf, sizeof(buf));
+	  snprintf(text, sizeof(text), "(%s|%d)[%s] %s: %s",
+		   entry->file ? entry->file : "", entry->line,
+		   msg[(int)entry->prio],
+		   entry->funcname ? entry->funcname : "", buf);
+	  ylog_output(entry->prio, text, &_ylog_async_tm);
+	  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	  ++nbr;
+	}
+      dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+      if (dropped != ring->reported)
+	{
+	  snprintf(text, sizeof(text), "[%s] %lu log entries dropped",
+		   msg[YLOG_WARN], dropped - ring->reported);
+	  ring->reported = dropped;
+	  ylog_output(YLOG_WARN, text, &_ylog_async_tm);
+	}
+    }
+  pthread_mutex_unlock(&_ylog_async_mutex);
+  return (nbr);
+}
+
+/*
+** ylog_async_exit()
+** Write the remaining log entries when the program exits.
+*/
+static void ylog_async_exit(void)
+{
+  ylog_async_flush();
+}
+
+/*
+** ylog_async_format()
+** Format an asynchronous log entry, using its format string and its
+** copied arguments. Each conversion is formatted separately.
+*/
+static void ylog_async_format(ylog_entry_t *entry, char *buf, size_t size)
+{
+  const unsigned char *pt = entry->args, *end = entry->args + entry->len;
+  const char *fmt, *next, *c;
+  char spec[64], str[YLOG_ASYNC_STRING_MAX + 1];
+  size_t n = 0, l;
+  ylog_arg_t type;
+  unsigned short slen;
+  int mod, stars, precision, star, rc = 0;
+
+  *buf = '\0';
+  for (fmt = entry->format; fmt && *fmt && n < size - 1; fmt = next + 1)
+    {
+      if (*fmt != '%')
+	{
+	  /* literal characters */
+	  for (next = fmt; next[1] && next[1] != '%'; ++next)
+	    ;
+	  l = (size_t)(next - fmt + 1);
+	  if (l > size - 1 - n)
+	    l = size - 1 - n;
+	  memcpy(buf + n, fmt, l);
+	  n += l;
+	  buf[n] = '\0';
+	  continue;
+	}
+      next = ylog_spec(fmt, &type, &mod, &stars, &precision);
+      if (type == YLOG_ARG_NONE)
+	{
+	  /* "%%" or unknown conversion, written as is */
+	  l = (size_t)(next - fmt + (*next ? 1 : 0));
+	  if (*next == '%' && next == fmt + 1)
+	    l = 1, ++fmt;
+	  if (l > size - 1 - n)
+	    l = size - 1 - n;
+	  memcpy(buf + n, fmt, l);
+	  n += l;
+	  buf[n] = '\0';
+	  if (!*next)
+	    break;
+	  continue;
+	}
+      /* rebuild the conversion, with the stars replaced by their values
+	 and the integers converted to long long */
+      l = 0;
+      for (c = fmt; c < next && l < sizeof(spec) - 24; ++c)
+	{
+	  if (*c == '*')
+	    {
+	      if (!ylog_unpack(&pt, end, &star, sizeof(star)))
+		goto truncated;
+	      l += (size_t)sprintf(spec + l, "%d", star);
+	    }
+	  else if (!strchr("hlqjztL", *c) ||
+		   (*c == 'L' && type == YLOG_ARG_LDOUBLE))
+	    spec[l++] = *c;
+	}
+      if (type == YLOG_ARG_INT || type == YLOG_ARG_UINT)
+	{
+	  spec[l++] = 'l';
+	  spec[l++] = 'l';
+	}
+      spec[l++] = *next;
+      spec[l] = '\0';
+      if (type == YLOG_ARG_INT)
+	{
+	  long long v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_UINT)
+	{
+	  unsigned long long v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_CHAR)
+	{
+	  int v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_DOUBLE)
+	{
+	  double v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_LDOUBLE)
+	{
+	  long double v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_STRING)
+	{
+	  if (!ylog_unpack(&pt, end, &slen, sizeof(slen)) ||
+	      !ylog_unpack(&pt, end, str, slen))
+	    goto truncated;
+	  str[slen] = '\0';
+	  rc = snprintf(buf + n, size - n, spec, str);
+	}
+      else if (type == YLOG_ARG_POINTER)
+	{
+	  void *v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = snprintf(buf + n, size - n, spec, v);
+	}
+      else if (type == YLOG_ARG_COUNT)
+	{
+	  /* "%n" conversions are ignored */
+	  void *v;
+	  if (!ylog_unpack(&pt, end, &v, sizeof(v)))
+	    goto truncated;
+	  rc = 0;
+	}
+      if (rc > 0)
+	n = ((size_t)rc >= size - n) ? size - 1 : n + (size_t)rc;
+      if (!*next)
+	break;
+    }
+  return;
+ truncated:
+  snprintf(buf + n, size - n, "[...]");
+}
+
+/*
+** ylog_spec()
+** Parse a conversion specification of a format string. Return a pointer to
+** its conversion character. The length modifier is given as a character
+** ('H' for "hh", 'q' for "ll"), the precision is -1 if not given and -2
+** if given as a star.
+*/
+static const char *ylog_spec(const char *pt, ylog_arg_t *type, int *mod,
+			     int *stars, int *precision)
+{
+  *type = YLOG_ARG_NONE;
+  *mod = 0;
+  *stars = 0;
+  *precision = -1;
+  /* flags and width */
+  for (++pt; *pt && strchr("-+ #0'", *pt); ++pt)
+    ;
+  if (*pt == '*')
+    ++*stars, ++pt;
+  for (; *pt >= '0' && *pt <= '9'; ++pt)
+    ;
+  /* precision */
+  if (*pt == '.')
+    {
+      ++pt;
+      if (*pt == '*')
+	{
+	  ++*stars;
+	  ++pt;
+	  *precision = -2;
+	}
+      else
+	for (*precision = 0; *pt >= '0' && *pt <= '9'; ++pt)
+	  *precision = *precision * 10 + (*pt - '0');
+    }
+  /* length modifier */
+  if ((pt[0] == 'h' && pt[1] == 'h') || (pt[0] == 'l' && pt[1] == 'l'))
+    {
+      *mod = pt[0] == 'h' ? 'H' : 'q';
+      pt += 2;
+    }
+  else if (*pt && strchr("hlqjztL", *pt))
+    *mod = *pt++;
+  /* conversion */
+  if (!*pt)
+    return (pt - 1);
+  if (strchr("di", *pt))
+    *type = YLOG_ARG_INT;
+  else if (strchr("uoxX", *pt))
+    *type = YLOG_ARG_UINT;
+  else if (*pt == 'c')
+    *type = YLOG_ARG_CHAR;
+  else if (strchr("eEfFgGaA", *pt))
+    *type = *mod == 'L' ? YLOG_ARG_LDOUBLE : YLOG_ARG_DOUBLE;
+  else if (*pt == 's')
+    *type = YLOG_ARG_STRING;
+  else if (*pt == 'p')
+    *type = YLOG_ARG_POINTER;
+  else if (*pt == 'n')
+    *type = YLOG_ARG_COUNT;
+  return (pt);
+}
+
+/*
+** ylog_pack()
+** Copy an argument into an asynchronous log entry. Return FALSE if there
+** is not enough room.
+*/
+static ybool_t ylog_pack(unsigned char **pt, unsigned char *end,
+			 const void *data, size_t len)
+{
+  if ((size_t)(end - *pt) < len)
+    {
+      *pt = end;
+      return (YFALSE);
+    }
+  memcpy(*pt, data, len);
+  *pt += len;
+  return (YTRUE);
+}
+
+/*
+** ylog_unpack()
+** Read an argument of an asynchronous log entry. Return FALSE if the
+** argument was not copied.
+*/
+static ybool_t ylog_unpack(const unsigned char **pt,
+			   const unsigned char *end, void *data, size_t len)
+{
+  if ((size_t)(end - *pt) < len)
+    return (YFALSE);
+  memcpy(data, *pt, len);
+  *pt += len;
+  return (YTRUE);
 }
@@ -105,6 +105,20 @@
  *			</li>
  *			</ul>
  *		</li>
+ *		<li><u>Additionnal feature: asynchronous logs</u><br />
+ *		After a call to YLOG_ASYNC(), the log entries are not formatted
+ *		nor written by the calling thread. Their arguments are copied
+ *		into a ring owned by the thread, and a background thread
+ *		formats and writes them. Strings are truncated to
+ *		YLOG_ASYNC_STRING_MAX characters. When a ring is full, the log
+ *		entries are dropped (their number is written later).
+ *		</li>
+ *		<li><u>Additionnal feature: compile-time threshold</u><br />
+ *		Log entries with a priority level lower than YLOG_COMPILE_PRIO
+ *		are removed at compile time, with their arguments. For example,
+ *		compile with -DYLOG_COMPILE_PRIO=YLOG_NOTE to remove the debug
+ *		and information logs.
+ *		</li>
  *		</ul>
  * @version	1.0.0 Jun 26 2002
  * @author	Amaury Bouchard <amaury@amaury.net>
@@ -128,6 +142,25 @@ extern "C" {
 /*! @define MB10 Value of 10 MB. */
 #define MB10			10485760
 
+#ifndef YLOG_COMPILE_PRIO
+/*! @define YLOG_COMPILE_PRIO Minimal priority level of the log entries kept
+ * at compile time. */
+# define YLOG_COMPILE_PRIO	YLOG_DEBUG
+#endif /* YLOG_COMPILE_PRIO */
+
+/*! @define YLOG_ASYNC_RING_SIZE Default number of entries of the threads'
+ * rings. */
+#define YLOG_ASYNC_RING_SIZE	1024
+/*! @define YLOG_ASYNC_ARGS_SIZE Size of the copied arguments of an
+ * asynchronous log entry. */
+#define YLOG_ASYNC_ARGS_SIZE	200
+/*! @define YLOG_ASYNC_STRING_MAX Maximum length of a string argument of an
+ * asynchronous log entry. */
+#define YLOG_ASYNC_STRING_MAX	128
+/*! @define YLOG_ASYNC_SLEEP_MS Time between two checks of the rings by the
+ * background thread, when they are empty (milliseconds). */
+#define YLOG_ASYNC_SLEEP_MS	10
+
 /*! @define YLOG_INIT_STDERR Initialize to use standard error output. */
 #define YLOG_INIT_STDERR()	ylog_init(YLOG_STDERR, NULL, argv[0], KB512)
 /*! @define YLOG_INIT_FILE Initialize to use an output file. */
@@ -203,6 +236,9 @@ extern "C" {
 /*! @define YLOG_SET_CRIT Set the default priority to critical level. */
 #define YLOG_SET_CRIT()		ylog_set_prio(YLOG_CRIT)
 
+/*! @define YLOG_ASYNC Write the logs from a background thread. */
+#define YLOG_ASYNC()		ylog_set_async(YLOG_ASYNC_RING_SIZE)
+
 /*! @define YLOG_SIZE_MINI Set the max log size to a minimal value (100 KB). */
 #define YLOG_SIZE_MINI()	ylog_set_logsize(KB100)
 /*! @define YLOG_SIZE_NORM Set the max log size to a normal value (512 KB). */
@@ -217,16 +253,23 @@ extern "C" {
  * in printf()). Return TRUE if the log entry was written, FALSE otherwise. */
 # define YLOG(...)		ylog_write(_ylog_gl.prio, __FILE__, __LINE__, \
 					   __FUNCTION__, __VA_ARGS__)
+/*! @define YLOG_ENABLED Tell if a priority level is kept at compile time and
+ * at run time. Constant levels are checked by the compiler. */
+#define YLOG_ENABLED(level)	((int)(level) >= (int)YLOG_COMPILE_PRIO && \
+				 (int)(level) >= (int)_ylog_gl.prio)
 /*! @define YLOG_ADD Add a log with a specified priority. The last parameter 
  * could be a simple character string, or a string with several arguments (like
- * in printf()). Return TRUE if the log entry was written, FALSE otherwise. */
-#define YLOG_ADD(prio, ...)	ylog_write(prio, __FILE__, __LINE__, \
-					   __FUNCTION__, __VA_ARGS__)
+ * in printf()). Return TRUE if the log entry was written, FALSE otherwise.
+ * The arguments are not evaluated if the log entry is not written. */
+#define YLOG_ADD(prio, ...)	(YLOG_ENABLED(prio) ? \
+				 ylog_write(prio, __FILE__, __LINE__, \
+					    __FUNCTION__, __VA_ARGS__) : YFALSE)
 /*! @define YLOG_MOD Add a log with a specified priority, only if the given
  * module name is specified in the YLOG_MODULES environment variable. The
  * last parameter could be a simple character string, or a string with several
  * arguments (like in printf()). Return value like YLOG_ADD(). */
-#define YLOG_MOD(mod, prio, ...)	(ylog_check_module(mod) ? \
+#define YLOG_MOD(mod, prio, ...)	(YLOG_ENABLED(prio) && \
+					 ylog_check_module(mod) ? \
 					 ylog_write(prio, __FILE__, __LINE__, \
 						    __FUNCTION__, __VA_ARGS__) : 0)
 
@@ -356,6 +399,17 @@ void ylog_set_logsize(unsigned int max_log_size);
  */
 void ylog_set_handler(void (*f)(const char*));
 
+/*!
+ * @function	ylog_set_async
+ *		Switch to asynchronous logs: log entries are copied into a ring
+ *		owned by each thread, and a background thread formats and
+ *		writes them. The remaining entries are written at exit.
+ * @param	ring_size	Number of entries of each ring (rounded up to
+ *				a power of 2).
+ * @return	TRUE if the background thread was started.
+ */
+ybool_t ylog_set_async(unsigned int ring_size);
+
 /*!
  * @function	ylog_set_identname
  *		Set the identity name used for syslog.
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "yring.h"
+
+/* Number of spin loops (-1 until the number of processors is known). */
+static int _yring_spin = -1;
+
+/* private functions */
+static ybool_t _yring_ready(yring_t *ring, ybool_t reader);
+static yerr_t _yring_wait(yring_t *ring, ybool_t reader, const struct timespec *deadline);
+static void _yring_wake(volatile uint32_t *seq, volatile uint32_t *waiting);
+static const struct timespec *_yring_deadline(struct timespec *deadline, int timeout_ms);
+
+/* Compute the memory needed by a ring. */
+size_t yring_memsize(uint32_t size) {
+	return (sizeof(yring_t) + size);
+}
+
+/* Initialize a ring. */
+yring_t *yring_init(void *mem, uint32_t size) {
+	yring_t *ring = (yring_t*)mem;
+
+	// the size must be a power of 2, lower than 2 GB
+	if (!size || (size & (size - 1)) || size > 0x80000000U)
+		return (NULL);
+	memset(ring, 0, sizeof(yring_t));
+	ring->size = size;
+	return (ring);
+}
+
+/* Write data into a ring. */
+yerr_t yring_writev(yring_t *ring, const struct iovec *iov, int iovcnt, int timeout_ms) {
+	struct timespec ts;
+	const struct timespec *deadline;
+	uint32_t head, tail, space, chunk, offset, first;
+	yerr_t rc;
+	int i;
+
+	deadline = _yring_deadline(&ts, timeout_ms);
+	// only the writer modifies the head
+	head = ring->head;
+	for (i = 0; i < iovcnt; i++) {
+		const char *pt = (const char*)iov[i].iov_base;
+		size_t len = iov[i].iov_len;
+
+		while (len) {
+			if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+				return (YEPIPE);
+			tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+			space = ring->size - (head - tail);
+			if (!space) {
+				// ring full: publish what was copied, and wait for free space
+				__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+				_yring_wake(&ring->data_seq, &ring->reader_waiting);
+				if ((rc = _yring_wait(ring, YFALSE, deadline)) != YENOERR)
+					return (rc);
+				continue;
+			}
+			chunk = (len < space) ? (uint32_t)len : space;
+			offset = head & (ring->size - 1);
+			first = (chunk < ring->size - offset) ? chunk : (ring->size - offset);
+			memcpy(ring->data + offset, pt, first);
+			if (chunk > first)
+				memcpy(ring->data, pt + first, chunk - first);
+			head += chunk;
+			pt += chunk;
+			len -= chunk;
+		}
+	}
+	// publish data
+	if (head != ring->head) {
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+		_yring_wake(&ring->data_seq, &ring->reader_waiting);
+	}
+	return (YENOERR);
+}
+
+/* Write data into a ring. */
+yerr_t yring_write(yring_t *ring, const void *data, size_t len, int timeout_ms) {
+	struct iovec iov;
+
+	iov.iov_base = (void*)data;
+	iov.iov_len = len;
+	return (yring_writev(ring, &iov, 1, timeout_ms));
+}
+
+/* Read data from a ring. */
+ssize_t yring_read(yring_t *ring, void *buf, size_t len, int timeout_ms) {
+	struct timespec ts;
+	const struct timespec *deadline;
+	uint32_t head, tail, chunk, offset, first;
+	yerr_t rc;
+
+	deadline = _yring_deadline(&ts, timeout_ms);
+	// only the reader modifies the tail
+	tail = ring->tail;
+	for (; ; ) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (head != tail)
+			break;
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+			return (0);
+		if ((rc = _yring_wait(ring, YTRUE, deadline)) != YENOERR)
+			return (rc);
+	}
+	chunk = ((head - tail) < len) ? (head - tail) : (uint32_t)len;
+	offset = tail & (ring->size - 1);
+	first = (chunk < ring->size - offset) ? chunk : (ring->size - offset);
+	memcpy(buf, ring->data + offset, first);
+	if (chunk > first)
+		memcpy((char*)buf + first, ring->data, chunk - first);
+	__atomic_store_n(&ring->tail, tail + chunk, __ATOMIC_RELEASE);
+	_yring_wake(&ring->space_seq, &ring->writer_waiting);
+	return ((ssize_t)chunk);
+}
+
+/* Close a ring. */
+void yring_close(yring_t *ring) {
+	__atomic_store_n(&ring->closed, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&ring->data_seq, 1, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&ring->space_seq, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, &ring->data_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+	syscall(SYS_futex, &ring->space_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_yring_ready
+ *		Tell if a side of a ring could go on.
+ * @param	ring	Pointer to the ring.
+ * @param	reader	YTRUE for the reader (data available), YFALSE for the
+ *			writer (free space available).
+ * @return	YTRUE if the side could go on, or if the ring was closed.
+ */
+static ybool_t _yring_ready(yring_t *ring, ybool_t reader) {
+	uint32_t used;
+
+	if (__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST))
+		return (YTRUE);
+	used = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) -
+	       __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+	if (reader)
+		return (used ? YTRUE : YFALSE);
+	return ((used < ring->size) ? YTRUE : YFALSE);
+}
+
+/**
+ * @function	_yring_wait
+ *		Spin for a while, then sleep until the peer wakes us up.
+ *		The caller must check again the state of the ring.
+ * @param	ring		Pointer to the ring.
+ * @param	reader		YTRUE if the reader is waiting for data, YFALSE
+ *				if the writer is waiting for free space.
+ * @param	deadline	Time limit (CLOCK_MONOTONIC). NULL for no limit.
+ * @return	YENOERR if OK, YETIMEDOUT if the deadline was reached.
+ */
+static yerr_t _yring_wait(yring_t *ring, ybool_t reader, const struct timespec *deadline) {
+	volatile uint32_t *seq = reader ? &ring->data_seq : &ring->space_seq;
+	volatile uint32_t *waiting = reader ? &ring->reader_waiting : &ring->writer_waiting;
+	struct timespec now, remaining, *premaining = NULL;
+	uint32_t current;
+	int i, spin;
+
+	// active wait (useless on a single processor, the peer couldn't run)
+	if ((spin = __atomic_load_n(&_yring_spin, __ATOMIC_RELAXED)) < 0) {
+		spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? YRING_SPIN : 0;
+		__atomic_store_n(&_yring_spin, spin, __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < spin; i++) {
+		if (_yring_ready(ring, reader))
+			return (YENOERR);
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+	// remaining time
+	if (deadline) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+		remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+		if (remaining.tv_nsec < 0) {
+			remaining.tv_sec--;
+			remaining.tv_nsec += 1000000000L;
+		}
+		if (remaining.tv_sec < 0)
+			return (YETIMEDOUT);
+		premaining = &remaining;
+	}
+	// declare the sleep, check again, then sleep
+	current = __atomic_load_n(seq, __ATOMIC_SEQ_CST);
+	__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+	if (!_yring_ready(ring, reader))
+		syscall(SYS_futex, seq, FUTEX_WAIT, current, premaining, NULL, 0);
+	__atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+	return (YENOERR);
+}
+
+/**
+ * @function	_yring_wake
+ *		Wake up the peer if it is sleeping.
+ * @param	seq	Pointer to the futex word.
+ * @param	waiting	Pointer to the peer's waiting flag.
+ */
+static void _yring_wake(volatile uint32_t *seq, volatile uint32_t *waiting) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(waiting, __ATOMIC_SEQ_CST))
+		return;
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	syscall(SYS_futex, seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/**
+ * @function	_yring_deadline
+ *		Compute the time limit of an operation.
+ * @param	deadline	Pointer to the structure to fill.
+ * @param	timeout_ms	Timeout in milliseconds. -1 for no limit.
+ * @return	The given pointer, or NULL if there is no limit.
+ */
+static const struct timespec *_yring_deadline(struct timespec *deadline, int timeout_ms) {
+	if (timeout_ms < 0)
+		return (NULL);
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += timeout_ms / 1000;
+	deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+	return (deadline);
+}
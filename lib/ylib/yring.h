@@ -0,0 +1,135 @@
+/* Process this file with the HeaderBrowser tool (http://www.headerbrowser.org)
+   to create documentation. */
+/*!
+ * @header	yring.h
+ * @abstract	Single-producer/single-consumer byte rings.
+ * @discussion	A ring is a circular buffer placed in a memory area that could
+ *		be shared between two processes (e.g. a memfd mapped by both).
+ *		One side writes bytes, the other side reads them. Each side
+ *		spins for a short time when the ring is empty (or full), and
+ *		then sleeps on a futex; the other side does a wake-up syscall
+ *		only if it knows that its peer is sleeping.
+ * @version	1.0.0 Oct 19 2026
+ * @author	Amaury Bouchard <amaury@amaury.net>
+ */
+#ifndef __YRING_H__
+#define __YRING_H__
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif /* __cplusplus || c_plusplus */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "ydefs.h"
+#include "yerror.h"
+
+/*! @define YRING_SPIN Number of loops before sleeping on a futex (no spin on a single processor). */
+#define YRING_SPIN		2000
+
+/*! @define YRING_CACHELINE Size of a cache line, used to separate fields. */
+#define YRING_CACHELINE		64
+
+/*!
+ * @struct	yring_s
+ *		Ring header, followed by the ring's data. Positions are
+ *		free-running counters (the size is a power of 2).
+ * @field	head		Number of bytes written since the creation.
+ * @field	data_seq	Futex word, incremented when data are written
+ *				while the reader is sleeping.
+ * @field	reader_waiting	1 when the reader sleeps (or is about to).
+ * @field	tail		Number of bytes read since the creation.
+ * @field	space_seq	Futex word, incremented when data are read
+ *				while the writer is sleeping.
+ * @field	writer_waiting	1 when the writer sleeps (or is about to).
+ * @field	closed		Not null when one side closed the ring.
+ * @field	size		Size of the data area.
+ * @field	data		Data area.
+ */
+struct yring_s {
+	volatile uint32_t head;
+	volatile uint32_t data_seq;
+	volatile uint32_t reader_waiting;
+	char pad1[YRING_CACHELINE - 3 * sizeof(uint32_t)];
+	volatile uint32_t tail;
+	volatile uint32_t space_seq;
+	volatile uint32_t writer_waiting;
+	char pad2[YRING_CACHELINE - 3 * sizeof(uint32_t)];
+	volatile uint32_t closed;
+	uint32_t size;
+	char pad3[YRING_CACHELINE - 2 * sizeof(uint32_t)];
+	char data[];
+};
+
+/*! @typedef yring_t See struct yring_s. */
+typedef struct yring_s yring_t;
+
+/*!
+ * @function	yring_memsize
+ *		Compute the memory needed by a ring.
+ * @param	size	Size of the data area. Must be a power of 2.
+ * @return	The number of bytes to allocate (or to map).
+ */
+size_t yring_memsize(uint32_t size);
+
+/*!
+ * @function	yring_init
+ *		Initialize a ring in a memory area.
+ * @param	mem	Pointer to the memory area (at least yring_memsize()
+ *			bytes, aligned on a cache line).
+ * @param	size	Size of the data area. Must be a power of 2.
+ * @return	A pointer to the ring, or NULL if the size is not valid.
+ */
+yring_t *yring_init(void *mem, uint32_t size);
+
+/*!
+ * @function	yring_writev
+ *		Write data into a ring. Data are published when everything was
+ *		copied, or progressively if the ring is too small.
+ * @param	ring		Pointer to the ring.
+ * @param	iov		Array of buffers.
+ * @param	iovcnt		Number of buffers.
+ * @param	timeout_ms	Maximum time to wait for free space, in
+ *				milliseconds. -1 to wait forever.
+ * @return	YENOERR if OK, YETIMEDOUT if the timeout expired, YEPIPE if
+ *		the ring was closed.
+ */
+yerr_t yring_writev(yring_t *ring, const struct iovec *iov, int iovcnt, int timeout_ms);
+
+/*!
+ * @function	yring_write
+ *		Write data into a ring.
+ * @param	ring		Pointer to the ring.
+ * @param	data		Pointer to the data.
+ * @param	len		Data size.
+ * @param	timeout_ms	Maximum time to wait for free space. -1 to wait forever.
+ * @return	YENOERR if OK, YETIMEDOUT if the timeout expired, YEPIPE if
+ *		the ring was closed.
+ */
+yerr_t yring_write(yring_t *ring, const void *data, size_t len, int timeout_ms);
+
+/*!
+ * @function	yring_read
+ *		Read data from a ring. Wait until at least one byte is available.
+ * @param	ring		Pointer to the ring.
+ * @param	buf		Pointer to the destination buffer.
+ * @param	len		Size of the buffer.
+ * @param	timeout_ms	Maximum time to wait for data. -1 to wait forever.
+ * @return	The number of bytes read, 0 if the ring was closed and is
+ *		empty, or YETIMEDOUT if the timeout expired.
+ */
+ssize_t yring_read(yring_t *ring, void *buf, size_t len, int timeout_ms);
+
+/*!
+ * @function	yring_close
+ *		Close a ring. The sleeping peer is awakened.
+ * @param	ring	Pointer to the ring.
+ */
+void yring_close(yring_t *ring);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif /* __cplusplus || c_plusplus */
+
+#endif /* __YRING_H__ */
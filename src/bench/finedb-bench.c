@@ -0,0 +1,1141 @@
+/**
+ * finedb-bench
+ * Benchmark tool for a FineDB server, with YCSB-style workloads.
+ *
+ * @author	Amaury Bouchard <amaury@amaury.net>
+ * @copyright	© 2013, Amaury Bouchard
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "libfinedb.h"
+#include "stats.h"
+
+/** @define DEFAULT_HOST Default hostname of the server. */
+#define DEFAULT_HOST		"localhost"
+/** @define DEFAULT_PORT Default port number of the server. */
+#define DEFAULT_PORT		11138
+/** @define DEFAULT_RECORDS Default number of records loaded before the run. */
+#define DEFAULT_RECORDS		100000
+/** @define DEFAULT_OPERATIONS Default number of operations of the run. */
+#define DEFAULT_OPERATIONS	100000
+/** @define DEFAULT_SCAN_MAX Default maximum number of keys of a scan. */
+#define DEFAULT_SCAN_MAX	100
+/** @define DEFAULT_THETA Default skew of the zipfian distribution. */
+#define DEFAULT_THETA		0.99
+/** @define KEY_DIGITS Number of digits of the record number in a key (keys are sorted by record). */
+#define KEY_DIGITS		12
+/** @define KEY_MAX Maximum size of a key. */
+#define KEY_MAX			1024
+/** @define VALUE_MAX Maximum size of a value. */
+#define VALUE_MAX		(16 * 1048576)
+
+/**
+ * @typedef	bench_op_t
+ *		Types of operations. They are used as command numbers in the
+ *		statistics histograms.
+ * @constant	BENCH_READ	GET of an existing record.
+ * @constant	BENCH_UPDATE	PUT of an existing record.
+ * @constant	BENCH_INSERT	PUT of a new record.
+ * @constant	BENCH_SCAN	AGGREGATE over a range of records.
+ * @constant	BENCH_RMW	GET then PUT of an existing record.
+ */
+typedef enum bench_op_e {
+	BENCH_READ = 0,
+	BENCH_UPDATE,
+	BENCH_INSERT,
+	BENCH_SCAN,
+	BENCH_RMW,
+	BENCH_OPS
+} bench_op_t;
+
+/**
+ * @typedef	bench_distrib_t
+ *		Distributions of the chosen records.
+ * @constant	BENCH_UNIFORM	All records have the same probability.
+ * @constant	BENCH_ZIPFIAN	Some records are much more accessed than the
+ *				others; they are spread over the key space.
+ * @constant	BENCH_LATEST	Like zipfian, the most recently inserted
+ *				records being the most accessed.
+ */
+typedef enum bench_distrib_e {
+	BENCH_UNIFORM = 0,
+	BENCH_ZIPFIAN,
+	BENCH_LATEST
+} bench_distrib_t;
+
+/**
+ * @typedef	bench_range_t
+ *		Range of sizes, uniformly distributed.
+ * @field	min	Minimum size.
+ * @field	max	Maximum size.
+ */
+typedef struct bench_range_s {
+	size_t min;
+	size_t max;
+} bench_range_t;
+
+/**
+ * @typedef	bench_config_t
+ *		Configuration of the benchmark.
+ * @field	hostname	Hostname of the server.
+ * @field	port		Port number of the server.
+ * @field	unix_path	Path to the server's Unix socket. NULL for TCP.
+ * @field	dbname		Name of the database. NULL for the default one.
+ * @field	workload	Name of the workload preset.
+ * @field	nbr_threads	Number of threads.
+ * @field	nbr_connections	Number of connections (shared by the threads).
+ * @field	depth		Number of pipelined requests per connection.
+ * @field	records		Number of records loaded before the run.
+ * @field	operations	Number of operations of the run.
+ * @field	duration	Duration of the run (seconds), 0 to use the
+ *				number of operations.
+ * @field	mix		Percentage of each type of operation.
+ * @field	distrib		Distribution of the chosen records.
+ * @field	theta		Skew of the zipfian distributions.
+ * @field	key_size	Sizes of the keys.
+ * @field	value_size	Sizes of the values.
+ * @field	scan_max	Maximum number of records of a scan.
+ * @field	rate		Target throughput (operations per second), 0
+ *				for the maximum throughput.
+ * @field	seed		Seed of the random generators.
+ * @field	sync		YTRUE for synchronous writes.
+ * @field	load		YTRUE to load the records before the run.
+ * @field	hdr		YTRUE to print the percentile distributions.
+ * @field	json_path	Path of the JSON results file ("-" for stdout).
+ */
+typedef struct bench_config_s {
+	char *hostname;
+	unsigned short port;
+	char *unix_path;
+	char *dbname;
+	char *workload;
+	unsigned int nbr_threads;
+	unsigned int nbr_connections;
+	unsigned int depth;
+	uint64_t records;
+	uint64_t operations;
+	unsigned int duration;
+	unsigned int mix[BENCH_OPS];
+	bench_distrib_t distrib;
+	double theta;
+	bench_range_t key_size;
+	bench_range_t value_size;
+	unsigned int scan_max;
+	double rate;
+	uint64_t seed;
+	ybool_t sync;
+	ybool_t load;
+	ybool_t hdr;
+	char *json_path;
+} bench_config_t;
+
+/**
+ * @typedef	bench_zipf_t
+ *		Zipfian generator (Gray et al., "Quickly generating
+ *		billion-record synthetic databases").
+ * @field	n	Number of items.
+ * @field	theta	Skew.
+ * @field	alpha	1 / (1 - theta).
+ * @field	zetan	Zeta of n.
+ * @field	eta	Precomputed constant.
+ * @field	half	1 + 0.5^theta.
+ */
+typedef struct bench_zipf_s {
+	uint64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+	double half;
+} bench_zipf_t;
+
+/**
+ * @typedef	bench_phase_t
+ *		State of a phase (load or run), shared by the threads.
+ * @field	name		Name of the phase.
+ * @field	load		YTRUE for the load phase (only inserts).
+ * @field	stats		Latency histograms.
+ * @field	next_insert	Number of the next inserted record.
+ * @field	operations	Number of operations per connection, 0 for
+ *				unlimited.
+ * @field	deadline	End time of the phase (nanoseconds), 0 for
+ *				unlimited.
+ * @field	interval	Time between two operations of a connection
+ *				(nanoseconds), 0 for the maximum throughput.
+ * @field	start		Start time of the phase.
+ * @field	end		End time of the phase.
+ */
+typedef struct bench_phase_s {
+	const char *name;
+	ybool_t load;
+	stats_t *stats;
+	uint64_t next_insert;
+	uint64_t operations;
+	uint64_t deadline;
+	uint64_t interval;
+	uint64_t start;
+	uint64_t end;
+} bench_phase_t;
+
+/**
+ * @typedef	bench_request_t
+ *		A pipelined operation.
+ * @field	conn	Connection of the operation.
+ * @field	op	Type of operation.
+ * @field	start	Start time (nanoseconds). In fixed-rate mode, it is
+ *			the time the operation should have been sent, so the
+ *			delays of the previous ones are counted.
+ * @field	index	Number of the record.
+ * @field	written	YTRUE when the PUT of a read-modify-write is sent.
+ * @field	pending	YTRUE while the operation waits for its response.
+ * @field	next	Next free request.
+ */
+typedef struct bench_request_s {
+	struct bench_connection_s *conn;
+	bench_op_t op;
+	uint64_t start;
+	uint64_t index;
+	ybool_t written;
+	ybool_t pending;
+	struct bench_request_s *next;
+} bench_request_t;
+
+/**
+ * @typedef	bench_connection_t
+ *		A connection to the server.
+ * @field	thread		Thread of the connection.
+ * @field	client		Client structure.
+ * @field	pipeline	Pipeline over the client.
+ * @field	requests	Array of requests (as much as the depth).
+ * @field	free		List of free requests.
+ * @field	inflight	Number of operations waiting for their responses.
+ * @field	issued		Number of sent operations.
+ * @field	next		Time of the next operation, in fixed-rate mode.
+ * @field	done		YTRUE when no more operation will be sent.
+ * @field	failed		YTRUE if the connection was lost.
+ */
+typedef struct bench_connection_s {
+	struct bench_thread_s *thread;
+	finedb_client_t *client;
+	finedb_pipeline_t *pipeline;
+	bench_request_t *requests;
+	bench_request_t *free;
+	unsigned int inflight;
+	uint64_t issued;
+	uint64_t next;
+	ybool_t done;
+	ybool_t failed;
+} bench_connection_t;
+
+/**
+ * @typedef	bench_thread_t
+ *		A benchmark thread, driving its connections in an event loop.
+ * @field	tid		Thread identifier.
+ * @field	nbr_connections	Number of connections.
+ * @field	connections	Array of connections.
+ * @field	pfds		Array of poll structures.
+ * @field	stats		Latency histograms of the thread.
+ * @field	rng		State of the random generator.
+ * @field	values		Random data, used as values.
+ */
+typedef struct bench_thread_s {
+	pthread_t tid;
+	unsigned int nbr_connections;
+	bench_connection_t *connections;
+	struct pollfd *pfds;
+	stats_thread_t *stats;
+	uint64_t rng;
+	char *values;
+} bench_thread_t;
+
+/* Names of the operations. */
+static const char *op_names[BENCH_OPS] = { "read", "update", "insert", "scan", "rmw" };
+/* Names of the distributions. */
+static const char *distrib_names[] = { "uniform", "zipfian", "latest" };
+
+/* Global variables. */
+static bench_config_t config_g;
+static bench_phase_t phase_g;
+static bench_zipf_t zipf_g;
+static volatile sig_atomic_t stop_g = 0;
+
+/* *** function declarations *** */
+static void usage(void);
+static void signal_handler(int sig);
+static int parse_range(const char *str, bench_range_t *range);
+static int parse_mix(const char *str, unsigned int *mix);
+static int set_workload(const char *name, unsigned int *mix, bench_distrib_t *distrib);
+static bench_thread_t *bench_connect(void);
+static void bench_phase(bench_thread_t *threads, const char *name, ybool_t load, FILE *json);
+static void *bench_thread(void *param);
+static ybool_t bench_more(bench_connection_t *conn, uint64_t now);
+static int bench_issue(bench_connection_t *conn, uint64_t start);
+static void bench_response(void *cb_data, int status, ybin_t value, unsigned long long version);
+static bench_op_t bench_choose_op(bench_thread_t *thread);
+static uint64_t bench_choose_record(bench_thread_t *thread);
+static void bench_release(bench_request_t *request);
+static ybin_t bench_key(char *buffer, uint64_t index);
+static ybin_t bench_value(bench_thread_t *thread);
+static void zipf_init(bench_zipf_t *zipf, uint64_t n, double theta);
+static uint64_t zipf_next(bench_zipf_t *zipf, bench_thread_t *thread);
+static uint64_t rng_next(uint64_t *state);
+static double rng_double(uint64_t *state);
+static uint64_t hash64(uint64_t value);
+static void histogram_add(stats_histogram_t *histogram, stats_histogram_t *src);
+static void report(const char *name, double duration, FILE *json);
+static void report_hdr(const char *name, stats_histogram_t *histogram);
+
+/** Usage function. */
+static void usage() {
+	printf("Usage: finedb-bench [-h host] [-p port] [-u path] [-b dbname] [-w workload] [-m mix]\n"
+	       "                    [-D distribution] [-z theta] [-n records] [-o operations] [-T seconds]\n"
+	       "                    [-t threads] [-c connections] [-d depth] [-k size] [-v size] [-S number]\n"
+	       "                    [-r rate] [-e seed] [-j path] [-s] [-L] [-H]\n"
+	       "\t-h host        Hostname of the server (default: %s).\n"
+	       "\t-p port        Port number of the server (default: %d).\n"
+	       "\t-u path        Path to the Unix socket of the server.\n"
+	       "\t-b dbname      Name of the database.\n"
+	       "\t-w workload    YCSB workload: a (50%% read, 50%% update), b (95%% read, 5%% update),\n"
+	       "\t               c (100%% read), d (95%% read, 5%% insert, latest), e (95%% scan, 5%% insert),\n"
+	       "\t               f (50%% read, 50%% read-modify-write). Default: a.\n"
+	       "\t-m mix         Percentages of read,update,insert,scan,rmw (overrides the workload).\n"
+	       "\t-D distrib     Distribution of the records: uniform, zipfian or latest.\n"
+	       "\t-z theta       Skew of the zipfian distributions (default: %.2f).\n"
+	       "\t-n records     Number of records (default: %d).\n"
+	       "\t-o operations  Number of operations of the run (default: %d).\n"
+	       "\t-T seconds     Duration of the run (overrides the number of operations).\n"
+	       "\t-t threads     Number of threads (default: 1).\n"
+	       "\t-c connections Number of connections, shared by the threads (default: 1 per thread).\n"
+	       "\t-d depth       Number of pipelined requests per connection (default: 1).\n"
+	       "\t-k size        Size of the keys, or min-max range (default: %d).\n"
+	       "\t-v size        Size of the values, or min-max range (default: 100).\n"
+	       "\t-S number      Maximum number of records of a scan (default: %d).\n"
+	       "\t-r rate        Target throughput (operations per second). Latencies are measured from\n"
+	       "\t               the time each operation should have been sent.\n"
+	       "\t-e seed        Seed of the random generators (default: 1).\n"
+	       "\t-j path        Write the results in JSON to this file (\"-\" for stdout).\n"
+	       "\t-s             Synchronous writes.\n"
+	       "\t-L             Don't load the records before the run.\n"
+	       "\t-H             Print the latency percentile distributions (HdrHistogram format).\n"
+	       "\n", DEFAULT_HOST, DEFAULT_PORT, DEFAULT_THETA, DEFAULT_RECORDS, DEFAULT_OPERATIONS, KEY_DIGITS,
+	       DEFAULT_SCAN_MAX);
+}
+
+/** Signal handler. */
+static void signal_handler(int sig) {
+	stop_g = 1;
+}
+
+/**
+ * Main function of the program.
+ */
+int main(int argc, char *argv[]) {
+	char *optstr = "h:p:u:b:w:m:D:z:n:o:T:t:c:d:k:v:S:r:e:j:sLH";
+	char *mix = NULL, *distrib = NULL;
+	bench_thread_t *threads;
+	FILE *json = NULL;
+	int i;
+
+	// default configuration
+	bzero(&config_g, sizeof(config_g));
+	config_g.hostname = DEFAULT_HOST;
+	config_g.port = DEFAULT_PORT;
+	config_g.workload = "a";
+	config_g.nbr_threads = 1;
+	config_g.depth = 1;
+	config_g.records = DEFAULT_RECORDS;
+	config_g.operations = DEFAULT_OPERATIONS;
+	config_g.theta = DEFAULT_THETA;
+	config_g.key_size.min = config_g.key_size.max = KEY_DIGITS;
+	config_g.value_size.min = config_g.value_size.max = 100;
+	config_g.scan_max = DEFAULT_SCAN_MAX;
+	config_g.seed = 1;
+	config_g.load = YTRUE;
+	// parse command line parameters
+	while ((i = getopt(argc, argv, optstr)) != -1) {
+		switch (i) {
+		case 'h':
+			config_g.hostname = optarg;
+			break;
+		case 'p':
+			config_g.port = (unsigned short)atoi(optarg);
+			break;
+		case 'u':
+			config_g.unix_path = optarg;
+			break;
+		case 'b':
+			config_g.dbname = optarg;
+			break;
+		case 'w':
+			config_g.workload = optarg;
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		case 'D':
+			distrib = optarg;
+			break;
+		case 'z':
+			config_g.theta = atof(optarg);
+			break;
+		case 'n':
+			config_g.records = strtoull(optarg, NULL, 10);
+			break;
+		case 'o':
+			config_g.operations = strtoull(optarg, NULL, 10);
+			break;
+		case 'T':
+			config_g.duration = (unsigned int)atoi(optarg);
+			break;
+		case 't':
+			config_g.nbr_threads = (unsigned int)atoi(optarg);
+			break;
+		case 'c':
+			config_g.nbr_connections = (unsigned int)atoi(optarg);
+			break;
+		case 'd':
+			config_g.depth = (unsigned int)atoi(optarg);
+			break;
+		case 'k':
+			if (parse_range(optarg, &config_g.key_size)) {
+				fprintf(stderr, "Bad key size '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'v':
+			if (parse_range(optarg, &config_g.value_size)) {
+				fprintf(stderr, "Bad value size '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'S':
+			config_g.scan_max = (unsigned int)atoi(optarg);
+			break;
+		case 'r':
+			config_g.rate = atof(optarg);
+			break;
+		case 'e':
+			config_g.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'j':
+			config_g.json_path = optarg;
+			break;
+		case 's':
+			config_g.sync = YTRUE;
+			break;
+		case 'L':
+			config_g.load = YFALSE;
+			break;
+		case 'H':
+			config_g.hdr = YTRUE;
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	// check the configuration
+	if (set_workload(config_g.workload, config_g.mix, &config_g.distrib)) {
+		fprintf(stderr, "Unknown workload '%s'.\n", config_g.workload);
+		exit(1);
+	}
+	if (mix && parse_mix(mix, config_g.mix)) {
+		fprintf(stderr, "Bad operation mix '%s' (percentages of read,update,insert,scan,rmw).\n", mix);
+		exit(1);
+	}
+	if (distrib) {
+		if (!strcasecmp(distrib, "uniform"))
+			config_g.distrib = BENCH_UNIFORM;
+		else if (!strcasecmp(distrib, "zipfian"))
+			config_g.distrib = BENCH_ZIPFIAN;
+		else if (!strcasecmp(distrib, "latest"))
+			config_g.distrib = BENCH_LATEST;
+		else {
+			fprintf(stderr, "Unknown distribution '%s'.\n", distrib);
+			exit(1);
+		}
+	}
+	if (!config_g.nbr_connections)
+		config_g.nbr_connections = config_g.nbr_threads;
+	if (!config_g.nbr_threads || !config_g.depth || !config_g.records || !config_g.scan_max ||
+	    config_g.nbr_connections < config_g.nbr_threads || config_g.theta <= 0.0 || config_g.theta == 1.0 ||
+	    config_g.key_size.max < KEY_DIGITS || config_g.key_size.max > KEY_MAX ||
+	    config_g.value_size.max > VALUE_MAX) {
+		fprintf(stderr, "Bad configuration (keys are %d to %d bytes long, there must be at least one "
+		        "connection per thread).\n", KEY_DIGITS, KEY_MAX);
+		exit(1);
+	}
+	if (config_g.key_size.min < KEY_DIGITS)
+		config_g.key_size.min = KEY_DIGITS;
+	if (config_g.json_path) {
+		if (!strcmp(config_g.json_path, "-"))
+			json = stdout;
+		else if ((json = fopen(config_g.json_path, "w")) == NULL) {
+			fprintf(stderr, "Unable to open '%s'.\n", config_g.json_path);
+			exit(1);
+		}
+	}
+	signal(SIGINT, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+	zipf_init(&zipf_g, config_g.records, config_g.theta);
+	// connections
+	if ((threads = bench_connect()) == NULL)
+		exit(2);
+	if (json) {
+		fprintf(json, "{\n\t\"config\": {\"workload\": \"%s\", \"records\": %llu, \"operations\": %llu, "
+		        "\"duration\": %u, \"threads\": %u, \"connections\": %u, \"depth\": %u, \"sync\": %s, "
+		        "\"rate\": %.0f, \"distribution\": \"%s\", \"theta\": %.3f, \"key_size\": [%zu, %zu], "
+		        "\"value_size\": [%zu, %zu], \"scan_max\": %u, \"seed\": %llu, \"mix\": {",
+		        config_g.workload, (unsigned long long)config_g.records,
+		        (unsigned long long)config_g.operations, config_g.duration, config_g.nbr_threads,
+		        config_g.nbr_connections, config_g.depth, (config_g.sync ? "true" : "false"), config_g.rate,
+		        distrib_names[config_g.distrib], config_g.theta, config_g.key_size.min,
+		        config_g.key_size.max, config_g.value_size.min, config_g.value_size.max, config_g.scan_max,
+		        (unsigned long long)config_g.seed);
+		for (i = 0; i < BENCH_OPS; i++)
+			fprintf(json, "%s\"%s\": %u", (i ? ", " : ""), op_names[i], config_g.mix[i]);
+		fprintf(json, "}},\n\t\"phases\": [");
+	}
+	// load and run
+	if (config_g.load)
+		bench_phase(threads, "load", YTRUE, json);
+	if (!stop_g)
+		bench_phase(threads, "run", YFALSE, json);
+	if (json) {
+		fprintf(json, "\n\t]\n}\n");
+		if (json != stdout)
+			fclose(json);
+	}
+	return (0);
+}
+
+/**
+ * Parse a size or a range of sizes ("100" or "10-1000").
+ * @param	str	The string.
+ * @param	range	Pointer to the range.
+ * @return	0 if OK, -1 on error.
+ */
+static int parse_range(const char *str, bench_range_t *range) {
+	char *pt;
+
+	range->min = range->max = (size_t)strtoull(str, &pt, 10);
+	if (*pt == '-')
+		range->max = (size_t)strtoull(pt + 1, &pt, 10);
+	if (*pt || range->max < range->min)
+		return (-1);
+	return (0);
+}
+
+/**
+ * Parse an operation mix ("95,5,0,0,0").
+ * @param	str	The string.
+ * @param	mix	Array of percentages.
+ * @return	0 if OK, -1 on error.
+ */
+static int parse_mix(const char *str, unsigned int *mix) {
+	unsigned int total = 0;
+	char *pt = (char*)str;
+	int i;
+
+	for (i = 0; i < BENCH_OPS; i++) {
+		mix[i] = (unsigned int)strtoul(pt, &pt, 10);
+		total += mix[i];
+		if (*pt != ',')
+			break;
+		pt++;
+	}
+	while (++i < BENCH_OPS)
+		mix[i] = 0;
+	return ((*pt || total != 100) ? -1 : 0);
+}
+
+/**
+ * Set the operation mix and the distribution of a YCSB workload.
+ * @param	name	Name of the workload.
+ * @param	mix	Array of percentages.
+ * @param	distrib	Pointer to the distribution.
+ * @return	0 if OK, -1 if the workload is unknown.
+ */
+static int set_workload(const char *name, unsigned int *mix, bench_distrib_t *distrib) {
+	bzero(mix, BENCH_OPS * sizeof(unsigned int));
+	*distrib = BENCH_ZIPFIAN;
+	if (strlen(name) != 1)
+		return (-1);
+	switch (name[0]) {
+	case 'a':
+		mix[BENCH_READ] = 50;
+		mix[BENCH_UPDATE] = 50;
+		break;
+	case 'b':
+		mix[BENCH_READ] = 95;
+		mix[BENCH_UPDATE] = 5;
+		break;
+	case 'c':
+		mix[BENCH_READ] = 100;
+		break;
+	case 'd':
+		mix[BENCH_READ] = 95;
+		mix[BENCH_INSERT] = 5;
+		*distrib = BENCH_LATEST;
+		break;
+	case 'e':
+		mix[BENCH_SCAN] = 95;
+		mix[BENCH_INSERT] = 5;
+		break;
+	case 'f':
+		mix[BENCH_READ] = 50;
+		mix[BENCH_RMW] = 50;
+		break;
+	default:
+		return (-1);
+	}
+	return (0);
+}
+
+/**
+ * Create the threads' structures and open their connections.
+ * @return	The array of threads, or NULL.
+ */
+static bench_thread_t *bench_connect() {
+	bench_thread_t *threads, *thread;
+	bench_connection_t *conn;
+	unsigned int i, j, k;
+
+	if ((threads = YMALLOC(config_g.nbr_threads * sizeof(bench_thread_t))) == NULL)
+		return (NULL);
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		thread = &threads[i];
+		thread->nbr_connections = config_g.nbr_connections / config_g.nbr_threads +
+		                          ((i < config_g.nbr_connections % config_g.nbr_threads) ? 1 : 0);
+		thread->rng = hash64(config_g.seed + i);
+		if ((thread->connections = YMALLOC(thread->nbr_connections * sizeof(bench_connection_t))) == NULL ||
+		    (thread->pfds = YMALLOC(thread->nbr_connections * sizeof(struct pollfd))) == NULL ||
+		    (thread->values = YMALLOC(2 * config_g.value_size.max + 1)) == NULL)
+			return (NULL);
+		// random printable values, as written by real applications
+		for (k = 0; k < 2 * config_g.value_size.max; k++)
+			thread->values[k] = (char)(' ' + rng_next(&thread->rng) % 95);
+		for (j = 0; j < thread->nbr_connections; j++) {
+			conn = &thread->connections[j];
+			conn->thread = thread;
+			if (config_g.unix_path)
+				conn->client = finedb_create_unix(config_g.unix_path);
+			else
+				conn->client = finedb_create(config_g.hostname, config_g.port);
+			if (conn->client == NULL ||
+			    (conn->requests = YMALLOC(config_g.depth * sizeof(bench_request_t))) == NULL) {
+				fprintf(stderr, "Memory error.\n");
+				return (NULL);
+			}
+			if (finedb_connect(conn->client) != FINEDB_OK ||
+			    (config_g.dbname && finedb_setdb(conn->client, config_g.dbname) != FINEDB_OK)) {
+				fprintf(stderr, "Unable to connect to the server.\n");
+				return (NULL);
+			}
+			if (config_g.sync)
+				finedb_sync(conn->client);
+			else
+				finedb_async(conn->client);
+			if ((conn->pipeline = finedb_pipeline_create(conn->client)) == NULL) {
+				fprintf(stderr, "Unable to create a pipeline.\n");
+				return (NULL);
+			}
+			for (k = 0; k < config_g.depth; k++) {
+				conn->requests[k].conn = conn;
+				conn->requests[k].next = (k + 1 < config_g.depth) ? &conn->requests[k + 1] : NULL;
+			}
+			conn->free = conn->requests;
+		}
+	}
+	return (threads);
+}
+
+/**
+ * Execute a phase of the benchmark, and print its results.
+ * @param	threads	Array of threads.
+ * @param	name	Name of the phase.
+ * @param	load	YTRUE to load the records.
+ * @param	json	JSON results file. Could be NULL.
+ */
+static void bench_phase(bench_thread_t *threads, const char *name, ybool_t load, FILE *json) {
+	bench_connection_t *conn;
+	unsigned int i, j;
+
+	bzero(&phase_g, sizeof(phase_g));
+	phase_g.name = name;
+	phase_g.load = load;
+	phase_g.next_insert = load ? 0 : config_g.records;
+	if ((phase_g.stats = stats_new()) == NULL) {
+		fprintf(stderr, "Memory error.\n");
+		exit(2);
+	}
+	if (!load && !config_g.duration)
+		phase_g.operations = config_g.operations / config_g.nbr_connections;
+	if (config_g.rate > 0.0)
+		phase_g.interval = (uint64_t)(1e9 * config_g.nbr_connections / config_g.rate);
+	phase_g.start = stats_now();
+	if (!load && config_g.duration)
+		phase_g.deadline = phase_g.start + (uint64_t)config_g.duration * 1000000000ULL;
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		threads[i].stats = stats_thread_new(phase_g.stats);
+		for (j = 0; j < threads[i].nbr_connections; j++) {
+			conn = &threads[i].connections[j];
+			conn->issued = 0;
+			conn->next = phase_g.start;
+			conn->done = conn->failed;
+		}
+		if (pthread_create(&threads[i].tid, NULL, bench_thread, &threads[i])) {
+			fprintf(stderr, "Unable to create thread.\n");
+			exit(2);
+		}
+	}
+	for (i = 0; i < config_g.nbr_threads; i++)
+		pthread_join(threads[i].tid, NULL);
+	phase_g.end = stats_now();
+	report(name, (double)(phase_g.end - phase_g.start) / 1e9, json);
+}
+
+/**
+ * Event loop of a thread: send the operations of its connections and read
+ * their responses.
+ * @param	param	Pointer to the thread structure.
+ * @return	NULL.
+ */
+static void *bench_thread(void *param) {
+	bench_thread_t *thread = param;
+	bench_connection_t *conn;
+	struct timespec ts;
+	uint64_t now, wakeup;
+	unsigned int i, nfds, active;
+
+	for (; ; ) {
+		now = stats_now();
+		wakeup = 0;
+		active = nfds = 0;
+		for (i = 0; i < thread->nbr_connections; i++) {
+			conn = &thread->connections[i];
+			// send the operations whose time has come
+			while (!conn->done && conn->free) {
+				if (!bench_more(conn, now)) {
+					conn->done = YTRUE;
+					break;
+				}
+				if (phase_g.interval && conn->next > now) {
+					if (!wakeup || conn->next < wakeup)
+						wakeup = conn->next;
+					break;
+				}
+				if (bench_issue(conn, phase_g.interval ? conn->next : now) != FINEDB_OK)
+					break;
+				conn->issued++;
+				conn->next += phase_g.interval;
+			}
+			if (!conn->done || conn->inflight)
+				active++;
+			if (conn->failed || !finedb_pipeline_events(conn->pipeline))
+				continue;
+			thread->pfds[nfds].fd = finedb_pipeline_fd(conn->pipeline);
+			thread->pfds[nfds].events = finedb_pipeline_events(conn->pipeline);
+			thread->pfds[nfds].revents = 0;
+			nfds++;
+		}
+		if (!active)
+			break;
+		// wait for the responses, or the time of the next operation
+		if (wakeup) {
+			ts.tv_sec = (time_t)((wakeup - now) / 1000000000ULL);
+			ts.tv_nsec = (long)((wakeup - now) % 1000000000ULL);
+		}
+		if (ppoll(thread->pfds, nfds, (wakeup ? &ts : NULL), NULL) <= 0)
+			continue;
+		for (i = 0, nfds = 0; i < thread->nbr_connections; i++) {
+			conn = &thread->connections[i];
+			if (conn->failed || !finedb_pipeline_events(conn->pipeline))
+				continue;
+			if (thread->pfds[nfds++].revents && finedb_pipeline_process(conn->pipeline) != FINEDB_OK) {
+				fprintf(stderr, "Connection lost.\n");
+				conn->failed = conn->done = YTRUE;
+			}
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * Tell if a connection has more operations to send.
+ * @param	conn	Pointer to the connection.
+ * @param	now	Current time.
+ * @return	YTRUE if more operations should be sent.
+ */
+static ybool_t bench_more(bench_connection_t *conn, uint64_t now) {
+	if (stop_g || conn->failed)
+		return (YFALSE);
+	if (phase_g.load)
+		return ((__atomic_load_n(&phase_g.next_insert, __ATOMIC_RELAXED) < config_g.records) ? YTRUE : YFALSE);
+	if (phase_g.deadline)
+		return ((now < phase_g.deadline) ? YTRUE : YFALSE);
+	return ((conn->issued < phase_g.operations) ? YTRUE : YFALSE);
+}
+
+/**
+ * Send an operation on a connection.
+ * @param	conn	Pointer to the connection.
+ * @param	start	Start time of the operation.
+ * @return	FINEDB_OK if OK.
+ */
+static int bench_issue(bench_connection_t *conn, uint64_t start) {
+	bench_thread_t *thread = conn->thread;
+	bench_request_t *request = conn->free;
+	char key[KEY_MAX], end_key[KEY_DIGITS + 1];
+	ybin_t start_bin, end_bin;
+	int rc;
+
+	request->op = phase_g.load ? BENCH_INSERT : bench_choose_op(thread);
+	request->start = start;
+	request->written = YFALSE;
+	if (request->op == BENCH_INSERT) {
+		request->index = __atomic_fetch_add(&phase_g.next_insert, 1, __ATOMIC_RELAXED);
+		if (phase_g.load && request->index >= config_g.records) {
+			conn->done = YTRUE;
+			return (FINEDB_ERR_VALUE);
+		}
+	} else
+		request->index = bench_choose_record(thread);
+	conn->free = request->next;
+	conn->inflight++;
+	request->pending = YTRUE;
+	switch (request->op) {
+	case BENCH_READ:
+	case BENCH_RMW:
+		rc = finedb_pipeline_get(conn->pipeline, bench_key(key, request->index), bench_response, request);
+		break;
+	case BENCH_SCAN:
+		// the range starts at the record number, without the key padding
+		snprintf(end_key, sizeof(end_key), "%0*llu", KEY_DIGITS, (unsigned long long)request->index +
+		         1 + rng_next(&thread->rng) % config_g.scan_max);
+		ybin_set(&end_bin, end_key, KEY_DIGITS);
+		snprintf(key, sizeof(key), "%0*llu", KEY_DIGITS, (unsigned long long)request->index);
+		ybin_set(&start_bin, key, KEY_DIGITS);
+		rc = finedb_pipeline_aggregate(conn->pipeline, start_bin, end_bin, FINEDB_ENC_NONE, bench_response,
+		                               request);
+		break;
+	default:
+		rc = finedb_pipeline_put(conn->pipeline, bench_key(key, request->index), bench_value(thread),
+		                         bench_response, request);
+	}
+	if (rc != FINEDB_OK) {
+		// on a lost connection, the callback was already called
+		if (request->pending)
+			bench_release(request);
+		conn->done = YTRUE;
+		if (rc == FINEDB_ERR_NETWORK)
+			conn->failed = YTRUE;
+	}
+	return (rc);
+}
+
+/**
+ * Callback of the pipelined operations: add the latency to the histograms.
+ * @param	cb_data	Pointer to the request.
+ * @param	status	FINEDB_OK if OK.
+ * @param	value	Returned value.
+ * @param	version	Version of the returned value.
+ */
+static void bench_response(void *cb_data, int status, ybin_t value, unsigned long long version) {
+	bench_request_t *request = cb_data;
+	bench_connection_t *conn = request->conn;
+	protocol_stats_result_t result;
+	char key[KEY_MAX];
+
+	// read-modify-write: the value is written back
+	if (request->op == BENCH_RMW && !request->written && status == FINEDB_OK) {
+		request->written = YTRUE;
+		status = finedb_pipeline_put(conn->pipeline, bench_key(key, request->index),
+		                             bench_value(conn->thread), bench_response, request);
+		// on a lost connection, the callback was already called
+		if (status == FINEDB_OK || !request->pending)
+			return;
+	}
+	if (status == FINEDB_OK)
+		result = PROTO_STATS_HIT;
+	else if (status == FINEDB_ERR_SERVER)
+		result = PROTO_STATS_MISS;
+	else
+		result = PROTO_STATS_ERROR;
+	stats_add(conn->thread->stats, (unsigned char)request->op, config_g.sync, result,
+	          stats_now() - request->start);
+	bench_release(request);
+}
+
+/**
+ * Give a request back to the free list of its connection.
+ * @param	request	Pointer to the request.
+ */
+static void bench_release(bench_request_t *request) {
+	bench_connection_t *conn = request->conn;
+
+	request->pending = YFALSE;
+	request->next = conn->free;
+	conn->free = request;
+	conn->inflight--;
+}
+
+/**
+ * Choose the type of the next operation, following the mix.
+ * @param	thread	Pointer to the thread.
+ * @return	The type of operation.
+ */
+static bench_op_t bench_choose_op(bench_thread_t *thread) {
+	unsigned int draw = (unsigned int)(rng_next(&thread->rng) % 100);
+	int op;
+
+	for (op = 0; op < BENCH_OPS - 1; op++) {
+		if (draw < config_g.mix[op])
+			break;
+		draw -= config_g.mix[op];
+	}
+	return ((bench_op_t)op);
+}
+
+/**
+ * Choose an existing record, following the distribution.
+ * @param	thread	Pointer to the thread.
+ * @return	The record number.
+ */
+static uint64_t bench_choose_record(bench_thread_t *thread) {
+	uint64_t count = __atomic_load_n(&phase_g.next_insert, __ATOMIC_RELAXED);
+	uint64_t rank;
+
+	if (config_g.distrib == BENCH_UNIFORM)
+		return (rng_next(&thread->rng) % count);
+	// the zipfian generator is computed for the loaded records only
+	rank = zipf_next(&zipf_g, thread);
+	if (config_g.distrib == BENCH_LATEST)
+		return ((rank < count) ? (count - 1 - rank) : 0);
+	// the most accessed records are spread over the key space
+	return (hash64(rank) % count);
+}
+
+/**
+ * Write the key of a record. Keys start with the zero-padded record number,
+ * so they are sorted like the records, and are padded to their size.
+ * @param	buffer	Buffer of at least KEY_MAX bytes.
+ * @param	index	Record number.
+ * @return	The key.
+ */
+static ybin_t bench_key(char *buffer, uint64_t index) {
+	size_t len = config_g.key_size.min;
+	ybin_t key;
+
+	// the size of a key is always the same
+	if (config_g.key_size.max > config_g.key_size.min)
+		len += hash64(index) % (config_g.key_size.max - config_g.key_size.min + 1);
+	snprintf(buffer, KEY_MAX, "%0*llu", KEY_DIGITS, (unsigned long long)index);
+	memset(buffer + KEY_DIGITS, '.', len - KEY_DIGITS);
+	ybin_set(&key, buffer, len);
+	return (key);
+}
+
+/**
+ * Choose a value, with a random size.
+ * @param	thread	Pointer to the thread.
+ * @return	The value.
+ */
+static ybin_t bench_value(bench_thread_t *thread) {
+	size_t len = config_g.value_size.min, offset;
+	ybin_t value;
+
+	if (config_g.value_size.max > config_g.value_size.min)
+		len += rng_next(&thread->rng) % (config_g.value_size.max - config_g.value_size.min + 1);
+	offset = rng_next(&thread->rng) % (config_g.value_size.max + 1);
+	ybin_set(&value, thread->values + offset, len);
+	return (value);
+}
+
+/**
+ * Initialize a zipfian generator.
+ * @param	zipf	Pointer to the generator.
+ * @param	n	Number of items.
+ * @param	theta	Skew.
+ */
+static void zipf_init(bench_zipf_t *zipf, uint64_t n, double theta) {
+	uint64_t i;
+
+	zipf->n = n;
+	zipf->theta = theta;
+	zipf->alpha = 1.0 / (1.0 - theta);
+	for (i = 1, zipf->zetan = 0.0; i <= n; i++)
+		zipf->zetan += 1.0 / pow((double)i, theta);
+	zipf->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) /
+	            (1.0 - (1.0 + 1.0 / pow(2.0, theta)) / zipf->zetan);
+	zipf->half = 1.0 + pow(0.5, theta);
+}
+
+/**
+ * Return the next value of a zipfian generator.
+ * @param	zipf	Pointer to the generator.
+ * @param	thread	Pointer to the thread (random generator).
+ * @return	A rank, between 0 (most frequent) and n - 1.
+ */
+static uint64_t zipf_next(bench_zipf_t *zipf, bench_thread_t *thread) {
+	double u = rng_double(&thread->rng);
+	double uz = u * zipf->zetan;
+	uint64_t rank;
+
+	if (uz < 1.0)
+		return (0);
+	if (uz < zipf->half)
+		return (1);
+	rank = (uint64_t)((double)zipf->n * pow(zipf->eta * u - zipf->eta + 1.0, zipf->alpha));
+	return ((rank < zipf->n) ? rank : zipf->n - 1);
+}
+
+/**
+ * Return the next value of a random generator (xorshift64*).
+ * @param	state	Pointer to the state of the generator.
+ * @return	A random value.
+ */
+static uint64_t rng_next(uint64_t *state) {
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 2685821657736338717ULL);
+}
+
+/**
+ * Return a random double.
+ * @param	state	Pointer to the state of the generator.
+ * @return	A value between 0 (included) and 1 (excluded).
+ */
+static double rng_double(uint64_t *state) {
+	return ((double)(rng_next(state) >> 11) / 9007199254740992.0);
+}
+
+/**
+ * Mix the bits of a value (splitmix64 finalizer). Never returns 0 for a
+ * random generator's seed.
+ * @param	value	The value.
+ * @return	The mixed value.
+ */
+static uint64_t hash64(uint64_t value) {
+	value += 0x9e3779b97f4a7c15ULL;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	return (value ? value : 1);
+}
+
+/**
+ * Add a histogram to another one.
+ * @param	histogram	Pointer to the histogram.
+ * @param	src		Pointer to the added histogram.
+ */
+static void histogram_add(stats_histogram_t *histogram, stats_histogram_t *src) {
+	unsigned int i;
+
+	histogram->count += src->count;
+	histogram->sum += src->sum;
+	if (src->max > histogram->max)
+		histogram->max = src->max;
+	for (i = 0; i < STATS_BUCKETS; i++)
+		histogram->buckets[i] += src->buckets[i];
+}
+
+/**
+ * Print the results of a phase.
+ * @param	name		Name of the phase.
+ * @param	duration	Duration of the phase (seconds).
+ * @param	json		JSON results file. Could be NULL.
+ */
+static void report(const char *name, double duration, FILE *json) {
+	static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	static const char *percentile_names[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	static ybool_t first_phase = YTRUE;
+	stats_histogram_t histogram, misses, errors;
+	uint64_t total = 0;
+	ybool_t first_op = YTRUE;
+	unsigned int i;
+	int op;
+
+	printf("[%s] %.3f s\n", name, duration);
+	printf("%-8s %10s %8s %8s %10s %9s %9s %9s %9s %9s %9s %9s\n", "op", "count", "misses", "errors",
+	       "ops/s", "mean(us)", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+	if (json)
+		fprintf(json, "%s\n\t\t{\"name\": \"%s\", \"duration\": %.6f, \"ops\": {", (first_phase ? "" : ","),
+		        name, duration);
+	first_phase = YFALSE;
+	for (op = 0; op < BENCH_OPS; op++) {
+		// latencies of the answered operations
+		stats_merge(phase_g.stats, (unsigned char)op, config_g.sync, PROTO_STATS_HIT, &histogram);
+		stats_merge(phase_g.stats, (unsigned char)op, config_g.sync, PROTO_STATS_MISS, &misses);
+		stats_merge(phase_g.stats, (unsigned char)op, config_g.sync, PROTO_STATS_ERROR, &errors);
+		histogram_add(&histogram, &misses);
+		if (!histogram.count && !errors.count)
+			continue;
+		total += histogram.count + errors.count;
+		printf("%-8s %10llu %8llu %8llu %10.0f %9.1f", op_names[op], (unsigned long long)histogram.count,
+		       (unsigned long long)misses.count, (unsigned long long)errors.count,
+		       histogram.count / duration, (histogram.count ? histogram.sum / 1000.0 / histogram.count : 0.0));
+		for (i = 0; i < sizeof(percentiles) / sizeof(double); i++)
+			printf(" %9.1f", stats_percentile(&histogram, percentiles[i]) / 1000.0);
+		printf(" %9.1f\n", histogram.max / 1000.0);
+		if (json) {
+			fprintf(json, "%s\n\t\t\t\"%s\": {\"count\": %llu, \"misses\": %llu, \"errors\": %llu, "
+			        "\"throughput\": %.1f, \"latency_us\": {\"mean\": %.3f", (first_op ? "" : ","),
+			        op_names[op], (unsigned long long)histogram.count, (unsigned long long)misses.count,
+			        (unsigned long long)errors.count, histogram.count / duration,
+			        (histogram.count ? histogram.sum / 1000.0 / histogram.count : 0.0));
+			for (i = 0; i < sizeof(percentiles) / sizeof(double); i++)
+				fprintf(json, ", \"%s\": %.3f", percentile_names[i],
+				        stats_percentile(&histogram, percentiles[i]) / 1000.0);
+			fprintf(json, ", \"max\": %.3f}}", histogram.max / 1000.0);
+		}
+		first_op = YFALSE;
+		if (config_g.hdr)
+			report_hdr(op_names[op], &histogram);
+	}
+	printf("total    %10llu %28.0f ops/s\n\n", (unsigned long long)total, total / duration);
+	if (json)
+		fprintf(json, "\n\t\t}, \"operations\": %llu, \"throughput\": %.1f}", (unsigned long long)total,
+		        total / duration);
+}
+
+/**
+ * Print the percentile distribution of a histogram, in the format of
+ * HdrHistogram (it could be plotted by its tools).
+ * @param	name		Name of the operation.
+ * @param	histogram	Pointer to the histogram.
+ */
+static void report_hdr(const char *name, stats_histogram_t *histogram) {
+	double percentile;
+	unsigned int tick;
+
+	if (!histogram->count)
+		return;
+	printf("# %s\n%12s %14s %10s %14s\n\n", name, "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+	// 5 ticks each time the distance to 100% is halved
+	for (tick = 0; ; tick++) {
+		percentile = 100.0 * (1.0 - pow(0.5, tick / 5.0));
+		if ((1.0 - percentile / 100.0) * histogram->count < 1.0)
+			break;
+		printf("%12.3f %14.12f %10llu %14.2f\n", stats_percentile(histogram, percentile) / 1000.0,
+		       percentile / 100.0, (unsigned long long)fmax(1.0, ceil(percentile / 100.0 * histogram->count)),
+		       1.0 / (1.0 - percentile / 100.0));
+	}
+	printf("%12.3f %14.12f %10llu\n", histogram->max / 1000.0, 1.0, (unsigned long long)histogram->count);
+	printf("#[Mean    = %12.3f, Max = %12.3f]\n#[Total count    = %12llu]\n\n",
+	       histogram->sum / 1000.0 / histogram->count, histogram->max / 1000.0,
+	       (unsigned long long)histogram->count);
+}
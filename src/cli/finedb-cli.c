@@ -13,6 +13,7 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 #include "ydefs.h"
 #include "libfinedb.h"
 #include "linenoise.h"
@@ -50,8 +51,12 @@ void command_use(cli_t *cli, char *pt);
 void command_get(cli_t *cli, char *pt);
 void command_del(cli_t *cli, char *pt);
 void command_send_data(cli_t *cli, char *pt, ybool_t create_only, ybool_t update_only);
+void command_aggregate(cli_t *cli, char *pt);
+void command_cas(cli_t *cli, char *pt);
 void command_inc(cli_t *cli, char *pt);
 void command_dec(cli_t *cli, char *pt);
+void command_incdec(cli_t *cli, char *pt, ybool_t dec);
+void command_merge(cli_t *cli, char *pt);
 void command_start(cli_t *cli);
 void command_stop(cli_t *cli);
 #if 0
@@ -59,39 +64,65 @@ void command_list(cli_t *cli, char *pt);
 void command_drop(cli_t *cli, char *pt);
 #endif
 void command_ping(cli_t *cli);
+void command_stats(cli_t *cli);
+void command_lmdb(cli_t *cli);
+void command_slowlog(cli_t *cli);
+void command_hotkeys(cli_t *cli);
 void command_sync(cli_t *cli);
 void command_async(cli_t *cli);
 void command_autocheck(cli_t *cli, char *pt);
 int check_connection(cli_t *cli);
+char *parse_quoted(char **pt);
 
 /* Array of commands. */
 char *commands[] = {
-	"help", "use", "get", "del", "put", "add", "update", "inc", "dec",
-	"start", "commit", "rollback", "ping", "sync", "async", "autocheck",
+	"help", "use", "get", "del", "put", "add", "update", "inc", "dec", "merge", "cas", "aggregate",
+	"start", "commit", "rollback", "ping", "stats", "lmdb", "slowlog", "hotkeys", "sync", "async", "autocheck",
 	NULL
 };
 
+/* Names of the protocol's commands. */
+static const char *command_names[] = {
+	"PING", "GET", "DEL", "PUT", "SETDB", "START", "STOP", "AGGREGATE",
+	"MERGE", "CAS", "SHM", "BATCH", "TRACK", "0xd", "ADMIN", "EXTRA"
+};
+
 /* Main function. */
 int main(int argc, char *argv[]) {
 	cli_t cli;
 	char *hostname = DEFAULT_HOST;
+	char *unix_path = NULL;
 	char history_file[4096];
 	ybool_t interactive_mode = YTRUE;
 
 	bzero(&cli, sizeof(cli_t));
 	cli.autocheck = YTRUE;
-	if (argc == 2 && argv[1][0] != '-')
-		hostname = argv[1];
-	if (argc == 3 && !strcmp(argv[2], "-"))
-		interactive_mode = YFALSE;
+	if (argc >= 3 && !strcmp(argv[1], "-u")) {
+		// local connection through a Unix socket
+		unix_path = argv[2];
+		if (argc == 4 && !strcmp(argv[3], "-"))
+			interactive_mode = YFALSE;
+	} else {
+		if (argc == 2 && argv[1][0] != '-')
+			hostname = argv[1];
+		if (argc == 3 && !strcmp(argv[2], "-"))
+			interactive_mode = YFALSE;
+	}
 	// init database connection
-	if ((cli.finedb = finedb_create(hostname, 11138)) == NULL) {
+	if (unix_path)
+		cli.finedb = finedb_create_unix(unix_path);
+	else
+		cli.finedb = finedb_create(hostname, 11138);
+	if (cli.finedb == NULL) {
 		printf_color("red", "Memory error.");
 		printf("\n");
 		exit(1);
 	}
 	if (finedb_connect(cli.finedb) != FINEDB_OK) {
-		printf_color("red", "Unable to connect to server '%s' on port '%d'.", argv[1], 11138);
+		if (unix_path)
+			printf_color("red", "Unable to connect to server on socket '%s'.", unix_path);
+		else
+			printf_color("red", "Unable to connect to server '%s' on port '%d'.", hostname, 11138);
 		printf("\n");
 		exit(2);
 	}
@@ -176,10 +207,16 @@ int main(int argc, char *argv[]) {
 			command_send_data(&cli, pt, YTRUE, YFALSE);
 		else if (!strcasecmp(cmd, "update"))
 			command_send_data(&cli, pt, YFALSE, YTRUE);
+		else if (!strcasecmp(cmd, "aggregate"))
+			command_aggregate(&cli, pt);
 		else if (!strcasecmp(cmd, "inc"))
 			command_inc(&cli, pt);
 		else if (!strcasecmp(cmd, "dec"))
 			command_dec(&cli, pt);
+		else if (!strcasecmp(cmd, "merge"))
+			command_merge(&cli, pt);
+		else if (!strcasecmp(cmd, "cas"))
+			command_cas(&cli, pt);
 		else if (!strcasecmp(cmd, "start"))
 			command_start(&cli);
 		else if (!strcasecmp(cmd, "stop"))
@@ -190,6 +227,14 @@ int main(int argc, char *argv[]) {
 #endif
 		else if (!strcasecmp(cmd, "ping"))
 			command_ping(&cli);
+		else if (!strcasecmp(cmd, "stats"))
+			command_stats(&cli);
+		else if (!strcasecmp(cmd, "lmdb"))
+			command_lmdb(&cli);
+		else if (!strcasecmp(cmd, "slowlog"))
+			command_slowlog(&cli);
+		else if (!strcasecmp(cmd, "hotkeys"))
+			command_hotkeys(&cli);
 		else if (!strcasecmp(cmd, "autocheck"))
 			command_autocheck(&cli, pt);
 		else {
@@ -205,17 +250,27 @@ reloop:
 /* Show usage. */
 void command_help() {
 	printf_decorated("faint", "Usage:    finedb-cli [hostname]\n"
+	                          "          finedb-cli -u socket_path\n"
 	                          "Commands:\n"
 	                          "    get \"key1\"\n"
 	                          "    put \"key\" \"data\"\n"
 	                          "    add \"key\" \"data\"\n"
 	                          "    update \"key\" \"data\"\n"
 	                          "    del \"key\"\n"
+	                          "    inc \"key\" [increment]\n"
+	                          "    dec \"key\" [decrement]\n"
+	                          "    merge \"key\" append|max|min|or \"operand\"\n"
+	                          "    cas \"key\" version [\"data\"]\n"
+	                          "    aggregate \"start\" \"end\" [string|int64]\n"
 	                          "    use \"dbname\"\n"
 	                          "    start\n"
 	                          "    commit\n"
 	                          "    rollback\n"
 	                          "    ping\n"
+	                          "    stats\n"
+	                          "    lmdb\n"
+	                          "    slowlog\n"
+	                          "    hotkeys\n"
 	                          "    sync\n"
 	                          "    async\n"
 	                          "    autocheck [on|off]\n"
@@ -272,6 +327,7 @@ void command_async(cli_t *cli) {
 void command_get(cli_t *cli, char *pt) {
 	char *pt2, *key;
 	ybin_t bkey, bdata;
+	unsigned long long version = 0;
 	int rc;
 
 	LTRIM(pt);
@@ -301,7 +357,7 @@ void command_get(cli_t *cli, char *pt) {
 	// request
 	bzero(&bdata, sizeof(bdata));
 	ybin_set(&bkey, key, strlen(key));
-	rc = finedb_get(cli->finedb, bkey, &bdata);
+	rc = finedb_get_versioned(cli->finedb, bkey, &bdata, &version);
 	if (rc) {
 		printf_color("red", "Unable to get key '%s' (%d).", key, rc);
 		printf("\n");
@@ -310,8 +366,11 @@ void command_get(cli_t *cli, char *pt) {
 	if (bdata.data == NULL || bdata.len == 0) {
 		printf_decorated("faint", "No data.");
 		printf("\n");
-	}
-	printf("%s\n", (char*)bdata.data);
+	} else
+		printf("%.*s\n", (int)bdata.len, (char*)bdata.data);
+	printf_decorated("faint", "Version %llu", version);
+	printf("\n");
+	YFREE(bdata.data);
 }
 
 /* Delete a key. */
@@ -428,12 +487,225 @@ void command_send_data(cli_t *cli, char *pt, ybool_t create_only, ybool_t update
 	printf("\n");
 }
 
+/* Aggregate the values of a range of keys. */
+void command_aggregate(cli_t *cli, char *pt) {
+	char *start, *end;
+	ybin_t bstart, bend;
+	finedb_encoding_t encoding = FINEDB_ENC_NONE;
+	finedb_aggregate_t result;
+	int rc;
+
+	if ((start = parse_quoted(&pt)) == NULL || (end = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad range format (keys must be quoted)");
+		printf("\n");
+		return;
+	}
+	LTRIM(pt);
+	if (!strcasecmp(pt, "string"))
+		encoding = FINEDB_ENC_STRING;
+	else if (!strcasecmp(pt, "int64"))
+		encoding = FINEDB_ENC_INT64;
+	else if (*pt) {
+		printf_decorated("faint", "Bad encoding (string or int64)");
+		printf("\n");
+		return;
+	}
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	ybin_set(&bstart, start, strlen(start));
+	ybin_set(&bend, end, strlen(end));
+	rc = finedb_aggregate(cli->finedb, bstart, bend, encoding, &result);
+	if (rc) {
+		printf_color("red", "Unable to aggregate keys (%d).", rc);
+		printf("\n");
+		return;
+	}
+	printf("count:   %llu\n", result.count);
+	printf("size:    %llu\n", result.size);
+	if (encoding == FINEDB_ENC_NONE)
+		return;
+	printf("numbers: %llu\n", result.numbers);
+	if (!result.numbers)
+		return;
+	printf("sum:     %lld\n", result.sum);
+	printf("min:     %lld\n", result.min);
+	printf("max:     %lld\n", result.max);
+}
+
+/* Write or remove a key if its version matches. */
+void command_cas(cli_t *cli, char *pt) {
+	char *key, *data = NULL, *end = NULL;
+	ybin_t bkey, bdata;
+	unsigned long long version, new_version = 0;
+	int rc;
+
+	if ((key = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad key format (must be quoted)");
+		printf("\n");
+		return;
+	}
+	LTRIM(pt);
+	version = strtoull(pt, &end, 10);
+	if (end == pt) {
+		printf_decorated("faint", "Bad version");
+		printf("\n");
+		return;
+	}
+	pt = end;
+	LTRIM(pt);
+	if (*pt && (data = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad data format (must be quoted)");
+		printf("\n");
+		return;
+	}
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request: write the data, or remove the key if there is no data
+	ybin_set(&bkey, key, strlen(key));
+	if (data) {
+		ybin_set(&bdata, data, strlen(data));
+		rc = finedb_cas(cli->finedb, bkey, bdata, version, &new_version);
+	} else
+		rc = finedb_cas_del(cli->finedb, bkey, version);
+	if (rc == FINEDB_ERR_VERSION) {
+		printf_color("red", "Version mismatch on key '%s'.", key);
+		printf("\n");
+		return;
+	} else if (rc) {
+		printf_color("red", "Unable to %s key '%s' (%d).", (data ? "write" : "remove"), key, rc);
+		printf("\n");
+		return;
+	}
+	if (data && cli->finedb->sync)
+		printf_decorated("faint", "OK (version %llu)", new_version);
+	else
+		printf_decorated("faint", "OK");
+	printf("\n");
+}
+
 /* Increment a value. */
 void command_inc(cli_t *cli, char *pt) {
+	command_incdec(cli, pt, YFALSE);
 }
 
 /* Decrement a value. */
 void command_dec(cli_t *cli, char *pt) {
+	command_incdec(cli, pt, YTRUE);
+}
+
+/* Increment or decrement a value. */
+void command_incdec(cli_t *cli, char *pt, ybool_t dec) {
+	char *key, *end = NULL;
+	ybin_t bkey;
+	long long val = 1, new_value = 0;
+	int rc;
+
+	if ((key = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad key format (must be quoted)");
+		printf("\n");
+		return;
+	}
+	LTRIM(pt);
+	if (*pt) {
+		val = strtoll(pt, &end, 10);
+		if (end == pt || *end) {
+			printf_decorated("faint", "Bad %s value", (dec ? "decrement" : "increment"));
+			printf("\n");
+			return;
+		}
+	}
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	ybin_set(&bkey, key, strlen(key));
+	if (dec)
+		rc = finedb_dec(cli->finedb, bkey, val, &new_value);
+	else
+		rc = finedb_inc(cli->finedb, bkey, val, &new_value);
+	if (rc == FINEDB_ERR_VALUE) {
+		printf_color("red", "The value of '%s' is not a number.", key);
+		printf("\n");
+		return;
+	} else if (rc) {
+		printf_color("red", "Unable to %s key '%s' (%d).", (dec ? "decrement" : "increment"), key, rc);
+		printf("\n");
+		return;
+	}
+	if (cli->finedb->sync)
+		printf("%lld\n", new_value);
+	else {
+		printf_decorated("faint", "OK");
+		printf("\n");
+	}
+}
+
+/* Apply a merge operator on a value. */
+void command_merge(cli_t *cli, char *pt) {
+	char *key, *op_name, *operand;
+	ybin_t bkey, boperand, result;
+	finedb_merge_t op;
+	int rc;
+
+	if ((key = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad key format (must be quoted)");
+		printf("\n");
+		return;
+	}
+	LTRIM(pt);
+	op_name = pt;
+	while (*pt && !IS_SPACE(*pt))
+		pt++;
+	if (*pt)
+		*pt++ = '\0';
+	if (!strcasecmp(op_name, "append"))
+		op = FINEDB_MERGE_APPEND;
+	else if (!strcasecmp(op_name, "max"))
+		op = FINEDB_MERGE_MAX;
+	else if (!strcasecmp(op_name, "min"))
+		op = FINEDB_MERGE_MIN;
+	else if (!strcasecmp(op_name, "or"))
+		op = FINEDB_MERGE_OR;
+	else {
+		printf_decorated("faint", "Bad operator (append, max, min or or)");
+		printf("\n");
+		return;
+	}
+	if ((operand = parse_quoted(&pt)) == NULL) {
+		printf_decorated("faint", "Bad operand format (must be quoted)");
+		printf("\n");
+		return;
+	}
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	ybin_set(&bkey, key, strlen(key));
+	ybin_set(&boperand, operand, strlen(operand));
+	rc = finedb_merge(cli->finedb, op, bkey, boperand, &result);
+	if (rc == FINEDB_ERR_VALUE) {
+		printf_color("red", "The value of '%s' is not compatible with '%s'.", key, op_name);
+		printf("\n");
+		return;
+	} else if (rc) {
+		printf_color("red", "Unable to merge key '%s' (%d).", key, rc);
+		printf("\n");
+		return;
+	}
+	if (cli->finedb->sync)
+		printf("%.*s\n", (int)result.len, (char*)result.data);
+	else {
+		printf_decorated("faint", "OK");
+		printf("\n");
+	}
+	YFREE(result.data);
 }
 
 /* Start a transaction. */
@@ -500,6 +772,154 @@ void command_ping(cli_t *cli) {
 	printf("\n");
 }
 
+/* Show the latency statistics of the server. */
+void command_stats(cli_t *cli) {
+	static const char *result_names[] = { "hit", "miss", "error" };
+	finedb_stats_t *stats;
+	size_t nbr_stats, i;
+	unsigned long long uptime;
+	int rc;
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	rc = finedb_stats(cli->finedb, &stats, &nbr_stats, &uptime);
+	if (rc) {
+		printf_color("red", "Unable to get statistics (%d).", rc);
+		printf("\n");
+		return;
+	}
+	printf_decorated("faint", "Uptime: %llu s - latencies in microseconds", uptime / 1000);
+	printf("\n");
+	printf_decorated("bold", "%-10s %-5s %-6s %10s %8s %9s %9s %9s %9s %9s",
+	                 "command", "mode", "result", "count", "req/s", "mean", "p50", "p99",
+	                 "p99.9", "max");
+	printf("\n");
+	for (i = 0; i < nbr_stats; i++) {
+		printf("%-10s %-5s %-6s %10llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+		       command_names[stats[i].command & 0xf], (stats[i].async ? "async" : "sync"),
+		       (stats[i].result <= FINEDB_STATS_ERROR ? result_names[stats[i].result] : "?"),
+		       stats[i].count, stats[i].throughput, stats[i].mean / 1000.0,
+		       stats[i].p50 / 1000.0, stats[i].p99 / 1000.0, stats[i].p999 / 1000.0,
+		       stats[i].max / 1000.0);
+	}
+	YFREE(stats);
+}
+
+/* Show the internals of the server's LMDB environment. */
+void command_lmdb(cli_t *cli) {
+	finedb_lmdb_t lmdb;
+	finedb_lmdb_db_t *dbs;
+	size_t nbr_dbs, i;
+	int rc;
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	rc = finedb_lmdb(cli->finedb, &lmdb, &dbs, &nbr_dbs);
+	if (rc) {
+		printf_color("red", "Unable to get LMDB information (%d).", rc);
+		printf("\n");
+		return;
+	}
+	printf("Map size:      %llu bytes (%.1f%% used)\n", lmdb.map_size,
+	       lmdb.map_size ? (lmdb.last_page + 1) * lmdb.page_size * 100.0 / lmdb.map_size : 0.0);
+	printf("Page size:     %llu bytes\n", lmdb.page_size);
+	printf("Last page:     %llu\n", lmdb.last_page);
+	printf("Free pages:    %llu\n", lmdb.free_pages);
+	printf("Last txn ID:   %llu\n", lmdb.last_txnid);
+	printf("Readers:       %llu / %llu\n", lmdb.readers, lmdb.max_readers);
+	if (lmdb.oldest_age)
+		printf("Oldest txn:    %llu ms, %llu commits behind\n", lmdb.oldest_age, lmdb.oldest_lag);
+	else
+		printf("Oldest txn:    none\n");
+	printf("Page faults:   %llu major, %llu minor\n", lmdb.major_faults, lmdb.minor_faults);
+	printf_decorated("bold", "%-20s %5s %10s %10s %10s %12s",
+	                 "database", "depth", "branch", "leaf", "overflow", "entries");
+	printf("\n");
+	for (i = 0; i < nbr_dbs; i++) {
+		printf("%-20s %5llu %10llu %10llu %10llu %12llu\n",
+		       (dbs[i].name ? dbs[i].name : "(default)"), dbs[i].depth, dbs[i].branch_pages,
+		       dbs[i].leaf_pages, dbs[i].overflow_pages, dbs[i].entries);
+	}
+	finedb_lmdb_free(dbs, nbr_dbs);
+}
+
+/* Show the slow-request log of the server. */
+void command_slowlog(cli_t *cli) {
+	finedb_slowlog_t *entries;
+	size_t nbr_entries, i;
+	unsigned long long threshold;
+	int rc;
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	rc = finedb_slowlog(cli->finedb, &entries, &nbr_entries, &threshold);
+	if (rc) {
+		printf_color("red", "Unable to get the slow-request log (%d).", rc);
+		printf("\n");
+		return;
+	}
+	if (!threshold) {
+		printf_decorated("faint", "The slow-request log is disabled (see the -l option of the server).");
+		printf("\n");
+		return;
+	}
+	printf_decorated("faint", "Requests slower than %llu ms - durations in microseconds", threshold / 1000000);
+	printf("\n");
+	printf_decorated("bold", "%-8s %-23s %-10s %-5s %4s %10s %9s %9s %9s %9s %9s %9s %7s",
+	                 "id", "date", "command", "mode", "resp", "total", "recv", "parse", "queue",
+	                 "txn", "zip", "send", "queued");
+	printf("\n");
+	for (i = 0; i < nbr_entries; i++) {
+		time_t date = (time_t)(entries[i].time / 1000);
+		char date_str[24];
+
+		strftime(date_str, sizeof(date_str), "%Y-%m-%d %H:%M:%S", localtime(&date));
+		printf("%-8llu %s.%03llu %-10s %-5s %4u %10.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %7llu\n",
+		       entries[i].id, date_str, entries[i].time % 1000, command_names[entries[i].command & 0xf],
+		       (entries[i].async ? "async" : "sync"), entries[i].response,
+		       entries[i].duration / 1000.0, entries[i].recv / 1000.0, entries[i].parse / 1000.0,
+		       entries[i].queue / 1000.0, entries[i].txn / 1000.0, entries[i].zip / 1000.0,
+		       entries[i].send / 1000.0, entries[i].queued);
+	}
+	YFREE(entries);
+}
+
+/* Show the most accessed keys of the server. */
+void command_hotkeys(cli_t *cli) {
+	finedb_hotkey_t *keys;
+	size_t nbr_keys, i;
+	unsigned long long reads, writes, total;
+	int rc;
+
+	// check connection if needed
+	if (!check_connection(cli))
+		return;
+	// request
+	rc = finedb_hotkeys(cli->finedb, &keys, &nbr_keys, &reads, &writes);
+	if (rc) {
+		printf_color("red", "Unable to get the hot keys (%d).", rc);
+		printf("\n");
+		return;
+	}
+	printf_decorated("faint", "Recent accesses: %llu reads, %llu writes", reads, writes);
+	printf("\n");
+	printf_decorated("bold", "%-6s %12s %7s %-20s %s", "access", "count", "share", "database", "key");
+	printf("\n");
+	for (i = 0; i < nbr_keys; i++) {
+		total = keys[i].write ? writes : reads;
+		printf("%-6s %12llu %6.1f%% %-20s \"%.*s\"\n", (keys[i].write ? "write" : "read"), keys[i].count,
+		       (total ? keys[i].count * 100.0 / total : 0.0), (keys[i].dbname ? keys[i].dbname : "(default)"),
+		       (int)keys[i].key.len, (char*)keys[i].key.data);
+	}
+	finedb_hotkeys_free(keys, nbr_keys);
+}
+
 /* Set the autocheck option. */
 void command_autocheck(cli_t *cli, char *pt) {
 	if (strlen(pt)) {
@@ -541,6 +961,29 @@ int check_connection(cli_t *cli) {
 	return (1);
 }
 
+/**
+ * @function	parse_quoted
+ * Extract a quoted string from a command line.
+ * @param	pt	Pointer to the current position in the command line.
+ *			It is moved after the trailing quote.
+ * @return	A pointer to the string (without quotes), or NULL if the
+ *		format is bad.
+ */
+char *parse_quoted(char **pt) {
+	char *s, *end;
+
+	s = *pt;
+	LTRIM(s);
+	if (*s != '"')
+		return (NULL);
+	s++;
+	if ((end = strchr(s, '"')) == NULL)
+		return (NULL);
+	*end = '\0';
+	*pt = end + 1;
+	return (s);
+}
+
 #if 0
 /* List the keys stored in database. */
 void command_list(cli_t *cli, char *pt) {
@@ -0,0 +1,239 @@
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "cache.h"
+
+/* private functions */
+static uint32_t _cache_slot(const char *dbname, ybin_t key);
+static ybool_t _cache_match(cache_entry_t *entry, uint32_t slot, const char *dbname, ybin_t key);
+static void _cache_unlink(cache_t *cache, cache_entry_t *entry);
+static void _cache_free_slot(cache_t *cache, uint32_t slot);
+
+/* Create a cache. */
+cache_t *cache_new(size_t max_entries) {
+	cache_t *cache;
+
+	if ((cache = YMALLOC(sizeof(cache_t))) == NULL)
+		return (NULL);
+	if ((cache->slots = YMALLOC(PROTO_TRACK_SLOTS * sizeof(cache_entry_t*))) == NULL ||
+	    (cache->in = ydynabin_new(NULL, 0, YFALSE)) == NULL) {
+		YFREE(cache->slots);
+		YFREE(cache);
+		return (NULL);
+	}
+	cache->max_entries = max_entries;
+	return (cache);
+}
+
+/* Destroy a cache. */
+void cache_delete(cache_t *cache) {
+	if (cache == NULL)
+		return;
+	cache_clear(cache);
+	ydynabin_delete(cache->in);
+	YFREE(cache->slots);
+	YFREE(cache);
+}
+
+/* Search a value in the cache. */
+cache_entry_t *cache_get(cache_t *cache, const char *dbname, ybin_t key) {
+	uint32_t slot = _cache_slot(dbname, key);
+	cache_entry_t *entry;
+
+	for (entry = cache->slots[slot]; entry; entry = entry->slot_next)
+		if (_cache_match(entry, slot, dbname, key))
+			break;
+	if (entry == NULL || entry == cache->lru_first)
+		return (entry);
+	// move the entry at the head of the LRU list
+	entry->lru_prev->lru_next = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_last = entry->lru_prev;
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_first;
+	cache->lru_first->lru_prev = entry;
+	cache->lru_first = entry;
+	return (entry);
+}
+
+/* Add a value in the cache. */
+void cache_set(cache_t *cache, const char *dbname, ybin_t key, ybin_t value, unsigned long long version) {
+	cache_entry_t *entry;
+
+	if (!cache->max_entries)
+		return;
+	cache_remove(cache, dbname, key);
+	// the cache is full: remove the least recently used entry
+	if (cache->nbr_entries >= cache->max_entries)
+		_cache_unlink(cache, cache->lru_last);
+	if ((entry = YMALLOC(sizeof(cache_entry_t))) == NULL)
+		return;
+	// a single allocation for the key and the value
+	if ((entry->key.data = YMALLOC(key.len + value.len + 1)) == NULL ||
+	    (dbname && (entry->dbname = strdup(dbname)) == NULL)) {
+		YFREE(entry->key.data);
+		YFREE(entry);
+		return;
+	}
+	memcpy(entry->key.data, key.data, key.len);
+	entry->key.len = key.len;
+	entry->value.data = (char*)entry->key.data + key.len;
+	if (value.len)
+		memcpy(entry->value.data, value.data, value.len);
+	entry->value.len = value.len;
+	entry->version = version;
+	entry->slot = _cache_slot(dbname, key);
+	entry->slot_next = cache->slots[entry->slot];
+	cache->slots[entry->slot] = entry;
+	entry->lru_next = cache->lru_first;
+	if (cache->lru_first)
+		cache->lru_first->lru_prev = entry;
+	else
+		cache->lru_last = entry;
+	cache->lru_first = entry;
+	cache->nbr_entries++;
+}
+
+/* Remove a key from the cache. */
+void cache_remove(cache_t *cache, const char *dbname, ybin_t key) {
+	uint32_t slot = _cache_slot(dbname, key);
+	cache_entry_t *entry;
+
+	for (entry = cache->slots[slot]; entry; entry = entry->slot_next) {
+		if (_cache_match(entry, slot, dbname, key)) {
+			_cache_unlink(cache, entry);
+			return;
+		}
+	}
+}
+
+/* Remove all the entries of the cache. */
+void cache_clear(cache_t *cache) {
+	while (cache->lru_first)
+		_cache_unlink(cache, cache->lru_first);
+}
+
+/* Process the waiting invalidation records. */
+int cache_invalidate(cache_t *cache, int sock) {
+	char buff[4096], dbname[256];
+	unsigned char *pt, dbname_len;
+	uint16_t key_len;
+	ybin_t key;
+	ssize_t rc;
+
+	// read all available data
+	for (; ; ) {
+		rc = recv(sock, buff, sizeof(buff), MSG_DONTWAIT);
+		if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			return (FINEDB_ERR_NETWORK);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (ydynabin_expand(cache->in, buff, (size_t)rc) != YENOERR)
+			return (FINEDB_ERR_MEMORY);
+	}
+	// process complete records
+	while (cache->in->len >= 1 + 1 + sizeof(uint16_t)) {
+		pt = cache->in->data;
+		dbname_len = pt[1];
+		if (cache->in->len < 1 + 1 + (size_t)dbname_len + sizeof(uint16_t))
+			break;
+		memcpy(&key_len, pt + 2 + dbname_len, sizeof(key_len));
+		key_len = ntohs(key_len);
+		if (cache->in->len < 1 + 1 + (size_t)dbname_len + sizeof(uint16_t) + key_len)
+			break;
+		if (pt[0] == PROTO_INVALIDATE_ALL) {
+			cache_clear(cache);
+		} else {
+			memcpy(dbname, pt + 2, dbname_len);
+			dbname[dbname_len] = '\0';
+			ybin_set(&key, pt + 2 + dbname_len + sizeof(key_len), key_len);
+			_cache_free_slot(cache, _cache_slot((dbname_len ? dbname : NULL), key));
+		}
+		ydynabin_forward(cache->in, 2 + dbname_len + sizeof(key_len) + key_len);
+	}
+	return (FINEDB_OK);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_cache_slot
+ * Compute the tracking slot of a key, as the server does.
+ * @param	dbname	Name of the database. NULL for the default one.
+ * @param	key	Key.
+ * @return	The slot number.
+ */
+static uint32_t _cache_slot(const char *dbname, ybin_t key) {
+	uint32_t hash = 2166136261U;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 16777619U;
+	hash = (hash ^ 0xff) * 16777619U;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 16777619U;
+	return (hash & (PROTO_TRACK_SLOTS - 1));
+}
+
+/**
+ * @function	_cache_match
+ * Tell if an entry matches a key.
+ * @param	entry	Pointer to the entry.
+ * @param	slot	Slot of the key.
+ * @param	dbname	Name of the database. NULL for the default one.
+ * @param	key	Key.
+ * @return	YTRUE if the entry matches.
+ */
+static ybool_t _cache_match(cache_entry_t *entry, uint32_t slot, const char *dbname, ybin_t key) {
+	if (entry->slot != slot || entry->key.len != key.len ||
+	    memcmp(entry->key.data, key.data, key.len))
+		return (YFALSE);
+	if (entry->dbname == NULL || dbname == NULL)
+		return ((entry->dbname == NULL && dbname == NULL) ? YTRUE : YFALSE);
+	return (strcmp(entry->dbname, dbname) ? YFALSE : YTRUE);
+}
+
+/**
+ * @function	_cache_unlink
+ * Remove an entry from the cache, and free it.
+ * @param	cache	Pointer to the cache.
+ * @param	entry	Pointer to the entry.
+ */
+static void _cache_unlink(cache_t *cache, cache_entry_t *entry) {
+	cache_entry_t **pentry;
+
+	for (pentry = &cache->slots[entry->slot]; *pentry != entry; pentry = &(*pentry)->slot_next)
+		;
+	*pentry = entry->slot_next;
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_first = entry->lru_next;
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_last = entry->lru_prev;
+	cache->nbr_entries--;
+	YFREE(entry->dbname);
+	YFREE(entry->key.data);
+	YFREE(entry);
+}
+
+/**
+ * @function	_cache_free_slot
+ * Remove all the entries of a slot.
+ * @param	cache	Pointer to the cache.
+ * @param	slot	Slot number.
+ */
+static void _cache_free_slot(cache_t *cache, uint32_t slot) {
+	while (cache->slots[slot])
+		_cache_unlink(cache, cache->slots[slot]);
+}
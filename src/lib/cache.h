@@ -0,0 +1,114 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "libfinedb.h"
+
+/**
+ * @typedef	cache_entry_t
+ * Value kept in the client-side cache.
+ * @field	slot		Tracking slot of the key.
+ * @field	dbname		Name of the database. NULL for the default one.
+ * @field	key		Key.
+ * @field	value		Value.
+ * @field	version		Version of the value.
+ * @field	slot_next	Next entry of the same slot.
+ * @field	lru_prev	Previous entry in the LRU list (more recently used).
+ * @field	lru_next	Next entry in the LRU list (less recently used).
+ */
+typedef struct cache_entry_s {
+	uint32_t slot;
+	char *dbname;
+	ybin_t key;
+	ybin_t value;
+	unsigned long long version;
+	struct cache_entry_s *slot_next;
+	struct cache_entry_s *lru_prev;
+	struct cache_entry_s *lru_next;
+} cache_entry_t;
+
+/**
+ * @typedef	cache_t
+ * Client-side cache of values. Entries are indexed by the tracking slot of
+ * their key (see PROTO_TRACK_SLOTS), so an invalidation record removes all
+ * the entries of its slot. The least recently used entry is removed when
+ * the cache is full.
+ * @field	max_entries	Maximum number of entries.
+ * @field	nbr_entries	Current number of entries.
+ * @field	slots		Lists of entries, per slot.
+ * @field	lru_first	Most recently used entry.
+ * @field	lru_last	Least recently used entry.
+ * @field	in		Received data not yet processed (partial record).
+ */
+typedef struct cache_s {
+	size_t max_entries;
+	size_t nbr_entries;
+	cache_entry_t **slots;
+	cache_entry_t *lru_first;
+	cache_entry_t *lru_last;
+	ydynabin_t *in;
+} cache_t;
+
+/**
+ * @function	cache_new
+ * Create a cache.
+ * @param	max_entries	Maximum number of entries.
+ * @return	A pointer to the allocated cache, or NULL.
+ */
+cache_t *cache_new(size_t max_entries);
+
+/**
+ * @function	cache_delete
+ * Destroy a cache.
+ * @param	cache	Pointer to the cache.
+ */
+void cache_delete(cache_t *cache);
+
+/**
+ * @function	cache_get
+ * Search a value in the cache.
+ * @param	cache	Pointer to the cache.
+ * @param	dbname	Name of the database. NULL for the default one.
+ * @param	key	Key.
+ * @return	A pointer to the entry, or NULL if the key is not cached.
+ */
+cache_entry_t *cache_get(cache_t *cache, const char *dbname, ybin_t key);
+
+/**
+ * @function	cache_set
+ * Add a value in the cache. Its data are copied.
+ * @param	cache	Pointer to the cache.
+ * @param	dbname	Name of the database. NULL for the default one.
+ * @param	key	Key.
+ * @param	value	Value.
+ * @param	version	Version of the value.
+ */
+void cache_set(cache_t *cache, const char *dbname, ybin_t key, ybin_t value, unsigned long long version);
+
+/**
+ * @function	cache_remove
+ * Remove a key from the cache.
+ * @param	cache	Pointer to the cache.
+ * @param	dbname	Name of the database. NULL for the default one.
+ * @param	key	Key.
+ */
+void cache_remove(cache_t *cache, const char *dbname, ybin_t key);
+
+/**
+ * @function	cache_clear
+ * Remove all the entries of the cache.
+ * @param	cache	Pointer to the cache.
+ */
+void cache_clear(cache_t *cache);
+
+/**
+ * @function	cache_invalidate
+ * Read the invalidation records waiting on an invalidation connection
+ * (without blocking), and remove the matching entries.
+ * @param	cache	Pointer to the cache.
+ * @param	sock	Socket of the invalidation connection.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_NETWORK if the connection is
+ *		closed (the cache can't be trusted anymore).
+ */
+int cache_invalidate(cache_t *cache, int sock);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,161 @@
+#include <string.h>
+#include "lmdb.h"
+#include "snappy.h"
+#include "database.h"
+#include "embedded.h"
+
+/* Open the database environment. */
+int embedded_open(finedb_client_t *client) {
+	if (client->env)
+		return (FINEDB_OK);
+	// no map size: the one recorded by the server is used
+	client->env = database_open(client->db_path, 0, EMBEDDED_NBR_READERS, EMBEDDED_NBR_DBS);
+	if (client->env == NULL)
+		return (FINEDB_ERR_FILE);
+	return (FINEDB_OK);
+}
+
+/* Close the database environment. */
+void embedded_close(finedb_client_t *client) {
+	if (client->txn) {
+		mdb_txn_abort((MDB_txn*)client->txn);
+		client->txn = NULL;
+	}
+	if (client->env) {
+		database_close((MDB_env*)client->env);
+		client->env = NULL;
+	}
+}
+
+/* Select a different database. */
+int embedded_setdb(finedb_client_t *client, const char *dbname) {
+	YFREE(client->dbname);
+	if (dbname && (client->dbname = strdup(dbname)) == NULL)
+		return (FINEDB_ERR_MEMORY);
+	return (FINEDB_OK);
+}
+
+/* Read a value. */
+int embedded_get(finedb_client_t *client, ybin_t key, ybin_t *value, unsigned long long *version) {
+	MDB_txn *txn = (MDB_txn*)client->txn;
+	ybin_t data;
+	uint64_t data_version;
+	size_t unzip_len = 0;
+	char *unzip_data = NULL;
+	int retval = FINEDB_OK;
+
+	if (!client->env)
+		return (FINEDB_ERR_NETWORK);
+	// read-only transaction, kept between two reads to keep its reader slot
+	if (txn == NULL) {
+		if ((txn = database_transaction_start((MDB_env*)client->env, YTRUE)) == NULL)
+			return (FINEDB_ERR_SERVER);
+		client->txn = txn;
+	} else if (mdb_txn_renew(txn))
+		return (FINEDB_ERR_SERVER);
+	if (database_get((MDB_env*)client->env, txn, client->dbname, key, &data, &data_version) != YENOERR) {
+		retval = FINEDB_ERR_SERVER;
+		goto end_of_process;
+	}
+	// uncompress data directly from the map
+	if (data.len) {
+		if (!snappy_uncompressed_length(data.data, data.len, &unzip_len)) {
+			retval = FINEDB_ERR_ZIP;
+			goto end_of_process;
+		}
+		if ((unzip_data = YMALLOC(unzip_len)) == NULL) {
+			retval = FINEDB_ERR_MEMORY;
+			goto end_of_process;
+		}
+		if (snappy_uncompress(data.data, data.len, unzip_data)) {
+			YFREE(unzip_data);
+			retval = FINEDB_ERR_ZIP;
+			goto end_of_process;
+		}
+	}
+	value->data = unzip_data;
+	value->len = unzip_len;
+	if (version)
+		*version = (unsigned long long)data_version;
+end_of_process:
+	mdb_txn_reset(txn);
+	return (retval);
+}
+
+/* Read a value in a buffer given by the caller. */
+int embedded_get_into(finedb_client_t *client, ybin_t key, void *buffer, size_t size,
+                      size_t *len, unsigned long long *version) {
+	MDB_txn *txn = (MDB_txn*)client->txn;
+	ybin_t data;
+	uint64_t data_version;
+	size_t unzip_len = 0;
+	int retval = FINEDB_OK;
+
+	if (!client->env)
+		return (FINEDB_ERR_NETWORK);
+	if (txn == NULL) {
+		if ((txn = database_transaction_start((MDB_env*)client->env, YTRUE)) == NULL)
+			return (FINEDB_ERR_SERVER);
+		client->txn = txn;
+	} else if (mdb_txn_renew(txn))
+		return (FINEDB_ERR_SERVER);
+	if (database_get((MDB_env*)client->env, txn, client->dbname, key, &data, &data_version) != YENOERR) {
+		retval = FINEDB_ERR_SERVER;
+		goto end_of_process;
+	}
+	if (version)
+		*version = (unsigned long long)data_version;
+	// uncompress data from the map to the destination buffer
+	if (data.len && !snappy_uncompressed_length(data.data, data.len, &unzip_len)) {
+		retval = FINEDB_ERR_ZIP;
+		goto end_of_process;
+	}
+	*len = unzip_len;
+	if (unzip_len > size)
+		retval = FINEDB_ERR_SIZE;
+	else if (data.len && snappy_uncompress(data.data, data.len, buffer))
+		retval = FINEDB_ERR_ZIP;
+end_of_process:
+	mdb_txn_reset(txn);
+	return (retval);
+}
+
+/* Write a value. */
+int embedded_put(finedb_client_t *client, ybool_t create_only, ybin_t key, ybin_t data) {
+	struct snappy_env zip_env;
+	size_t zip_len;
+	char *zip_data;
+	ybin_t zip;
+	yerr_t rc;
+
+	if (!client->env)
+		return (FINEDB_ERR_NETWORK);
+	// data compression
+	memset(&zip_env, 0, sizeof(struct snappy_env));
+	if (snappy_init_env(&zip_env))
+		return (FINEDB_ERR_ZIP);
+	if ((zip_data = YMALLOC(snappy_max_compressed_length(data.len))) == NULL) {
+		snappy_free_env(&zip_env);
+		return (FINEDB_ERR_MEMORY);
+	}
+	if (snappy_compress(&zip_env, data.data, data.len, zip_data, &zip_len)) {
+		snappy_free_env(&zip_env);
+		YFREE(zip_data);
+		return (FINEDB_ERR_ZIP);
+	}
+	snappy_free_env(&zip_env);
+	// write in a standalone transaction (LMDB's write lock is shared with other processes)
+	ybin_set(&zip, zip_data, zip_len);
+	rc = database_put((MDB_env*)client->env, NULL, create_only, client->dbname, key, zip, 0, NULL);
+	YFREE(zip_data);
+	return ((rc == YENOERR) ? FINEDB_OK : FINEDB_ERR_SERVER);
+}
+
+/* Remove a key. */
+int embedded_del(finedb_client_t *client, ybin_t key) {
+	if (!client->env)
+		return (FINEDB_ERR_NETWORK);
+	if (database_del((MDB_env*)client->env, NULL, client->dbname, key, 0) != YENOERR)
+		return (FINEDB_ERR_SERVER);
+	return (FINEDB_OK);
+}
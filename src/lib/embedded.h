@@ -0,0 +1,91 @@
+#ifndef __EMBEDDED_H__
+#define __EMBEDDED_H__
+
+#include "ybin.h"
+#include "libfinedb.h"
+
+/**
+ * @define	EMBEDDED_NBR_READERS
+ * Maximum number of reader slots, if the database's lock file is created
+ * by the embedded library (otherwise the existing value is used).
+ */
+#define EMBEDDED_NBR_READERS	126
+
+/**
+ * @define	EMBEDDED_NBR_DBS
+ * Maximum number of databases opened by an embedded client.
+ */
+#define EMBEDDED_NBR_DBS	256
+
+/**
+ * @function	embedded_open
+ * Open the LMDB environment of an embedded client. The map size recorded in
+ * the environment is used, to stay compatible with a running server.
+ * @param	client	Pointer to the client structure.
+ * @return	FINEDB_OK if OK.
+ */
+int embedded_open(finedb_client_t *client);
+
+/**
+ * @function	embedded_close
+ * Close the LMDB environment of an embedded client.
+ * @param	client	Pointer to the client structure.
+ */
+void embedded_close(finedb_client_t *client);
+
+/**
+ * @function	embedded_setdb
+ * Select a different database.
+ * @param	client	Pointer to the client structure.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @return	FINEDB_OK if OK.
+ */
+int embedded_setdb(finedb_client_t *client, const char *dbname);
+
+/**
+ * @function	embedded_get
+ * Read a value directly from the database.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @param	data	Pointer to the destination data (must be freed).
+ * @param	version	Pointer to the version of the value. Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int embedded_get(finedb_client_t *client, ybin_t key, ybin_t *data, unsigned long long *version);
+
+/**
+ * @function	embedded_get_into
+ * Read a value directly from the database, and uncompress it in a buffer
+ * given by the caller.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @param	buffer	Pointer to the destination buffer.
+ * @param	size	Size of the destination buffer.
+ * @param	len	Pointer to the size of the value.
+ * @param	version	Pointer to the version of the value. Could be NULL.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_SIZE if the buffer is too small.
+ */
+int embedded_get_into(finedb_client_t *client, ybin_t key, void *buffer, size_t size,
+                      size_t *len, unsigned long long *version);
+
+/**
+ * @function	embedded_put
+ * Write a value directly in the database.
+ * @param	client		Pointer to the client structure.
+ * @param	create_only	YTRUE if the key must not already exist.
+ * @param	key		Pointer to the key content.
+ * @param	data		Pointer to the data content.
+ * @return	FINEDB_OK if OK.
+ */
+int embedded_put(finedb_client_t *client, ybool_t create_only, ybin_t key, ybin_t data);
+
+/**
+ * @function	embedded_del
+ * Remove a key directly from the database.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @return	FINEDB_OK if OK.
+ */
+int embedded_del(finedb_client_t *client, ybin_t key);
+
+#endif /* __EMBEDDED_H__ */
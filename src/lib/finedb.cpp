@@ -0,0 +1,248 @@
+#include <cerrno>
+#include <poll.h>
+#include "protocol.h"
+#include "finedb.hpp"
+
+namespace finedb {
+
+/* private functions */
+static const char *_error_message(int code) noexcept;
+static void _check(int code);
+
+/* ********************* ERROR **************** */
+/* Constructor. */
+error::error(int code) : std::runtime_error(_error_message(code)), _code(code) {
+}
+
+/* ********************* CONNECTION **************** */
+/* Connect to a server. */
+connection::connection(const std::string &hostname, unsigned short port) :
+	connection(finedb_create(hostname.c_str(), port)) {
+}
+
+/* Connect to the Unix socket of a local server. */
+connection connection::unix_socket(const std::string &path) {
+	return (connection(finedb_create_unix(path.c_str())));
+}
+
+/* Private constructor: connect a client. */
+connection::connection(finedb_client_t *client) : _client(client) {
+	int rc;
+
+	if (_client == nullptr)
+		throw error(FINEDB_ERR_MEMORY);
+	if ((rc = finedb_connect(_client)) != FINEDB_OK) {
+		finedb_delete(_client);
+		throw error(rc);
+	}
+	finedb_sync(_client);
+}
+
+/* Destructor. */
+connection::~connection() {
+	if (_client)
+		finedb_delete(_client);
+}
+
+/* Move constructor. */
+connection::connection(connection &&other) noexcept :
+	_client(other._client), _buffer(std::move(other._buffer)) {
+	other._client = nullptr;
+}
+
+/* Move assignment. */
+connection &connection::operator=(connection &&other) noexcept {
+	if (this != &other) {
+		if (_client)
+			finedb_delete(_client);
+		_client = other._client;
+		_buffer = std::move(other._buffer);
+		other._client = nullptr;
+	}
+	return (*this);
+}
+
+/* Set synchronous or asynchronous mode. */
+void connection::sync(bool sync) noexcept {
+	if (sync)
+		finedb_sync(_client);
+	else
+		finedb_async(_client);
+}
+
+/* Select a database. */
+void connection::setdb(std::string_view dbname) {
+	std::string name(dbname);
+
+	_check(finedb_setdb(_client, dbname.empty() ? nullptr : name.data()));
+}
+
+/* Read a value. */
+value connection::get(bin_view key) {
+	unsigned long long version = 0;
+	size_t len = 0;
+	int rc;
+
+	rc = finedb_get_into(_client, key.bin(), _buffer.data(), _buffer.size(), &len, &version);
+	if (rc == FINEDB_ERR_SIZE) {
+		// the buffer is too small: grow it and read again
+		_buffer.resize(len);
+		rc = finedb_get_into(_client, key.bin(), _buffer.data(), _buffer.size(), &len, &version);
+	}
+	// a missing key is reported by the server as an error
+	if (rc == FINEDB_ERR_SERVER)
+		return (value(rc, std::string_view(), 0));
+	_check(rc);
+	return (value(rc, std::string_view(_buffer.data(), len), version));
+}
+
+/* Write a value. */
+void connection::put(bin_view key, bin_view data) {
+	_check(finedb_put(_client, key.bin(), data.bin()));
+}
+
+/* Remove a key. */
+void connection::del(bin_view key) {
+	_check(finedb_del(_client, key.bin()));
+}
+
+/* Test the connection. */
+void connection::ping() {
+	_check(finedb_ping(_client));
+}
+
+/* ********************* REQUEST **************** */
+/* Queue the request and suspend the coroutine. */
+bool request::await_suspend(std::coroutine_handle<> handle) {
+	finedb_pipeline_t *pipeline = _conn._pipeline;
+	int rc = FINEDB_ERR_NETWORK;
+
+	_handle = handle;
+	if (_command == PROTO_GET)
+		rc = finedb_pipeline_get(pipeline, _key.bin(), _callback, this);
+	else if (_command == PROTO_PUT)
+		rc = finedb_pipeline_put(pipeline, _key.bin(), _data.bin(), _callback, this);
+	else if (_command == PROTO_DEL)
+		rc = finedb_pipeline_del(pipeline, _key.bin(), _callback, this);
+	else if (_command == PROTO_PING)
+		rc = finedb_pipeline_ping(pipeline, _callback, this);
+	// the request was not queued: resume immediately
+	if (rc != FINEDB_OK) {
+		_status = rc;
+		return (false);
+	}
+	return (true);
+}
+
+/* Return the result of the request. */
+value request::await_resume() {
+	if (_command == PROTO_GET && _status == FINEDB_ERR_SERVER)
+		return (value(_status, std::string_view(), 0));
+	_check(_status);
+	return (value(_status, _value, _version));
+}
+
+/* Receive the response, and resume the waiting coroutine. */
+void request::_callback(void *cb_data, int status, ybin_t value, unsigned long long version) {
+	request *req = static_cast<request*>(cb_data);
+
+	req->_status = status;
+	req->_value = std::string_view(static_cast<const char*>(value.data), value.len);
+	req->_version = version;
+	// the value stays valid while the coroutine runs
+	req->_handle.resume();
+}
+
+/* ********************* ASYNC CONNECTION **************** */
+/* Constructor. */
+async_connection::async_connection(connection &conn) {
+	if ((_pipeline = finedb_pipeline_create(conn.native())) == nullptr)
+		throw error(FINEDB_ERR_NETWORK);
+}
+
+/* Destructor. */
+async_connection::~async_connection() {
+	finedb_pipeline_delete(_pipeline);
+}
+
+/* Awaitable GET request. */
+request async_connection::get(bin_view key) noexcept {
+	return (request(*this, PROTO_GET, key, bin_view("")));
+}
+
+/* Awaitable PUT request. */
+request async_connection::put(bin_view key, bin_view data) noexcept {
+	return (request(*this, PROTO_PUT, key, data));
+}
+
+/* Awaitable DEL request. */
+request async_connection::del(bin_view key) noexcept {
+	return (request(*this, PROTO_DEL, key, bin_view("")));
+}
+
+/* Awaitable PING request. */
+request async_connection::ping() noexcept {
+	return (request(*this, PROTO_PING, bin_view(""), bin_view("")));
+}
+
+/* Send queued requests and read available responses. */
+void async_connection::process() {
+	_check(finedb_pipeline_process(_pipeline));
+}
+
+/* Resume coroutines until no request is pending. */
+void async_connection::run() {
+	struct pollfd pfd;
+
+	while (pending()) {
+		pfd.fd = fd();
+		pfd.events = events();
+		pfd.revents = 0;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			throw error(FINEDB_ERR_NETWORK);
+		process();
+	}
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_error_message
+ * Return the message of a libfinedb error code.
+ * @param	code	Error code.
+ * @return	The message.
+ */
+static const char *_error_message(int code) noexcept {
+	switch (code) {
+	case FINEDB_OK:
+		return ("OK");
+	case FINEDB_ERR_NETWORK:
+		return ("FineDB: network error");
+	case FINEDB_ERR_SERVER:
+		return ("FineDB: server error");
+	case FINEDB_ERR_FILE:
+		return ("FineDB: file error");
+	case FINEDB_ERR_MEMORY:
+		return ("FineDB: memory allocation error");
+	case FINEDB_ERR_ZIP:
+		return ("FineDB: compression error");
+	case FINEDB_ERR_VALUE:
+		return ("FineDB: incompatible value");
+	case FINEDB_ERR_VERSION:
+		return ("FineDB: version mismatch");
+	case FINEDB_ERR_SIZE:
+		return ("FineDB: buffer too small");
+	}
+	return ("FineDB: unknown error");
+}
+
+/**
+ * @function	_check
+ * Throw an exception if a libfinedb function failed.
+ * @param	code	Return value of the function.
+ */
+static void _check(int code) {
+	if (code != FINEDB_OK)
+		throw error(code);
+}
+
+} // namespace finedb
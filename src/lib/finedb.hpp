@@ -0,0 +1,278 @@
+#ifndef __FINEDB_HPP__
+#define __FINEDB_HPP__
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "libfinedb.h"
+
+/**
+ * @namespace	finedb
+ * C++ client of FineDB, built on libfinedb. Values are returned as views
+ * borrowed from the client's receive buffers: nothing is copied unless
+ * asked for. Network failures are reported by exceptions.
+ */
+namespace finedb {
+
+/**
+ * @class	error
+ * Exception thrown when a request fails.
+ */
+class error : public std::runtime_error {
+public:
+	/**
+	 * Constructor.
+	 * @param	code	libfinedb error code (finedb_result_t).
+	 */
+	explicit error(int code);
+	/** Return the libfinedb error code. */
+	int code() const noexcept { return (_code); }
+private:
+	int _code;
+};
+
+/**
+ * @class	bin_view
+ * Non-owning view on a key or a value. Implicitly built from strings and
+ * byte spans.
+ */
+class bin_view {
+public:
+	bin_view(std::string_view str) noexcept : _data(str.data()), _len(str.size()) {}
+	bin_view(const std::string &str) noexcept : _data(str.data()), _len(str.size()) {}
+	bin_view(const char *str) noexcept : bin_view(std::string_view(str)) {}
+	bin_view(std::span<const std::byte> bytes) noexcept :
+		_data(reinterpret_cast<const char*>(bytes.data())), _len(bytes.size()) {}
+	/** Return the libfinedb representation (no copy). */
+	ybin_t bin() const noexcept {
+		ybin_t b;
+		b.data = const_cast<char*>(_data);
+		b.len = _len;
+		return (b);
+	}
+private:
+	const char *_data;
+	size_t _len;
+};
+
+/**
+ * @class	value
+ * Result of a GET request. It is move-only, and its data is borrowed from
+ * a receive buffer: for a connection, it is valid until the next GET;
+ * for an awaited request, until the coroutine suspends again. Use str() to
+ * keep a copy.
+ */
+class value {
+public:
+	value() noexcept = default;
+	value(int status, std::string_view data, unsigned long long version) noexcept :
+		_status(status), _data(data), _version(version) {}
+	value(value &&other) noexcept = default;
+	value &operator=(value &&other) noexcept = default;
+	value(const value&) = delete;
+	value &operator=(const value&) = delete;
+	/** Return true if the key exists. */
+	bool found() const noexcept { return (_status == FINEDB_OK); }
+	explicit operator bool() const noexcept { return (found()); }
+	/** Return the libfinedb status of the request. */
+	int status() const noexcept { return (_status); }
+	/** Return the version of the value. */
+	unsigned long long version() const noexcept { return (_version); }
+	/** Return a view on the data. */
+	std::string_view view() const noexcept { return (_data); }
+	/** Return a view on the data, as bytes. */
+	std::span<const std::byte> bytes() const noexcept {
+		return (std::as_bytes(std::span<const char>(_data.data(), _data.size())));
+	}
+	/** Return a copy of the data. */
+	std::string str() const { return (std::string(_data)); }
+private:
+	int _status = FINEDB_ERR_SERVER;
+	std::string_view _data;
+	unsigned long long _version = 0;
+};
+
+/**
+ * @class	connection
+ * Connection to a FineDB server (RAII: the connection is closed by the
+ * destructor). Requests are synchronous by default. A connection must not
+ * be used by several threads at the same time.
+ */
+class connection {
+public:
+	/**
+	 * Connect to a server.
+	 * @param	hostname	Hostname, or IPv4/IPv6 address.
+	 * @param	port		Port number.
+	 */
+	connection(const std::string &hostname, unsigned short port);
+	/**
+	 * Connect to the Unix socket of a local server.
+	 * @param	path	Path to the server's socket.
+	 */
+	static connection unix_socket(const std::string &path);
+	~connection();
+	connection(connection &&other) noexcept;
+	connection &operator=(connection &&other) noexcept;
+	connection(const connection&) = delete;
+	connection &operator=(const connection&) = delete;
+	/**
+	 * Set synchronous or asynchronous mode for writes.
+	 * @param	sync	true for synchronous writes.
+	 */
+	void sync(bool sync) noexcept;
+	/**
+	 * Select a database.
+	 * @param	dbname	Name of the database. Empty for the default one.
+	 */
+	void setdb(std::string_view dbname);
+	/**
+	 * Read a value. The data is uncompressed in the connection's buffer,
+	 * which grows to the size of the largest value read.
+	 * @param	key	Key.
+	 * @return	The value; check found() before using its data.
+	 */
+	value get(bin_view key);
+	/**
+	 * Write a value.
+	 * @param	key	Key.
+	 * @param	data	Value.
+	 */
+	void put(bin_view key, bin_view data);
+	/**
+	 * Remove a key.
+	 * @param	key	Key.
+	 */
+	void del(bin_view key);
+	/** Test the connection. */
+	void ping();
+	/** Return the underlying libfinedb client. */
+	finedb_client_t *native() const noexcept { return (_client); }
+private:
+	explicit connection(finedb_client_t *client);
+	finedb_client_t *_client;
+	std::vector<char> _buffer;
+};
+
+class async_connection;
+
+/**
+ * @class	request
+ * Awaitable request, sent by an async_connection. It must be awaited
+ * immediately (co_await conn.get(key)): the request is queued when the
+ * coroutine suspends, and the coroutine is resumed when its response is
+ * received, from async_connection::process().
+ */
+class request {
+public:
+	request(request&&) = delete;
+	request(const request&) = delete;
+	bool await_ready() const noexcept { return (false); }
+	bool await_suspend(std::coroutine_handle<> handle);
+	/**
+	 * Return the result. A GET returns its value; other requests throw
+	 * an error if they failed.
+	 */
+	value await_resume();
+private:
+	friend class async_connection;
+	request(async_connection &conn, unsigned char command, bin_view key, bin_view data) noexcept :
+		_conn(conn), _command(command), _key(key), _data(data) {}
+	static void _callback(void *cb_data, int status, ybin_t value, unsigned long long version);
+	async_connection &_conn;
+	unsigned char _command;
+	bin_view _key;
+	bin_view _data;
+	std::coroutine_handle<> _handle;
+	int _status = FINEDB_ERR_NETWORK;
+	std::string_view _value;
+	unsigned long long _version = 0;
+};
+
+/**
+ * @class	async_connection
+ * Asynchronous interface over a connection, for coroutines. Any number of
+ * coroutines could wait for requests on the same connection: requests are
+ * pipelined, and coroutines are resumed in order as responses arrive. The
+ * connection must not be used directly while this object exists.
+ */
+class async_connection {
+public:
+	/**
+	 * Constructor.
+	 * @param	conn	Connection (TCP or Unix socket). Must outlive this object.
+	 */
+	explicit async_connection(connection &conn);
+	~async_connection();
+	async_connection(const async_connection&) = delete;
+	async_connection &operator=(const async_connection&) = delete;
+	/** Awaitable GET request. */
+	request get(bin_view key) noexcept;
+	/** Awaitable PUT request. */
+	request put(bin_view key, bin_view data) noexcept;
+	/** Awaitable DEL request. */
+	request del(bin_view key) noexcept;
+	/** Awaitable PING request. */
+	request ping() noexcept;
+	/** Return the file descriptor to watch in an event loop. */
+	int fd() const noexcept { return (finedb_pipeline_fd(_pipeline)); }
+	/** Return the events to watch on the file descriptor. */
+	short events() const noexcept { return (finedb_pipeline_events(_pipeline)); }
+	/** Return the number of requests waiting for their responses. */
+	size_t pending() const noexcept { return (finedb_pipeline_pending(_pipeline)); }
+	/**
+	 * Send queued requests and read available responses without blocking;
+	 * waiting coroutines are resumed. To be called when fd() is ready.
+	 */
+	void process();
+	/** Wait for responses and resume coroutines, until no request is pending. */
+	void run();
+private:
+	friend class request;
+	finedb_pipeline_t *_pipeline;
+};
+
+/**
+ * @class	task
+ * Coroutine type for functions using an async_connection. The coroutine
+ * starts immediately, and runs until its first suspension. An exception
+ * thrown by the coroutine is rethrown by get().
+ */
+class task {
+public:
+	struct promise_type {
+		std::exception_ptr exception;
+		task get_return_object() noexcept {
+			return (task(std::coroutine_handle<promise_type>::from_promise(*this)));
+		}
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { exception = std::current_exception(); }
+	};
+	task(task &&other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+	task(const task&) = delete;
+	~task() {
+		if (_handle)
+			_handle.destroy();
+	}
+	/** Return true when the coroutine is over. */
+	bool done() const noexcept { return (!_handle || _handle.done()); }
+	/** Rethrow the exception of the coroutine, if any. */
+	void get() const {
+		if (_handle && _handle.promise().exception)
+			std::rethrow_exception(_handle.promise().exception);
+	}
+private:
+	explicit task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {}
+	std::coroutine_handle<promise_type> _handle;
+};
+
+} // namespace finedb
+
+#endif /* __FINEDB_HPP__ */
@@ -2,30 +2,57 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <endian.h>
+#include <time.h>
 
 #include "yerror.h"
 #include "ydynabin.h"
+#include "yring.h"
 
 #include "snappy.h"
 
 #include "protocol.h"
 
 #include "libfinedb.h"
+#include "transport.h"
+#include "cache.h"
+#ifdef FINEDB_EMBEDDED
+# include "embedded.h"
+#endif /* FINEDB_EMBEDDED */
 
 /* *** Private functions *** */
-static yerr_t _read_data(int fd, ydynabin_t *container, size_t size);
+static ssize_t _sendmsg(finedb_client_t *client, const struct msghdr *mh);
+static ssize_t _write(finedb_client_t *client, const void *buf, size_t len);
+static ssize_t _read(finedb_client_t *client, void *buf, size_t len);
+static ssize_t _check_timeout(finedb_client_t *client, ssize_t rc);
+static yerr_t _read_data(finedb_client_t *client, ydynabin_t *container, size_t size);
+static yerr_t _read_full(finedb_client_t *client, void *buf, size_t len);
+static int _send_get(finedb_client_t *client, ybin_t key);
+static int _batch_add(finedb_client_t *client, unsigned char command, ybin_t key, ybin_t data);
+static int _batch_send(finedb_client_t *client);
 static int _send_key_data(finedb_client_t *client, ybool_t create_only,
                           ybool_t update_only, ybin_t key, ybin_t data);
-//static int _send_incdec(finedb_client_t *client, ybool_t dec, ybin_t key, int val, int *new_value);
+static int _send_incdec(finedb_client_t *client, ybool_t dec, ybin_t key, long long val, long long *new_value);
+static int _send_cas(finedb_client_t *client, protocol_cas_t op, ybin_t key, ybin_t data,
+                     unsigned long long version, unsigned long long *new_version);
 static int _send_simple_request(finedb_client_t *client, const char code, char *response);
+static int _send_admin(finedb_client_t *client, protocol_admin_t op, ybin_t *data);
+static cache_entry_t *_cache_lookup(finedb_client_t *client, ybin_t key);
+static void _cache_store(finedb_client_t *client, ybin_t key, ybin_t value, unsigned long long version);
+static void _cache_forget(finedb_client_t *client, ybin_t key);
+static void _cache_drop(finedb_client_t *client);
 
 /* Create a FineDB connection client. */
 finedb_client_t *finedb_create(const char *hostname, unsigned short port) {
@@ -39,46 +66,302 @@ finedb_client_t *finedb_create(const char *hostname, unsigned short port) {
 	}
 	client->port = port;
 	client->sock = -1;
+	client->track_sock = -1;
+	client->connect_timeout = FINEDB_CONNECT_TIMEOUT;
+	client->nodelay = YTRUE;
+	client->keepalive = YTRUE;
 	return (client);
 }
 
+/* Create a FineDB connection client, using a Unix socket. */
+finedb_client_t *finedb_create_unix(const char *path) {
+	finedb_client_t *client;
+
+	if (strlen(path) >= sizeof(((struct sockaddr_un*)NULL)->sun_path) ||
+	    (client = YMALLOC(sizeof(finedb_client_t))) == NULL)
+		return (NULL);
+	if ((client->unix_path = strdup(path)) == NULL) {
+		YFREE(client);
+		return (NULL);
+	}
+	client->sock = -1;
+	client->track_sock = -1;
+	client->connect_timeout = FINEDB_CONNECT_TIMEOUT;
+	return (client);
+}
+
+#ifdef FINEDB_EMBEDDED
+/* Create an embedded FineDB client. */
+finedb_client_t *finedb_create_embedded(const char *path) {
+	finedb_client_t *client;
+
+	if ((client = YMALLOC(sizeof(finedb_client_t))) == NULL)
+		return (NULL);
+	if ((client->db_path = strdup(path)) == NULL) {
+		YFREE(client);
+		return (NULL);
+	}
+	client->sock = -1;
+	client->track_sock = -1;
+	client->sync = YTRUE;
+	return (client);
+}
+#endif /* FINEDB_EMBEDDED */
+
 /* Destroy a FineDB connection client. */
 void finedb_delete(finedb_client_t *client) {
 	finedb_disconnect(client);
 	YFREE(client->hostname);
+	YFREE(client->unix_path);
+	YFREE(client->db_path);
+	YFREE(client->dbname);
+	YFREE(client->recv_buf);
+	YFREE(client->batch);
+	if (client->zip_env) {
+		snappy_free_env((struct snappy_env*)client->zip_env);
+		YFREE(client->zip_env);
+	}
 	YFREE(client);
 }
 
 /* Connect to a FineDB server. */
 int finedb_connect(finedb_client_t *client) {
-	int sockfd;
-	struct sockaddr_in serv_addr;
-	struct hostent *server;
-
 	// if a connection is open, close it
 	finedb_disconnect(client);
-	// open a new connection
-	sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	if ((server = gethostbyname(client->hostname)) == NULL) {
-		client->sock = -1;
+#ifdef FINEDB_EMBEDDED
+	// local database
+	if (client->db_path)
+		return (embedded_open(client));
+#endif /* FINEDB_EMBEDDED */
+	// a new connection uses the default database
+	YFREE(client->dbname);
+	client->transaction = YFALSE;
+	// local connection or TCP connection
+	if (client->unix_path)
+		client->sock = transport_connect_unix(client);
+	else
+		client->sock = transport_connect_tcp(client);
+	if (client->sock < 0)
+		return (FINEDB_ERR_NETWORK);
+	// the cache starts empty; the client works without it if it can't be enabled
+	if (client->cache_size)
+		finedb_cache_enable(client, client->cache_size);
+	return (FINEDB_OK);
+}
+
+/* Reconnect to a previously connected server. */
+int finedb_reconnect(finedb_client_t *client) {
+	unsigned long long now = transport_now();
+	char *dbname;
+	int rc;
+
+	// wait for the end of the delay
+	if (client->reconnect_time && now < client->reconnect_time)
 		return (FINEDB_ERR_NETWORK);
+	dbname = client->dbname;
+	client->dbname = NULL;
+	if ((rc = finedb_connect(client)) == FINEDB_OK && dbname)
+		rc = finedb_setdb(client, dbname);
+	YFREE(dbname);
+	if (rc == FINEDB_OK) {
+		client->reconnect_delay = 0;
+		client->reconnect_time = 0;
+		return (FINEDB_OK);
 	}
-	bzero(&serv_addr, sizeof(serv_addr));
-	serv_addr.sin_family = AF_INET;
-	bcopy(server->h_addr, &serv_addr.sin_addr.s_addr, server->h_length);
-	serv_addr.sin_port = htons(client->port);
-	if (connect(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
-		client->sock = -1;
+	// next attempt delayed
+	if (!client->reconnect_delay)
+		client->reconnect_delay = FINEDB_RECONNECT_MIN_DELAY;
+	else if ((client->reconnect_delay *= 2) > FINEDB_RECONNECT_MAX_DELAY)
+		client->reconnect_delay = FINEDB_RECONNECT_MAX_DELAY;
+	client->reconnect_time = transport_now() + (unsigned long long)client->reconnect_delay * 1000;
+	return (rc);
+}
+
+/* Set the connection and I/O timeouts. */
+void finedb_set_timeouts(finedb_client_t *client, unsigned int connect_timeout, unsigned int io_timeout) {
+	client->connect_timeout = connect_timeout;
+	client->io_timeout = io_timeout;
+	if (client->sock > -1)
+		transport_set_options(client, client->sock);
+}
+
+/* Set the socket options. */
+void finedb_set_socket_options(finedb_client_t *client, ybool_t nodelay, ybool_t keepalive, int buffer_size) {
+	client->nodelay = nodelay;
+	client->keepalive = keepalive;
+	client->buffer_size = buffer_size;
+	if (client->sock > -1)
+		transport_set_options(client, client->sock);
+}
+
+/* Use shared memory rings instead of the Unix socket. */
+int finedb_shm(finedb_client_t *client, unsigned int size) {
+	char code;
+	uint32_t size_nbr;
+	struct iovec iov[2];
+	struct msghdr mh;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	size_t ring_size;
+	void *mem;
+	ssize_t rc;
+	int fd = -1;
+
+	if (!client->unix_path || client->sock < 0 || client->shm)
+		return (FINEDB_ERR_NETWORK);
+	// request
+	code = PROTO_SHM;
+	size_nbr = htonl((uint32_t)size);
+	bzero(&mh, sizeof(struct msghdr));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 2;
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&size_nbr;
+	iov[1].iov_len = sizeof(uint32_t);
+	if (sendmsg(client->sock, &mh, 0) != (ssize_t)(sizeof(code) + sizeof(uint32_t)))
+		return (FINEDB_ERR_NETWORK);
+	// response: code, size of the rings and file descriptor of the shared memory
+	bzero(&control, sizeof(control));
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof(control.buf);
+	if ((rc = recvmsg(client->sock, &mh, MSG_CMSG_CLOEXEC)) < 1)
+		return (FINEDB_ERR_NETWORK);
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg))
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	if (RESPONSE_STATUS(code) != RESP_OK) {
+		if (fd >= 0)
+			close(fd);
+		return (FINEDB_ERR_SERVER);
+	}
+	if (fd < 0 || rc != (ssize_t)(sizeof(code) + sizeof(uint32_t))) {
+		if (fd >= 0)
+			close(fd);
 		return (FINEDB_ERR_NETWORK);
 	}
-	client->sock = sockfd;
+	// mapping
+	ring_size = yring_memsize(ntohl(size_nbr));
+	mem = mmap(NULL, 2 * ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return (FINEDB_ERR_MEMORY);
+	client->shm = mem;
+	client->shm_size = 2 * ring_size;
+	client->shm_out = (yring_t*)mem;
+	client->shm_in = (yring_t*)((char*)mem + ring_size);
 	return (FINEDB_OK);
 }
 
 /* Disconnect and free allocated memory. */
 void finedb_disconnect(finedb_client_t *client) {
+	// send coalesced writes, or drop them if the connection is broken
+	if (client->sock > -1)
+		finedb_flush(client);
+	client->batch_len = 0;
+	client->batch_count = 0;
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		embedded_close(client);
+#endif /* FINEDB_EMBEDDED */
+	if (client->shm) {
+		yring_close(client->shm_out);
+		munmap(client->shm, client->shm_size);
+		client->shm = NULL;
+		client->shm_in = client->shm_out = NULL;
+	}
+	_cache_drop(client);
 	if (client->sock > -1)
 		close(client->sock);
+	client->sock = -1;
+}
+
+/* Enable the client-side cache. */
+int finedb_cache_enable(finedb_client_t *client, size_t max_entries) {
+	unsigned char request[3], response[sizeof(uint32_t) + 1];
+	cache_t *cache;
+	char code;
+	int sock;
+
+	if (client->db_path || client->sock < 0 || !max_entries)
+		return (FINEDB_ERR_NETWORK);
+	_cache_drop(client);
+	// invalidation connection
+	if (client->unix_path)
+		sock = transport_connect_unix(client);
+	else
+		sock = transport_connect_tcp(client);
+	if (sock < 0)
+		return (FINEDB_ERR_NETWORK);
+	request[0] = PROTO_TRACK;
+	request[1] = PROTO_TRACK_SUBSCRIBE;
+	if (write(sock, request, 2) != 2 || recv(sock, &code, 1, MSG_WAITALL) != 1) {
+		close(sock);
+		return (FINEDB_ERR_NETWORK);
+	}
+	if (RESPONSE_STATUS(code) != RESP_OK) {
+		close(sock);
+		return (FINEDB_ERR_SERVER);
+	}
+	// response data: size (1) and tracking ID
+	if (recv(sock, response, sizeof(response), MSG_WAITALL) != (ssize_t)sizeof(response)) {
+		close(sock);
+		return (FINEDB_ERR_NETWORK);
+	}
+	if ((cache = cache_new(max_entries)) == NULL) {
+		close(sock);
+		return (FINEDB_ERR_MEMORY);
+	}
+	// the keys read by the main connection are tracked for this ID
+	request[1] = PROTO_TRACK_ATTACH;
+	request[2] = response[sizeof(uint32_t)];
+	if (_write(client, request, 3) != 3 || _read(client, &code, 1) != 1 ||
+	    RESPONSE_STATUS(code) != RESP_OK) {
+		cache_delete(cache);
+		close(sock);
+		return (FINEDB_ERR_NETWORK);
+	}
+	client->cache = cache;
+	client->cache_size = max_entries;
+	client->track_sock = sock;
+	return (FINEDB_OK);
+}
+
+/* Disable the client-side cache. */
+void finedb_cache_disable(finedb_client_t *client) {
+	unsigned char request[2];
+	char code;
+
+	client->cache_size = 0;
+	if (client->cache == NULL)
+		return;
+	_cache_drop(client);
+	// stop tracking the keys read by the main connection
+	request[0] = PROTO_TRACK;
+	request[1] = PROTO_TRACK_DETACH;
+	if (_write(client, request, 2) == 2)
+		_read(client, &code, 1);
+}
+
+/* Configure the coalescing of writes. */
+int finedb_coalesce(finedb_client_t *client, unsigned int delay, size_t size) {
+	int rc = FINEDB_OK;
+
+	if (!size)
+		rc = finedb_flush(client);
+	client->batch_delay = delay;
+	client->batch_max = size;
+	return (rc);
+}
+
+/* Send the coalesced writes. */
+int finedb_flush(finedb_client_t *client) {
+	if (!client->batch_count)
+		return (FINEDB_OK);
+	return (_batch_send(client));
 }
 
 /* Set synchronous mode. */
@@ -96,6 +379,10 @@ int finedb_setdb(finedb_client_t *client, char *dbname) {
 	char *buff, *pt, res;
 	int buflen, rc;
 
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		return (embedded_setdb(client, dbname));
+#endif /* FINEDB_EMBEDDED */
 	buflen = 2 + (dbname ? strlen(dbname) : 0);
 	buff = YMALLOC(buflen);
 	pt = buff;
@@ -107,60 +394,62 @@ int finedb_setdb(finedb_client_t *client, char *dbname) {
 		memcpy(pt, dbname, strlen(dbname));
 	}
 	// send data
-	rc = write(client->sock, buff, buflen);
+	rc = _write(client, buff, buflen);
 	YFREE(buff);
 	if (rc != buflen)
 		return (FINEDB_ERR_NETWORK);
 	// get response
-	rc = read(client->sock, &res, 1);
+	rc = _read(client, &res, 1);
 	if (rc != 1)
 		return (FINEDB_ERR_NETWORK);
 	if (RESPONSE_STATUS(res) != RESP_OK)
 		return (FINEDB_ERR_SERVER);
+	// keep the name of the selected database
+	YFREE(client->dbname);
+	if (dbname && (client->dbname = strdup(dbname)) == NULL)
+		return (FINEDB_ERR_MEMORY);
 	return (FINEDB_OK);
 }
 
 /* Get a value from its key. */
 int finedb_get(finedb_client_t *client, ybin_t key, ybin_t *value) {
+	return (finedb_get_versioned(client, key, value, NULL));
+}
+
+/* Get a value and its version from its key. */
+int finedb_get_versioned(finedb_client_t *client, ybin_t key, ybin_t *value, unsigned long long *version) {
+	cache_entry_t *entry;
 	char code;
-	ssize_t expected, rc;
 	int retval = FINEDB_OK;
 
-	// request
-	{
-		struct iovec iov[3];
-		struct msghdr mh;
-		uint16_t key_nlen;
-
-		code = PROTO_GET;
-		code = REQUEST_ADD_COMPRESSED(code);
-		key_nlen = htons((uint16_t)key.len);
-		// creation of the message
-		bzero(&mh, sizeof(struct msghdr));
-		mh.msg_iov = iov;
-		mh.msg_iovlen = 3;
-		iov[0].iov_base = (caddr_t)&code;
-		iov[0].iov_len = sizeof(code);
-		iov[1].iov_base = (caddr_t)&key_nlen;
-		iov[1].iov_len = sizeof(uint16_t);
-		iov[2].iov_base = (caddr_t)key.data;
-		iov[2].iov_len = key.len;
-		// sending
-		expected = 1 + sizeof(uint16_t) + key.len;
-		rc = sendmsg(client->sock, &mh, 0);
-		if (rc != expected)
-			return (FINEDB_ERR_NETWORK);
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		return (embedded_get(client, key, value, version));
+#endif /* FINEDB_EMBEDDED */
+	// cached value
+	if ((entry = _cache_lookup(client, key)) != NULL) {
+		if ((value->data = YMALLOC(entry->value.len + 1)) == NULL)
+			return (FINEDB_ERR_MEMORY);
+		memcpy(value->data, entry->value.data, entry->value.len);
+		value->len = entry->value.len;
+		if (version)
+			*version = entry->version;
+		return (FINEDB_OK);
 	}
+	// request
+	if (_send_get(client, key) != FINEDB_OK)
+		return (FINEDB_ERR_NETWORK);
 	// response
 	{
 		char *pt;
 		uint32_t *pdata_len, data_len;
+		uint64_t version_nbr;
 		ydynabin_t *buff;
 		void *ptr, *data = NULL;
 
 		buff = ydynabin_new(NULL, 0, YFALSE);
 		// read the response code
-		if (_read_data(client->sock, buff, 1) != YENOERR) {
+		if (_read_data(client, buff, 1) != YENOERR) {
 			retval = FINEDB_ERR_NETWORK;
 			goto end_of_process;
 		}
@@ -170,8 +459,17 @@ int finedb_get(finedb_client_t *client, ybin_t key, ybin_t *value) {
 			retval = FINEDB_ERR_SERVER;
 			goto end_of_process;
 		}
+		// read the version
+		if (_read_data(client, buff, sizeof(version_nbr)) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		memcpy(&version_nbr, ydynabin_forward(buff, sizeof(version_nbr)), sizeof(version_nbr));
+		version_nbr = be64toh(version_nbr);
+		if (version)
+			*version = (unsigned long long)version_nbr;
 		// read the size of data
-		if (_read_data(client->sock, buff, sizeof(data_len)) != YENOERR) {
+		if (_read_data(client, buff, sizeof(data_len)) != YENOERR) {
 			retval = FINEDB_ERR_NETWORK;
 			goto end_of_process;
 		}
@@ -179,7 +477,7 @@ int finedb_get(finedb_client_t *client, ybin_t key, ybin_t *value) {
 		data_len = ntohl(*pdata_len);
 		// read data
 		if (data_len > 0) {
-			if (_read_data(client->sock, buff, (size_t)data_len) != YENOERR) {
+			if (_read_data(client, buff, (size_t)data_len) != YENOERR) {
 				retval = FINEDB_ERR_NETWORK;
 				goto end_of_process;
 			}
@@ -214,17 +512,105 @@ int finedb_get(finedb_client_t *client, ybin_t key, ybin_t *value) {
 		// result
 		value->len = data_len;
 		value->data = data;
+		_cache_store(client, key, *value, (unsigned long long)version_nbr);
 end_of_process:
 		ydynabin_delete(buff);
 	}
 	return (retval);
 }
 
+/* Get a value from its key, in a buffer given by the caller. */
+int finedb_get_into(finedb_client_t *client, ybin_t key, void *buffer, size_t size,
+                    size_t *len, unsigned long long *version) {
+	unsigned char code;
+	char header[sizeof(uint64_t) + sizeof(uint32_t)];
+	uint64_t version_nbr;
+	uint32_t data_len;
+	size_t unzip_len;
+	cache_entry_t *entry;
+	ybin_t value;
+
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		return (embedded_get_into(client, key, buffer, size, len, version));
+#endif /* FINEDB_EMBEDDED */
+	// cached value
+	if ((entry = _cache_lookup(client, key)) != NULL) {
+		*len = entry->value.len;
+		if (version)
+			*version = entry->version;
+		if (entry->value.len > size)
+			return (FINEDB_ERR_SIZE);
+		memcpy(buffer, entry->value.data, entry->value.len);
+		return (FINEDB_OK);
+	}
+	// request
+	if (_send_get(client, key) != FINEDB_OK)
+		return (FINEDB_ERR_NETWORK);
+	// response code
+	if (_read_full(client, &code, sizeof(code)) != YENOERR)
+		return (FINEDB_ERR_NETWORK);
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	// version and size of data
+	if (_read_full(client, header, sizeof(header)) != YENOERR)
+		return (FINEDB_ERR_NETWORK);
+	memcpy(&version_nbr, header, sizeof(version_nbr));
+	memcpy(&data_len, header + sizeof(version_nbr), sizeof(data_len));
+	data_len = ntohl(data_len);
+	version_nbr = be64toh(version_nbr);
+	if (version)
+		*version = (unsigned long long)version_nbr;
+	// read data in the receive buffer (always read, to keep the connection usable)
+	if (data_len > client->recv_size) {
+		YFREE(client->recv_buf);
+		client->recv_size = 0;
+		if ((client->recv_buf = YMALLOC((size_t)data_len)) == NULL)
+			return (FINEDB_ERR_MEMORY);
+		client->recv_size = data_len;
+	}
+	if (data_len && _read_full(client, client->recv_buf, (size_t)data_len) != YENOERR)
+		return (FINEDB_ERR_NETWORK);
+	// uncompressed data
+	if (!REQUEST_HAS_COMPRESSED(code) || !data_len) {
+		*len = data_len;
+		ybin_set(&value, client->recv_buf, data_len);
+		_cache_store(client, key, value, (unsigned long long)version_nbr);
+		if (data_len > size)
+			return (FINEDB_ERR_SIZE);
+		memcpy(buffer, client->recv_buf, data_len);
+		return (FINEDB_OK);
+	}
+	// uncompress directly in the destination buffer
+	if (!snappy_uncompressed_length(client->recv_buf, data_len, &unzip_len))
+		return (FINEDB_ERR_ZIP);
+	*len = unzip_len;
+	if (unzip_len > size)
+		return (FINEDB_ERR_SIZE);
+	if (snappy_uncompress(client->recv_buf, data_len, buffer))
+		return (FINEDB_ERR_ZIP);
+	ybin_set(&value, buffer, unzip_len);
+	_cache_store(client, key, value, (unsigned long long)version_nbr);
+	return (FINEDB_OK);
+}
+
 /* Delete a velue from database. */
 int finedb_del(finedb_client_t *client, ybin_t key) {
 	char code;
 	ssize_t expected, rc;
 
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		return (embedded_del(client, key));
+#endif /* FINEDB_EMBEDDED */
+	_cache_forget(client, key);
+	// coalesced write
+	if (client->batch_max && !client->sync) {
+		ybin_t empty;
+
+		ybin_set(&empty, NULL, 0);
+		return (_batch_add(client, PROTO_DEL, key, empty));
+	}
 	// request
 	{
 		struct iovec iov[3];
@@ -247,12 +633,12 @@ int finedb_del(finedb_client_t *client, ybin_t key) {
 		iov[2].iov_len = key.len;
 		// sending
 		expected = 1 + sizeof(uint16_t) + key.len;
-		rc = sendmsg(client->sock, &mh, 0);
+		rc = _sendmsg(client, &mh);
 		if (rc != expected)
 			return (FINEDB_ERR_NETWORK);
 	}
 	// response
-	rc = read(client->sock, &code, 1);
+	rc = _read(client, &code, 1);
 	if (rc != 1)
 		return (FINEDB_ERR_NETWORK);
 	if (RESPONSE_STATUS(code) != RESP_OK)
@@ -275,136 +661,70 @@ int finedb_update(finedb_client_t *client, ybin_t key, ybin_t data) {
 	return (_send_key_data(client, YFALSE, YTRUE, key, data));
 }
 
-#if 0
-/* Increment a value. */
-int finedb_inc(finedb_client_t *client, ybin_t key, int increment, int *new_value) {
-	return (_send_incdec(client, YFALSE, key, increment, new_value));
-}
-
-/* Decrement a value. */
-int finedb_dec(finedb_client_t *client, ybin_t key, int increment, int *new_value) {
-	return (_send_incdec(client, YTRUE, key, increment, new_value));
-}
-#endif /* 0 */
-
-/* Start a transaction. */
-int finedb_start(finedb_client_t *client) {
-	char code;
-	int rc;
-
-	rc = _send_simple_request(client, PROTO_START, &code);
-	if (rc)
-		return (rc);
-	if (RESPONSE_STATUS(code) != RESP_OK)
-		return (FINEDB_ERR_SERVER);
-	return (FINEDB_OK);
-}
-
-/* Stop a transaction. */
-int finedb_stop(finedb_client_t *client) {
-	char code;
-	int rc;
-
-	rc = _send_simple_request(client, PROTO_STOP, &code);
-	if (rc)
-		return (rc);
-	if (RESPONSE_STATUS(code) != RESP_OK)
-		return (FINEDB_ERR_SERVER);
-	return (FINEDB_OK);
-}
-
-/* Test a running connection. */
-int finedb_ping(finedb_client_t *client) {
-	char code;
-	int rc;
-
-	rc = _send_simple_request(client, PROTO_PING, &code);
-	if (rc)
-		return (rc);
-	if (RESPONSE_STATUS(code) != RESP_OK)
-		return (FINEDB_ERR_SERVER);
-	return (FINEDB_OK);
+/* Update a key if its version matches. */
+int finedb_cas(finedb_client_t *client, ybin_t key, ybin_t data, unsigned long long version,
+               unsigned long long *new_version) {
+	return (_send_cas(client, PROTO_CAS_PUT, key, data, version, new_version));
 }
 
-/* ********************* PRIVATE FUNCTIONS **************** */
-/**
- * @function	_send_simple_request
- * Send a simple request and get a simple response.
- * @param	client		Pointer to the client structure.
- * @param	code		Request code.
- * @param	response	Pointer to an interger where the response code will be copied.
- * @return	FINEDB_OK if OK.
- */
-static int _send_simple_request(finedb_client_t *client, const char code, char *response) {
-	char res;
-	int rc;
+/* Remove a key if its version matches. */
+int finedb_cas_del(finedb_client_t *client, ybin_t key, unsigned long long version) {
+	ybin_t empty;
 
-	// send data
-	rc = write(client->sock, &code, 1);
-	if (rc != 1)
-		return (FINEDB_ERR_NETWORK);
-	// get response
-	rc = read(client->sock, &res, 1);
-	if (rc != 1)
-		return (FINEDB_ERR_NETWORK);
-	if (response)
-		*response = res;
-	return (FINEDB_OK);
+	ybin_set(&empty, NULL, 0);
+	return (_send_cas(client, PROTO_CAS_DEL, key, empty, version, NULL));
 }
 
-#if 0
-/**
- * @function	_send_incdec
- * Send an INC/DEC request to the server.
- * @param	client		Pointer to the client structure.
- * @param	dec		YFALSE for INC, YTRUE for DEC.
- * @param	key		Pointer to the key content.
- * @param	val		Increment/decrement value.
- * @param	new_value	Pointer to the integer where the new value will be copied.
- * @return 	FINEDB_OK if OK.
- */
-static int _send_incdec(finedb_client_t *client, ybool_t dec, ybin_t key, int val, int *new_value) {
+/* Aggregate the values of a range of keys. */
+int finedb_aggregate(finedb_client_t *client, ybin_t start, ybin_t end,
+                     finedb_encoding_t encoding, finedb_aggregate_t *result) {
 	char code;
 	ssize_t expected, rc;
 	int retval = FINEDB_OK;
 
 	// request
 	{
-		struct iovec iov[4];
+		struct iovec iov[6];
 		struct msghdr mh;
-		uint16_t key_nlen;
-		uint32_t nincrement;
+		unsigned char enc;
+		uint16_t start_nlen, end_nlen;
 
-		code = dec ? PROTO_DEC : PROTO_INC;
-		key_nlen = htons((uint16_t)key.len);
-		nincrement = htonl((uint32_t)val);
+		code = PROTO_AGGREGATE;
+		enc = (unsigned char)encoding;
+		start_nlen = htons((uint16_t)start.len);
+		end_nlen = htons((uint16_t)end.len);
 		// creation of the message
 		bzero(&mh, sizeof(struct msghdr));
 		mh.msg_iov = iov;
-		mh.msg_iovlen = 4;
+		mh.msg_iovlen = 6;
 		iov[0].iov_base = (caddr_t)&code;
 		iov[0].iov_len = sizeof(code);
-		iov[1].iov_base = (caddr_t)&key_nlen;
-		iov[1].iov_len = sizeof(uint16_t);
-		iov[2].iov_base = (caddr_t)key.data;
-		iov[2].iov_len = key.len;
-		iov[3].iov_base = (caddr_t)&nincrement;
-		iov[3].iov_len = sizeof(uint32_t);
+		iov[1].iov_base = (caddr_t)&enc;
+		iov[1].iov_len = sizeof(enc);
+		iov[2].iov_base = (caddr_t)&start_nlen;
+		iov[2].iov_len = sizeof(uint16_t);
+		iov[3].iov_base = (caddr_t)start.data;
+		iov[3].iov_len = start.len;
+		iov[4].iov_base = (caddr_t)&end_nlen;
+		iov[4].iov_len = sizeof(uint16_t);
+		iov[5].iov_base = (caddr_t)end.data;
+		iov[5].iov_len = end.len;
 		// sending
-		expected = 1 + sizeof(uint16_t) + key.len + sizeof(uint32_t);
-		rc = sendmsg(client->sock, &mh, 0);
+		expected = 1 + 1 + sizeof(uint16_t) + start.len + sizeof(uint16_t) + end.len;
+		rc = _sendmsg(client, &mh);
 		if (rc != expected)
 			return (FINEDB_ERR_NETWORK);
 	}
 	// response
 	{
 		char *pt;
-		uint32_t *pnew_value;
+		uint32_t *pdata_len, data_len;
+		uint64_t values[6];
 		ydynabin_t *buff;
 
 		buff = ydynabin_new(NULL, 0, YFALSE);
 		// read the response code
-		if (_read_data(client->sock, buff, 1) != YENOERR) {
+		if (_read_data(client, buff, 1) != YENOERR) {
 			retval = FINEDB_ERR_NETWORK;
 			goto end_of_process;
 		}
@@ -415,55 +735,575 @@ static int _send_incdec(finedb_client_t *client, ybool_t dec, ybin_t key, int va
 			goto end_of_process;
 		}
 		// read the size of data
-		if (_read_data(client->sock, buff, sizeof(uint32_t)) != YENOERR) {
+		if (_read_data(client, buff, sizeof(data_len)) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		pdata_len = ydynabin_forward(buff, sizeof(data_len));
+		data_len = ntohl(*pdata_len);
+		if (data_len != PROTO_AGGREGATE_RESULT_SIZE) {
+			retval = FINEDB_ERR_SERVER;
+			goto end_of_process;
+		}
+		// read data
+		if (_read_data(client, buff, (size_t)data_len) != YENOERR) {
 			retval = FINEDB_ERR_NETWORK;
 			goto end_of_process;
 		}
-		pnew_value = ydynabin_forward(buff, sizeof(uint32_t));
-		if (new_value)
-			*new_value = (int)ntohl(*pnew_value);
+		memcpy(values, ydynabin_forward(buff, (size_t)data_len), sizeof(values));
+		result->count = be64toh(values[0]);
+		result->size = be64toh(values[1]);
+		result->numbers = be64toh(values[2]);
+		result->sum = (long long)be64toh(values[3]);
+		result->min = (long long)be64toh(values[4]);
+		result->max = (long long)be64toh(values[5]);
 end_of_process:
 		ydynabin_delete(buff);
 	}
 	return (retval);
 }
-#endif /* 0 */
 
-/**
- * @function	_send_key_data
- * Send a PUT/ADD/UPDATE request to the server.
- * @param	client		Pointer to the client structure.
- * @param	create_only	YTRUE for an ADD request.
- * @param	update_only	YTRUE for an UPDATE request.
- * @param	key		Pointer to the key content.
- * @param	data		Pointer to the data content.
- * @return 	FINEDB_OK if OK.
- */
-static int _send_key_data(finedb_client_t *client, ybool_t create_only,
-                          ybool_t update_only, ybin_t key, ybin_t data) {
+/* Apply a merge operator on a value. */
+int finedb_merge(finedb_client_t *client, finedb_merge_t op, ybin_t key, ybin_t operand, ybin_t *result) {
 	char code;
 	ssize_t expected, rc;
+	int retval = FINEDB_OK;
 
+	if (result)
+		ybin_set(result, NULL, 0);
+	_cache_forget(client, key);
 	// request
 	{
-		struct iovec iov[5];
+		struct iovec iov[6];
 		struct msghdr mh;
+		unsigned char merge_op;
 		uint16_t key_nlen;
-		uint32_t data_nlen;
-		struct snappy_env zip_env;
-		size_t zip_len;
-		char *zip_data = NULL;
+		uint32_t operand_nlen;
 
-		// data compression
-		memset(&zip_env, 0, sizeof(struct snappy_env));
-		if (snappy_init_env(&zip_env)) {
+		code = PROTO_MERGE;
+		if (client->sync)
+			code = REQUEST_ADD_SYNC(code);
+		merge_op = (unsigned char)op;
+		key_nlen = htons((uint16_t)key.len);
+		operand_nlen = htonl((uint32_t)operand.len);
+		// creation of the message
+		bzero(&mh, sizeof(struct msghdr));
+		mh.msg_iov = iov;
+		mh.msg_iovlen = 6;
+		iov[0].iov_base = (caddr_t)&code;
+		iov[0].iov_len = sizeof(code);
+		iov[1].iov_base = (caddr_t)&merge_op;
+		iov[1].iov_len = sizeof(merge_op);
+		iov[2].iov_base = (caddr_t)&key_nlen;
+		iov[2].iov_len = sizeof(uint16_t);
+		iov[3].iov_base = (caddr_t)key.data;
+		iov[3].iov_len = key.len;
+		iov[4].iov_base = (caddr_t)&operand_nlen;
+		iov[4].iov_len = sizeof(uint32_t);
+		iov[5].iov_base = (caddr_t)operand.data;
+		iov[5].iov_len = operand.len;
+		// sending
+		expected = 1 + 1 + sizeof(uint16_t) + key.len + sizeof(uint32_t) + operand.len;
+		rc = _sendmsg(client, &mh);
+		if (rc != expected)
 			return (FINEDB_ERR_NETWORK);
-		}
-		if ((zip_data = YMALLOC(snappy_max_compressed_length(data.len))) == NULL) {
-			return (FINEDB_ERR_MEMORY);
-		}
-		if (snappy_compress(&zip_env, data.data, data.len, zip_data, &zip_len)) {
-			YFREE(zip_data);
+	}
+	// response
+	{
+		char *pt;
+		uint32_t *pdata_len, data_len;
+		ydynabin_t *buff;
+		void *data = NULL;
+
+		buff = ydynabin_new(NULL, 0, YFALSE);
+		// read the response code
+		if (_read_data(client, buff, 1) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		pt = ydynabin_forward(buff, sizeof(unsigned char));
+		code = *pt;
+		if (RESPONSE_STATUS(code) == RESP_ERR_BAD_VALUE) {
+			retval = FINEDB_ERR_VALUE;
+			goto end_of_process;
+		}
+		if (RESPONSE_STATUS(code) != RESP_OK) {
+			retval = FINEDB_ERR_SERVER;
+			goto end_of_process;
+		}
+		// asynchronous mode: no data
+		if (!client->sync)
+			goto end_of_process;
+		// read the size of data
+		if (_read_data(client, buff, sizeof(data_len)) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		pdata_len = ydynabin_forward(buff, sizeof(data_len));
+		data_len = ntohl(*pdata_len);
+		// read data
+		if (data_len > 0) {
+			if (_read_data(client, buff, (size_t)data_len) != YENOERR) {
+				retval = FINEDB_ERR_NETWORK;
+				goto end_of_process;
+			}
+			pt = ydynabin_forward(buff, (size_t)data_len);
+			if (result) {
+				if ((data = YMALLOC((size_t)data_len)) == NULL) {
+					retval = FINEDB_ERR_MEMORY;
+					goto end_of_process;
+				}
+				memcpy(data, pt, (size_t)data_len);
+			}
+		}
+		if (result)
+			ybin_set(result, data, (size_t)data_len);
+end_of_process:
+		ydynabin_delete(buff);
+	}
+	return (retval);
+}
+
+/* Increment a value. */
+int finedb_inc(finedb_client_t *client, ybin_t key, long long increment, long long *new_value) {
+	return (_send_incdec(client, YFALSE, key, increment, new_value));
+}
+
+/* Decrement a value. */
+int finedb_dec(finedb_client_t *client, ybin_t key, long long decrement, long long *new_value) {
+	return (_send_incdec(client, YTRUE, key, decrement, new_value));
+}
+
+/* Start a transaction. */
+int finedb_start(finedb_client_t *client) {
+	char code;
+	int rc;
+
+	rc = _send_simple_request(client, PROTO_START, &code);
+	if (rc)
+		return (rc);
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	client->transaction = YTRUE;
+	return (FINEDB_OK);
+}
+
+/* Stop a transaction. */
+int finedb_stop(finedb_client_t *client) {
+	char code;
+	int rc;
+
+	rc = _send_simple_request(client, PROTO_STOP, &code);
+	if (rc)
+		return (rc);
+	client->transaction = YFALSE;
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	return (FINEDB_OK);
+}
+
+/* Test a running connection. */
+int finedb_ping(finedb_client_t *client) {
+	char code;
+	int rc;
+
+	rc = _send_simple_request(client, PROTO_PING, &code);
+	if (rc)
+		return (rc);
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	return (FINEDB_OK);
+}
+
+/* Fetch the latency statistics of the server. */
+int finedb_stats(finedb_client_t *client, finedb_stats_t **stats, size_t *nbr_stats,
+                 unsigned long long *uptime) {
+	unsigned char *pt;
+	uint64_t values[7];
+	ybin_t data;
+	size_t i;
+	int rc;
+
+	*stats = NULL;
+	*nbr_stats = 0;
+	if ((rc = _send_admin(client, PROTO_ADMIN_STATS, &data)) != FINEDB_OK)
+		return (rc);
+	if (data.len < sizeof(uint64_t) ||
+	    (data.len - sizeof(uint64_t)) % PROTO_STATS_ENTRY_SIZE) {
+		YFREE(data.data);
+		return (FINEDB_ERR_SERVER);
+	}
+	pt = data.data;
+	memcpy(values, pt, sizeof(uint64_t));
+	if (uptime)
+		*uptime = be64toh(values[0]);
+	pt += sizeof(uint64_t);
+	*nbr_stats = (data.len - sizeof(uint64_t)) / PROTO_STATS_ENTRY_SIZE;
+	if (*nbr_stats && (*stats = YMALLOC(*nbr_stats * sizeof(finedb_stats_t))) == NULL) {
+		*nbr_stats = 0;
+		YFREE(data.data);
+		return (FINEDB_ERR_MEMORY);
+	}
+	for (i = 0; i < *nbr_stats; i++) {
+		(*stats)[i].command = pt[0];
+		(*stats)[i].async = pt[1] ? YTRUE : YFALSE;
+		(*stats)[i].result = (finedb_stats_result_t)pt[2];
+		memcpy(values, pt + 3, sizeof(values));
+		(*stats)[i].count = be64toh(values[0]);
+		(*stats)[i].throughput = be64toh(values[1]);
+		(*stats)[i].mean = be64toh(values[2]);
+		(*stats)[i].p50 = be64toh(values[3]);
+		(*stats)[i].p99 = be64toh(values[4]);
+		(*stats)[i].p999 = be64toh(values[5]);
+		(*stats)[i].max = be64toh(values[6]);
+		pt += PROTO_STATS_ENTRY_SIZE;
+	}
+	YFREE(data.data);
+	return (FINEDB_OK);
+}
+
+/* Fetch the internals of the server's LMDB environment. */
+int finedb_lmdb(finedb_client_t *client, finedb_lmdb_t *lmdb, finedb_lmdb_db_t **dbs, size_t *nbr_dbs) {
+	unsigned char *pt, *end, name_len;
+	uint64_t values[11];
+	finedb_lmdb_db_t *db;
+	ybin_t data;
+	size_t nbr = 0;
+	int rc;
+
+	if (dbs)
+		*dbs = NULL;
+	if (nbr_dbs)
+		*nbr_dbs = 0;
+	if ((rc = _send_admin(client, PROTO_ADMIN_LMDB, &data)) != FINEDB_OK)
+		return (rc);
+	if (data.len < PROTO_LMDB_INFO_SIZE) {
+		YFREE(data.data);
+		return (FINEDB_ERR_SERVER);
+	}
+	memcpy(values, data.data, sizeof(values));
+	lmdb->map_size = be64toh(values[0]);
+	lmdb->last_page = be64toh(values[1]);
+	lmdb->last_txnid = be64toh(values[2]);
+	lmdb->max_readers = be64toh(values[3]);
+	lmdb->readers = be64toh(values[4]);
+	lmdb->page_size = be64toh(values[5]);
+	lmdb->free_pages = be64toh(values[6]);
+	lmdb->oldest_age = be64toh(values[7]);
+	lmdb->oldest_lag = be64toh(values[8]);
+	lmdb->major_faults = be64toh(values[9]);
+	lmdb->minor_faults = be64toh(values[10]);
+	if (dbs == NULL || nbr_dbs == NULL) {
+		YFREE(data.data);
+		return (FINEDB_OK);
+	}
+	// count the databases
+	end = (unsigned char*)data.data + data.len;
+	for (pt = (unsigned char*)data.data + PROTO_LMDB_INFO_SIZE; pt < end; nbr++) {
+		if ((size_t)(end - pt) < PROTO_LMDB_DB_SIZE + *pt) {
+			YFREE(data.data);
+			return (FINEDB_ERR_SERVER);
+		}
+		pt += PROTO_LMDB_DB_SIZE + *pt;
+	}
+	if (nbr && (*dbs = YMALLOC(nbr * sizeof(finedb_lmdb_db_t))) == NULL) {
+		YFREE(data.data);
+		return (FINEDB_ERR_MEMORY);
+	}
+	for (pt = (unsigned char*)data.data + PROTO_LMDB_INFO_SIZE; pt < end; ) {
+		db = &(*dbs)[(*nbr_dbs)++];
+		name_len = *pt++;
+		if (name_len && (db->name = YMALLOC(name_len + 1)) != NULL)
+			memcpy(db->name, pt, name_len);
+		pt += name_len;
+		memcpy(values, pt, 5 * sizeof(uint64_t));
+		pt += 5 * sizeof(uint64_t);
+		db->depth = be64toh(values[0]);
+		db->branch_pages = be64toh(values[1]);
+		db->leaf_pages = be64toh(values[2]);
+		db->overflow_pages = be64toh(values[3]);
+		db->entries = be64toh(values[4]);
+	}
+	YFREE(data.data);
+	return (FINEDB_OK);
+}
+
+/* Free an array of database statistics. */
+void finedb_lmdb_free(finedb_lmdb_db_t *dbs, size_t nbr_dbs) {
+	size_t i;
+
+	if (dbs == NULL)
+		return;
+	for (i = 0; i < nbr_dbs; i++)
+		YFREE(dbs[i].name);
+	YFREE(dbs);
+}
+
+/* Fetch the server's slow-request log. */
+int finedb_slowlog(finedb_client_t *client, finedb_slowlog_t **entries, size_t *nbr_entries,
+                   unsigned long long *threshold) {
+	unsigned char *pt;
+	uint64_t values[10];
+	finedb_slowlog_t *entry;
+	ybin_t data;
+	size_t i;
+	int rc;
+
+	*entries = NULL;
+	*nbr_entries = 0;
+	if ((rc = _send_admin(client, PROTO_ADMIN_SLOWLOG, &data)) != FINEDB_OK)
+		return (rc);
+	if (data.len < sizeof(uint64_t) ||
+	    (data.len - sizeof(uint64_t)) % PROTO_SLOWLOG_ENTRY_SIZE) {
+		YFREE(data.data);
+		return (FINEDB_ERR_SERVER);
+	}
+	pt = data.data;
+	memcpy(values, pt, sizeof(uint64_t));
+	if (threshold)
+		*threshold = be64toh(values[0]);
+	pt += sizeof(uint64_t);
+	*nbr_entries = (data.len - sizeof(uint64_t)) / PROTO_SLOWLOG_ENTRY_SIZE;
+	if (*nbr_entries && (*entries = YMALLOC(*nbr_entries * sizeof(finedb_slowlog_t))) == NULL) {
+		*nbr_entries = 0;
+		YFREE(data.data);
+		return (FINEDB_ERR_MEMORY);
+	}
+	for (i = 0; i < *nbr_entries; i++) {
+		entry = &(*entries)[i];
+		entry->command = pt[0];
+		entry->async = pt[1] ? YTRUE : YFALSE;
+		entry->response = pt[2];
+		memcpy(values, pt + 3, sizeof(values));
+		entry->id = be64toh(values[0]);
+		entry->time = be64toh(values[1]);
+		entry->duration = be64toh(values[2]);
+		entry->recv = be64toh(values[3]);
+		entry->parse = be64toh(values[4]);
+		entry->queue = be64toh(values[5]);
+		entry->txn = be64toh(values[6]);
+		entry->zip = be64toh(values[7]);
+		entry->send = be64toh(values[8]);
+		entry->queued = be64toh(values[9]);
+		pt += PROTO_SLOWLOG_ENTRY_SIZE;
+	}
+	YFREE(data.data);
+	return (FINEDB_OK);
+}
+
+/* Fetch the most accessed keys of the server. */
+int finedb_hotkeys(finedb_client_t *client, finedb_hotkey_t **keys, size_t *nbr_keys,
+                   unsigned long long *reads, unsigned long long *writes) {
+	unsigned char *pt, *end, name_len;
+	uint64_t values[2];
+	uint16_t key_len;
+	finedb_hotkey_t *key;
+	ybin_t data;
+	size_t nbr = 0;
+	int rc;
+
+	*keys = NULL;
+	*nbr_keys = 0;
+	if ((rc = _send_admin(client, PROTO_ADMIN_HOTKEYS, &data)) != FINEDB_OK)
+		return (rc);
+	if (data.len < sizeof(values)) {
+		YFREE(data.data);
+		return (FINEDB_ERR_SERVER);
+	}
+	memcpy(values, data.data, sizeof(values));
+	if (reads)
+		*reads = be64toh(values[0]);
+	if (writes)
+		*writes = be64toh(values[1]);
+	// count the keys
+	end = (unsigned char*)data.data + data.len;
+	for (pt = (unsigned char*)data.data + sizeof(values); pt < end; nbr++) {
+		if ((size_t)(end - pt) < PROTO_HOTKEYS_ENTRY_SIZE ||
+		    (size_t)(end - pt) < PROTO_HOTKEYS_ENTRY_SIZE + pt[1 + sizeof(uint64_t)]) {
+			YFREE(data.data);
+			return (FINEDB_ERR_SERVER);
+		}
+		pt += 1 + sizeof(uint64_t) + 1 + pt[1 + sizeof(uint64_t)];
+		memcpy(&key_len, pt, sizeof(key_len));
+		pt += sizeof(key_len);
+		if ((size_t)(end - pt) < ntohs(key_len)) {
+			YFREE(data.data);
+			return (FINEDB_ERR_SERVER);
+		}
+		pt += ntohs(key_len);
+	}
+	if (nbr && (*keys = YMALLOC(nbr * sizeof(finedb_hotkey_t))) == NULL) {
+		YFREE(data.data);
+		return (FINEDB_ERR_MEMORY);
+	}
+	for (pt = (unsigned char*)data.data + sizeof(values); pt < end; ) {
+		key = &(*keys)[(*nbr_keys)++];
+		key->write = *pt++ ? YTRUE : YFALSE;
+		memcpy(values, pt, sizeof(uint64_t));
+		key->count = be64toh(values[0]);
+		pt += sizeof(uint64_t);
+		name_len = *pt++;
+		if (name_len && (key->dbname = YMALLOC(name_len + 1)) != NULL)
+			memcpy(key->dbname, pt, name_len);
+		pt += name_len;
+		memcpy(&key_len, pt, sizeof(key_len));
+		pt += sizeof(key_len);
+		key->key.len = ntohs(key_len);
+		if ((key->key.data = YMALLOC(key->key.len + 1)) != NULL)
+			memcpy(key->key.data, pt, key->key.len);
+		pt += key->key.len;
+	}
+	YFREE(data.data);
+	return (FINEDB_OK);
+}
+
+/* Free an array of hot keys. */
+void finedb_hotkeys_free(finedb_hotkey_t *keys, size_t nbr_keys) {
+	size_t i;
+
+	if (keys == NULL)
+		return;
+	for (i = 0; i < nbr_keys; i++) {
+		YFREE(keys[i].dbname);
+		YFREE(keys[i].key.data);
+	}
+	YFREE(keys);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_send_admin
+ * Send an ADMIN request and get its response data.
+ * @param	client	Pointer to the client structure.
+ * @param	op	Administrative operation.
+ * @param	data	Pointer to the returned data (must be freed).
+ * @return	FINEDB_OK if OK.
+ */
+static int _send_admin(finedb_client_t *client, protocol_admin_t op, ybin_t *data) {
+	unsigned char request[2], code;
+	uint32_t data_len;
+
+	ybin_set(data, NULL, 0);
+	request[0] = PROTO_ADMIN;
+	request[1] = (unsigned char)op;
+	if (_write(client, request, sizeof(request)) != (ssize_t)sizeof(request) ||
+	    _read_full(client, &code, sizeof(code)) != YENOERR)
+		return (FINEDB_ERR_NETWORK);
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	if (_read_full(client, &data_len, sizeof(data_len)) != YENOERR)
+		return (FINEDB_ERR_NETWORK);
+	data_len = ntohl(data_len);
+	if ((data->data = YMALLOC((size_t)data_len + 1)) == NULL)
+		return (FINEDB_ERR_MEMORY);
+	if (_read_full(client, data->data, (size_t)data_len) != YENOERR) {
+		YFREE(data->data);
+		return (FINEDB_ERR_NETWORK);
+	}
+	data->len = (size_t)data_len;
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_send_simple_request
+ * Send a simple request and get a simple response.
+ * @param	client		Pointer to the client structure.
+ * @param	code		Request code.
+ * @param	response	Pointer to an interger where the response code will be copied.
+ * @return	FINEDB_OK if OK.
+ */
+static int _send_simple_request(finedb_client_t *client, const char code, char *response) {
+	char res;
+	int rc;
+
+	// send data
+	rc = _write(client, &code, 1);
+	if (rc != 1)
+		return (FINEDB_ERR_NETWORK);
+	// get response
+	rc = _read(client, &res, 1);
+	if (rc != 1)
+		return (FINEDB_ERR_NETWORK);
+	if (response)
+		*response = res;
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_send_incdec
+ * Send an INC/DEC merge request to the server.
+ * @param	client		Pointer to the client structure.
+ * @param	dec		YFALSE for INC, YTRUE for DEC.
+ * @param	key		Pointer to the key content.
+ * @param	val		Increment/decrement value.
+ * @param	new_value	Pointer to the integer where the new value will be copied.
+ * @return 	FINEDB_OK if OK.
+ */
+static int _send_incdec(finedb_client_t *client, ybool_t dec, ybin_t key, long long val, long long *new_value) {
+	char str[24];
+	ybin_t operand, result;
+	int retval;
+
+	snprintf(str, sizeof(str), "%lld", val);
+	ybin_set(&operand, str, strlen(str));
+	retval = finedb_merge(client, (dec ? FINEDB_MERGE_DEC : FINEDB_MERGE_INC), key, operand,
+	                      (new_value ? &result : NULL));
+	if (retval != FINEDB_OK || !new_value || !client->sync)
+		return (retval);
+	// conversion of the returned decimal value
+	if (result.len && result.len < sizeof(str)) {
+		memcpy(str, result.data, result.len);
+		str[result.len] = '\0';
+		*new_value = strtoll(str, NULL, 10);
+	} else
+		*new_value = 0;
+	YFREE(result.data);
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_send_key_data
+ * Send a PUT/ADD/UPDATE request to the server.
+ * @param	client		Pointer to the client structure.
+ * @param	create_only	YTRUE for an ADD request.
+ * @param	update_only	YTRUE for an UPDATE request.
+ * @param	key		Pointer to the key content.
+ * @param	data		Pointer to the data content.
+ * @return 	FINEDB_OK if OK.
+ */
+static int _send_key_data(finedb_client_t *client, ybool_t create_only,
+                          ybool_t update_only, ybin_t key, ybin_t data) {
+	char code;
+	ssize_t expected, rc;
+
+#ifdef FINEDB_EMBEDDED
+	if (client->db_path)
+		return (embedded_put(client, create_only, key, data));
+#endif /* FINEDB_EMBEDDED */
+	_cache_forget(client, key);
+	// coalesced write
+	if (client->batch_max && !client->sync)
+		return (_batch_add(client, PROTO_PUT, key, data));
+	// request
+	{
+		struct iovec iov[5];
+		struct msghdr mh;
+		uint16_t key_nlen;
+		uint32_t data_nlen;
+		struct snappy_env zip_env;
+		size_t zip_len;
+		char *zip_data = NULL;
+
+		// data compression
+		memset(&zip_env, 0, sizeof(struct snappy_env));
+		if (snappy_init_env(&zip_env)) {
+			return (FINEDB_ERR_NETWORK);
+		}
+		if ((zip_data = YMALLOC(snappy_max_compressed_length(data.len))) == NULL) {
+			return (FINEDB_ERR_MEMORY);
+		}
+		if (snappy_compress(&zip_env, data.data, data.len, zip_data, &zip_len)) {
+			YFREE(zip_data);
 			return (FINEDB_ERR_ZIP);
 		}
 		zip_data[zip_len] = '\0';
@@ -498,13 +1338,13 @@ static int _send_key_data(finedb_client_t *client, ybool_t create_only,
 		iov[4].iov_len = zip_len;
 		// sending
 		expected = 1 + sizeof(uint16_t) + key.len + sizeof(uint32_t) + zip_len;
-		rc = sendmsg(client->sock, &mh, 0);
+		rc = _sendmsg(client, &mh);
 		YFREE(zip_data);
 		if (rc != expected)
 			return (FINEDB_ERR_NETWORK);
 	}
 	// response
-	rc = read(client->sock, &code, 1);
+	rc = _read(client, &code, 1);
 	if (rc != 1)
 		return (FINEDB_ERR_NETWORK);
 	if (RESPONSE_STATUS(code) != RESP_OK)
@@ -513,13 +1353,252 @@ static int _send_key_data(finedb_client_t *client, ybool_t create_only,
 }
 
 /**
- * Read data from a socket.
- * @param	fd		Socket descriptor.
+ * @function	_send_cas
+ * Send a CAS request to the server.
+ * @param	client		Pointer to the client structure.
+ * @param	op		PROTO_CAS_PUT or PROTO_CAS_DEL.
+ * @param	key		Pointer to the key content.
+ * @param	data		Pointer to the data content (unused for PROTO_CAS_DEL).
+ * @param	version		Expected version of the key.
+ * @param	new_version	Pointer to the new version. Could be NULL.
+ * @return 	FINEDB_OK if OK.
+ */
+static int _send_cas(finedb_client_t *client, protocol_cas_t op, ybin_t key, ybin_t data,
+                     unsigned long long version, unsigned long long *new_version) {
+	char code;
+	ssize_t expected, rc;
+	int retval = FINEDB_OK;
+
+	_cache_forget(client, key);
+	// request
+	{
+		struct iovec iov[7];
+		struct msghdr mh;
+		unsigned char cas_op;
+		uint64_t version_nbr;
+		uint16_t key_nlen;
+		uint32_t data_nlen;
+		struct snappy_env zip_env;
+		size_t zip_len = 0;
+		char *zip_data = NULL;
+
+		// data compression
+		if (op == PROTO_CAS_PUT) {
+			memset(&zip_env, 0, sizeof(struct snappy_env));
+			if (snappy_init_env(&zip_env))
+				return (FINEDB_ERR_ZIP);
+			if ((zip_data = YMALLOC(snappy_max_compressed_length(data.len))) == NULL) {
+				snappy_free_env(&zip_env);
+				return (FINEDB_ERR_MEMORY);
+			}
+			if (snappy_compress(&zip_env, data.data, data.len, zip_data, &zip_len)) {
+				snappy_free_env(&zip_env);
+				YFREE(zip_data);
+				return (FINEDB_ERR_ZIP);
+			}
+			snappy_free_env(&zip_env);
+		}
+		// preparation
+		code = REQUEST_ADD_COMPRESSED(PROTO_CAS);
+		if (client->sync)
+			code = REQUEST_ADD_SYNC(code);
+		cas_op = (unsigned char)op;
+		version_nbr = htobe64((uint64_t)version);
+		key_nlen = htons((uint16_t)key.len);
+		data_nlen = htonl((uint32_t)zip_len);
+		// creation of the message
+		bzero(&mh, sizeof(struct msghdr));
+		mh.msg_iov = iov;
+		mh.msg_iovlen = (op == PROTO_CAS_PUT) ? 7 : 5;
+		iov[0].iov_base = (caddr_t)&code;
+		iov[0].iov_len = sizeof(code);
+		iov[1].iov_base = (caddr_t)&cas_op;
+		iov[1].iov_len = sizeof(cas_op);
+		iov[2].iov_base = (caddr_t)&version_nbr;
+		iov[2].iov_len = sizeof(uint64_t);
+		iov[3].iov_base = (caddr_t)&key_nlen;
+		iov[3].iov_len = sizeof(uint16_t);
+		iov[4].iov_base = (caddr_t)key.data;
+		iov[4].iov_len = key.len;
+		iov[5].iov_base = (caddr_t)&data_nlen;
+		iov[5].iov_len = sizeof(uint32_t);
+		iov[6].iov_base = (caddr_t)zip_data;
+		iov[6].iov_len = zip_len;
+		// sending
+		expected = 1 + 1 + sizeof(uint64_t) + sizeof(uint16_t) + key.len;
+		if (op == PROTO_CAS_PUT)
+			expected += sizeof(uint32_t) + zip_len;
+		rc = _sendmsg(client, &mh);
+		YFREE(zip_data);
+		if (rc != expected)
+			return (FINEDB_ERR_NETWORK);
+	}
+	// response
+	{
+		char *pt;
+		uint64_t version_nbr;
+		ydynabin_t *buff;
+
+		buff = ydynabin_new(NULL, 0, YFALSE);
+		// read the response code
+		if (_read_data(client, buff, 1) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		pt = ydynabin_forward(buff, sizeof(unsigned char));
+		code = *pt;
+		if (RESPONSE_STATUS(code) == RESP_ERR_VERSION) {
+			retval = FINEDB_ERR_VERSION;
+			goto end_of_process;
+		}
+		if (RESPONSE_STATUS(code) != RESP_OK) {
+			retval = FINEDB_ERR_SERVER;
+			goto end_of_process;
+		}
+		// asynchronous mode: no version
+		if (!client->sync)
+			goto end_of_process;
+		// read the new version and the (empty) data size
+		if (_read_data(client, buff, sizeof(uint64_t) + sizeof(uint32_t)) != YENOERR) {
+			retval = FINEDB_ERR_NETWORK;
+			goto end_of_process;
+		}
+		memcpy(&version_nbr, ydynabin_forward(buff, sizeof(version_nbr)), sizeof(version_nbr));
+		ydynabin_forward(buff, sizeof(uint32_t));
+		if (new_version)
+			*new_version = (unsigned long long)be64toh(version_nbr);
+end_of_process:
+		ydynabin_delete(buff);
+	}
+	return (retval);
+}
+
+/**
+ * @function	_send_get
+ * Send a GET request.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @return	FINEDB_OK if OK.
+ */
+static int _send_get(finedb_client_t *client, ybin_t key) {
+	struct iovec iov[3];
+	struct msghdr mh;
+	uint16_t key_nlen;
+	char code;
+	ssize_t expected;
+
+	code = PROTO_GET;
+	code = REQUEST_ADD_COMPRESSED(code);
+	key_nlen = htons((uint16_t)key.len);
+	// creation of the message
+	bzero(&mh, sizeof(struct msghdr));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 3;
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&key_nlen;
+	iov[1].iov_len = sizeof(uint16_t);
+	iov[2].iov_base = (caddr_t)key.data;
+	iov[2].iov_len = key.len;
+	// sending
+	expected = 1 + sizeof(uint16_t) + key.len;
+	if (_sendmsg(client, &mh) != expected)
+		return (FINEDB_ERR_NETWORK);
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_sendmsg
+ * Send a request, through the socket or the shared memory ring.
+ * @param	client	Pointer to the client structure.
+ * @param	mh	Pointer to the message.
+ * @return	The number of bytes sent, or -1 on error.
+ */
+static ssize_t _sendmsg(finedb_client_t *client, const struct msghdr *mh) {
+	ssize_t len = 0;
+	size_t i;
+
+	// coalesced writes are sent before any other request
+	if (client->batch_count && _batch_send(client) != FINEDB_OK)
+		return (-1);
+	if (!client->shm_out)
+		return (_check_timeout(client, sendmsg(client->sock, mh, MSG_NOSIGNAL)));
+	if (yring_writev(client->shm_out, mh->msg_iov, (int)mh->msg_iovlen, -1) != YENOERR)
+		return (-1);
+	for (i = 0; i < mh->msg_iovlen; i++)
+		len += mh->msg_iov[i].iov_len;
+	return (len);
+}
+
+/**
+ * @function	_write
+ * Send raw data, through the socket or the shared memory ring.
+ * @param	client	Pointer to the client structure.
+ * @param	buf	Pointer to the data.
+ * @param	len	Size of the data.
+ * @return	The number of bytes sent, or -1 on error.
+ */
+static ssize_t _write(finedb_client_t *client, const void *buf, size_t len) {
+	if (client->batch_count && _batch_send(client) != FINEDB_OK)
+		return (-1);
+	if (!client->shm_out)
+		return (_check_timeout(client, send(client->sock, buf, len, MSG_NOSIGNAL)));
+	if (yring_write(client->shm_out, buf, len, -1) != YENOERR)
+		return (-1);
+	return ((ssize_t)len);
+}
+
+/**
+ * @function	_read
+ * Read data, from the socket or the shared memory ring. When waiting on
+ * the ring, the socket is checked from time to time to detect the death
+ * of the server.
+ * @param	client	Pointer to the client structure.
+ * @param	buf	Pointer to the destination buffer.
+ * @param	len	Size of the buffer.
+ * @return	The number of bytes read, 0 if the connection was closed, or
+ *		-1 on error.
+ */
+static ssize_t _read(finedb_client_t *client, void *buf, size_t len) {
+	struct pollfd pfd;
+	ssize_t rc;
+
+	if (!client->shm_in)
+		return (_check_timeout(client, read(client->sock, buf, len)));
+	while ((rc = yring_read(client->shm_in, buf, len, FINEDB_SHM_POLL_MS)) == YETIMEDOUT) {
+		pfd.fd = client->sock;
+		pfd.events = POLLRDHUP;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+			return (-1);
+	}
+	return (rc);
+}
+
+/**
+ * @function	_check_timeout
+ * Close the connection if a socket read or write timed out: the stream
+ * is no longer synchronized with the requests.
+ * @param	client	Pointer to the client structure.
+ * @param	rc	Return value of the read or write.
+ * @return	The given return value.
+ */
+static ssize_t _check_timeout(finedb_client_t *client, ssize_t rc) {
+	if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && client->io_timeout) {
+		close(client->sock);
+		client->sock = -1;
+	}
+	return (rc);
+}
+
+/**
+ * Read data from the server.
+ * @param	client		Pointer to the client structure.
  * @param	container	Dynamic buffer.
  * @param	size		Expected size of data.
  * @return	YENOERR if OK.
  */
-static yerr_t _read_data(int fd, ydynabin_t *container, size_t size) {
+static yerr_t _read_data(finedb_client_t *client, ydynabin_t *container, size_t size) {
 	char buff[8196];
 	ssize_t bufsz;
 	yerr_t dynaerr;
@@ -527,7 +1606,7 @@ static yerr_t _read_data(int fd, ydynabin_t *container, size_t size) {
 	if (container->len >= size)
 		return (YENOERR);
 	while (container->len < size) {
-		if ((bufsz = read(fd, buff, 8196)) < 0)
+		if ((bufsz = _read(client, buff, 8196)) < 0)
 			return (YEACCESS);
 		if (bufsz == 0) {
 			if (container->len < size)
@@ -539,3 +1618,194 @@ static yerr_t _read_data(int fd, ydynabin_t *container, size_t size) {
 	}
 	return (YENOERR);
 }
+
+/**
+ * @function	_read_full
+ * Read an exact amount of data from the server, without buffering.
+ * @param	client	Pointer to the client structure.
+ * @param	buf	Pointer to the destination buffer.
+ * @param	len	Size of data to read.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _read_full(finedb_client_t *client, void *buf, size_t len) {
+	ssize_t rc;
+
+	while (len > 0) {
+		if ((rc = _read(client, buf, len)) < 0)
+			return (YEACCESS);
+		if (rc == 0)
+			return (YECONNRESET);
+		buf = (char*)buf + rc;
+		len -= (size_t)rc;
+	}
+	return (YENOERR);
+}
+
+/**
+ * @function	_batch_add
+ * Add a write to the coalesced writes. The batch is sent if it is full or
+ * too old.
+ * @param	client	Pointer to the client structure.
+ * @param	command	PROTO_PUT or PROTO_DEL.
+ * @param	key	Pointer to the key content.
+ * @param	data	Pointer to the data content (unused for PROTO_DEL).
+ * @return	FINEDB_OK if OK.
+ */
+static int _batch_add(finedb_client_t *client, unsigned char command, ybin_t key, ybin_t data) {
+	uint16_t key_nlen;
+	uint32_t data_nlen;
+	size_t needed, zip_len;
+	char *pt;
+	int rc;
+
+	needed = 1 + sizeof(key_nlen) + key.len;
+	if (command == PROTO_PUT)
+		needed += sizeof(data_nlen) + snappy_max_compressed_length(data.len);
+	// send the current batch if the new entry doesn't fit in
+	if (client->batch_count && client->batch_len + needed > client->batch_max &&
+	    (rc = _batch_send(client)) != FINEDB_OK)
+		return (rc);
+	// buffer allocation
+	if (client->batch_len + needed > client->batch_size) {
+		size_t size = client->batch_len + needed;
+
+		if (size < client->batch_max)
+			size = client->batch_max;
+		if ((pt = YMALLOC(size)) == NULL)
+			return (FINEDB_ERR_MEMORY);
+		if (client->batch_len)
+			memcpy(pt, client->batch, client->batch_len);
+		YFREE(client->batch);
+		client->batch = pt;
+		client->batch_size = size;
+	}
+	if (command == PROTO_PUT && client->zip_env == NULL) {
+		if ((client->zip_env = YMALLOC(sizeof(struct snappy_env))) == NULL)
+			return (FINEDB_ERR_MEMORY);
+		if (snappy_init_env((struct snappy_env*)client->zip_env)) {
+			YFREE(client->zip_env);
+			return (FINEDB_ERR_ZIP);
+		}
+	}
+	// add the entry
+	pt = client->batch + client->batch_len;
+	*pt++ = (char)command;
+	key_nlen = htons((uint16_t)key.len);
+	memcpy(pt, &key_nlen, sizeof(key_nlen));
+	pt += sizeof(key_nlen);
+	memcpy(pt, key.data, key.len);
+	pt += key.len;
+	if (command == PROTO_PUT) {
+		// data compressed directly in the batch
+		if (snappy_compress((struct snappy_env*)client->zip_env, data.data, data.len,
+		                    pt + sizeof(data_nlen), &zip_len))
+			return (FINEDB_ERR_ZIP);
+		data_nlen = htonl((uint32_t)zip_len);
+		memcpy(pt, &data_nlen, sizeof(data_nlen));
+		pt += sizeof(data_nlen) + zip_len;
+	}
+	client->batch_len = (size_t)(pt - client->batch);
+	if (!client->batch_count++ && client->batch_delay)
+		client->batch_start = transport_now();
+	// send the batch if it is full or too old
+	if (client->batch_len >= client->batch_max || client->batch_count >= PROTO_BATCH_MAX_ENTRIES ||
+	    (client->batch_delay && transport_now() - client->batch_start >= client->batch_delay))
+		return (_batch_send(client));
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_batch_send
+ * Send the coalesced writes in a BATCH request, and read the response.
+ * @param	client	Pointer to the client structure.
+ * @return	FINEDB_OK if OK.
+ */
+static int _batch_send(finedb_client_t *client) {
+	struct iovec iov[3];
+	struct msghdr mh;
+	uint32_t count_nbr;
+	ssize_t expected;
+	char code;
+
+	// the batch is emptied first (a failed batch is lost, like async writes)
+	count_nbr = htonl(client->batch_count);
+	expected = 1 + sizeof(count_nbr) + client->batch_len;
+	client->batch_count = 0;
+	client->batch_len = 0;
+	code = REQUEST_ADD_COMPRESSED(PROTO_BATCH);
+	bzero(&mh, sizeof(struct msghdr));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 3;
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&count_nbr;
+	iov[1].iov_len = sizeof(count_nbr);
+	iov[2].iov_base = (caddr_t)client->batch;
+	iov[2].iov_len = (size_t)expected - 1 - sizeof(count_nbr);
+	if (_sendmsg(client, &mh) != expected)
+		return (FINEDB_ERR_NETWORK);
+	// response
+	if (_read(client, &code, 1) != 1)
+		return (FINEDB_ERR_NETWORK);
+	if (RESPONSE_STATUS(code) != RESP_OK)
+		return (FINEDB_ERR_SERVER);
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_cache_lookup
+ * Process the waiting invalidation records, and search a key in the
+ * client-side cache. The cache is dropped if the invalidation connection
+ * was lost.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Key.
+ * @return	A pointer to the cache entry, or NULL.
+ */
+static cache_entry_t *_cache_lookup(finedb_client_t *client, ybin_t key) {
+	if (client->cache == NULL || client->transaction)
+		return (NULL);
+	if (cache_invalidate(client->cache, client->track_sock) != FINEDB_OK) {
+		_cache_drop(client);
+		return (NULL);
+	}
+	return (cache_get(client->cache, client->dbname, key));
+}
+
+/**
+ * @function	_cache_store
+ * Add a value read from the server in the client-side cache, if any.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Key.
+ * @param	value	Value.
+ * @param	version	Version of the value.
+ */
+static void _cache_store(finedb_client_t *client, ybin_t key, ybin_t value, unsigned long long version) {
+	// values read inside a transaction could already be modified
+	if (client->cache && !client->transaction)
+		cache_set(client->cache, client->dbname, key, value, version);
+}
+
+/**
+ * @function	_cache_forget
+ * Remove a key written by the client from the client-side cache, if any.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Key.
+ */
+static void _cache_forget(finedb_client_t *client, ybin_t key) {
+	if (client->cache)
+		cache_remove(client->cache, client->dbname, key);
+}
+
+/**
+ * @function	_cache_drop
+ * Free the client-side cache and close the invalidation connection. The
+ * cache size is kept, to enable the cache again after a reconnection.
+ * @param	client	Pointer to the client structure.
+ */
+static void _cache_drop(finedb_client_t *client) {
+	cache_delete(client->cache);
+	client->cache = NULL;
+	if (client->track_sock > -1)
+		close(client->track_sock);
+	client->track_sock = -1;
+}
@@ -1,8 +1,47 @@
 #ifndef __LIBFINEDB_H__
 #define __LIBFINEDB_H__
 
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include "ydefs.h"
 #include "ybin.h"
+#include "ydynabin.h"
+#include "yring.h"
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif /* __cplusplus || c_plusplus */
+
+/** @define FINEDB_PIPELINE_QUEUE_SIZE Initial size of the queue of pipelined requests. */
+#define FINEDB_PIPELINE_QUEUE_SIZE	256
+
+/** @define FINEDB_PIPELINE_FLUSH_SIZE Size of buffered requests over which they are sent immediately. */
+#define FINEDB_PIPELINE_FLUSH_SIZE	65536
+
+/** @define FINEDB_POOL_CHECK_INTERVAL Idle time (seconds) after which a pooled connection is pinged before use. */
+#define FINEDB_POOL_CHECK_INTERVAL	5
+
+/** @define FINEDB_POOL_WAIT_MS Maximum time to wait for a free connection, when the pool is full. */
+#define FINEDB_POOL_WAIT_MS		1000
+
+/** @define FINEDB_CONNECT_TIMEOUT Default connection timeout (milliseconds). */
+#define FINEDB_CONNECT_TIMEOUT		5000
+
+/** @define FINEDB_RECONNECT_MIN_DELAY Delay (milliseconds) between two reconnection attempts, after a first failure. */
+#define FINEDB_RECONNECT_MIN_DELAY	100
+
+/** @define FINEDB_RECONNECT_MAX_DELAY Maximum delay (milliseconds) between two reconnection attempts. */
+#define FINEDB_RECONNECT_MAX_DELAY	10000
+
+/** @define FINEDB_DEFAULT_PORT Port used when a server address has no port number. */
+#define FINEDB_DEFAULT_PORT	11138
+
+/** @define FINEDB_SHARD_POINTS Number of points of each server on the hash ring of a sharded client. */
+#define FINEDB_SHARD_POINTS	160
+
+/** @define FINEDB_SHM_POLL_MS Time between two checks of the server's socket, when using shared memory. */
+#define FINEDB_SHM_POLL_MS	1000
 
 /**
  * @typedef	finedb_result_t
@@ -13,6 +52,9 @@
  * @const	FINEDB_ERR_FILE		File exists or doesn't exist.
  * @const	FINEDB_ERR_MEMORY	Unable to allocate memory.
  * @const	FINEDB_ERR_ZIP		Compression/decompression error.
+ * @const	FINEDB_ERR_VALUE	Value not compatible with the operation.
+ * @const	FINEDB_ERR_VERSION	The version of the key doesn't match.
+ * @const	FINEDB_ERR_SIZE		The destination buffer is too small.
  */
 typedef enum finedb_result_e {
 	FINEDB_OK = 0,
@@ -20,35 +62,470 @@ typedef enum finedb_result_e {
 	FINEDB_ERR_SERVER = 2,
 	FINEDB_ERR_FILE = 3,
 	FINEDB_ERR_MEMORY = 4,
-	FINEDB_ERR_ZIP = 5
+	FINEDB_ERR_ZIP = 5,
+	FINEDB_ERR_VALUE = 6,
+	FINEDB_ERR_VERSION = 7,
+	FINEDB_ERR_SIZE = 8
 } finedb_result_t;
 
+/**
+ * @typedef	finedb_merge_t
+ * Merge operators, applied server-side on the current value of a key.
+ * A missing key is processed as an empty value.
+ * @const	FINEDB_MERGE_INC	Add a number to a decimal value.
+ * @const	FINEDB_MERGE_DEC	Subtract a number from a decimal value.
+ * @const	FINEDB_MERGE_APPEND	Append data at the end of the value.
+ * @const	FINEDB_MERGE_MAX	Keep the greatest of two decimal values.
+ * @const	FINEDB_MERGE_MIN	Keep the smallest of two decimal values.
+ * @const	FINEDB_MERGE_OR		Bitwise OR (the value is extended if needed).
+ */
+typedef enum finedb_merge_e {
+	FINEDB_MERGE_INC = 0,
+	FINEDB_MERGE_DEC = 1,
+	FINEDB_MERGE_APPEND = 2,
+	FINEDB_MERGE_MAX = 3,
+	FINEDB_MERGE_MIN = 4,
+	FINEDB_MERGE_OR = 5
+} finedb_merge_t;
+
+/**
+ * @typedef	finedb_encoding_t
+ * Integer encodings of values, used for aggregations.
+ * @const	FINEDB_ENC_NONE		Values are not numbers.
+ * @const	FINEDB_ENC_STRING	Values are decimal strings.
+ * @const	FINEDB_ENC_INT64	Values are 64 bits big-endian signed integers.
+ */
+typedef enum finedb_encoding_e {
+	FINEDB_ENC_NONE = 0,
+	FINEDB_ENC_STRING = 1,
+	FINEDB_ENC_INT64 = 2
+} finedb_encoding_t;
+
+/**
+ * @typedef	finedb_aggregate_t
+ * Result of an aggregation over a range of keys.
+ * @field	count	Number of keys.
+ * @field	size	Total size of the values.
+ * @field	numbers	Number of values that are valid numbers.
+ * @field	sum	Sum of numeric values.
+ * @field	min	Minimum numeric value.
+ * @field	max	Maximum numeric value.
+ */
+typedef struct finedb_aggregate_s {
+	unsigned long long count;
+	unsigned long long size;
+	unsigned long long numbers;
+	long long sum;
+	long long min;
+	long long max;
+} finedb_aggregate_t;
+
+/**
+ * @typedef	finedb_stats_result_t
+ * Results of requests, as counted by the server's statistics.
+ * @const	FINEDB_STATS_HIT	The request was successful.
+ * @const	FINEDB_STATS_MISS	The key was not found, or its version didn't match.
+ * @const	FINEDB_STATS_ERROR	Any other error.
+ */
+typedef enum finedb_stats_result_e {
+	FINEDB_STATS_HIT = 0,
+	FINEDB_STATS_MISS = 1,
+	FINEDB_STATS_ERROR = 2
+} finedb_stats_result_t;
+
+/**
+ * @typedef	finedb_stats_t
+ * Latency statistics of a kind of request, merged from all the server's
+ * connection threads. Latencies are in nanoseconds.
+ * @field	command		Command number.
+ * @field	async		YTRUE for asynchronous requests.
+ * @field	result		Result of the requests.
+ * @field	count		Number of requests.
+ * @field	throughput	Requests per second since the start of the server.
+ * @field	mean		Mean latency.
+ * @field	p50		Median latency.
+ * @field	p99		99th percentile latency.
+ * @field	p999		99.9th percentile latency.
+ * @field	max		Maximum latency.
+ */
+typedef struct finedb_stats_s {
+	unsigned char command;
+	ybool_t async;
+	finedb_stats_result_t result;
+	unsigned long long count;
+	unsigned long long throughput;
+	unsigned long long mean;
+	unsigned long long p50;
+	unsigned long long p99;
+	unsigned long long p999;
+	unsigned long long max;
+} finedb_stats_t;
+
+/**
+ * @typedef	finedb_lmdb_t
+ * Internals of the server's LMDB environment.
+ * @field	map_size	Size of the memory map (bytes).
+ * @field	last_page	Last used page number.
+ * @field	last_txnid	ID of the last committed transaction.
+ * @field	max_readers	Number of reader slots.
+ * @field	readers		Number of used reader slots.
+ * @field	page_size	Size of a page (bytes).
+ * @field	free_pages	Number of pages in the free-list.
+ * @field	oldest_age	Age of the oldest transaction opened by a client
+ *				(milliseconds). 0 if there is none.
+ * @field	oldest_lag	Number of transactions committed since the
+ *				oldest transaction started.
+ * @field	major_faults	Number of major page faults of the server.
+ * @field	minor_faults	Number of minor page faults of the server.
+ */
+typedef struct finedb_lmdb_s {
+	unsigned long long map_size;
+	unsigned long long last_page;
+	unsigned long long last_txnid;
+	unsigned long long max_readers;
+	unsigned long long readers;
+	unsigned long long page_size;
+	unsigned long long free_pages;
+	unsigned long long oldest_age;
+	unsigned long long oldest_lag;
+	unsigned long long major_faults;
+	unsigned long long minor_faults;
+} finedb_lmdb_t;
+
+/**
+ * @typedef	finedb_lmdb_db_t
+ * Statistics of a database of the server.
+ * @field	name		Name of the database (must be freed). NULL for the
+ *				default database.
+ * @field	depth		Depth of the B-tree.
+ * @field	branch_pages	Number of branch pages.
+ * @field	leaf_pages	Number of leaf pages.
+ * @field	overflow_pages	Number of overflow pages.
+ * @field	entries		Number of entries.
+ */
+typedef struct finedb_lmdb_db_s {
+	char *name;
+	unsigned long long depth;
+	unsigned long long branch_pages;
+	unsigned long long leaf_pages;
+	unsigned long long overflow_pages;
+	unsigned long long entries;
+} finedb_lmdb_db_t;
+
+/**
+ * @typedef	finedb_slowlog_t
+ * A request logged by the server's slow-request log. Durations are in
+ * nanoseconds.
+ * @field	id		Sequence number of the entry.
+ * @field	time		Date of the request (Unix time, milliseconds).
+ * @field	command		Command number.
+ * @field	async		YTRUE for an asynchronous request.
+ * @field	response	Response code sent by the server.
+ * @field	duration	Total duration of the request.
+ * @field	recv		Time spent receiving the request.
+ * @field	parse		Time spent processing the request (everything
+ *				not counted in the other fields).
+ * @field	queue		Time spent sending to the writer thread, or
+ *				waiting for its write lock.
+ * @field	txn		Time spent in LMDB.
+ * @field	zip		Time spent compressing or uncompressing data.
+ * @field	send		Time spent sending the response.
+ * @field	queued		Number of messages waiting for the writer thread
+ *				at the end of the request.
+ */
+typedef struct finedb_slowlog_s {
+	unsigned long long id;
+	unsigned long long time;
+	unsigned char command;
+	ybool_t async;
+	unsigned char response;
+	unsigned long long duration;
+	unsigned long long recv;
+	unsigned long long parse;
+	unsigned long long queue;
+	unsigned long long txn;
+	unsigned long long zip;
+	unsigned long long send;
+	unsigned long long queued;
+} finedb_slowlog_t;
+
+/**
+ * @typedef	finedb_hotkey_t
+ * One of the most accessed keys of the server.
+ * @field	write	YTRUE for a written key, YFALSE for a read one.
+ * @field	count	Estimated number of accesses (halved as the counts age).
+ * @field	dbname	Name of the database (must be freed). NULL for the
+ *			default database.
+ * @field	key	Key (its data must be freed). Long keys are truncated.
+ */
+typedef struct finedb_hotkey_s {
+	ybool_t write;
+	unsigned long long count;
+	char *dbname;
+	ybin_t key;
+} finedb_hotkey_t;
+
 /**
  * @typedef	finedb_clien_t
  * Structure used by the client to connect to a FineDB server.
  * @field	hostname	Server hostname.
  * @field	port		Port number.
+ * @field	unix_path	Path to the server's Unix socket. NULL for TCP.
  * @field	sock		Connection socket.
+ * @field	connect_timeout	Connection timeout (milliseconds). 0 for no limit.
+ * @field	io_timeout	Timeout of socket reads and writes (milliseconds).
+ *				0 for no limit.
+ * @field	nodelay		YTRUE to disable Nagle's algorithm (TCP_NODELAY).
+ * @field	keepalive	YTRUE to activate TCP keepalive.
+ * @field	buffer_size	Size of socket send/receive buffers. 0 for the
+ *				system default.
+ * @field	reconnect_delay	Current delay between reconnection attempts (ms).
+ * @field	reconnect_time	Time of the next allowed reconnection attempt
+ *				(microseconds, monotonic clock).
  * @field	sync		YTRUE for synchronous mode.
  * @field	debug		YTRUE for debug mode.
+ * @field	shm		Pointer to the shared memory mapping. NULL if not used.
+ * @field	shm_size	Size of the shared memory mapping.
+ * @field	shm_in		Ring used to receive responses.
+ * @field	shm_out		Ring used to send requests.
+ * @field	db_path		Path to the database, for embedded clients. NULL otherwise.
+ * @field	env		Database environment of an embedded client.
+ * @field	txn		Read-only transaction of an embedded client, reused
+ *				between reads.
+ * @field	dbname		Name of the selected database. NULL for the default one.
+ * @field	pool_slot	Index of the client in its pool, if any.
+ * @field	recv_buf	Receive buffer, kept between requests.
+ * @field	recv_size	Size of the receive buffer.
+ * @field	batch		Buffer of coalesced writes (entries of a BATCH
+ *				request), waiting to be sent.
+ * @field	batch_len	Size of the coalesced writes.
+ * @field	batch_size	Size of the batch buffer.
+ * @field	batch_count	Number of coalesced writes.
+ * @field	batch_start	Time of the first coalesced write (microseconds).
+ * @field	batch_delay	Maximum time a write could be delayed
+ *				(microseconds). 0 for no limit.
+ * @field	batch_max	Maximum size of a batch. 0 if writes are not
+ *				coalesced.
+ * @field	zip_env		Snappy environment used to compress coalesced values.
+ * @field	cache		Client-side cache of values. NULL if not used.
+ * @field	cache_size	Maximum number of cached values. 0 if the cache
+ *				is disabled.
+ * @field	track_sock	Socket of the invalidation connection. -1 if unused.
+ * @field	transaction	YTRUE while a transaction is running (the cache
+ *				is then not used).
  */
 typedef struct finedb_client_s {
 	char *hostname;
 	unsigned short port;
+	char *unix_path;
 	int sock;
+	unsigned int connect_timeout;
+	unsigned int io_timeout;
+	ybool_t nodelay;
+	ybool_t keepalive;
+	int buffer_size;
+	unsigned int reconnect_delay;
+	unsigned long long reconnect_time;
 	ybool_t sync;
 	ybool_t debug;
+	void *shm;
+	size_t shm_size;
+	yring_t *shm_in;
+	yring_t *shm_out;
+	char *db_path;
+	void *env;
+	void *txn;
+	char *dbname;
+	unsigned int pool_slot;
+	char *recv_buf;
+	size_t recv_size;
+	char *batch;
+	size_t batch_len;
+	size_t batch_size;
+	uint32_t batch_count;
+	unsigned long long batch_start;
+	unsigned int batch_delay;
+	size_t batch_max;
+	void *zip_env;
+	void *cache;
+	size_t cache_size;
+	int track_sock;
+	ybool_t transaction;
 } finedb_client_t;
 
+/**
+ * @typedef	finedb_callback_t
+ * Function called when the response of a pipelined request is received.
+ * @param	cb_data	Pointer given with the request.
+ * @param	status	FINEDB_OK if OK.
+ * @param	value	Value returned by a GET request, or finedb_aggregate_t
+ *			structure returned by an AGGREGATE request (empty
+ *			otherwise). It is only valid during the call.
+ * @param	version	Version of the value returned by a GET request.
+ */
+typedef void (*finedb_callback_t)(void *cb_data, int status, ybin_t value, unsigned long long version);
+
+/**
+ * @typedef	finedb_pending_t
+ * Pipelined request waiting for its response.
+ * @field	command		Request command.
+ * @field	callback	Callback function. Could be NULL.
+ * @field	cb_data		Pointer given to the callback function.
+ */
+typedef struct finedb_pending_s {
+	unsigned char command;
+	finedb_callback_t callback;
+	void *cb_data;
+} finedb_pending_t;
+
+/**
+ * @typedef	finedb_pipeline_t
+ * Pipeline of asynchronous requests, sent over a client connection without
+ * waiting for the responses. The server processes the requests of a
+ * connection one after the other, so responses are matched in order.
+ * @field	client		Pointer to the client structure.
+ * @field	queue		Circular array of requests waiting for a response.
+ * @field	queue_size	Size of the array (power of 2).
+ * @field	queue_head	Index of the oldest request.
+ * @field	pending		Number of requests waiting for a response.
+ * @field	out		Buffer of requests waiting to be sent.
+ * @field	in		Buffer of received data.
+ * @field	unzip		Buffer used to uncompress values.
+ * @field	unzip_size	Size of the uncompression buffer.
+ */
+typedef struct finedb_pipeline_s {
+	finedb_client_t *client;
+	finedb_pending_t *queue;
+	size_t queue_size;
+	size_t queue_head;
+	size_t pending;
+	ydynabin_t *out;
+	ydynabin_t *in;
+	char *unzip;
+	size_t unzip_size;
+} finedb_pipeline_t;
+
+/**
+ * @typedef	finedb_pooled_t
+ * Slot of a connection pool.
+ * @field	client		Pointer to the client structure. NULL until the
+ *				connection is created.
+ * @field	next		Index + 1 of the next free slot (0 for none).
+ * @field	last_used	Last time the connection was released.
+ */
+typedef struct finedb_pooled_s {
+	finedb_client_t *client;
+	volatile uint32_t next;
+	time_t last_used;
+} finedb_pooled_t;
+
+/**
+ * @typedef	finedb_pool_t
+ * Pool of connections, shared by several threads. Free connections are
+ * kept in a lock-free stack.
+ * @field	hostname	Server hostname. NULL for a Unix socket.
+ * @field	port		Port number.
+ * @field	unix_path	Path to the server's Unix socket. NULL for TCP.
+ * @field	min		Number of connections opened at creation.
+ * @field	max		Maximum number of connections.
+ * @field	count		Number of created connections.
+ * @field	free_head	Head of the stack of free slots: index + 1 of the
+ *				first free slot in the low 32 bits, and a counter
+ *				incremented on every change in the high 32 bits
+ *				(avoids the ABA problem).
+ * @field	slots		Array of slots.
+ */
+typedef struct finedb_pool_s {
+	char *hostname;
+	unsigned short port;
+	char *unix_path;
+	unsigned int min;
+	unsigned int max;
+	volatile unsigned int count;
+	volatile uint64_t free_head;
+	finedb_pooled_t *slots;
+} finedb_pool_t;
+
+/**
+ * @typedef	finedb_shard_t
+ * Server of a sharded client.
+ * @field	name	Address of the server ("host:port", "[IPv6]:port" or
+ *			path to a Unix socket).
+ * @field	pool	Pool of connections to the server.
+ */
+typedef struct finedb_shard_s {
+	char *name;
+	finedb_pool_t *pool;
+} finedb_shard_t;
+
+/**
+ * @typedef	finedb_ring_point_t
+ * Point of a server on the hash ring.
+ * @field	hash	Position on the ring.
+ * @field	shard	Index of the server.
+ */
+typedef struct finedb_ring_point_s {
+	uint64_t hash;
+	size_t shard;
+} finedb_ring_point_t;
+
+/**
+ * @typedef	finedb_sharded_t
+ * Client spreading keys over several servers, by consistent hashing
+ * (ketama): each server owns FINEDB_SHARD_POINTS points on a hash ring,
+ * placed from its name, and a key goes to the first point following its
+ * hash. When a server is added or removed, only the keys of its points
+ * move. Shared by several threads.
+ * @field	lock		Lock of the server list: taken for reading by
+ *				requests, and for writing by rebalancing.
+ * @field	pool_min	Number of connections opened to each server.
+ * @field	pool_max	Maximum number of connections to each server.
+ * @field	nbr_shards	Number of servers.
+ * @field	shards		Array of servers.
+ * @field	ring_size	Number of points on the ring.
+ * @field	ring		Points of the ring, sorted by position.
+ */
+typedef struct finedb_sharded_s {
+	pthread_rwlock_t lock;
+	unsigned int pool_min;
+	unsigned int pool_max;
+	size_t nbr_shards;
+	finedb_shard_t *shards;
+	size_t ring_size;
+	finedb_ring_point_t *ring;
+} finedb_sharded_t;
+
 /**
  * @function	finedb_create
  * Create a FineDB connection client.
- * @param	hostname	Hostname.
+ * @param	hostname	Hostname, or IPv4/IPv6 address.
  * @param	port		Port number.
  * @return	A pointer to an allocated client structure.
  */
 finedb_client_t *finedb_create(const char *hostname, unsigned short port);
 
+/**
+ * @function	finedb_create_unix
+ * Create a FineDB connection client, using a Unix domain socket. It should
+ * be preferred over TCP when the server runs on the same host.
+ * @param	path	Path to the server's Unix socket.
+ * @return	A pointer to an allocated client structure.
+ */
+finedb_client_t *finedb_create_unix(const char *path);
+
+/**
+ * @function	finedb_create_embedded
+ * Create an embedded FineDB client, which reads and writes directly in a
+ * local database (no server, no network). It could be used while a server
+ * runs on the same database. Only finedb_setdb(), finedb_get(),
+ * finedb_get_versioned(), finedb_put(), finedb_add() and finedb_del() are
+ * available; requests are always synchronous.
+ * Only available in libfinedb_embedded.
+ * @param	path	Path to the database directory.
+ * @return	A pointer to an allocated client structure.
+ */
+finedb_client_t *finedb_create_embedded(const char *path);
+
 /**
  * @function	finedb_delete
  * @Destroy a FineDB connection client.
@@ -64,6 +541,19 @@ void finedb_delete(finedb_client_t *client);
  */
 int finedb_connect(finedb_client_t *client);
 
+/**
+ * @function	finedb_shm
+ * Switch a Unix socket connection to shared memory. Requests and responses
+ * are then exchanged through two rings mapped by the client and the server,
+ * without any syscall as long as both sides are busy.
+ * @param	client	Pointer to the client structure (connected to a Unix socket).
+ * @param	size	Size of each ring (power of 2 between 4 KB and 64 MB).
+ *			0 for the default size (1 MB).
+ * @return	FINEDB_OK if OK. If an error occured, the socket could still
+ *		be used.
+ */
+int finedb_shm(finedb_client_t *client, unsigned int size);
+
 /**
  * @function	finedb_disconnect
  * Disconnect and free allocated memory.
@@ -72,13 +562,90 @@ int finedb_connect(finedb_client_t *client);
 void finedb_disconnect(finedb_client_t *client);
 
 /**
- * @function	findb_reconnect
- * Reconnect to a previously connected server.
+ * @function	finedb_reconnect
+ * Reconnect to a previously connected server, and select the same
+ * database. This function doesn't wait: after a failure, new attempts are
+ * refused (FINEDB_ERR_NETWORK is returned immediately) during a delay that
+ * doubles at each failure, from FINEDB_RECONNECT_MIN_DELAY to
+ * FINEDB_RECONNECT_MAX_DELAY milliseconds.
  * @param	client	Pointer to the client structure.
  * @return	FINEDB_OK if OK.
  */
 int finedb_reconnect(finedb_client_t *client);
 
+/**
+ * @function	finedb_set_timeouts
+ * Set the connection and I/O timeouts. The I/O timeout is applied to each
+ * read and write on the socket; when it expires the connection is closed
+ * (the response could arrive later) and FINEDB_ERR_NETWORK is returned.
+ * The new values are used immediately.
+ * @param	client		Pointer to the client structure.
+ * @param	connect_timeout	Connection timeout in milliseconds (default:
+ *				FINEDB_CONNECT_TIMEOUT). 0 for no limit.
+ * @param	io_timeout	I/O timeout in milliseconds. 0 for no limit (default).
+ */
+void finedb_set_timeouts(finedb_client_t *client, unsigned int connect_timeout, unsigned int io_timeout);
+
+/**
+ * @function	finedb_set_socket_options
+ * Set the socket options. They are used immediately.
+ * @param	client		Pointer to the client structure.
+ * @param	nodelay		YTRUE to disable Nagle's algorithm (default).
+ * @param	keepalive	YTRUE to activate TCP keepalive (default).
+ * @param	buffer_size	Size of send and receive buffers. 0 for the
+ *				system default.
+ */
+void finedb_set_socket_options(finedb_client_t *client, ybool_t nodelay, ybool_t keepalive, int buffer_size);
+
+/**
+ * @function	finedb_coalesce
+ * Configure the coalescing of writes. In asynchronous mode, finedb_put(),
+ * finedb_add(), finedb_update() and finedb_del() then return immediately;
+ * the writes are accumulated and sent in one BATCH request, applied by the
+ * server in one transaction. The batch is sent when it reaches the given
+ * size or age (checked at each write), before any other request, or when
+ * finedb_flush() is called. Not used by embedded clients.
+ * @param	client	Pointer to the client structure.
+ * @param	delay	Maximum time a write could be delayed, in microseconds.
+ *			0 for no time limit.
+ * @param	size	Maximum size of a batch, in bytes. 0 to stop coalescing
+ *			(waiting writes are sent).
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_coalesce(finedb_client_t *client, unsigned int delay, size_t size);
+
+/**
+ * @function	finedb_cache_enable
+ * Keep the values read by finedb_get(), finedb_get_versioned() and
+ * finedb_get_into() in a local cache. A second connection is opened to
+ * the server, on which it pushes an invalidation record each time a key
+ * read by the client is modified; waiting records are processed before
+ * each read, so a cached value is never older than the last processed
+ * record. The cache is not used inside transactions. It is enabled again
+ * after a reconnection, and dropped if the invalidation connection is
+ * lost. Not available for embedded clients.
+ * @param	client		Pointer to the client structure (connected).
+ * @param	max_entries	Maximum number of cached values (the least
+ *				recently used are removed first).
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_cache_enable(finedb_client_t *client, size_t max_entries);
+
+/**
+ * @function	finedb_cache_disable
+ * Drop the local cache and close the invalidation connection.
+ * @param	client	Pointer to the client structure.
+ */
+void finedb_cache_disable(finedb_client_t *client);
+
+/**
+ * @function	finedb_flush
+ * Send the coalesced writes, if any.
+ * @param	client	Pointer to the client structure.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_flush(finedb_client_t *client);
+
 /**
  * @function	finedb_sync
  * Set synchronous mode.
@@ -112,6 +679,36 @@ int finedb_setdb(finedb_client_t *client, char *dbname);
  */
 int finedb_get(finedb_client_t *client, ybin_t key, ybin_t *data);
 
+/**
+ * @function	finedb_get_versioned
+ * Get a value and its version from its key.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @param	data	Pointer to the destination data.
+ * @param	version	Pointer to the version of the value. Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_get_versioned(finedb_client_t *client, ybin_t key, ybin_t *data, unsigned long long *version);
+
+/**
+ * @function	finedb_get_into
+ * Get a value from its key, and write it in a buffer given by the caller.
+ * The compressed data is read in a receive buffer kept by the client, and
+ * uncompressed directly in the destination buffer; no memory is allocated
+ * once the receive buffer is large enough.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @param	buffer	Pointer to the destination buffer.
+ * @param	size	Size of the destination buffer.
+ * @param	len	Pointer to the size of the value. If the buffer is too
+ *			small, it is set to the needed size.
+ * @param	version	Pointer to the version of the value. Could be NULL.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_SIZE if the buffer is too small
+ *		(the connection remains usable).
+ */
+int finedb_get_into(finedb_client_t *client, ybin_t key, void *buffer, size_t size,
+                    size_t *len, unsigned long long *version);
+
 /**
  * @function	finedb_del
  * Delete a value from database.
@@ -151,7 +748,58 @@ int finedb_add(finedb_client_t *client, ybin_t key, ybin_t data);
  */
 int finedb_update(finedb_client_t *client, ybin_t key, ybin_t data);
 
-#if 0
+/**
+ * @function	finedb_cas
+ * Write a key only if its current version is equal to the given one
+ * (compare-and-swap). In asynchronous mode, the version is checked later
+ * by the server and the result is unknown.
+ * @param	client		Pointer to the client structure.
+ * @param	key		Pointer to the key content.
+ * @param	data		Pointer to the data content.
+ * @param	version		Expected version (returned by finedb_get_versioned()).
+ * @param	new_version	Pointer to the new version. Could be NULL.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_VERSION if the version doesn't match.
+ */
+int finedb_cas(finedb_client_t *client, ybin_t key, ybin_t data, unsigned long long version,
+               unsigned long long *new_version);
+
+/**
+ * @function	finedb_cas_del
+ * Remove a key only if its current version is equal to the given one.
+ * @param	client	Pointer to the client structure.
+ * @param	key	Pointer to the key content.
+ * @param	version	Expected version (returned by finedb_get_versioned()).
+ * @return	FINEDB_OK if OK, FINEDB_ERR_VERSION if the version doesn't match.
+ */
+int finedb_cas_del(finedb_client_t *client, ybin_t key, unsigned long long version);
+
+/**
+ * @function	finedb_aggregate
+ * Compute the number of keys, the total size of values and the sum/min/max
+ * of numeric values, over a range of keys. Everything is done server-side.
+ * @param	client		Pointer to the client structure.
+ * @param	start		First key of the range (included). Empty for the first key.
+ * @param	end		Last key of the range (excluded). Empty for the last key.
+ * @param	encoding	Integer encoding of the values.
+ * @param	result		Pointer to the structure where the result will be copied.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_aggregate(finedb_client_t *client, ybin_t start, ybin_t end,
+                     finedb_encoding_t encoding, finedb_aggregate_t *result);
+
+/**
+ * @function	finedb_merge
+ * Apply a merge operator on the value of a key. In asynchronous mode, the
+ * merge is done later by the server and no value is returned.
+ * @param	client	Pointer to the client structure.
+ * @param	op	Merge operator.
+ * @param	key	Pointer to the key content.
+ * @param	operand	Pointer to the operand content.
+ * @param	result	Pointer to the new value (must be freed). Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_merge(finedb_client_t *client, finedb_merge_t op, ybin_t key, ybin_t operand, ybin_t *result);
+
 /**
  * @function	finedb_inc
  * Increment a value.
@@ -159,9 +807,10 @@ int finedb_update(finedb_client_t *client, ybin_t key, ybin_t data);
  * @param	key		Pointer to the key content.
  * @param	increment	Increment value.
  * @param	new_value	Pointer to the new value. Could be NULL.
+ *				Not set in asynchronous mode.
  * @return	FINEDB_OK if OK.
  */
-int finedb_inc(finedb_client_t *client, ybin_t key, int increment, int *new_value);
+int finedb_inc(finedb_client_t *client, ybin_t key, long long increment, long long *new_value);
 
 /**
  * @function	finedb_dec
@@ -170,10 +819,10 @@ int finedb_inc(finedb_client_t *client, ybin_t key, int increment, int *new_valu
  * @param	key		Pointer to the key content.
  * @param	decrement	Decrement value.
  * @param	new_value	Pointer to the new value. Could be NULL.
+ *				Not set in asynchronous mode.
  * @return	FINEDB_OK if OK.
  */
-int finedb_dec(finedb_client_t *client, ybin_t key, int increment, int *new_value);
-#endif /* 0 */
+int finedb_dec(finedb_client_t *client, ybin_t key, long long decrement, long long *new_value);
 
 /**
  * @function	finedb_start
@@ -199,4 +848,381 @@ int finedb_stop(finedb_client_t *client);
  */
 int finedb_ping(finedb_client_t *client);
 
+/**
+ * @function	finedb_stats
+ * Fetch the latency statistics of the server, per command, mode and result.
+ * @param	client		Pointer to the client structure.
+ * @param	stats		Pointer to the returned array (must be freed).
+ * @param	nbr_stats	Pointer to the number of elements of the array.
+ * @param	uptime		Pointer to the uptime of the server (milliseconds).
+ *				Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_stats(finedb_client_t *client, finedb_stats_t **stats, size_t *nbr_stats,
+                 unsigned long long *uptime);
+
+/**
+ * @function	finedb_lmdb
+ * Fetch the internals of the server's LMDB environment, and the statistics
+ * of its databases.
+ * @param	client	Pointer to the client structure.
+ * @param	lmdb	Pointer to the environment's information.
+ * @param	dbs	Pointer to the returned array (must be freed with
+ *			finedb_lmdb_free()). Could be NULL.
+ * @param	nbr_dbs	Pointer to the number of elements of the array.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_lmdb(finedb_client_t *client, finedb_lmdb_t *lmdb, finedb_lmdb_db_t **dbs, size_t *nbr_dbs);
+
+/**
+ * @function	finedb_lmdb_free
+ * Free an array of database statistics.
+ * @param	dbs	Pointer to the array.
+ * @param	nbr_dbs	Number of elements of the array.
+ */
+void finedb_lmdb_free(finedb_lmdb_db_t *dbs, size_t nbr_dbs);
+
+/**
+ * @function	finedb_slowlog
+ * Fetch the server's slow-request log, from the most recent request.
+ * @param	client		Pointer to the client structure.
+ * @param	entries		Pointer to the returned array (must be freed).
+ * @param	nbr_entries	Pointer to the number of elements of the array.
+ * @param	threshold	Pointer to the threshold of the log (nanoseconds,
+ *				0 if the log is disabled). Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_slowlog(finedb_client_t *client, finedb_slowlog_t **entries, size_t *nbr_entries,
+                   unsigned long long *threshold);
+
+/**
+ * @function	finedb_hotkeys
+ * Fetch the most read and the most written keys of the server, from the
+ * most accessed one.
+ * @param	client		Pointer to the client structure.
+ * @param	keys		Pointer to the returned array (must be freed with
+ *				finedb_hotkeys_free()).
+ * @param	nbr_keys	Pointer to the number of elements of the array.
+ * @param	reads		Pointer to the number of reads counted by the
+ *				server. Could be NULL.
+ * @param	writes		Pointer to the number of writes counted by the
+ *				server. Could be NULL.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_hotkeys(finedb_client_t *client, finedb_hotkey_t **keys, size_t *nbr_keys,
+                   unsigned long long *reads, unsigned long long *writes);
+
+/**
+ * @function	finedb_hotkeys_free
+ * Free an array of hot keys.
+ * @param	keys		Pointer to the array.
+ * @param	nbr_keys	Number of elements of the array.
+ */
+void finedb_hotkeys_free(finedb_hotkey_t *keys, size_t nbr_keys);
+
+/**
+ * @function	finedb_pipeline_create
+ * Create a pipeline over a connected client (TCP or Unix socket). The
+ * socket is switched to non-blocking mode: the client must not be used by
+ * other functions until the pipeline is deleted.
+ * @param	client	Pointer to the client structure.
+ * @return	A pointer to the allocated pipeline, or NULL.
+ */
+finedb_pipeline_t *finedb_pipeline_create(finedb_client_t *client);
+
+/**
+ * @function	finedb_pipeline_delete
+ * Destroy a pipeline. The callbacks of the requests still waiting for
+ * their responses are called with FINEDB_ERR_NETWORK. The client's socket
+ * is switched back to blocking mode; it should be reconnected if some
+ * responses were not read.
+ * @param	pipeline	Pointer to the pipeline.
+ */
+void finedb_pipeline_delete(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_fd
+ * Give the file descriptor to watch in an event loop (epoll, libuv...).
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	The socket's file descriptor.
+ */
+int finedb_pipeline_fd(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_events
+ * Give the events to watch on the pipeline's file descriptor.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	POLLIN if responses are expected, plus POLLOUT if some
+ *		requests are not sent yet.
+ */
+short finedb_pipeline_events(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_pending
+ * Give the number of requests waiting for their responses.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	The number of pending requests.
+ */
+size_t finedb_pipeline_pending(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_process
+ * Send buffered requests and read available responses, without blocking.
+ * The callbacks of the received responses are called. Must be called when
+ * the file descriptor is readable or writable.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_NETWORK if the connection was lost
+ *		(the callbacks of pending requests are then called with this error).
+ */
+int finedb_pipeline_process(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_flush
+ * Wait until all the pending requests got their responses.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_flush(finedb_pipeline_t *pipeline);
+
+/**
+ * @function	finedb_pipeline_get
+ * Add a GET request to a pipeline.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	key		Pointer to the key content.
+ * @param	callback	Function called with the value. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_get(finedb_pipeline_t *pipeline, ybin_t key, finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pipeline_put
+ * Add a PUT request to a pipeline. The request is synchronous if the client
+ * is in synchronous mode.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	key		Pointer to the key content.
+ * @param	data		Pointer to the data content.
+ * @param	callback	Function called with the result. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_put(finedb_pipeline_t *pipeline, ybin_t key, ybin_t data,
+                        finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pipeline_del
+ * Add a DEL request to a pipeline. The request is synchronous if the client
+ * is in synchronous mode.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	key		Pointer to the key content.
+ * @param	callback	Function called with the result. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_del(finedb_pipeline_t *pipeline, ybin_t key, finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pipeline_aggregate
+ * Add an AGGREGATE request to a pipeline. The callback's value points to
+ * the finedb_aggregate_t result.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	start		First key of the range (included). Empty for the first key.
+ * @param	end		Last key of the range (excluded). Empty for the last key.
+ * @param	encoding	Integer encoding of the values.
+ * @param	callback	Function called with the result. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_aggregate(finedb_pipeline_t *pipeline, ybin_t start, ybin_t end, finedb_encoding_t encoding,
+                              finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pipeline_setdb
+ * Add a SETDB request to a pipeline. Following requests use the selected database.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	dbname		Name of the database, or NULL for the default database.
+ * @param	callback	Function called with the result. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_setdb(finedb_pipeline_t *pipeline, const char *dbname,
+                          finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pipeline_ping
+ * Add a PING request to a pipeline.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	callback	Function called with the result. Could be NULL.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_pipeline_ping(finedb_pipeline_t *pipeline, finedb_callback_t callback, void *cb_data);
+
+/**
+ * @function	finedb_pool_create
+ * Create a pool of connections to a server, and open its first connections.
+ * @param	hostname	Hostname.
+ * @param	port		Port number.
+ * @param	min		Number of connections opened immediately.
+ * @param	max		Maximum number of connections.
+ * @return	A pointer to the allocated pool, or NULL.
+ */
+finedb_pool_t *finedb_pool_create(const char *hostname, unsigned short port, unsigned int min, unsigned int max);
+
+/**
+ * @function	finedb_pool_create_unix
+ * Create a pool of connections to a server's Unix socket.
+ * @param	path	Path to the server's Unix socket.
+ * @param	min	Number of connections opened immediately.
+ * @param	max	Maximum number of connections.
+ * @return	A pointer to the allocated pool, or NULL.
+ */
+finedb_pool_t *finedb_pool_create_unix(const char *path, unsigned int min, unsigned int max);
+
+/**
+ * @function	finedb_pool_delete
+ * Close all connections and destroy a pool. All connections must have been
+ * released.
+ * @param	pool	Pointer to the pool.
+ */
+void finedb_pool_delete(finedb_pool_t *pool);
+
+/**
+ * @function	finedb_pool_get
+ * Take a connection from a pool. A connection that was idle for more than
+ * FINEDB_POOL_CHECK_INTERVAL seconds is checked with a PING, and reopened if
+ * needed. If all connections are used and the pool is full, wait until one
+ * is released (at most FINEDB_POOL_WAIT_MS milliseconds).
+ * @param	pool	Pointer to the pool.
+ * @param	dbname	Name of the database to select, or NULL for the
+ *			default database. A SETDB request is sent only if the
+ *			connection uses another database.
+ * @return	A pointer to the client structure (in asynchronous mode), or NULL.
+ */
+finedb_client_t *finedb_pool_get(finedb_pool_t *pool, const char *dbname);
+
+/**
+ * @function	finedb_pool_release
+ * Give back a connection to its pool.
+ * @param	pool	Pointer to the pool.
+ * @param	client	Pointer to the client structure.
+ * @param	status	Result of the last request. If it is FINEDB_ERR_NETWORK,
+ *			the connection is closed and will be reopened when needed.
+ */
+void finedb_pool_release(finedb_pool_t *pool, finedb_client_t *client, int status);
+
+/**
+ * @function	finedb_sharded_create
+ * Create a sharded client over a list of servers, with a pool of
+ * connections to each of them.
+ * @param	servers		Array of server addresses: "host:port",
+ *				"[IPv6]:port", "host" (default port) or path to
+ *				a Unix socket (starting with '/').
+ * @param	nbr_servers	Number of servers.
+ * @param	pool_min	Number of connections opened immediately to
+ *				each server (0 to connect on first use).
+ * @param	pool_max	Maximum number of connections to each server.
+ * @return	A pointer to the allocated client, or NULL.
+ */
+finedb_sharded_t *finedb_sharded_create(const char **servers, size_t nbr_servers,
+                                        unsigned int pool_min, unsigned int pool_max);
+
+/**
+ * @function	finedb_sharded_delete
+ * Close all connections and destroy a sharded client.
+ * @param	sharded	Pointer to the sharded client.
+ */
+void finedb_sharded_delete(finedb_sharded_t *sharded);
+
+/**
+ * @function	finedb_sharded_rebalance
+ * Replace the list of servers. The pools of the servers kept in the list
+ * are reused, and only the keys owned by added or removed servers change
+ * of server. Waits for running requests; data are not moved between servers.
+ * @param	sharded		Pointer to the sharded client.
+ * @param	servers		Array of server addresses.
+ * @param	nbr_servers	Number of servers.
+ * @return	FINEDB_OK if OK. On error, the previous list is kept.
+ */
+int finedb_sharded_rebalance(finedb_sharded_t *sharded, const char **servers, size_t nbr_servers);
+
+/**
+ * @function	finedb_sharded_server
+ * Give the server owning a key.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	key	Pointer to the key content.
+ * @return	The index of the server in the current list.
+ */
+int finedb_sharded_server(finedb_sharded_t *sharded, ybin_t key);
+
+/**
+ * @function	finedb_sharded_get
+ * Get a value from its key, on the server owning the key.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @param	key	Pointer to the key content.
+ * @param	data	Pointer to the destination data (allocated, to be freed
+ *			by the caller).
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_sharded_get(finedb_sharded_t *sharded, const char *dbname, ybin_t key, ybin_t *data);
+
+/**
+ * @function	finedb_sharded_put
+ * Put a key/value on the server owning the key (asynchronous mode).
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @param	key	Pointer to the key content.
+ * @param	data	Pointer to the data content.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_sharded_put(finedb_sharded_t *sharded, const char *dbname, ybin_t key, ybin_t data);
+
+/**
+ * @function	finedb_sharded_del
+ * Remove a key from the server owning it (asynchronous mode).
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @param	key	Pointer to the key content.
+ * @return	FINEDB_OK if OK.
+ */
+int finedb_sharded_del(finedb_sharded_t *sharded, const char *dbname, ybin_t key);
+
+/**
+ * @function	finedb_sharded_mget
+ * Get several values. Keys are split by server, and the requests are
+ * pipelined on one connection per server, all servers in parallel.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @param	nbr	Number of keys.
+ * @param	keys	Array of keys.
+ * @param	values	Array of values (allocated, to be freed by the caller).
+ *			Empty for keys not found.
+ * @param	results	Array of results (FINEDB_OK if the key was found). Could
+ *			be NULL.
+ * @return	FINEDB_OK if all servers answered.
+ */
+int finedb_sharded_mget(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                        ybin_t *values, int *results);
+
+/**
+ * @function	finedb_sharded_mput
+ * Put several key/values. Keys are split by server, and the requests are
+ * pipelined on one connection per server, all servers in parallel.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default database.
+ * @param	nbr	Number of keys.
+ * @param	keys	Array of keys.
+ * @param	values	Array of values.
+ * @param	sync	YTRUE to wait until values are written.
+ * @param	results	Array of results. Could be NULL.
+ * @return	FINEDB_OK if all values were written.
+ */
+int finedb_sharded_mput(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                        const ybin_t *values, ybool_t sync, int *results);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif /* __cplusplus || c_plusplus */
+
 #endif /* __LIBFINEDB_H__ */
@@ -0,0 +1,476 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include "snappy.h"
+#include "protocol.h"
+#include "libfinedb.h"
+
+/* private functions */
+static int _pipeline_push(finedb_pipeline_t *pipeline, unsigned char command, struct iovec *iov,
+                          int iovcnt, finedb_callback_t callback, void *cb_data);
+static int _pipeline_send(finedb_pipeline_t *pipeline);
+static int _pipeline_dispatch(finedb_pipeline_t *pipeline);
+static void _pipeline_call(finedb_pipeline_t *pipeline, int status, ybin_t value, unsigned long long version);
+static void _pipeline_fail(finedb_pipeline_t *pipeline);
+static int _pipeline_set_blocking(int fd, ybool_t blocking);
+
+/* Create a pipeline over a connected client. */
+finedb_pipeline_t *finedb_pipeline_create(finedb_client_t *client) {
+	finedb_pipeline_t *pipeline;
+
+	// only on sockets
+	if (client->sock < 0 || client->shm || client->db_path)
+		return (NULL);
+	// coalesced writes must be sent before pipelined requests
+	if (finedb_flush(client) != FINEDB_OK)
+		return (NULL);
+	if ((pipeline = YMALLOC(sizeof(finedb_pipeline_t))) == NULL)
+		return (NULL);
+	pipeline->client = client;
+	pipeline->queue_size = FINEDB_PIPELINE_QUEUE_SIZE;
+	if ((pipeline->queue = YMALLOC(pipeline->queue_size * sizeof(finedb_pending_t))) == NULL ||
+	    (pipeline->out = ydynabin_new(NULL, 0, YFALSE)) == NULL ||
+	    (pipeline->in = ydynabin_new(NULL, 0, YFALSE)) == NULL ||
+	    _pipeline_set_blocking(client->sock, YFALSE)) {
+		YFREE(pipeline->queue);
+		ydynabin_delete(pipeline->out);
+		ydynabin_delete(pipeline->in);
+		YFREE(pipeline);
+		return (NULL);
+	}
+	return (pipeline);
+}
+
+/* Destroy a pipeline. */
+void finedb_pipeline_delete(finedb_pipeline_t *pipeline) {
+	if (pipeline == NULL)
+		return;
+	_pipeline_fail(pipeline);
+	if (pipeline->client->sock >= 0)
+		_pipeline_set_blocking(pipeline->client->sock, YTRUE);
+	YFREE(pipeline->queue);
+	ydynabin_delete(pipeline->out);
+	ydynabin_delete(pipeline->in);
+	YFREE(pipeline->unzip);
+	YFREE(pipeline);
+}
+
+/* Give the file descriptor to watch. */
+int finedb_pipeline_fd(finedb_pipeline_t *pipeline) {
+	return (pipeline->client->sock);
+}
+
+/* Give the events to watch. */
+short finedb_pipeline_events(finedb_pipeline_t *pipeline) {
+	short events = 0;
+
+	if (pipeline->pending)
+		events |= POLLIN;
+	if (pipeline->out->len)
+		events |= POLLOUT;
+	return (events);
+}
+
+/* Give the number of pending requests. */
+size_t finedb_pipeline_pending(finedb_pipeline_t *pipeline) {
+	return (pipeline->pending);
+}
+
+/* Send buffered requests and read available responses. */
+int finedb_pipeline_process(finedb_pipeline_t *pipeline) {
+	char buff[65536];
+	ssize_t rc;
+
+	// send buffered requests
+	if (_pipeline_send(pipeline) != FINEDB_OK)
+		return (FINEDB_ERR_NETWORK);
+	// read available responses
+	while (pipeline->pending) {
+		rc = recv(pipeline->client->sock, buff, sizeof(buff), 0);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (rc <= 0 || ydynabin_expand(pipeline->in, buff, (size_t)rc) != YENOERR) {
+			_pipeline_fail(pipeline);
+			return (FINEDB_ERR_NETWORK);
+		}
+		if (_pipeline_dispatch(pipeline) != FINEDB_OK) {
+			_pipeline_fail(pipeline);
+			return (FINEDB_ERR_NETWORK);
+		}
+		// the socket is empty
+		if ((size_t)rc < sizeof(buff))
+			break;
+	}
+	return (FINEDB_OK);
+}
+
+/* Wait until all the pending requests got their responses. */
+int finedb_pipeline_flush(finedb_pipeline_t *pipeline) {
+	struct pollfd pfd;
+	int rc;
+
+	while (pipeline->pending) {
+		pfd.fd = pipeline->client->sock;
+		pfd.events = finedb_pipeline_events(pipeline);
+		pfd.revents = 0;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+			_pipeline_fail(pipeline);
+			return (FINEDB_ERR_NETWORK);
+		}
+		if ((rc = finedb_pipeline_process(pipeline)) != FINEDB_OK)
+			return (rc);
+	}
+	return (FINEDB_OK);
+}
+
+/* Add a GET request. */
+int finedb_pipeline_get(finedb_pipeline_t *pipeline, ybin_t key, finedb_callback_t callback, void *cb_data) {
+	struct iovec iov[3];
+	unsigned char code;
+	uint16_t key_nlen;
+
+	code = REQUEST_ADD_COMPRESSED(PROTO_GET);
+	key_nlen = htons((uint16_t)key.len);
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&key_nlen;
+	iov[1].iov_len = sizeof(uint16_t);
+	iov[2].iov_base = (caddr_t)key.data;
+	iov[2].iov_len = key.len;
+	return (_pipeline_push(pipeline, PROTO_GET, iov, 3, callback, cb_data));
+}
+
+/* Add a PUT request. */
+int finedb_pipeline_put(finedb_pipeline_t *pipeline, ybin_t key, ybin_t data,
+                        finedb_callback_t callback, void *cb_data) {
+	struct iovec iov[5];
+	unsigned char code;
+	uint16_t key_nlen;
+	uint32_t data_nlen;
+	struct snappy_env zip_env;
+	size_t zip_len;
+	char *zip_data;
+	int rc;
+
+	// data compression
+	memset(&zip_env, 0, sizeof(struct snappy_env));
+	if (snappy_init_env(&zip_env))
+		return (FINEDB_ERR_ZIP);
+	if ((zip_data = YMALLOC(snappy_max_compressed_length(data.len))) == NULL) {
+		snappy_free_env(&zip_env);
+		return (FINEDB_ERR_MEMORY);
+	}
+	if (snappy_compress(&zip_env, data.data, data.len, zip_data, &zip_len)) {
+		snappy_free_env(&zip_env);
+		YFREE(zip_data);
+		return (FINEDB_ERR_ZIP);
+	}
+	snappy_free_env(&zip_env);
+	// request
+	code = REQUEST_ADD_COMPRESSED(PROTO_PUT);
+	if (pipeline->client->sync)
+		code = REQUEST_ADD_SYNC(code);
+	key_nlen = htons((uint16_t)key.len);
+	data_nlen = htonl((uint32_t)zip_len);
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&key_nlen;
+	iov[1].iov_len = sizeof(uint16_t);
+	iov[2].iov_base = (caddr_t)key.data;
+	iov[2].iov_len = key.len;
+	iov[3].iov_base = (caddr_t)&data_nlen;
+	iov[3].iov_len = sizeof(uint32_t);
+	iov[4].iov_base = (caddr_t)zip_data;
+	iov[4].iov_len = zip_len;
+	rc = _pipeline_push(pipeline, PROTO_PUT, iov, 5, callback, cb_data);
+	YFREE(zip_data);
+	return (rc);
+}
+
+/* Add a DEL request. */
+int finedb_pipeline_del(finedb_pipeline_t *pipeline, ybin_t key, finedb_callback_t callback, void *cb_data) {
+	struct iovec iov[3];
+	unsigned char code;
+	uint16_t key_nlen;
+
+	code = PROTO_DEL;
+	if (pipeline->client->sync)
+		code = REQUEST_ADD_SYNC(code);
+	key_nlen = htons((uint16_t)key.len);
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&key_nlen;
+	iov[1].iov_len = sizeof(uint16_t);
+	iov[2].iov_base = (caddr_t)key.data;
+	iov[2].iov_len = key.len;
+	return (_pipeline_push(pipeline, PROTO_DEL, iov, 3, callback, cb_data));
+}
+
+/* Add an AGGREGATE request. */
+int finedb_pipeline_aggregate(finedb_pipeline_t *pipeline, ybin_t start, ybin_t end, finedb_encoding_t encoding,
+                              finedb_callback_t callback, void *cb_data) {
+	struct iovec iov[6];
+	unsigned char code, enc;
+	uint16_t start_nlen, end_nlen;
+
+	code = PROTO_AGGREGATE;
+	enc = (unsigned char)encoding;
+	start_nlen = htons((uint16_t)start.len);
+	end_nlen = htons((uint16_t)end.len);
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&enc;
+	iov[1].iov_len = sizeof(enc);
+	iov[2].iov_base = (caddr_t)&start_nlen;
+	iov[2].iov_len = sizeof(uint16_t);
+	iov[3].iov_base = (caddr_t)start.data;
+	iov[3].iov_len = start.len;
+	iov[4].iov_base = (caddr_t)&end_nlen;
+	iov[4].iov_len = sizeof(uint16_t);
+	iov[5].iov_base = (caddr_t)end.data;
+	iov[5].iov_len = end.len;
+	return (_pipeline_push(pipeline, PROTO_AGGREGATE, iov, 6, callback, cb_data));
+}
+
+/* Add a SETDB request. */
+int finedb_pipeline_setdb(finedb_pipeline_t *pipeline, const char *dbname,
+                          finedb_callback_t callback, void *cb_data) {
+	struct iovec iov[3];
+	unsigned char code, len;
+
+	if (dbname && strlen(dbname) > 255)
+		return (FINEDB_ERR_VALUE);
+	code = PROTO_SETDB;
+	len = dbname ? (unsigned char)strlen(dbname) : 0;
+	iov[0].iov_base = (caddr_t)&code;
+	iov[0].iov_len = sizeof(code);
+	iov[1].iov_base = (caddr_t)&len;
+	iov[1].iov_len = sizeof(len);
+	iov[2].iov_base = (caddr_t)dbname;
+	iov[2].iov_len = len;
+	return (_pipeline_push(pipeline, PROTO_SETDB, iov, 3, callback, cb_data));
+}
+
+/* Add a PING request. */
+int finedb_pipeline_ping(finedb_pipeline_t *pipeline, finedb_callback_t callback, void *cb_data) {
+	struct iovec iov;
+	unsigned char code = PROTO_PING;
+
+	iov.iov_base = (caddr_t)&code;
+	iov.iov_len = sizeof(code);
+	return (_pipeline_push(pipeline, PROTO_PING, &iov, 1, callback, cb_data));
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_pipeline_push
+ * Add a request in the output buffer and in the queue of pending requests.
+ * The output buffer is sent if it is large enough.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	command		Request command.
+ * @param	iov		Request content.
+ * @param	iovcnt		Number of buffers.
+ * @param	callback	Callback function.
+ * @param	cb_data		Pointer given to the callback function.
+ * @return	FINEDB_OK if OK.
+ */
+static int _pipeline_push(finedb_pipeline_t *pipeline, unsigned char command, struct iovec *iov,
+                          int iovcnt, finedb_callback_t callback, void *cb_data) {
+	finedb_pending_t *pending;
+	int i;
+
+	if (pipeline->client->sock < 0)
+		return (FINEDB_ERR_NETWORK);
+	// expand the queue
+	if (pipeline->pending == pipeline->queue_size) {
+		finedb_pending_t *queue;
+		size_t j;
+
+		if ((queue = YMALLOC(2 * pipeline->queue_size * sizeof(finedb_pending_t))) == NULL)
+			return (FINEDB_ERR_MEMORY);
+		for (j = 0; j < pipeline->pending; j++)
+			queue[j] = pipeline->queue[(pipeline->queue_head + j) & (pipeline->queue_size - 1)];
+		YFREE(pipeline->queue);
+		pipeline->queue = queue;
+		pipeline->queue_size *= 2;
+		pipeline->queue_head = 0;
+	}
+	// copy the request
+	for (i = 0; i < iovcnt; i++)
+		if (ydynabin_expand(pipeline->out, iov[i].iov_base, iov[i].iov_len) != YENOERR)
+			return (FINEDB_ERR_MEMORY);
+	pending = &pipeline->queue[(pipeline->queue_head + pipeline->pending) & (pipeline->queue_size - 1)];
+	pending->command = command;
+	pending->callback = callback;
+	pending->cb_data = cb_data;
+	pipeline->pending++;
+	// send if there is enough data
+	if (pipeline->out->len >= FINEDB_PIPELINE_FLUSH_SIZE)
+		return (_pipeline_send(pipeline));
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_pipeline_send
+ * Send buffered requests, without blocking. Responses are not read, so this
+ * function could be used from a callback.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_NETWORK if the connection was lost.
+ */
+static int _pipeline_send(finedb_pipeline_t *pipeline) {
+	ssize_t rc;
+
+	while (pipeline->out->len) {
+		rc = send(pipeline->client->sock, pipeline->out->data, pipeline->out->len, MSG_NOSIGNAL);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (rc <= 0) {
+			_pipeline_fail(pipeline);
+			return (FINEDB_ERR_NETWORK);
+		}
+		ydynabin_forward(pipeline->out, (size_t)rc);
+	}
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_pipeline_dispatch
+ * Parse the received responses and call their callbacks.
+ * @param	pipeline	Pointer to the pipeline.
+ * @return	FINEDB_OK if OK, FINEDB_ERR_NETWORK if a response is not valid.
+ */
+static int _pipeline_dispatch(finedb_pipeline_t *pipeline) {
+	ybin_t value;
+
+	while (pipeline->pending && pipeline->in->len) {
+		finedb_pending_t *pending = &pipeline->queue[pipeline->queue_head];
+		unsigned char *pt = (unsigned char*)pipeline->in->data;
+		unsigned char code = *pt;
+		uint64_t version_nbr;
+		uint32_t data_len;
+		size_t unzip_len;
+
+		ybin_set(&value, NULL, 0);
+		if (RESPONSE_STATUS(code) == RESP_OK && pending->command == PROTO_AGGREGATE) {
+			// AGGREGATE response: code, data size and result
+			finedb_aggregate_t result;
+			uint64_t values[6];
+
+			if (pipeline->in->len < 1 + sizeof(uint32_t))
+				break;
+			memcpy(&data_len, pt + 1, sizeof(uint32_t));
+			data_len = ntohl(data_len);
+			if (data_len != PROTO_AGGREGATE_RESULT_SIZE)
+				return (FINEDB_ERR_NETWORK);
+			if (pipeline->in->len < 1 + sizeof(uint32_t) + data_len)
+				break;
+			memcpy(values, pt + 1 + sizeof(uint32_t), sizeof(values));
+			result.count = be64toh(values[0]);
+			result.size = be64toh(values[1]);
+			result.numbers = be64toh(values[2]);
+			result.sum = (long long)be64toh(values[3]);
+			result.min = (long long)be64toh(values[4]);
+			result.max = (long long)be64toh(values[5]);
+			ybin_set(&value, &result, sizeof(result));
+			ydynabin_forward(pipeline->in, 1 + sizeof(uint32_t) + data_len);
+			_pipeline_call(pipeline, FINEDB_OK, value, 0);
+			continue;
+		}
+		if (RESPONSE_STATUS(code) != RESP_OK || pending->command != PROTO_GET) {
+			// simple response
+			ydynabin_forward(pipeline->in, 1);
+			_pipeline_call(pipeline, (RESPONSE_STATUS(code) == RESP_OK) ? FINEDB_OK : FINEDB_ERR_SERVER,
+			               value, 0);
+			continue;
+		}
+		// GET response: code, version, data size and data
+		if (pipeline->in->len < 1 + sizeof(uint64_t) + sizeof(uint32_t))
+			break;
+		memcpy(&version_nbr, pt + 1, sizeof(uint64_t));
+		memcpy(&data_len, pt + 1 + sizeof(uint64_t), sizeof(uint32_t));
+		data_len = ntohl(data_len);
+		if (pipeline->in->len < 1 + sizeof(uint64_t) + sizeof(uint32_t) + data_len)
+			break;
+		ybin_set(&value, pt + 1 + sizeof(uint64_t) + sizeof(uint32_t), data_len);
+		if (data_len && REQUEST_HAS_COMPRESSED(code)) {
+			// uncompress in the reused buffer
+			if (!snappy_uncompressed_length(value.data, value.len, &unzip_len))
+				return (FINEDB_ERR_NETWORK);
+			if (unzip_len > pipeline->unzip_size) {
+				YFREE(pipeline->unzip);
+				if ((pipeline->unzip = YMALLOC(unzip_len)) == NULL) {
+					pipeline->unzip_size = 0;
+					return (FINEDB_ERR_NETWORK);
+				}
+				pipeline->unzip_size = unzip_len;
+			}
+			if (snappy_uncompress(value.data, value.len, pipeline->unzip))
+				return (FINEDB_ERR_NETWORK);
+			ybin_set(&value, pipeline->unzip, unzip_len);
+		}
+		_pipeline_call(pipeline, FINEDB_OK, value, (unsigned long long)be64toh(version_nbr));
+		ydynabin_forward(pipeline->in, 1 + sizeof(uint64_t) + sizeof(uint32_t) + data_len);
+	}
+	return (FINEDB_OK);
+}
+
+/**
+ * @function	_pipeline_call
+ * Remove the oldest pending request from the queue, and call its callback.
+ * @param	pipeline	Pointer to the pipeline.
+ * @param	status		Result of the request.
+ * @param	value		Returned value.
+ * @param	version		Version of the returned value.
+ */
+static void _pipeline_call(finedb_pipeline_t *pipeline, int status, ybin_t value, unsigned long long version) {
+	finedb_pending_t pending = pipeline->queue[pipeline->queue_head];
+
+	// the queue is updated first, the callback could add new requests
+	pipeline->queue_head = (pipeline->queue_head + 1) & (pipeline->queue_size - 1);
+	pipeline->pending--;
+	if (pending.callback)
+		pending.callback(pending.cb_data, status, value, version);
+}
+
+/**
+ * @function	_pipeline_fail
+ * Call the callbacks of all pending requests with a network error, and
+ * empty the buffers.
+ * @param	pipeline	Pointer to the pipeline.
+ */
+static void _pipeline_fail(finedb_pipeline_t *pipeline) {
+	ybin_t empty;
+	size_t count = pipeline->pending;
+
+	ybin_set(&empty, NULL, 0);
+	ydynabin_forward(pipeline->out, pipeline->out->len);
+	ydynabin_forward(pipeline->in, pipeline->in->len);
+	// only the requests already sent (a callback could add new requests)
+	while (count-- && pipeline->pending)
+		_pipeline_call(pipeline, FINEDB_ERR_NETWORK, empty, 0);
+}
+
+/**
+ * @function	_pipeline_set_blocking
+ * Set a socket in blocking or non-blocking mode.
+ * @param	fd		File descriptor.
+ * @param	blocking	YTRUE for blocking mode.
+ * @return	0 if OK, -1 on error.
+ */
+static int _pipeline_set_blocking(int fd, ybool_t blocking) {
+	int flags;
+
+	if ((flags = fcntl(fd, F_GETFL, 0)) < 0)
+		return (-1);
+	flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+	return (fcntl(fd, F_SETFL, flags));
+}
@@ -0,0 +1,208 @@
+#include <string.h>
+#include <time.h>
+#include "libfinedb.h"
+
+/* private functions */
+static finedb_pool_t *_pool_create(const char *hostname, unsigned short port, const char *path,
+                                   unsigned int min, unsigned int max);
+static finedb_client_t *_pool_new_client(finedb_pool_t *pool);
+static void _pool_push(finedb_pool_t *pool, uint32_t slot);
+static int _pool_pop(finedb_pool_t *pool, uint32_t *slot);
+static ybool_t _pool_grow(finedb_pool_t *pool, uint32_t *slot);
+
+/* Create a pool of connections to a server. */
+finedb_pool_t *finedb_pool_create(const char *hostname, unsigned short port, unsigned int min, unsigned int max) {
+	return (_pool_create(hostname, port, NULL, min, max));
+}
+
+/* Create a pool of connections to a server's Unix socket. */
+finedb_pool_t *finedb_pool_create_unix(const char *path, unsigned int min, unsigned int max) {
+	return (_pool_create(NULL, 0, path, min, max));
+}
+
+/* Close all connections and destroy a pool. */
+void finedb_pool_delete(finedb_pool_t *pool) {
+	unsigned int i;
+
+	if (pool == NULL)
+		return;
+	for (i = 0; i < pool->count; i++)
+		if (pool->slots[i].client)
+			finedb_delete(pool->slots[i].client);
+	YFREE(pool->slots);
+	YFREE(pool->hostname);
+	YFREE(pool->unix_path);
+	YFREE(pool);
+}
+
+/* Take a connection from a pool. */
+finedb_client_t *finedb_pool_get(finedb_pool_t *pool, const char *dbname) {
+	struct timespec pause = {0, 1000000};
+	finedb_pooled_t *pooled;
+	finedb_client_t *client;
+	unsigned int waited = 0;
+	uint32_t slot;
+
+	// get a free connection, or create a new one, or wait for one
+	while (!_pool_pop(pool, &slot) && !_pool_grow(pool, &slot)) {
+		if (waited++ >= FINEDB_POOL_WAIT_MS)
+			return (NULL);
+		nanosleep(&pause, NULL);
+	}
+	pooled = &pool->slots[slot];
+	client = pooled->client;
+	// check the connection
+	if (client->sock < 0) {
+		if (finedb_connect(client) != FINEDB_OK)
+			goto error;
+	} else if (time(NULL) - pooled->last_used > FINEDB_POOL_CHECK_INTERVAL &&
+	           finedb_ping(client) != FINEDB_OK) {
+		if (finedb_connect(client) != FINEDB_OK)
+			goto error;
+	}
+	// select the database if needed
+	if ((dbname == NULL && client->dbname != NULL) ||
+	    (dbname != NULL && (client->dbname == NULL || strcmp(dbname, client->dbname)))) {
+		if (finedb_setdb(client, (char*)dbname) != FINEDB_OK) {
+			finedb_disconnect(client);
+			goto error;
+		}
+	}
+	return (client);
+error:
+	_pool_push(pool, slot);
+	return (NULL);
+}
+
+/* Give back a connection to its pool. */
+void finedb_pool_release(finedb_pool_t *pool, finedb_client_t *client, int status) {
+	finedb_pooled_t *pooled = &pool->slots[client->pool_slot];
+
+	// the stream could be desynchronized after a network error
+	if (status == FINEDB_ERR_NETWORK)
+		finedb_disconnect(client);
+	finedb_async(client);
+	pooled->last_used = time(NULL);
+	_pool_push(pool, client->pool_slot);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_pool_create
+ *		Create a pool of connections and open its first connections.
+ * @param	hostname	Server hostname, or NULL.
+ * @param	port		Port number.
+ * @param	path		Path to the server's Unix socket, or NULL.
+ * @param	min		Number of connections opened immediately.
+ * @param	max		Maximum number of connections.
+ * @return	A pointer to the allocated pool, or NULL.
+ */
+static finedb_pool_t *_pool_create(const char *hostname, unsigned short port, const char *path,
+                                   unsigned int min, unsigned int max) {
+	finedb_pool_t *pool;
+	uint32_t slot;
+	unsigned int i;
+
+	if (!max || min > max)
+		return (NULL);
+	if ((pool = YMALLOC(sizeof(finedb_pool_t))) == NULL)
+		return (NULL);
+	if ((pool->slots = YMALLOC(max * sizeof(finedb_pooled_t))) == NULL ||
+	    (hostname && (pool->hostname = strdup(hostname)) == NULL) ||
+	    (path && (pool->unix_path = strdup(path)) == NULL))
+		goto error;
+	pool->port = port;
+	pool->min = min;
+	pool->max = max;
+	// open the first connections
+	for (i = 0; i < min; i++) {
+		if (!_pool_grow(pool, &slot))
+			goto error;
+		if (finedb_connect(pool->slots[slot].client) != FINEDB_OK)
+			goto error;
+		pool->slots[slot].last_used = time(NULL);
+		_pool_push(pool, slot);
+	}
+	return (pool);
+error:
+	finedb_pool_delete(pool);
+	return (NULL);
+}
+
+/**
+ * @function	_pool_new_client
+ *		Create a client structure (not connected) for a pool.
+ * @param	pool	Pointer to the pool.
+ * @return	A pointer to the client structure, or NULL.
+ */
+static finedb_client_t *_pool_new_client(finedb_pool_t *pool) {
+	if (pool->unix_path)
+		return (finedb_create_unix(pool->unix_path));
+	return (finedb_create(pool->hostname, pool->port));
+}
+
+/**
+ * @function	_pool_push
+ *		Put a slot on the stack of free slots.
+ * @param	pool	Pointer to the pool.
+ * @param	slot	Index of the slot.
+ */
+static void _pool_push(finedb_pool_t *pool, uint32_t slot) {
+	uint64_t head, new_head;
+
+	head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+	do {
+		pool->slots[slot].next = (uint32_t)head;
+		new_head = ((head >> 32) + 1) << 32 | (slot + 1);
+	} while (!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, YFALSE,
+	                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @function	_pool_pop
+ *		Take a slot from the stack of free slots.
+ * @param	pool	Pointer to the pool.
+ * @param	slot	Pointer to the index of the slot.
+ * @return	1 if a slot was taken, 0 if the stack is empty.
+ */
+static int _pool_pop(finedb_pool_t *pool, uint32_t *slot) {
+	uint64_t head, new_head;
+	uint32_t index;
+
+	head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+	do {
+		if ((index = (uint32_t)head) == 0)
+			return (0);
+		new_head = ((head >> 32) + 1) << 32 | pool->slots[index - 1].next;
+	} while (!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, YFALSE,
+	                                      __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	*slot = index - 1;
+	return (1);
+}
+
+/**
+ * @function	_pool_grow
+ *		Reserve a new slot, if the pool is not full, and create its
+ *		client structure. The connection is opened later.
+ * @param	pool	Pointer to the pool.
+ * @param	slot	Pointer to the index of the slot.
+ * @return	YTRUE if a slot was created.
+ */
+static ybool_t _pool_grow(finedb_pool_t *pool, uint32_t *slot) {
+	finedb_client_t *client;
+	unsigned int count;
+
+	count = __atomic_load_n(&pool->count, __ATOMIC_ACQUIRE);
+	do {
+		if (count >= pool->max)
+			return (YFALSE);
+	} while (!__atomic_compare_exchange_n(&pool->count, &count, count + 1, YFALSE,
+	                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	// on allocation error, the slot is lost (it can't be given back safely)
+	if ((client = _pool_new_client(pool)) == NULL)
+		return (YFALSE);
+	client->pool_slot = count;
+	pool->slots[count].client = client;
+	*slot = count;
+	return (YTRUE);
+}
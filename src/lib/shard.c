@@ -0,0 +1,543 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "libfinedb.h"
+
+/**
+ * @typedef	shard_result_t
+ * Result of a request of a multi-key operation.
+ * @field	status	Result of the request.
+ * @field	value	Value returned by a GET request.
+ */
+typedef struct shard_result_s {
+	int status;
+	ybin_t value;
+} shard_result_t;
+
+/* private functions */
+static int _sharded_build(finedb_sharded_t *sharded, const char **servers, size_t nbr_servers,
+                          finedb_shard_t **pshards, finedb_ring_point_t **pring);
+static finedb_pool_t *_sharded_pool_create(const char *name, unsigned int min, unsigned int max);
+static int _sharded_point_cmp(const void *p1, const void *p2);
+static uint64_t _sharded_hash(const void *data, size_t len, uint32_t salt);
+static size_t _sharded_lookup(finedb_sharded_t *sharded, ybin_t key);
+static finedb_client_t *_sharded_client(finedb_sharded_t *sharded, const char *dbname, ybin_t key,
+                                        finedb_pool_t **ppool);
+static int _sharded_multi(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                          const ybin_t *values, ybool_t sync, shard_result_t *res);
+static void _sharded_callback(void *cb_data, int status, ybin_t value, unsigned long long version);
+
+/* Create a sharded client. */
+finedb_sharded_t *finedb_sharded_create(const char **servers, size_t nbr_servers,
+                                        unsigned int pool_min, unsigned int pool_max) {
+	finedb_sharded_t *sharded;
+
+	if ((sharded = YMALLOC(sizeof(finedb_sharded_t))) == NULL)
+		return (NULL);
+	if (pthread_rwlock_init(&sharded->lock, NULL)) {
+		YFREE(sharded);
+		return (NULL);
+	}
+	sharded->pool_min = pool_min;
+	sharded->pool_max = pool_max;
+	if (_sharded_build(sharded, servers, nbr_servers, &sharded->shards, &sharded->ring) != FINEDB_OK) {
+		pthread_rwlock_destroy(&sharded->lock);
+		YFREE(sharded);
+		return (NULL);
+	}
+	sharded->nbr_shards = nbr_servers;
+	sharded->ring_size = nbr_servers * FINEDB_SHARD_POINTS;
+	return (sharded);
+}
+
+/* Destroy a sharded client. */
+void finedb_sharded_delete(finedb_sharded_t *sharded) {
+	size_t i;
+
+	if (sharded == NULL)
+		return;
+	for (i = 0; i < sharded->nbr_shards; i++) {
+		finedb_pool_delete(sharded->shards[i].pool);
+		YFREE(sharded->shards[i].name);
+	}
+	YFREE(sharded->shards);
+	YFREE(sharded->ring);
+	pthread_rwlock_destroy(&sharded->lock);
+	YFREE(sharded);
+}
+
+/* Replace the list of servers. */
+int finedb_sharded_rebalance(finedb_sharded_t *sharded, const char **servers, size_t nbr_servers) {
+	finedb_shard_t *shards;
+	finedb_ring_point_t *ring;
+	size_t i;
+	int rc;
+
+	// wait for running requests
+	pthread_rwlock_wrlock(&sharded->lock);
+	if ((rc = _sharded_build(sharded, servers, nbr_servers, &shards, &ring)) != FINEDB_OK) {
+		pthread_rwlock_unlock(&sharded->lock);
+		return (rc);
+	}
+	// close the pools of removed servers (reused pools were taken)
+	for (i = 0; i < sharded->nbr_shards; i++) {
+		finedb_pool_delete(sharded->shards[i].pool);
+		YFREE(sharded->shards[i].name);
+	}
+	YFREE(sharded->shards);
+	YFREE(sharded->ring);
+	sharded->shards = shards;
+	sharded->nbr_shards = nbr_servers;
+	sharded->ring = ring;
+	sharded->ring_size = nbr_servers * FINEDB_SHARD_POINTS;
+	pthread_rwlock_unlock(&sharded->lock);
+	return (FINEDB_OK);
+}
+
+/* Give the server owning a key. */
+int finedb_sharded_server(finedb_sharded_t *sharded, ybin_t key) {
+	int server;
+
+	pthread_rwlock_rdlock(&sharded->lock);
+	server = (int)_sharded_lookup(sharded, key);
+	pthread_rwlock_unlock(&sharded->lock);
+	return (server);
+}
+
+/* Get a value from the server owning its key. */
+int finedb_sharded_get(finedb_sharded_t *sharded, const char *dbname, ybin_t key, ybin_t *data) {
+	finedb_client_t *client;
+	finedb_pool_t *pool;
+	int rc;
+
+	if ((client = _sharded_client(sharded, dbname, key, &pool)) == NULL)
+		return (FINEDB_ERR_NETWORK);
+	rc = finedb_get(client, key, data);
+	finedb_pool_release(pool, client, rc);
+	pthread_rwlock_unlock(&sharded->lock);
+	return (rc);
+}
+
+/* Put a key/value on the server owning the key. */
+int finedb_sharded_put(finedb_sharded_t *sharded, const char *dbname, ybin_t key, ybin_t data) {
+	finedb_client_t *client;
+	finedb_pool_t *pool;
+	int rc;
+
+	if ((client = _sharded_client(sharded, dbname, key, &pool)) == NULL)
+		return (FINEDB_ERR_NETWORK);
+	rc = finedb_put(client, key, data);
+	finedb_pool_release(pool, client, rc);
+	pthread_rwlock_unlock(&sharded->lock);
+	return (rc);
+}
+
+/* Remove a key from the server owning it. */
+int finedb_sharded_del(finedb_sharded_t *sharded, const char *dbname, ybin_t key) {
+	finedb_client_t *client;
+	finedb_pool_t *pool;
+	int rc;
+
+	if ((client = _sharded_client(sharded, dbname, key, &pool)) == NULL)
+		return (FINEDB_ERR_NETWORK);
+	rc = finedb_del(client, key);
+	finedb_pool_release(pool, client, rc);
+	pthread_rwlock_unlock(&sharded->lock);
+	return (rc);
+}
+
+/* Get several values, from all servers in parallel. */
+int finedb_sharded_mget(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                        ybin_t *values, int *results) {
+	shard_result_t *res;
+	size_t i;
+	int rc;
+
+	if ((res = YMALLOC(nbr * sizeof(shard_result_t) + 1)) == NULL)
+		return (FINEDB_ERR_MEMORY);
+	rc = _sharded_multi(sharded, dbname, nbr, keys, NULL, YFALSE, res);
+	for (i = 0; i < nbr; i++) {
+		values[i] = res[i].value;
+		if (results)
+			results[i] = res[i].status;
+		// a missing key is not an error
+		if (rc == FINEDB_OK && res[i].status != FINEDB_OK && res[i].status != FINEDB_ERR_SERVER)
+			rc = res[i].status;
+	}
+	YFREE(res);
+	return (rc);
+}
+
+/* Put several key/values, on all servers in parallel. */
+int finedb_sharded_mput(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                        const ybin_t *values, ybool_t sync, int *results) {
+	shard_result_t *res;
+	size_t i;
+	int rc;
+
+	if ((res = YMALLOC(nbr * sizeof(shard_result_t) + 1)) == NULL)
+		return (FINEDB_ERR_MEMORY);
+	rc = _sharded_multi(sharded, dbname, nbr, keys, values, sync, res);
+	for (i = 0; i < nbr; i++) {
+		if (results)
+			results[i] = res[i].status;
+		if (rc == FINEDB_OK && res[i].status != FINEDB_OK)
+			rc = res[i].status;
+	}
+	YFREE(res);
+	return (rc);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_sharded_build
+ *		Create the servers and the hash ring of a server list. Pools
+ *		of servers already known are reused (and removed from the
+ *		current list), new ones are created.
+ * @param	sharded		Pointer to the sharded client.
+ * @param	servers		Array of server addresses.
+ * @param	nbr_servers	Number of servers.
+ * @param	pshards		Pointer to the created array of servers.
+ * @param	pring		Pointer to the created ring.
+ * @return	FINEDB_OK if OK. On error, the current list is not modified.
+ */
+static int _sharded_build(finedb_sharded_t *sharded, const char **servers, size_t nbr_servers,
+                          finedb_shard_t **pshards, finedb_ring_point_t **pring) {
+	finedb_shard_t *shards;
+	finedb_ring_point_t *ring;
+	size_t i, j, name_len;
+	uint32_t point;
+	int rc = FINEDB_ERR_MEMORY;
+
+	if (!nbr_servers || sharded->pool_max == 0)
+		return (FINEDB_ERR_VALUE);
+	shards = YMALLOC(nbr_servers * sizeof(finedb_shard_t));
+	ring = YMALLOC(nbr_servers * FINEDB_SHARD_POINTS * sizeof(finedb_ring_point_t));
+	if (shards == NULL || ring == NULL)
+		goto error;
+	// create the pools of new servers
+	for (i = 0; i < nbr_servers; i++) {
+		for (j = 0; j < i; j++) {
+			if (!strcmp(servers[i], servers[j])) {
+				rc = FINEDB_ERR_VALUE;
+				goto error;
+			}
+		}
+		if ((shards[i].name = strdup(servers[i])) == NULL)
+			goto error;
+		for (j = 0; j < sharded->nbr_shards; j++)
+			if (!strcmp(servers[i], sharded->shards[j].name))
+				break;
+		if (j < sharded->nbr_shards)
+			continue;
+		if ((shards[i].pool = _sharded_pool_create(servers[i], sharded->pool_min,
+		                                           sharded->pool_max)) == NULL) {
+			rc = FINEDB_ERR_NETWORK;
+			goto error;
+		}
+	}
+	// take the pools of known servers
+	for (i = 0; i < nbr_servers; i++) {
+		for (j = 0; j < sharded->nbr_shards; j++) {
+			if (!strcmp(servers[i], sharded->shards[j].name)) {
+				shards[i].pool = sharded->shards[j].pool;
+				sharded->shards[j].pool = NULL;
+			}
+		}
+	}
+	// points of the ring, placed from the servers' names
+	for (i = 0; i < nbr_servers; i++) {
+		name_len = strlen(shards[i].name);
+		for (point = 0; point < FINEDB_SHARD_POINTS; point++) {
+			ring[i * FINEDB_SHARD_POINTS + point].hash = _sharded_hash(shards[i].name, name_len, point + 1);
+			ring[i * FINEDB_SHARD_POINTS + point].shard = i;
+		}
+	}
+	qsort(ring, nbr_servers * FINEDB_SHARD_POINTS, sizeof(finedb_ring_point_t), _sharded_point_cmp);
+	*pshards = shards;
+	*pring = ring;
+	return (FINEDB_OK);
+error:
+	// only new pools were set
+	for (i = 0; shards && i < nbr_servers; i++) {
+		finedb_pool_delete(shards[i].pool);
+		YFREE(shards[i].name);
+	}
+	YFREE(shards);
+	YFREE(ring);
+	return (rc);
+}
+
+/**
+ * @function	_sharded_pool_create
+ *		Create a pool of connections from a server address.
+ * @param	name	Server address.
+ * @param	min	Number of connections opened immediately.
+ * @param	max	Maximum number of connections.
+ * @return	A pointer to the pool, or NULL.
+ */
+static finedb_pool_t *_sharded_pool_create(const char *name, unsigned int min, unsigned int max) {
+	char hostname[256], *end;
+	const char *pt, *host_end;
+	unsigned long port = FINEDB_DEFAULT_PORT;
+	size_t len;
+
+	if (name[0] == '/')
+		return (finedb_pool_create_unix(name, min, max));
+	if (name[0] == '[') {
+		// "[IPv6]" or "[IPv6]:port"
+		if ((host_end = strchr(name, ']')) == NULL)
+			return (NULL);
+		pt = name + 1;
+		len = host_end - pt;
+		host_end++;
+	} else {
+		// "host" or "host:port" (an IPv6 address without brackets has no port)
+		pt = name;
+		host_end = strchr(name, ':');
+		if (host_end == NULL || strchr(host_end + 1, ':'))
+			host_end = name + strlen(name);
+		len = host_end - pt;
+	}
+	if (*host_end == ':') {
+		errno = 0;
+		port = strtoul(host_end + 1, &end, 10);
+		if (errno || *end || !port || port > 65535)
+			return (NULL);
+	} else if (*host_end)
+		return (NULL);
+	if (!len || len >= sizeof(hostname))
+		return (NULL);
+	memcpy(hostname, pt, len);
+	hostname[len] = '\0';
+	return (finedb_pool_create(hostname, (unsigned short)port, min, max));
+}
+
+/**
+ * @function	_sharded_point_cmp
+ *		Compare two points of the ring, for qsort().
+ * @param	p1	Pointer to the first point.
+ * @param	p2	Pointer to the second point.
+ * @return	-1, 0 or 1.
+ */
+static int _sharded_point_cmp(const void *p1, const void *p2) {
+	const finedb_ring_point_t *point1 = p1, *point2 = p2;
+
+	if (point1->hash != point2->hash)
+		return ((point1->hash < point2->hash) ? -1 : 1);
+	if (point1->shard != point2->shard)
+		return ((point1->shard < point2->shard) ? -1 : 1);
+	return (0);
+}
+
+/**
+ * @function	_sharded_hash
+ *		Compute the position of a key or a server's point on the ring:
+ *		64 bits FNV-1a, followed by the MurmurHash3 finalizer to
+ *		spread close inputs over the whole ring.
+ * @param	data	Pointer to the data.
+ * @param	len	Size of the data.
+ * @param	salt	Index of the server's point (0 for a key).
+ * @return	The hash value.
+ */
+static uint64_t _sharded_hash(const void *data, size_t len, uint32_t salt) {
+	const unsigned char *pt = data;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= pt[i];
+		hash *= 0x100000001b3ULL;
+	}
+	for (i = 0; salt && i < sizeof(salt); i++) {
+		hash ^= (salt >> (i * 8)) & 0xff;
+		hash *= 0x100000001b3ULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return (hash);
+}
+
+/**
+ * @function	_sharded_lookup
+ *		Find the server owning a key: the first point of the ring
+ *		following the key's hash. The lock must be held.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	key	Pointer to the key content.
+ * @return	The index of the server.
+ */
+static size_t _sharded_lookup(finedb_sharded_t *sharded, ybin_t key) {
+	uint64_t hash = _sharded_hash(key.data, key.len, 0);
+	size_t low = 0, high = sharded->ring_size, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (sharded->ring[mid].hash < hash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	// after the last point, back to the first one
+	if (low == sharded->ring_size)
+		low = 0;
+	return (sharded->ring[low].shard);
+}
+
+/**
+ * @function	_sharded_client
+ *		Take the lock, and a connection to the server owning a key.
+ *		The caller must release the connection, then the lock.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default one.
+ * @param	key	Pointer to the key content.
+ * @param	ppool	Pointer to the pool of the connection.
+ * @return	A pointer to the client structure, or NULL (the lock is then
+ *		released).
+ */
+static finedb_client_t *_sharded_client(finedb_sharded_t *sharded, const char *dbname, ybin_t key,
+                                        finedb_pool_t **ppool) {
+	finedb_client_t *client;
+
+	pthread_rwlock_rdlock(&sharded->lock);
+	*ppool = sharded->shards[_sharded_lookup(sharded, key)].pool;
+	if ((client = finedb_pool_get(*ppool, dbname)) == NULL)
+		pthread_rwlock_unlock(&sharded->lock);
+	return (client);
+}
+
+/**
+ * @function	_sharded_multi
+ *		Execute GET or PUT requests on several keys. Keys are split by
+ *		server; the requests of a server are pipelined on one of its
+ *		connections, and all the connections are processed together.
+ * @param	sharded	Pointer to the sharded client.
+ * @param	dbname	Name of the database, or NULL for the default one.
+ * @param	nbr	Number of keys.
+ * @param	keys	Array of keys.
+ * @param	values	Array of values for PUT requests. NULL for GET requests.
+ * @param	sync	YTRUE for synchronous PUT requests.
+ * @param	res	Array of results.
+ * @return	FINEDB_OK if OK, or an error if no request could be sent.
+ */
+static int _sharded_multi(finedb_sharded_t *sharded, const char *dbname, size_t nbr, const ybin_t *keys,
+                          const ybin_t *values, ybool_t sync, shard_result_t *res) {
+	finedb_client_t **clients = NULL;
+	finedb_pipeline_t **pipelines = NULL;
+	struct pollfd *fds = NULL;
+	size_t *owners = NULL, *polled = NULL, nbr_shards, nbr_fds, i;
+	int *statuses = NULL, rc = FINEDB_OK;
+
+	for (i = 0; i < nbr; i++) {
+		res[i].status = FINEDB_ERR_NETWORK;
+		ybin_set(&res[i].value, NULL, 0);
+	}
+	pthread_rwlock_rdlock(&sharded->lock);
+	nbr_shards = sharded->nbr_shards;
+	if ((clients = YMALLOC(nbr_shards * sizeof(finedb_client_t*))) == NULL ||
+	    (pipelines = YMALLOC(nbr_shards * sizeof(finedb_pipeline_t*))) == NULL ||
+	    (fds = YMALLOC(nbr_shards * sizeof(struct pollfd))) == NULL ||
+	    (polled = YMALLOC(nbr_shards * sizeof(size_t))) == NULL ||
+	    (statuses = YMALLOC(nbr_shards * sizeof(int))) == NULL ||
+	    (owners = YMALLOC(nbr * sizeof(size_t) + 1)) == NULL) {
+		rc = FINEDB_ERR_MEMORY;
+		goto end_of_process;
+	}
+	// split the keys by server, and open a pipeline on each used server
+	for (i = 0; i < nbr; i++) {
+		size_t shard = owners[i] = _sharded_lookup(sharded, keys[i]);
+
+		if (clients[shard] != NULL || statuses[shard] != FINEDB_OK)
+			continue;
+		if ((clients[shard] = finedb_pool_get(sharded->shards[shard].pool, dbname)) == NULL) {
+			statuses[shard] = FINEDB_ERR_NETWORK;
+			continue;
+		}
+		if (sync)
+			finedb_sync(clients[shard]);
+		if ((pipelines[shard] = finedb_pipeline_create(clients[shard])) == NULL)
+			statuses[shard] = FINEDB_ERR_NETWORK;
+	}
+	// queue the requests
+	for (i = 0; i < nbr; i++) {
+		finedb_pipeline_t *pipeline = pipelines[owners[i]];
+		int status;
+
+		if (pipeline == NULL)
+			continue;
+		if (values)
+			status = finedb_pipeline_put(pipeline, keys[i], values[i], _sharded_callback, &res[i]);
+		else
+			status = finedb_pipeline_get(pipeline, keys[i], _sharded_callback, &res[i]);
+		if (status != FINEDB_OK)
+			res[i].status = status;
+	}
+	// send the requests and read the responses of all servers
+	for (; ; ) {
+		for (i = 0, nbr_fds = 0; i < nbr_shards; i++) {
+			if (pipelines[i] == NULL || !finedb_pipeline_pending(pipelines[i]))
+				continue;
+			fds[nbr_fds].fd = finedb_pipeline_fd(pipelines[i]);
+			fds[nbr_fds].events = finedb_pipeline_events(pipelines[i]);
+			fds[nbr_fds].revents = 0;
+			polled[nbr_fds++] = i;
+		}
+		if (!nbr_fds)
+			break;
+		if (poll(fds, nbr_fds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = FINEDB_ERR_NETWORK;
+			break;
+		}
+		for (i = 0; i < nbr_fds; i++) {
+			if (fds[i].revents &&
+			    finedb_pipeline_process(pipelines[polled[i]]) != FINEDB_OK)
+				statuses[polled[i]] = FINEDB_ERR_NETWORK;
+		}
+	}
+end_of_process:
+	// close the pipelines and give back the connections
+	for (i = 0; clients && i < nbr_shards; i++) {
+		if (pipelines && pipelines[i]) {
+			if (finedb_pipeline_pending(pipelines[i]))
+				statuses[i] = FINEDB_ERR_NETWORK;
+			finedb_pipeline_delete(pipelines[i]);
+		}
+		if (clients[i])
+			finedb_pool_release(sharded->shards[i].pool, clients[i], statuses ? statuses[i] : FINEDB_OK);
+	}
+	pthread_rwlock_unlock(&sharded->lock);
+	YFREE(clients);
+	YFREE(pipelines);
+	YFREE(fds);
+	YFREE(polled);
+	YFREE(statuses);
+	YFREE(owners);
+	return (rc);
+}
+
+/**
+ * @function	_sharded_callback
+ *		Store the result of a pipelined request. A returned value is copied.
+ * @param	cb_data	Pointer to the result.
+ * @param	status	Result of the request.
+ * @param	value	Returned value.
+ * @param	version	Version of the value.
+ */
+static void _sharded_callback(void *cb_data, int status, ybin_t value, unsigned long long version) {
+	shard_result_t *res = cb_data;
+
+	res->status = status;
+	if (status != FINEDB_OK || value.data == NULL)
+		return;
+	if ((res->value.data = YMALLOC(value.len + 1)) == NULL) {
+		res->status = FINEDB_ERR_MEMORY;
+		return;
+	}
+	memcpy(res->value.data, value.data, value.len);
+	res->value.len = value.len;
+}
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "transport.h"
+
+/* private functions */
+static int _transport_sort(struct addrinfo *res, struct addrinfo **addrs);
+static int _transport_start(struct addrinfo *addr);
+static int _transport_wait_time(unsigned long long now, unsigned long long next, unsigned long long deadline);
+
+/* Resolve the hostname and connect to the server. */
+int transport_connect_tcp(finedb_client_t *client) {
+	struct addrinfo hints, *res = NULL, *addrs[TRANSPORT_MAX_ADDRS];
+	struct pollfd fds[TRANSPORT_MAX_ADDRS];
+	unsigned long long now, next, deadline = 0;
+	char port[8];
+	int nbr_addrs, started = 0, pending = 0, sock = -1, err, i;
+	socklen_t err_len;
+
+	// name resolution
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+	snprintf(port, sizeof(port), "%hu", client->port);
+	if (getaddrinfo(client->hostname, port, &hints, &res) || res == NULL)
+		return (-1);
+	nbr_addrs = _transport_sort(res, addrs);
+	// connection attempts
+	now = next = transport_now();
+	if (client->connect_timeout)
+		deadline = now + (unsigned long long)client->connect_timeout * 1000;
+	while (sock < 0) {
+		// start a new attempt
+		if (started < nbr_addrs && now >= next) {
+			if ((fds[pending].fd = _transport_start(addrs[started++])) >= 0) {
+				fds[pending].events = POLLOUT;
+				fds[pending].revents = 0;
+				pending++;
+				next = now + TRANSPORT_ATTEMPT_DELAY * 1000;
+			}
+			continue;
+		}
+		if (!pending && started >= nbr_addrs)
+			break;
+		if (deadline && now >= deadline)
+			break;
+		// wait for a connection
+		if (poll(fds, pending, _transport_wait_time(now, (started < nbr_addrs) ? next : 0, deadline)) < 0 &&
+		    errno != EINTR)
+			break;
+		now = transport_now();
+		for (i = 0; i < pending; i++) {
+			if (!fds[i].revents)
+				continue;
+			err = 0;
+			err_len = sizeof(err);
+			if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0) {
+				sock = fds[i].fd;
+				fds[i] = fds[--pending];
+				break;
+			}
+			// failed attempt: the next address is tried immediately
+			close(fds[i].fd);
+			fds[i--] = fds[--pending];
+			next = now;
+		}
+	}
+	// close the other attempts
+	for (i = 0; i < pending; i++)
+		close(fds[i].fd);
+	freeaddrinfo(res);
+	if (sock < 0)
+		return (-1);
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+	transport_set_options(client, sock);
+	return (sock);
+}
+
+/* Connect to the server's Unix socket. */
+int transport_connect_unix(finedb_client_t *client) {
+	struct sockaddr_un addr;
+	int sock;
+
+	bzero(&addr, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, client->unix_path, sizeof(addr.sun_path) - 1);
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return (-1);
+	if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(sock);
+		return (-1);
+	}
+	transport_set_options(client, sock);
+	return (sock);
+}
+
+/* Apply the client's options on its socket. */
+void transport_set_options(finedb_client_t *client, int sock) {
+	const int on = 1;
+	int size;
+	struct timeval tv;
+
+	// TCP options
+	if (client->hostname) {
+		if (client->nodelay)
+			setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		if (client->keepalive)
+			setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+	}
+	// buffer sizes
+	if (client->buffer_size > 0) {
+		size = client->buffer_size;
+		setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+	// I/O timeouts
+	tv.tv_sec = client->io_timeout / 1000;
+	tv.tv_usec = (client->io_timeout % 1000) * 1000;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/* Return the current time of a monotonic clock. */
+unsigned long long transport_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_transport_sort
+ * Sort resolved addresses, alternating address families. The order given
+ * by getaddrinfo() (RFC 6724) is kept inside each family.
+ * @param	res	List of addresses given by getaddrinfo().
+ * @param	addrs	Array of sorted addresses.
+ * @return	The number of addresses.
+ */
+static int _transport_sort(struct addrinfo *res, struct addrinfo **addrs) {
+	struct addrinfo *first[2], *pt;
+	int nbr = 0, family = 0, f;
+
+	// first address of each family
+	first[0] = res;
+	for (first[1] = res; first[1] && first[1]->ai_family == res->ai_family; first[1] = first[1]->ai_next)
+		;
+	while (nbr < TRANSPORT_MAX_ADDRS && (first[0] || first[1])) {
+		f = first[family] ? family : !family;
+		addrs[nbr++] = first[f];
+		// next address of the same family
+		for (pt = first[f]->ai_next; pt && pt->ai_family != first[f]->ai_family; pt = pt->ai_next)
+			;
+		first[f] = pt;
+		family = !f;
+	}
+	return (nbr);
+}
+
+/**
+ * @function	_transport_start
+ * Start a non-blocking connection.
+ * @param	addr	Address of the server.
+ * @return	The socket, or -1 if the attempt failed immediately.
+ */
+static int _transport_start(struct addrinfo *addr) {
+	int sock;
+
+	if ((sock = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	                   addr->ai_protocol)) < 0)
+		return (-1);
+	if (connect(sock, addr->ai_addr, addr->ai_addrlen) < 0 && errno != EINPROGRESS) {
+		close(sock);
+		return (-1);
+	}
+	return (sock);
+}
+
+/**
+ * @function	_transport_wait_time
+ * Compute the poll() timeout, until the next attempt or the deadline.
+ * @param	now		Current time (microseconds).
+ * @param	next		Time of the next attempt. 0 if none.
+ * @param	deadline	Deadline of the connection. 0 if none.
+ * @return	The timeout in milliseconds, -1 for no limit.
+ */
+static int _transport_wait_time(unsigned long long now, unsigned long long next, unsigned long long deadline) {
+	unsigned long long limit = next;
+
+	if (deadline && (!limit || deadline < limit))
+		limit = deadline;
+	if (!limit)
+		return (-1);
+	if (limit <= now)
+		return (0);
+	return ((int)((limit - now + 999) / 1000));
+}
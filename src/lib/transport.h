@@ -0,0 +1,51 @@
+#ifndef __TRANSPORT_H__
+#define __TRANSPORT_H__
+
+#include "libfinedb.h"
+
+/**
+ * @define	TRANSPORT_ATTEMPT_DELAY
+ * Delay (milliseconds) before starting a connection attempt to the next
+ * address, while the previous attempts are still pending (RFC 8305).
+ */
+#define TRANSPORT_ATTEMPT_DELAY	250
+
+/** @define TRANSPORT_MAX_ADDRS Maximum number of addresses tried for a hostname. */
+#define TRANSPORT_MAX_ADDRS	16
+
+/**
+ * @function	transport_connect_tcp
+ * Resolve the client's hostname and connect to the server. All the
+ * addresses are tried, IPv6 and IPv4 alternately ("happy eyeballs"): a new
+ * attempt starts every TRANSPORT_ATTEMPT_DELAY milliseconds, or as soon as
+ * the previous one fails, and the first established connection is kept.
+ * @param	client	Pointer to the client structure.
+ * @return	The connected socket, or -1.
+ */
+int transport_connect_tcp(finedb_client_t *client);
+
+/**
+ * @function	transport_connect_unix
+ * Connect to the server's Unix socket.
+ * @param	client	Pointer to the client structure.
+ * @return	The connected socket, or -1.
+ */
+int transport_connect_unix(finedb_client_t *client);
+
+/**
+ * @function	transport_set_options
+ * Apply the client's options (TCP_NODELAY, keepalive, buffer sizes and I/O
+ * timeouts) on its socket.
+ * @param	client	Pointer to the client structure.
+ * @param	sock	Socket.
+ */
+void transport_set_options(finedb_client_t *client, int sock);
+
+/**
+ * @function	transport_now
+ * Return the current time of a monotonic clock.
+ * @return	The time in microseconds.
+ */
+unsigned long long transport_now(void);
+
+#endif /* __TRANSPORT_H__ */
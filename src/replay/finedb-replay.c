@@ -0,0 +1,922 @@
+/**
+ * finedb-replay
+ * Replay a trace of requests, recorded by a FineDB server (option -r),
+ * against a server.
+ *
+ * @author	Amaury Bouchard <amaury@amaury.net>
+ * @copyright	© 2013, Amaury Bouchard
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include "ydefs.h"
+#include "libfinedb.h"
+#include "protocol.h"
+#include "stats.h"
+#include "capture.h"
+
+/** @define DEFAULT_HOST Default hostname of the server. */
+#define DEFAULT_HOST		"localhost"
+/** @define DEFAULT_PORT Default port number of the server. */
+#define DEFAULT_PORT		11138
+/** @define DEFAULT_CONNECTIONS Default number of simultaneous connections at maximum speed. */
+#define DEFAULT_CONNECTIONS	256
+/** @define REPLAY_WINDOW Maximum number of requests waiting for their responses on a connection. */
+#define REPLAY_WINDOW		1024
+/** @define REPLAY_POLL_MS Maximum time of a wait, to check for an interruption. */
+#define REPLAY_POLL_MS		100
+/** @define RECV_SIZE Initial size of the receive buffers. */
+#define RECV_SIZE		65536
+
+/**
+ * @typedef	replay_frame_t
+ *		A recorded request.
+ * @field	time	Time of the request in the trace (nanoseconds since
+ *			the beginning of the capture).
+ * @field	seq	Position of the record in the trace.
+ * @field	id	Connection ID.
+ * @field	len	Size of the frame.
+ * @field	data	Pointer to the frame, in the mapped trace.
+ * @field	start	Time from which the latency is measured. At maximum
+ *			speed, it is the time the request was sent; otherwise
+ *			it is the time it should have been sent, so the delays
+ *			of the previous requests are counted.
+ */
+typedef struct replay_frame_s {
+	uint64_t time;
+	uint64_t seq;
+	uint32_t id;
+	uint32_t len;
+	const unsigned char *data;
+	uint64_t start;
+} replay_frame_t;
+
+/**
+ * @typedef	replay_connection_t
+ *		A recorded connection, replayed on its own connection.
+ * @field	id		Connection ID.
+ * @field	frames		Requests of the connection, in order.
+ * @field	nbr_frames	Number of requests.
+ * @field	sent		Number of completely sent requests.
+ * @field	offset		Number of sent bytes of the next request.
+ * @field	answered	Number of received responses.
+ * @field	client		Client structure.
+ * @field	fd		Socket descriptor.
+ * @field	transaction	YTRUE while a transaction is running (all
+ *				requests are then synchronous).
+ * @field	blocked		YTRUE if the socket can't take more data.
+ * @field	done		YTRUE when the connection is finished.
+ * @field	in		Receive buffer.
+ * @field	in_len		Number of bytes in the receive buffer.
+ * @field	in_size		Size of the receive buffer.
+ */
+typedef struct replay_connection_s {
+	uint32_t id;
+	replay_frame_t *frames;
+	size_t nbr_frames;
+	size_t sent;
+	size_t offset;
+	size_t answered;
+	finedb_client_t *client;
+	int fd;
+	ybool_t transaction;
+	ybool_t blocked;
+	ybool_t done;
+	char *in;
+	size_t in_len;
+	size_t in_size;
+} replay_connection_t;
+
+/**
+ * @typedef	replay_thread_t
+ *		A replay thread, driving its connections in an event loop.
+ * @field	tid		Thread identifier.
+ * @field	nbr_connections	Number of connections.
+ * @field	connections	Connections, by time of their first request.
+ * @field	next		Index of the next connection to open.
+ * @field	open		Number of open connections.
+ * @field	max_open	Maximum number of open connections, at maximum
+ *				speed.
+ * @field	pfds		Array of poll structures.
+ * @field	polled		Connections of the poll structures.
+ * @field	stats		Latency histograms of the thread.
+ * @field	lag		Greatest delay between the time a request should
+ *				have been sent and the time it was sent.
+ * @field	lost		Number of requests without response.
+ */
+typedef struct replay_thread_s {
+	pthread_t tid;
+	size_t nbr_connections;
+	replay_connection_t **connections;
+	size_t next;
+	size_t open;
+	size_t max_open;
+	struct pollfd *pfds;
+	replay_connection_t **polled;
+	stats_thread_t *stats;
+	uint64_t lag;
+	uint64_t lost;
+} replay_thread_t;
+
+/**
+ * @typedef	replay_config_t
+ *		Configuration of the replay.
+ * @field	hostname	Hostname of the server.
+ * @field	port		Port number of the server.
+ * @field	unix_path	Path to the server's Unix socket. NULL for TCP.
+ * @field	trace_path	Path to the trace file.
+ * @field	speed		Speed factor (1 for the original speed), 0 for
+ *				the maximum speed.
+ * @field	nbr_threads	Number of threads.
+ * @field	max_connections	Maximum number of simultaneous connections, at
+ *				maximum speed.
+ * @field	depth		Number of pipelined requests per connection, at
+ *				maximum speed.
+ * @field	hdr		YTRUE to print the percentile distributions.
+ * @field	json_path	Path of the JSON results file ("-" for stdout).
+ */
+typedef struct replay_config_s {
+	char *hostname;
+	unsigned short port;
+	char *unix_path;
+	char *trace_path;
+	double speed;
+	unsigned int nbr_threads;
+	unsigned int max_connections;
+	unsigned int depth;
+	ybool_t hdr;
+	char *json_path;
+} replay_config_t;
+
+/**
+ * @typedef	replay_trace_t
+ *		A loaded trace.
+ * @field	date		Date of the beginning of the capture (Unix time,
+ *				milliseconds).
+ * @field	nbr_frames	Number of requests.
+ * @field	frames		Requests, sorted by connection.
+ * @field	nbr_connections	Number of replayed connections.
+ * @field	connections	Connections, by time of their first request.
+ * @field	cut		Number of connections cut at a request that
+ *				couldn't be replayed.
+ * @field	skipped		Number of requests not replayed.
+ * @field	first		Time of the first request.
+ * @field	last		Time of the last request.
+ */
+typedef struct replay_trace_s {
+	uint64_t date;
+	size_t nbr_frames;
+	replay_frame_t *frames;
+	size_t nbr_connections;
+	replay_connection_t *connections;
+	size_t cut;
+	size_t skipped;
+	uint64_t first;
+	uint64_t last;
+} replay_trace_t;
+
+/* Names of the commands. */
+static const char *command_names[STATS_COMMANDS] = {
+	"ping", "get", "del", "put", "setdb", "start", "stop", "aggregate",
+	"merge", "cas", "shm", "batch", "track", "0xd", "admin", "extra"
+};
+
+/* Global variables. */
+static replay_config_t config_g;
+static replay_trace_t trace_g;
+static stats_t *stats_g;
+static uint64_t start_g;
+static volatile sig_atomic_t stop_g = 0;
+
+/* *** function declarations *** */
+static void usage(void);
+static void signal_handler(int sig);
+static int load_trace(const char *path);
+static ybool_t replayable(const replay_frame_t *frame);
+static int compare_frames(const void *p1, const void *p2);
+static int compare_connections(const void *p1, const void *p2);
+static replay_thread_t *replay_prepare(void);
+static void *replay_thread(void *param);
+static int replay_open(replay_connection_t *conn);
+static void replay_send(replay_thread_t *thread, replay_connection_t *conn, uint64_t now, uint64_t *wakeup);
+static void replay_receive(replay_thread_t *thread, replay_connection_t *conn);
+static size_t replay_response_size(replay_connection_t *conn, const unsigned char *buf, size_t len);
+static void replay_close(replay_thread_t *thread, replay_connection_t *conn, ybool_t failed);
+static uint64_t schedule(const replay_frame_t *frame);
+static void histogram_add(stats_histogram_t *histogram, stats_histogram_t *src);
+static void report(replay_thread_t *threads, double duration, FILE *json);
+static void report_hdr(const char *name, ybool_t sync, stats_histogram_t *histogram);
+
+/** Usage function. */
+static void usage() {
+	printf("Usage: finedb-replay [-h host] [-p port] [-u path] [-s speed] [-t threads] [-c connections]\n"
+	       "                     [-d depth] [-j path] [-H] trace_file\n"
+	       "\t-h host        Hostname of the server (default: %s).\n"
+	       "\t-p port        Port number of the server (default: %d).\n"
+	       "\t-u path        Path to the Unix socket of the server.\n"
+	       "\t-s speed       Speed factor: 1 for the original speed (default), 2 for twice as fast,\n"
+	       "\t               0.5 for half as fast, 'max' for the maximum speed. Latencies are measured\n"
+	       "\t               from the time each request should have been sent, except at maximum speed.\n"
+	       "\t-t threads     Number of threads (default: 1).\n"
+	       "\t-c connections Maximum number of simultaneous connections at maximum speed (default: %d).\n"
+	       "\t-d depth       Number of pipelined requests per connection at maximum speed (default: 1).\n"
+	       "\t-j path        Write the results in JSON to this file (\"-\" for stdout).\n"
+	       "\t-H             Print the latency percentile distributions (HdrHistogram format).\n"
+	       "\n"
+	       "The requests of each recorded connection are sent in order on their own connection.\n"
+	       "Connections are cut before SHM and TRACK subscription requests, which can't be replayed.\n"
+	       "\n", DEFAULT_HOST, DEFAULT_PORT, DEFAULT_CONNECTIONS);
+}
+
+/** Signal handler. */
+static void signal_handler(int sig) {
+	stop_g = 1;
+}
+
+/**
+ * Main function of the program.
+ */
+int main(int argc, char *argv[]) {
+	char *optstr = "h:p:u:s:t:c:d:j:H";
+	replay_thread_t *threads;
+	FILE *json = NULL;
+	unsigned int i;
+	int opt;
+
+	// default configuration
+	bzero(&config_g, sizeof(config_g));
+	config_g.hostname = DEFAULT_HOST;
+	config_g.port = DEFAULT_PORT;
+	config_g.speed = 1.0;
+	config_g.nbr_threads = 1;
+	config_g.max_connections = DEFAULT_CONNECTIONS;
+	config_g.depth = 1;
+	// parse command line parameters
+	while ((opt = getopt(argc, argv, optstr)) != -1) {
+		switch (opt) {
+		case 'h':
+			config_g.hostname = optarg;
+			break;
+		case 'p':
+			config_g.port = (unsigned short)atoi(optarg);
+			break;
+		case 'u':
+			config_g.unix_path = optarg;
+			break;
+		case 's':
+			config_g.speed = strcasecmp(optarg, "max") ? atof(optarg) : 0.0;
+			break;
+		case 't':
+			config_g.nbr_threads = (unsigned int)atoi(optarg);
+			break;
+		case 'c':
+			config_g.max_connections = (unsigned int)atoi(optarg);
+			break;
+		case 'd':
+			config_g.depth = (unsigned int)atoi(optarg);
+			break;
+		case 'j':
+			config_g.json_path = optarg;
+			break;
+		case 'H':
+			config_g.hdr = YTRUE;
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	// check the configuration
+	if (optind != argc - 1) {
+		usage();
+		exit(1);
+	}
+	config_g.trace_path = argv[optind];
+	if (!config_g.nbr_threads || !config_g.max_connections || !config_g.depth || config_g.speed < 0.0 ||
+	    config_g.max_connections < config_g.nbr_threads) {
+		fprintf(stderr, "Bad configuration (there must be at least one connection per thread).\n");
+		exit(1);
+	}
+	if (config_g.json_path) {
+		if (!strcmp(config_g.json_path, "-"))
+			json = stdout;
+		else if ((json = fopen(config_g.json_path, "w")) == NULL) {
+			fprintf(stderr, "Unable to open '%s'.\n", config_g.json_path);
+			exit(1);
+		}
+	}
+	// trace loading
+	if (load_trace(config_g.trace_path))
+		exit(2);
+	if (!trace_g.nbr_connections) {
+		fprintf(stderr, "No request to replay.\n");
+		exit(0);
+	}
+	signal(SIGINT, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+	if ((stats_g = stats_new()) == NULL || (threads = replay_prepare()) == NULL) {
+		fprintf(stderr, "Memory error.\n");
+		exit(2);
+	}
+	// replay
+	start_g = stats_now();
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		if (pthread_create(&threads[i].tid, NULL, replay_thread, &threads[i])) {
+			fprintf(stderr, "Unable to create thread.\n");
+			exit(2);
+		}
+	}
+	for (i = 0; i < config_g.nbr_threads; i++)
+		pthread_join(threads[i].tid, NULL);
+	report(threads, (double)(stats_now() - start_g) / 1e9, json);
+	if (json && json != stdout)
+		fclose(json);
+	return (0);
+}
+
+/**
+ * Load a trace file. The file is mapped, the frames are not copied.
+ * @param	path	Path to the trace file.
+ * @return	0 if OK, -1 on error.
+ */
+static int load_trace(const char *path) {
+	const unsigned char *map, *pt, *end;
+	replay_frame_t *frame;
+	replay_connection_t *conn;
+	struct stat st;
+	uint64_t nbr64;
+	uint32_t nbr32, len;
+	size_t i, j, k;
+	int fd;
+
+	bzero(&trace_g, sizeof(trace_g));
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) ||
+	    (size_t)st.st_size < CAPTURE_HEADER_SIZE ||
+	    (map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Unable to read the trace file '%s'.\n", path);
+		return (-1);
+	}
+	close(fd);
+	// header
+	memcpy(&nbr32, map + 8, sizeof(nbr32));
+	if (memcmp(map, CAPTURE_MAGIC, 8) || be32toh(nbr32) != CAPTURE_VERSION) {
+		fprintf(stderr, "'%s' is not a trace file, or its version is not supported.\n", path);
+		return (-1);
+	}
+	memcpy(&nbr64, map + 8 + sizeof(nbr32), sizeof(nbr64));
+	trace_g.date = be64toh(nbr64);
+	// count the frames (records without frame are ends of connections)
+	end = map + st.st_size;
+	for (pt = map + CAPTURE_HEADER_SIZE; (size_t)(end - pt) >= CAPTURE_RECORD_SIZE; pt += len) {
+		memcpy(&nbr32, pt + sizeof(uint64_t) + sizeof(uint32_t), sizeof(nbr32));
+		len = be32toh(nbr32);
+		pt += CAPTURE_RECORD_SIZE;
+		if ((size_t)(end - pt) < len)
+			break;
+		if (len)
+			trace_g.nbr_frames++;
+	}
+	if (pt != end)
+		fprintf(stderr, "The trace is truncated, its last record is ignored.\n");
+	if (!trace_g.nbr_frames)
+		return (0);
+	if ((trace_g.frames = YMALLOC(trace_g.nbr_frames * sizeof(replay_frame_t))) == NULL) {
+		fprintf(stderr, "Memory error.\n");
+		return (-1);
+	}
+	for (pt = map + CAPTURE_HEADER_SIZE, i = 0; i < trace_g.nbr_frames; pt += len) {
+		memcpy(&nbr32, pt + sizeof(uint64_t) + sizeof(uint32_t), sizeof(nbr32));
+		len = be32toh(nbr32);
+		if (len) {
+			frame = &trace_g.frames[i];
+			memcpy(&nbr64, pt, sizeof(nbr64));
+			frame->time = be64toh(nbr64);
+			memcpy(&nbr32, pt + sizeof(uint64_t), sizeof(nbr32));
+			frame->id = be32toh(nbr32);
+			frame->len = len;
+			frame->data = pt + CAPTURE_RECORD_SIZE;
+			frame->seq = i++;
+		}
+		pt += CAPTURE_RECORD_SIZE;
+	}
+	// group the frames by connection, keeping their order
+	qsort(trace_g.frames, trace_g.nbr_frames, sizeof(replay_frame_t), compare_frames);
+	if ((trace_g.connections = YMALLOC(trace_g.nbr_frames * sizeof(replay_connection_t))) == NULL) {
+		fprintf(stderr, "Memory error.\n");
+		return (-1);
+	}
+	trace_g.first = trace_g.frames[0].time;
+	for (i = 0; i < trace_g.nbr_frames; i = j) {
+		for (j = i; j < trace_g.nbr_frames && trace_g.frames[j].id == trace_g.frames[i].id; j++) {
+			if (trace_g.frames[j].time < trace_g.first)
+				trace_g.first = trace_g.frames[j].time;
+			if (trace_g.frames[j].time > trace_g.last)
+				trace_g.last = trace_g.frames[j].time;
+		}
+		// the connection stops before the first request that can't be replayed
+		for (k = i; k < j && replayable(&trace_g.frames[k]); k++)
+			;
+		if (k < j) {
+			trace_g.cut++;
+			trace_g.skipped += j - k;
+		}
+		if (k == i)
+			continue;
+		conn = &trace_g.connections[trace_g.nbr_connections++];
+		conn->id = trace_g.frames[i].id;
+		conn->frames = &trace_g.frames[i];
+		conn->nbr_frames = k - i;
+		conn->fd = -1;
+	}
+	qsort(trace_g.connections, trace_g.nbr_connections, sizeof(replay_connection_t), compare_connections);
+	return (0);
+}
+
+/**
+ * Tell if a recorded request could be replayed. SHM requests need a file
+ * descriptor from the client, TRACK subscriptions turn the connection
+ * into an invalidation connection.
+ * @param	frame	Pointer to the frame.
+ * @return	YTRUE if the request could be replayed.
+ */
+static ybool_t replayable(const replay_frame_t *frame) {
+	unsigned char command = REQUEST_COMMAND(frame->data[0]);
+
+	if (command == PROTO_SHM || command == 0xd || command == PROTO_EXTRA)
+		return (YFALSE);
+	if (command == PROTO_TRACK && (frame->len < 2 || frame->data[1] == PROTO_TRACK_SUBSCRIBE))
+		return (YFALSE);
+	return (YTRUE);
+}
+
+/**
+ * Compare two frames by connection, then by position in the trace (for qsort).
+ * @param	p1	Pointer to the first frame.
+ * @param	p2	Pointer to the second frame.
+ * @return	The comparison result.
+ */
+static int compare_frames(const void *p1, const void *p2) {
+	const replay_frame_t *f1 = p1, *f2 = p2;
+
+	if (f1->id != f2->id)
+		return ((f1->id < f2->id) ? -1 : 1);
+	if (f1->seq == f2->seq)
+		return (0);
+	return ((f1->seq < f2->seq) ? -1 : 1);
+}
+
+/**
+ * Compare two connections by time of their first request (for qsort).
+ * @param	p1	Pointer to the first connection.
+ * @param	p2	Pointer to the second connection.
+ * @return	The comparison result.
+ */
+static int compare_connections(const void *p1, const void *p2) {
+	const replay_connection_t *c1 = p1, *c2 = p2;
+
+	if (c1->frames[0].time != c2->frames[0].time)
+		return ((c1->frames[0].time < c2->frames[0].time) ? -1 : 1);
+	if (c1->id == c2->id)
+		return (0);
+	return ((c1->id < c2->id) ? -1 : 1);
+}
+
+/**
+ * Create the threads' structures, and share the connections between them.
+ * @return	The array of threads, or NULL.
+ */
+static replay_thread_t *replay_prepare() {
+	replay_thread_t *threads, *thread;
+	size_t i;
+
+	if ((threads = YMALLOC(config_g.nbr_threads * sizeof(replay_thread_t))) == NULL)
+		return (NULL);
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		thread = &threads[i];
+		thread->max_open = config_g.max_connections / config_g.nbr_threads;
+		if ((thread->connections = YMALLOC((trace_g.nbr_connections / config_g.nbr_threads + 1) *
+		                                   sizeof(replay_connection_t*))) == NULL ||
+		    (thread->stats = stats_thread_new(stats_g)) == NULL)
+			return (NULL);
+	}
+	// each thread keeps the connections ordered by their first request
+	for (i = 0; i < trace_g.nbr_connections; i++) {
+		thread = &threads[i % config_g.nbr_threads];
+		thread->connections[thread->nbr_connections++] = &trace_g.connections[i];
+	}
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		thread = &threads[i];
+		if (!thread->nbr_connections)
+			continue;
+		if ((thread->pfds = YMALLOC(thread->nbr_connections * sizeof(struct pollfd))) == NULL ||
+		    (thread->polled = YMALLOC(thread->nbr_connections * sizeof(replay_connection_t*))) == NULL)
+			return (NULL);
+	}
+	return (threads);
+}
+
+/**
+ * Event loop of a thread: open its connections, send their requests and
+ * read their responses.
+ * @param	param	Pointer to the thread structure.
+ * @return	NULL.
+ */
+static void *replay_thread(void *param) {
+	replay_thread_t *thread = param;
+	replay_connection_t *conn;
+	struct timespec ts;
+	uint64_t now, wakeup, next;
+	size_t i, nfds, active;
+
+	for (; ; ) {
+		now = stats_now();
+		wakeup = 0;
+		// open the connections whose time has come
+		while (!stop_g && thread->next < thread->nbr_connections) {
+			conn = thread->connections[thread->next];
+			if (config_g.speed > 0.0 && (next = schedule(&conn->frames[0])) > now) {
+				wakeup = next;
+				break;
+			}
+			if (config_g.speed == 0.0 && thread->open >= thread->max_open)
+				break;
+			thread->next++;
+			if (replay_open(conn)) {
+				fprintf(stderr, "Unable to connect to the server.\n");
+				thread->lost += conn->nbr_frames;
+				conn->done = YTRUE;
+				continue;
+			}
+			thread->open++;
+		}
+		// send the requests whose time has come
+		for (i = 0, nfds = 0, active = 0; i < thread->next; i++) {
+			conn = thread->connections[i];
+			if (conn->done)
+				continue;
+			replay_send(thread, conn, now, &wakeup);
+			if (conn->done)
+				continue;
+			if (conn->answered == conn->sent && (conn->sent == conn->nbr_frames || stop_g)) {
+				replay_close(thread, conn, YFALSE);
+				continue;
+			}
+			active++;
+			thread->pfds[nfds].fd = conn->fd;
+			thread->pfds[nfds].events = (conn->answered < conn->sent ? POLLIN : 0) |
+			                            (conn->blocked ? POLLOUT : 0);
+			thread->pfds[nfds].revents = 0;
+			thread->polled[nfds++] = conn;
+		}
+		if (!active && (stop_g || thread->next >= thread->nbr_connections))
+			break;
+		if (!active && config_g.speed == 0.0)
+			continue;
+		// wait for the responses, or the time of the next request
+		now = stats_now();
+		if (!wakeup || wakeup > now + REPLAY_POLL_MS * 1000000ULL)
+			wakeup = now + REPLAY_POLL_MS * 1000000ULL;
+		ts.tv_sec = (time_t)((wakeup > now ? wakeup - now : 0) / 1000000000ULL);
+		ts.tv_nsec = (long)((wakeup > now ? wakeup - now : 0) % 1000000000ULL);
+		if (ppoll(thread->pfds, nfds, &ts, NULL) <= 0)
+			continue;
+		for (i = 0; i < nfds; i++) {
+			if (thread->pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				replay_receive(thread, thread->polled[i]);
+		}
+	}
+	return (NULL);
+}
+
+/**
+ * Open the connection of a recorded connection.
+ * @param	conn	Pointer to the connection.
+ * @return	0 if OK, -1 on error.
+ */
+static int replay_open(replay_connection_t *conn) {
+	if (config_g.unix_path)
+		conn->client = finedb_create_unix(config_g.unix_path);
+	else
+		conn->client = finedb_create(config_g.hostname, config_g.port);
+	if (conn->client == NULL || (conn->in = malloc(RECV_SIZE)) == NULL ||
+	    finedb_connect(conn->client) != FINEDB_OK) {
+		if (conn->client)
+			finedb_delete(conn->client);
+		conn->client = NULL;
+		YFREE(conn->in);
+		return (-1);
+	}
+	conn->in_size = RECV_SIZE;
+	conn->fd = conn->client->sock;
+	fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL, 0) | O_NONBLOCK);
+	return (0);
+}
+
+/**
+ * Send the requests of a connection whose time has come.
+ * @param	thread	Pointer to the thread.
+ * @param	conn	Pointer to the connection.
+ * @param	now	Current time.
+ * @param	wakeup	Pointer to the time of the next request of the thread.
+ */
+static void replay_send(replay_thread_t *thread, replay_connection_t *conn, uint64_t now, uint64_t *wakeup) {
+	replay_frame_t *frame;
+	size_t window = (config_g.speed > 0.0) ? REPLAY_WINDOW : config_g.depth;
+	uint64_t when;
+	ssize_t rc;
+
+	conn->blocked = YFALSE;
+	while (!stop_g && conn->sent < conn->nbr_frames && conn->sent - conn->answered < window) {
+		frame = &conn->frames[conn->sent];
+		if (!conn->offset) {
+			if (config_g.speed > 0.0) {
+				if ((when = schedule(frame)) > now) {
+					if (!*wakeup || when < *wakeup)
+						*wakeup = when;
+					break;
+				}
+				frame->start = when;
+				if (now - when > thread->lag)
+					thread->lag = now - when;
+			} else
+				frame->start = stats_now();
+		}
+		if ((rc = send(conn->fd, frame->data + conn->offset, frame->len - conn->offset, MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				conn->blocked = YTRUE;
+				break;
+			}
+			replay_close(thread, conn, YTRUE);
+			return;
+		}
+		conn->offset += (size_t)rc;
+		if (conn->offset == frame->len) {
+			conn->sent++;
+			conn->offset = 0;
+		}
+	}
+}
+
+/**
+ * Read the responses of a connection.
+ * @param	thread	Pointer to the thread.
+ * @param	conn	Pointer to the connection.
+ */
+static void replay_receive(replay_thread_t *thread, replay_connection_t *conn) {
+	replay_frame_t *frame;
+	unsigned char code, command;
+	size_t pos = 0, size;
+	ssize_t rc;
+	uint64_t now;
+	char *in;
+
+	for (; ; ) {
+		// a response could be bigger than the buffer
+		if (conn->in_len == conn->in_size) {
+			if ((in = realloc(conn->in, 2 * conn->in_size)) == NULL) {
+				replay_close(thread, conn, YTRUE);
+				return;
+			}
+			conn->in = in;
+			conn->in_size *= 2;
+		}
+		if ((rc = recv(conn->fd, conn->in + conn->in_len, conn->in_size - conn->in_len, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+		}
+		if (rc <= 0) {
+			replay_close(thread, conn, YTRUE);
+			return;
+		}
+		conn->in_len += (size_t)rc;
+		// responses come in the order of the requests
+		now = stats_now();
+		for (pos = 0; conn->answered < conn->sent &&
+		     (size = replay_response_size(conn, (unsigned char*)conn->in + pos, conn->in_len - pos)); pos += size) {
+			frame = &conn->frames[conn->answered++];
+			command = REQUEST_COMMAND(frame->data[0]);
+			code = RESPONSE_STATUS((unsigned char)conn->in[pos]);
+			stats_add(thread->stats, command,
+			          ((conn->transaction || REQUEST_HAS_SYNC(frame->data[0])) ? YTRUE : YFALSE),
+			          ((code == RESP_OK) ? PROTO_STATS_HIT :
+			           ((code == RESP_ERR_BAD_NAME || code == RESP_ERR_VERSION) ? PROTO_STATS_MISS :
+			            PROTO_STATS_ERROR)), now - frame->start);
+			if (command == PROTO_START)
+				conn->transaction = (code == RESP_OK) ? YTRUE : YFALSE;
+			else if (command == PROTO_STOP)
+				conn->transaction = YFALSE;
+		}
+		memmove(conn->in, conn->in + pos, conn->in_len - pos);
+		conn->in_len -= pos;
+		if (conn->in_len < conn->in_size)
+			return;
+	}
+}
+
+/**
+ * Compute the size of the response of the oldest unanswered request of a
+ * connection. The size of the response depends on the command and on its
+ * mode.
+ * @param	conn	Pointer to the connection.
+ * @param	buf	Pointer to the received data.
+ * @param	len	Size of the received data.
+ * @return	The size of the response, or 0 if it is not complete.
+ */
+static size_t replay_response_size(replay_connection_t *conn, const unsigned char *buf, size_t len) {
+	const replay_frame_t *frame = &conn->frames[conn->answered];
+	unsigned char command = REQUEST_COMMAND(frame->data[0]);
+	ybool_t sync = (conn->transaction || REQUEST_HAS_SYNC(frame->data[0])) ? YTRUE : YFALSE;
+	size_t header = 1;
+	uint32_t data_len;
+
+	if (!len)
+		return (0);
+	// errors and most responses are made of the response code only
+	if (RESPONSE_STATUS(buf[0]) != RESP_OK)
+		return (1);
+	if (command == PROTO_GET || (command == PROTO_CAS && sync))
+		header += sizeof(uint64_t);
+	else if (command != PROTO_AGGREGATE && command != PROTO_ADMIN && (command != PROTO_MERGE || !sync))
+		return (1);
+	// version, then data size and data
+	if (len < header + sizeof(uint32_t))
+		return (0);
+	memcpy(&data_len, buf + header, sizeof(data_len));
+	data_len = be32toh(data_len);
+	if (len - header - sizeof(uint32_t) < data_len)
+		return (0);
+	return (header + sizeof(uint32_t) + data_len);
+}
+
+/**
+ * Close a connection.
+ * @param	thread	Pointer to the thread.
+ * @param	conn	Pointer to the connection.
+ * @param	failed	YTRUE if the connection was lost.
+ */
+static void replay_close(replay_thread_t *thread, replay_connection_t *conn, ybool_t failed) {
+	if (failed) {
+		fprintf(stderr, "Connection %u lost.\n", conn->id);
+		thread->lost += conn->nbr_frames - conn->answered;
+	} else
+		thread->lost += conn->nbr_frames - conn->sent;
+	finedb_delete(conn->client);
+	conn->client = NULL;
+	conn->fd = -1;
+	YFREE(conn->in);
+	conn->done = YTRUE;
+	thread->open--;
+}
+
+/**
+ * Compute the time a request should be sent, at the given speed.
+ * @param	frame	Pointer to the frame.
+ * @return	The time (nanoseconds).
+ */
+static uint64_t schedule(const replay_frame_t *frame) {
+	return (start_g + (uint64_t)((double)(frame->time - trace_g.first) / config_g.speed));
+}
+
+/**
+ * Add a histogram to another one.
+ * @param	histogram	Pointer to the histogram.
+ * @param	src		Pointer to the added histogram.
+ */
+static void histogram_add(stats_histogram_t *histogram, stats_histogram_t *src) {
+	unsigned int i;
+
+	histogram->count += src->count;
+	histogram->sum += src->sum;
+	if (src->max > histogram->max)
+		histogram->max = src->max;
+	for (i = 0; i < STATS_BUCKETS; i++)
+		histogram->buckets[i] += src->buckets[i];
+}
+
+/**
+ * Print the results of the replay.
+ * @param	threads		Array of threads.
+ * @param	duration	Duration of the replay (seconds).
+ * @param	json		JSON results file. Could be NULL.
+ */
+static void report(replay_thread_t *threads, double duration, FILE *json) {
+	static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	static const char *percentile_names[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	stats_histogram_t histogram, misses, errors;
+	uint64_t total = 0, lost = 0, lag = 0;
+	ybool_t first = YTRUE;
+	time_t date = (time_t)(trace_g.date / 1000);
+	char date_str[32];
+	unsigned int i, command, sync;
+
+	for (i = 0; i < config_g.nbr_threads; i++) {
+		lost += threads[i].lost;
+		if (threads[i].lag > lag)
+			lag = threads[i].lag;
+	}
+	strftime(date_str, sizeof(date_str), "%Y-%m-%d %H:%M:%S", localtime(&date));
+	printf("Trace: %s (recorded %s, %.3f s, %zu requests, %zu connections)\n", config_g.trace_path, date_str,
+	       (double)(trace_g.last - trace_g.first) / 1e9, trace_g.nbr_frames, trace_g.nbr_connections);
+	if (trace_g.cut)
+		printf("%zu connections cut at a request that can't be replayed (%zu requests skipped)\n",
+		       trace_g.cut, trace_g.skipped);
+	if (config_g.speed > 0.0)
+		printf("Replay: speed x%g, %.3f s, greatest send delay %.3f ms\n", config_g.speed, duration, lag / 1e6);
+	else
+		printf("Replay: maximum speed, %.3f s\n", duration);
+	printf("%-10s %-5s %10s %8s %8s %10s %9s %9s %9s %9s %9s %9s %9s\n", "command", "mode", "count", "misses",
+	       "errors", "req/s", "mean(us)", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+	if (json)
+		fprintf(json, "{\n\t\"trace\": {\"path\": \"%s\", \"date\": %llu, \"duration\": %.6f, \"requests\": %zu, "
+		        "\"connections\": %zu, \"skipped\": %zu},\n\t\"replay\": {\"speed\": %g, \"duration\": %.6f, "
+		        "\"lag_ms\": %.3f, \"commands\": {", config_g.trace_path, (unsigned long long)trace_g.date,
+		        (double)(trace_g.last - trace_g.first) / 1e9, trace_g.nbr_frames, trace_g.nbr_connections,
+		        trace_g.skipped, config_g.speed, duration, lag / 1e6);
+	for (command = 0; command < STATS_COMMANDS; command++) {
+		for (sync = 0; sync < STATS_MODES; sync++) {
+			// latencies of the answered requests
+			stats_merge(stats_g, (unsigned char)command, (ybool_t)sync, PROTO_STATS_HIT, &histogram);
+			stats_merge(stats_g, (unsigned char)command, (ybool_t)sync, PROTO_STATS_MISS, &misses);
+			stats_merge(stats_g, (unsigned char)command, (ybool_t)sync, PROTO_STATS_ERROR, &errors);
+			histogram_add(&histogram, &misses);
+			histogram_add(&histogram, &errors);
+			if (!histogram.count)
+				continue;
+			total += histogram.count;
+			printf("%-10s %-5s %10llu %8llu %8llu %10.0f %9.1f", command_names[command],
+			       (sync ? "sync" : "async"), (unsigned long long)histogram.count,
+			       (unsigned long long)misses.count, (unsigned long long)errors.count,
+			       histogram.count / duration, histogram.sum / 1000.0 / histogram.count);
+			for (i = 0; i < sizeof(percentiles) / sizeof(double); i++)
+				printf(" %9.1f", stats_percentile(&histogram, percentiles[i]) / 1000.0);
+			printf(" %9.1f\n", histogram.max / 1000.0);
+			if (json) {
+				fprintf(json, "%s\n\t\t\"%s/%s\": {\"count\": %llu, \"misses\": %llu, \"errors\": %llu, "
+				        "\"throughput\": %.1f, \"latency_us\": {\"mean\": %.3f", (first ? "" : ","),
+				        command_names[command], (sync ? "sync" : "async"),
+				        (unsigned long long)histogram.count, (unsigned long long)misses.count,
+				        (unsigned long long)errors.count, histogram.count / duration,
+				        histogram.sum / 1000.0 / histogram.count);
+				for (i = 0; i < sizeof(percentiles) / sizeof(double); i++)
+					fprintf(json, ", \"%s\": %.3f", percentile_names[i],
+					        stats_percentile(&histogram, percentiles[i]) / 1000.0);
+				fprintf(json, ", \"max\": %.3f}}", histogram.max / 1000.0);
+			}
+			first = YFALSE;
+			if (config_g.hdr)
+				report_hdr(command_names[command], (ybool_t)sync, &histogram);
+		}
+	}
+	printf("total            %10llu %28.0f req/s\n", (unsigned long long)total, total / duration);
+	if (lost)
+		printf("lost             %10llu (not sent or not answered)\n", (unsigned long long)lost);
+	printf("\n");
+	if (json)
+		fprintf(json, "\n\t}, \"requests\": %llu, \"lost\": %llu, \"throughput\": %.1f}\n}\n",
+		        (unsigned long long)total, (unsigned long long)lost, total / duration);
+}
+
+/**
+ * Print the percentile distribution of a histogram, in the format of
+ * HdrHistogram (it could be plotted by its tools).
+ * @param	name		Name of the command.
+ * @param	sync		YTRUE for synchronous requests.
+ * @param	histogram	Pointer to the histogram.
+ */
+static void report_hdr(const char *name, ybool_t sync, stats_histogram_t *histogram) {
+	double percentile;
+	unsigned int tick;
+
+	printf("# %s/%s\n%12s %14s %10s %14s\n\n", name, (sync ? "sync" : "async"), "Value", "Percentile",
+	       "TotalCount", "1/(1-Percentile)");
+	// 5 ticks each time the distance to 100% is halved
+	for (tick = 0; ; tick++) {
+		percentile = 100.0 * (1.0 - pow(0.5, tick / 5.0));
+		if ((1.0 - percentile / 100.0) * histogram->count < 1.0)
+			break;
+		printf("%12.3f %14.12f %10llu %14.2f\n", stats_percentile(histogram, percentile) / 1000.0,
+		       percentile / 100.0, (unsigned long long)fmax(1.0, ceil(percentile / 100.0 * histogram->count)),
+		       1.0 / (1.0 - percentile / 100.0));
+	}
+	printf("%12.3f %14.12f %10llu\n", histogram->max / 1000.0, 1.0, (unsigned long long)histogram->count);
+	printf("#[Mean    = %12.3f, Max = %12.3f]\n#[Total count    = %12llu]\n\n",
+	       histogram->sum / 1000.0 / histogram->count, histogram->max / 1000.0,
+	       (unsigned long long)histogram->count);
+}
@@ -0,0 +1,290 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/time.h>
+#include "ylog.h"
+#include "stats.h"
+#include "capture.h"
+
+/* private functions */
+static ybool_t _capture_write(capture_thread_t *thread_capture, uint64_t timestamp,
+                              const void *frame, uint32_t frame_len);
+static void _capture_copy(capture_thread_t *thread_capture, uint64_t position, const void *data, size_t len);
+static void *_capture_loop(void *param);
+static size_t _capture_flush(capture_t *capture);
+static yerr_t _capture_write_file(capture_t *capture, const void *data, size_t len);
+
+/* Create the trace file and start the flush thread. */
+capture_t *capture_new(const char *path) {
+	capture_t *capture;
+	char header[CAPTURE_HEADER_SIZE];
+	uint32_t version;
+	uint64_t date;
+	struct timeval tv;
+
+	if ((capture = YMALLOC(sizeof(capture_t))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&capture->mutex, NULL);
+	if ((capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		YLOG_ADD(YLOG_WARN, "Unable to open trace file '%s'.", path);
+		goto error;
+	}
+	// header
+	gettimeofday(&tv, NULL);
+	capture->start = stats_now();
+	memcpy(header, CAPTURE_MAGIC, 8);
+	version = htobe32(CAPTURE_VERSION);
+	memcpy(header + 8, &version, sizeof(version));
+	date = htobe64((uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000);
+	memcpy(header + 8 + sizeof(version), &date, sizeof(date));
+	if (_capture_write_file(capture, header, sizeof(header)) != YENOERR)
+		goto error;
+	// flush thread
+	capture->run = YTRUE;
+	if (pthread_create(&capture->tid, NULL, _capture_loop, capture)) {
+		YLOG_ADD(YLOG_WARN, "Unable to create capture thread.");
+		goto error;
+	}
+	return (capture);
+error:
+	if (capture->fd >= 0)
+		close(capture->fd);
+	YFREE(capture);
+	return (NULL);
+}
+
+/* Stop the capture. */
+void capture_stop(capture_t *capture) {
+	capture_thread_t *thread_capture;
+	uint64_t dropped = 0;
+
+	if (!__atomic_exchange_n(&capture->run, YFALSE, __ATOMIC_ACQ_REL))
+		return;
+	pthread_join(capture->tid, NULL);
+	// records written since the last flush
+	_capture_flush(capture);
+	pthread_mutex_lock(&capture->mutex);
+	for (thread_capture = capture->threads; thread_capture; thread_capture = thread_capture->next)
+		dropped += __atomic_load_n(&thread_capture->dropped, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&capture->mutex);
+	close(capture->fd);
+	capture->fd = -1;
+	YLOG_ADD(YLOG_NOTE, "Capture stopped: %llu bytes written, %llu frames dropped.",
+	         (unsigned long long)capture->written, (unsigned long long)dropped);
+}
+
+/* Create the ring of a thread. */
+capture_thread_t *capture_thread_new(capture_t *capture) {
+	capture_thread_t *thread_capture;
+
+	if ((thread_capture = YMALLOC(sizeof(capture_thread_t))) == NULL)
+		return (NULL);
+	if ((thread_capture->data = malloc(CAPTURE_RING_SIZE)) == NULL) {
+		YFREE(thread_capture);
+		return (NULL);
+	}
+	pthread_mutex_lock(&capture->mutex);
+	thread_capture->next = capture->threads;
+	capture->threads = thread_capture;
+	pthread_mutex_unlock(&capture->mutex);
+	return (thread_capture);
+}
+
+/* Give an ID to a new connection. */
+void capture_connect(capture_t *capture, capture_thread_t *thread_capture) {
+	if (capture == NULL || thread_capture == NULL)
+		return;
+	thread_capture->id = __atomic_add_fetch(&capture->next_id, 1, __ATOMIC_RELAXED);
+	// 0 is reserved for connections that are not captured
+	if (!thread_capture->id)
+		thread_capture->id = __atomic_add_fetch(&capture->next_id, 1, __ATOMIC_RELAXED);
+	thread_capture->pending_len = 0;
+}
+
+/* Keep received bytes. */
+void capture_received(capture_thread_t *thread_capture, const void *data, size_t len) {
+	char *pending;
+	size_t size;
+
+	if (thread_capture == NULL || !thread_capture->id || !len)
+		return;
+	if (thread_capture->pending_len + len > thread_capture->pending_size) {
+		for (size = thread_capture->pending_size ? thread_capture->pending_size : 8192;
+		     size < thread_capture->pending_len + len; size *= 2)
+			;
+		if ((pending = realloc(thread_capture->pending, size)) == NULL) {
+			// the rest of the connection is not captured
+			__atomic_store_n(&thread_capture->dropped, thread_capture->dropped + 1, __ATOMIC_RELAXED);
+			thread_capture->id = 0;
+			return;
+		}
+		thread_capture->pending = pending;
+		thread_capture->pending_size = size;
+	}
+	memcpy(thread_capture->pending + thread_capture->pending_len, data, len);
+	thread_capture->pending_len += len;
+}
+
+/* Write the record of a processed request. */
+void capture_frame(capture_t *capture, capture_thread_t *thread_capture, uint64_t start, size_t unread) {
+	size_t frame_len;
+
+	if (capture == NULL || thread_capture == NULL || !thread_capture->id ||
+	    unread >= thread_capture->pending_len)
+		return;
+	frame_len = thread_capture->pending_len - unread;
+	if (frame_len > UINT32_MAX ||
+	    !_capture_write(thread_capture, start - capture->start, thread_capture->pending, (uint32_t)frame_len)) {
+		// the ring is full: the rest of the connection is not captured
+		__atomic_store_n(&thread_capture->dropped, thread_capture->dropped + 1, __ATOMIC_RELAXED);
+		thread_capture->id = 0;
+		return;
+	}
+	// the next pipelined requests stay pending
+	memmove(thread_capture->pending, thread_capture->pending + frame_len, unread);
+	thread_capture->pending_len = unread;
+}
+
+/* Write the end of the running connection. */
+void capture_disconnect(capture_t *capture, capture_thread_t *thread_capture) {
+	if (capture == NULL || thread_capture == NULL || !thread_capture->id)
+		return;
+	_capture_write(thread_capture, stats_now() - capture->start, NULL, 0);
+	thread_capture->id = 0;
+	thread_capture->pending_len = 0;
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_capture_write
+ *		Write a record into the ring of a thread. The record is
+ *		published when it is complete.
+ * @param	thread_capture	Pointer to the thread's ring.
+ * @param	timestamp	Time of the record (nanoseconds since the
+ *				beginning of the capture).
+ * @param	frame		Pointer to the frame. NULL for the end of the
+ *				connection.
+ * @param	frame_len	Size of the frame.
+ * @return	YTRUE if OK, YFALSE if the ring was full.
+ */
+static ybool_t _capture_write(capture_thread_t *thread_capture, uint64_t timestamp,
+                              const void *frame, uint32_t frame_len) {
+	unsigned char header[CAPTURE_RECORD_SIZE];
+	uint64_t tail, nbr64;
+	uint32_t nbr32;
+
+	// only the thread modifies the tail
+	tail = thread_capture->tail;
+	if (CAPTURE_RECORD_SIZE + (uint64_t)frame_len >
+	    CAPTURE_RING_SIZE - (tail - __atomic_load_n(&thread_capture->head, __ATOMIC_ACQUIRE)))
+		return (YFALSE);
+	nbr64 = htobe64(timestamp);
+	memcpy(header, &nbr64, sizeof(nbr64));
+	nbr32 = htobe32(thread_capture->id);
+	memcpy(header + sizeof(nbr64), &nbr32, sizeof(nbr32));
+	nbr32 = htobe32(frame_len);
+	memcpy(header + sizeof(nbr64) + sizeof(nbr32), &nbr32, sizeof(nbr32));
+	_capture_copy(thread_capture, tail, header, sizeof(header));
+	if (frame_len)
+		_capture_copy(thread_capture, tail + sizeof(header), frame, frame_len);
+	__atomic_store_n(&thread_capture->tail, tail + sizeof(header) + frame_len, __ATOMIC_RELEASE);
+	return (YTRUE);
+}
+
+/**
+ * @function	_capture_copy
+ *		Copy data into a ring, at a given position.
+ * @param	thread_capture	Pointer to the thread's ring.
+ * @param	position	Position in the ring (free-running counter).
+ * @param	data		Pointer to the data.
+ * @param	len		Size of the data.
+ */
+static void _capture_copy(capture_thread_t *thread_capture, uint64_t position, const void *data, size_t len) {
+	size_t offset, first;
+
+	offset = (size_t)(position & (CAPTURE_RING_SIZE - 1));
+	first = (len < CAPTURE_RING_SIZE - offset) ? len : (CAPTURE_RING_SIZE - offset);
+	memcpy(thread_capture->data + offset, data, first);
+	if (len > first)
+		memcpy(thread_capture->data, (const char*)data + first, len - first);
+}
+
+/**
+ * @function	_capture_loop
+ *		Main loop of the flush thread. Write the rings into the trace
+ *		file, and sleep when they are empty.
+ * @param	param	Pointer to the capture.
+ * @return	Always NULL.
+ */
+static void *_capture_loop(void *param) {
+	capture_t *capture = param;
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = CAPTURE_FLUSH_MS * 1000000L;
+	while (__atomic_load_n(&capture->run, __ATOMIC_ACQUIRE)) {
+		if (!_capture_flush(capture))
+			nanosleep(&ts, NULL);
+	}
+	return (NULL);
+}
+
+/**
+ * @function	_capture_flush
+ *		Write the waiting records of all rings into the trace file.
+ *		Each ring holds complete records, the file never gets a part of
+ *		a record.
+ * @param	capture	Pointer to the capture.
+ * @return	The number of bytes written.
+ */
+static size_t _capture_flush(capture_t *capture) {
+	capture_thread_t *thread_capture;
+	uint64_t head, tail;
+	size_t offset, len, total = 0;
+
+	pthread_mutex_lock(&capture->mutex);
+	for (thread_capture = capture->threads; thread_capture; thread_capture = thread_capture->next) {
+		// only the flush thread modifies the head
+		head = thread_capture->head;
+		tail = __atomic_load_n(&thread_capture->tail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			offset = (size_t)(head & (CAPTURE_RING_SIZE - 1));
+			len = (tail - head < CAPTURE_RING_SIZE - offset) ? (size_t)(tail - head) :
+			      (CAPTURE_RING_SIZE - offset);
+			// on error, the records are lost but the server goes on
+			_capture_write_file(capture, thread_capture->data + offset, len);
+			head += len;
+			total += len;
+		}
+		__atomic_store_n(&thread_capture->head, head, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&capture->mutex);
+	return (total);
+}
+
+/**
+ * @function	_capture_write_file
+ *		Write data into the trace file.
+ * @param	capture	Pointer to the capture.
+ * @param	data	Pointer to the data.
+ * @param	len	Size of the data.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _capture_write_file(capture_t *capture, const void *data, size_t len) {
+	const char *pt = data;
+	ssize_t rc;
+
+	while (len) {
+		if ((rc = write(capture->fd, pt, len)) < 0) {
+			YLOG_ADD(YLOG_WARN, "Unable to write into the trace file.");
+			return (YEIO);
+		}
+		pt += rc;
+		len -= (size_t)rc;
+		capture->written += (uint64_t)rc;
+	}
+	return (YENOERR);
+}
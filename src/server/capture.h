@@ -0,0 +1,156 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "yerror.h"
+
+/** @const CAPTURE_RING_SIZE Size of the ring of each connection thread (power of 2). */
+#define CAPTURE_RING_SIZE	4194304
+/** @const CAPTURE_FLUSH_MS Time between two flushes of the rings, when they are empty. */
+#define CAPTURE_FLUSH_MS	10
+/** @const CAPTURE_MAGIC Magic string at the beginning of a trace file. */
+#define CAPTURE_MAGIC		"FDBTRACE"
+/** @const CAPTURE_VERSION Version of the trace file format. */
+#define CAPTURE_VERSION		1
+
+/**
+ * @define	CAPTURE_HEADER_SIZE
+ *		Size of the header of a trace file. It is made of the magic
+ *		string (8 bytes, without its terminating null byte), the format
+ *		version (32 bits) and the date of the beginning of the capture
+ *		(64 bits, Unix time in milliseconds).
+ */
+#define CAPTURE_HEADER_SIZE	(8 + sizeof(uint32_t) + sizeof(uint64_t))
+
+/**
+ * @define	CAPTURE_RECORD_SIZE
+ *		Size of a record of a trace file, without its frame. It is made
+ *		of the time at which the server started to process the request
+ *		(64 bits, nanoseconds since the beginning of the capture), the
+ *		connection ID (32 bits) and the size of the frame (32 bits),
+ *		followed by the request, as received. A record without frame
+ *		marks the end of a connection. Integers are big-endian.
+ *		Records of a connection are in order, but records of different
+ *		connections could be out of order.
+ */
+#define CAPTURE_RECORD_SIZE	(sizeof(uint64_t) + 2 * sizeof(uint32_t))
+
+/**
+ * @typedef	capture_thread_t
+ *		Ring of the records of a connection thread. The tail is
+ *		written only by the thread, the head only by the flush thread.
+ * @field	tail		Number of bytes written since the creation.
+ * @field	head		Number of bytes flushed since the creation.
+ * @field	dropped		Number of frames lost because the ring was full.
+ * @field	id		ID of the running connection, 0 if it is not
+ *				captured.
+ * @field	pending		Bytes received and not yet part of a frame.
+ * @field	pending_len	Number of bytes received.
+ * @field	pending_size	Size of the pending buffer.
+ * @field	data		Data of the ring.
+ * @field	next		Next thread.
+ */
+typedef struct capture_thread_s {
+	uint64_t tail;
+	uint64_t head;
+	uint64_t dropped;
+	uint32_t id;
+	char *pending;
+	size_t pending_len;
+	size_t pending_size;
+	char *data;
+	struct capture_thread_s *next;
+} capture_thread_t;
+
+/**
+ * @typedef	capture_t
+ *		Capture of the incoming requests into a trace file. Each
+ *		connection thread writes its records in its own ring, without
+ *		lock; a background thread writes the rings into the file.
+ * @field	fd		File descriptor of the trace file.
+ * @field	start		Time of the beginning of the capture (nanoseconds).
+ * @field	next_id		Last given connection ID.
+ * @field	run		YTRUE while the flush thread must run.
+ * @field	tid		ID of the flush thread.
+ * @field	mutex		Mutex protecting the list of threads.
+ * @field	threads		List of the threads' rings.
+ * @field	written		Number of bytes written into the file.
+ */
+typedef struct capture_s {
+	int fd;
+	uint64_t start;
+	uint32_t next_id;
+	ybool_t run;
+	pthread_t tid;
+	pthread_mutex_t mutex;
+	capture_thread_t *threads;
+	uint64_t written;
+} capture_t;
+
+/**
+ * @function	capture_new
+ *		Create the trace file and start the flush thread.
+ * @param	path	Path to the trace file (overwritten if it exists).
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+capture_t *capture_new(const char *path);
+
+/**
+ * @function	capture_stop
+ *		Stop the flush thread, after it wrote the waiting records, and
+ *		close the trace file.
+ * @param	capture	Pointer to the capture.
+ */
+void capture_stop(capture_t *capture);
+
+/**
+ * @function	capture_thread_new
+ *		Create the ring of a thread.
+ * @param	capture	Pointer to the capture.
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+capture_thread_t *capture_thread_new(capture_t *capture);
+
+/**
+ * @function	capture_connect
+ *		Give an ID to a new connection.
+ * @param	capture		Pointer to the capture. NULL if disabled.
+ * @param	thread_capture	Pointer to the thread's ring.
+ */
+void capture_connect(capture_t *capture, capture_thread_t *thread_capture);
+
+/**
+ * @function	capture_received
+ *		Keep bytes received on the running connection, until the end
+ *		of their request.
+ * @param	thread_capture	Pointer to the thread's ring. NULL if disabled.
+ * @param	data		Pointer to the received bytes.
+ * @param	len		Number of bytes.
+ */
+void capture_received(capture_thread_t *thread_capture, const void *data, size_t len);
+
+/**
+ * @function	capture_frame
+ *		Write the record of a processed request. If the ring is full,
+ *		the rest of the connection is not captured; its records stay
+ *		a valid beginning of the connection.
+ * @param	capture		Pointer to the capture. NULL if disabled.
+ * @param	thread_capture	Pointer to the thread's ring.
+ * @param	start		Time at which the request was started
+ *				(nanoseconds, see stats_now()).
+ * @param	unread		Number of received bytes that are not part of
+ *				the request (next pipelined requests).
+ */
+void capture_frame(capture_t *capture, capture_thread_t *thread_capture, uint64_t start, size_t unread);
+
+/**
+ * @function	capture_disconnect
+ *		Write the end of the running connection.
+ * @param	capture		Pointer to the capture. NULL if disabled.
+ * @param	thread_capture	Pointer to the thread's ring.
+ */
+void capture_disconnect(capture_t *capture, capture_thread_t *thread_capture);
+
+#endif /* __CAPTURE_H__ */
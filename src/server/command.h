@@ -20,6 +20,57 @@ typedef yerr_t (*command_handler_t)(tcp_thread_t *thread, ybool_t sync,
                                     ybool_t compress, ybool_t serialized,
                                     ydynabin_t *buff);
 
+/**
+ * @function	command_admin
+ *		Process an ADMIN command. With PROTO_ADMIN_STATS, the latency
+ *		statistics of all connection threads are merged and sent.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_admin(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                     ydynabin_t *buff);
+
+/**
+ * @function	command_aggregate
+ *		Process an AGGREGATE command. Loop on a range of keys and
+ *		compute the number of keys, the total size of values, and the
+ *		sum/min/max of numeric values.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_aggregate(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                         ydynabin_t *buff);
+
+/**
+ * @function	command_batch
+ *		Process a BATCH command. The PUT and DEL entries of the request
+ *		are applied in one transaction, by the writer thread (or
+ *		directly if synchronized).
+ * @param	thread		Pointer to the thread's structure.
+ * @param	sync		YTRUE if the response must be synchronized.
+ * @param	compress	YTRUE if the given data are already compressed.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_batch(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                     ydynabin_t *buff);
+
+/**
+ * @function	command_cas
+ *		Process a CAS command. The key is written or removed only if its
+ *		current version is equal to the expected one.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	sync		YTRUE if the response must be synchronized. The
+ *				new version is then sent back to the client.
+ * @param	compress	YTRUE if the given data is already compressed.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_cas(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                   ydynabin_t *buff);
+
 /**
  * @function	command_del
  *		Process a DEL command.
@@ -63,6 +114,19 @@ yerr_t command_get(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 yerr_t command_list(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
                     ydynabin_t *buff);
 
+/**
+ * @function	command_merge
+ *		Process a MERGE command. The operator is applied on the current
+ *		value by the writer thread (or directly if synchronized).
+ * @param	thread		Pointer to the thread's structure.
+ * @param	sync		YTRUE if the response must be synchronized. The
+ *				new value is then sent back to the client.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_merge(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                     ydynabin_t *buff);
+
 /**
  * @function	command_ping
  *		Process a PING command.
@@ -96,6 +160,21 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 yerr_t command_setdb(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
                      ydynabin_t *buff);
 
+/**
+ * @function	command_shm
+ *		Process a SHM command. Only allowed on Unix socket connections.
+ *		A shared memory segment is created, containing two rings (one
+ *		for requests, one for responses), and its file descriptor is
+ *		sent to the client. All the following requests and responses
+ *		go through the rings; the socket is only used to detect the
+ *		client's death.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_shm(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                   ydynabin_t *buff);
+
 /**
  * @function	command_start
  *		Process a START command.
@@ -114,4 +193,18 @@ yerr_t command_start(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool
 yerr_t command_stop(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
                     ydynabin_t *buff);
 
+/**
+ * @function	command_track
+ *		Process a TRACK command. With PROTO_TRACK_SUBSCRIBE, the
+ *		connection becomes an invalidation connection: the thread
+ *		pushes invalidation records to the client until it disconnects.
+ *		With PROTO_TRACK_ATTACH, the keys read by the connection are
+ *		tracked for an invalidation connection.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @return	YENOERR if OK.
+ */
+yerr_t command_track(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized,
+                     ydynabin_t *buff);
+
 #endif /* __COMMAND_H__ */
@@ -0,0 +1,296 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/resource.h>
+#include "ylog.h"
+#include "command.h"
+#include "protocol.h"
+#include "database.h"
+#include "stats.h"
+#include "slowlog.h"
+#include "hotkeys.h"
+
+/* private functions */
+static yerr_t _admin_stats(tcp_thread_t *thread);
+static yerr_t _admin_lmdb(tcp_thread_t *thread);
+static yerr_t _admin_lmdb_db(void *ptr, const char *name, MDB_stat *stat);
+static yerr_t _admin_slowlog(tcp_thread_t *thread);
+static yerr_t _admin_hotkeys(tcp_thread_t *thread);
+
+/* Process an ADMIN command. */
+yerr_t command_admin(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	unsigned char *pop;
+
+	YLOG_ADD(YLOG_DEBUG, "ADMIN command");
+	// read operation
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR) {
+		YLOG_ADD(YLOG_WARN, "ADMIN error");
+		CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+		return (YEIO);
+	}
+	pop = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pop == PROTO_ADMIN_STATS)
+		return (_admin_stats(thread));
+	if (*pop == PROTO_ADMIN_LMDB)
+		return (_admin_lmdb(thread));
+	if (*pop == PROTO_ADMIN_SLOWLOG)
+		return (_admin_slowlog(thread));
+	if (*pop == PROTO_ADMIN_HOTKEYS)
+		return (_admin_hotkeys(thread));
+	YLOG_ADD(YLOG_DEBUG, "Bad ADMIN operation '%x'", *pop);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+	return (YEPROTO);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_admin_stats
+ *		Send the latency statistics of the requests, merged from all
+ *		connection threads.
+ * @param	thread	Pointer to the thread's structure.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _admin_stats(tcp_thread_t *thread) {
+	stats_t *stats = thread->finedb->stats;
+	stats_histogram_t *histogram;
+	unsigned char *data, *pt;
+	unsigned int command, mode, result;
+	uint64_t uptime, values[7];
+	yerr_t rc;
+	int i;
+
+	if ((histogram = YMALLOC(sizeof(stats_histogram_t))) == NULL ||
+	    (data = YMALLOC(sizeof(uint64_t) + STATS_COMMANDS * STATS_MODES * STATS_RESULTS *
+	                    PROTO_STATS_ENTRY_SIZE)) == NULL) {
+		YFREE(histogram);
+		YLOG_ADD(YLOG_WARN, "ADMIN STATS error");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER));
+	}
+	uptime = stats_now() - stats->start;
+	values[0] = htobe64(uptime / 1000000);
+	memcpy(data, values, sizeof(uint64_t));
+	pt = data + sizeof(uint64_t);
+	for (command = 0; command < STATS_COMMANDS; command++) {
+		for (mode = 0; mode < STATS_MODES; mode++) {
+			for (result = 0; result < STATS_RESULTS; result++) {
+				if (stats_merge(stats, (unsigned char)command, (mode ? YFALSE : YTRUE),
+				                (protocol_stats_result_t)result, histogram) != YENOERR)
+					continue;
+				*pt++ = (unsigned char)command;
+				*pt++ = (unsigned char)mode;
+				*pt++ = (unsigned char)result;
+				values[0] = histogram->count;
+				values[1] = uptime ? (uint64_t)((double)histogram->count * 1e9 / (double)uptime) : 0;
+				values[2] = histogram->sum / histogram->count;
+				values[3] = stats_percentile(histogram, 50.0);
+				values[4] = stats_percentile(histogram, 99.0);
+				values[5] = stats_percentile(histogram, 99.9);
+				values[6] = histogram->max;
+				for (i = 0; i < 7; i++)
+					values[i] = htobe64(values[i]);
+				memcpy(pt, values, sizeof(values));
+				pt += sizeof(values);
+			}
+		}
+	}
+	YFREE(histogram);
+	YLOG_ADD(YLOG_DEBUG, "ADMIN STATS OK");
+	rc = connection_send_response(thread, RESP_OK, YFALSE, YFALSE, data, (size_t)(pt - data));
+	YFREE(data);
+	return (rc);
+}
+
+/**
+ * @function	_admin_lmdb
+ *		Send the internals of the LMDB environment: environment
+ *		information, free-list size, oldest client transaction, page
+ *		faults and statistics of every database.
+ * @param	thread	Pointer to the thread's structure.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _admin_lmdb(tcp_thread_t *thread) {
+	finedb_t *finedb = thread->finedb;
+	MDB_envinfo info;
+	MDB_stat stat;
+	struct rusage usage;
+	ydynabin_t *data;
+	uint64_t values[11], now, start, oldest = 0;
+	size_t i, free_pages, txnid = 0;
+	tcp_thread_t *other;
+	yerr_t rc;
+
+	// room for the header, put before the entries of the databases
+	memset(values, 0, sizeof(values));
+	if ((data = ydynabin_new(values, sizeof(values), YTRUE)) == NULL ||
+	    database_info(finedb->database, &info, &stat) != YENOERR ||
+	    database_stats(finedb->database, &free_pages, _admin_lmdb_db, data) != YENOERR) {
+		if (data)
+			ydynabin_delete(data);
+		YLOG_ADD(YLOG_WARN, "ADMIN LMDB error");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER));
+	}
+	// oldest transaction opened by a client
+	now = stats_now();
+	for (i = 0; i < yv_len(finedb->tcp_threads); i++) {
+		other = finedb->tcp_threads[i];
+		start = __atomic_load_n(&other->transaction_start, __ATOMIC_ACQUIRE);
+		if (start && start < now && (!oldest || now - start > oldest)) {
+			oldest = now - start;
+			txnid = other->transaction_txnid;
+		}
+	}
+	memset(&usage, 0, sizeof(usage));
+	getrusage(RUSAGE_SELF, &usage);
+	values[0] = info.me_mapsize;
+	values[1] = info.me_last_pgno;
+	values[2] = info.me_last_txnid;
+	values[3] = info.me_maxreaders;
+	values[4] = info.me_numreaders;
+	values[5] = stat.ms_psize;
+	values[6] = free_pages;
+	values[7] = oldest / 1000000;
+	values[8] = (oldest && info.me_last_txnid > txnid) ? info.me_last_txnid - txnid : 0;
+	values[9] = (uint64_t)usage.ru_majflt;
+	values[10] = (uint64_t)usage.ru_minflt;
+	for (i = 0; i < 11; i++)
+		values[i] = htobe64(values[i]);
+	memcpy(data->data, values, sizeof(values));
+	YLOG_ADD(YLOG_DEBUG, "ADMIN LMDB OK");
+	rc = connection_send_response(thread, RESP_OK, YFALSE, YFALSE, data->data, data->len);
+	ydynabin_delete(data);
+	return (rc);
+}
+
+/**
+ * @function	_admin_lmdb_db
+ *		Add the statistics of a database to the ADMIN LMDB response.
+ * @param	ptr	Pointer to the response data.
+ * @param	name	Name of the database. NULL for the default database.
+ * @param	stat	Pointer to the database statistics.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _admin_lmdb_db(void *ptr, const char *name, MDB_stat *stat) {
+	ydynabin_t *data = ptr;
+	unsigned char name_len;
+	uint64_t values[5];
+	int i;
+
+	// names are limited to 255 characters, like in the SETDB command
+	name_len = (unsigned char)((name && strlen(name) < 256) ? strlen(name) : 0);
+	if (name && !name_len)
+		return (YENOERR);
+	values[0] = stat->ms_depth;
+	values[1] = stat->ms_branch_pages;
+	values[2] = stat->ms_leaf_pages;
+	values[3] = stat->ms_overflow_pages;
+	values[4] = stat->ms_entries;
+	for (i = 0; i < 5; i++)
+		values[i] = htobe64(values[i]);
+	if (ydynabin_expand(data, &name_len, sizeof(name_len)) != YENOERR ||
+	    (name_len && ydynabin_expand(data, (void*)name, name_len) != YENOERR) ||
+	    ydynabin_expand(data, values, sizeof(values)) != YENOERR)
+		return (YENOMEM);
+	return (YENOERR);
+}
+
+/**
+ * @function	_admin_slowlog
+ *		Send the entries of the slow-request log.
+ * @param	thread	Pointer to the thread's structure.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _admin_slowlog(tcp_thread_t *thread) {
+	slowlog_t *slowlog = thread->finedb->slowlog;
+	slowlog_entry_t *entries = NULL;
+	unsigned char *data, *pt;
+	uint64_t values[10];
+	size_t nbr = 0, i, j;
+	yerr_t rc;
+
+	if ((data = YMALLOC(sizeof(uint64_t) + SLOWLOG_SIZE * PROTO_SLOWLOG_ENTRY_SIZE)) == NULL ||
+	    (slowlog && (entries = YMALLOC(SLOWLOG_SIZE * sizeof(slowlog_entry_t))) == NULL)) {
+		YFREE(data);
+		YLOG_ADD(YLOG_WARN, "ADMIN SLOWLOG error");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER));
+	}
+	values[0] = htobe64(slowlog ? slowlog->threshold : 0);
+	memcpy(data, values, sizeof(uint64_t));
+	pt = data + sizeof(uint64_t);
+	if (slowlog)
+		nbr = slowlog_get(slowlog, entries);
+	for (i = 0; i < nbr; i++) {
+		*pt++ = entries[i].command;
+		*pt++ = entries[i].sync ? 0 : 1;
+		*pt++ = (unsigned char)entries[i].response;
+		values[0] = entries[i].id;
+		values[1] = entries[i].time;
+		values[2] = entries[i].duration;
+		for (j = 0; j < SLOWLOG_STAGES; j++)
+			values[3 + j] = entries[i].stages[j];
+		values[9] = entries[i].queued > 0 ? (uint64_t)entries[i].queued : 0;
+		for (j = 0; j < 10; j++)
+			values[j] = htobe64(values[j]);
+		memcpy(pt, values, sizeof(values));
+		pt += sizeof(values);
+	}
+	YFREE(entries);
+	YLOG_ADD(YLOG_DEBUG, "ADMIN SLOWLOG OK");
+	rc = connection_send_response(thread, RESP_OK, YFALSE, YFALSE, data, (size_t)(pt - data));
+	YFREE(data);
+	return (rc);
+}
+
+/**
+ * @function	_admin_hotkeys
+ *		Send the most read and the most written keys, merged from all
+ *		connection threads.
+ * @param	thread	Pointer to the thread's structure.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _admin_hotkeys(tcp_thread_t *thread) {
+	hotkeys_key_t *top;
+	unsigned char *data, *pt;
+	uint64_t totals[HOTKEYS_TYPES], value;
+	uint16_t key_len;
+	size_t nbr[HOTKEYS_TYPES], i;
+	unsigned int type;
+	yerr_t rc;
+
+	if ((top = YMALLOC(HOTKEYS_TYPES * HOTKEYS_TOP * sizeof(hotkeys_key_t))) == NULL ||
+	    (data = YMALLOC(HOTKEYS_TYPES * sizeof(uint64_t) + HOTKEYS_TYPES * HOTKEYS_TOP *
+	                    (PROTO_HOTKEYS_ENTRY_SIZE + HOTKEYS_NAME_MAX + HOTKEYS_KEY_MAX))) == NULL) {
+		YFREE(top);
+		YLOG_ADD(YLOG_WARN, "ADMIN HOTKEYS error");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER));
+	}
+	for (type = 0; type < HOTKEYS_TYPES; type++) {
+		nbr[type] = hotkeys_merge(thread->finedb->hotkeys, (hotkeys_type_t)type,
+		                          &top[type * HOTKEYS_TOP], &totals[type]);
+		totals[type] = htobe64(totals[type]);
+	}
+	memcpy(data, totals, sizeof(totals));
+	pt = data + sizeof(totals);
+	for (type = 0; type < HOTKEYS_TYPES; type++) {
+		for (i = 0; i < nbr[type]; i++) {
+			hotkeys_key_t *key = &top[type * HOTKEYS_TOP + i];
+
+			*pt++ = (unsigned char)type;
+			value = htobe64(key->count);
+			memcpy(pt, &value, sizeof(value));
+			pt += sizeof(value);
+			*pt++ = key->name_len;
+			memcpy(pt, key->name, key->name_len);
+			pt += key->name_len;
+			key_len = htons(key->key_len);
+			memcpy(pt, &key_len, sizeof(key_len));
+			pt += sizeof(key_len);
+			memcpy(pt, key->key, key->key_len);
+			pt += key->key_len;
+		}
+	}
+	YFREE(top);
+	YLOG_ADD(YLOG_DEBUG, "ADMIN HOTKEYS OK");
+	rc = connection_send_response(thread, RESP_OK, YFALSE, YFALSE, data, (size_t)(pt - data));
+	YFREE(data);
+	return (rc);
+}
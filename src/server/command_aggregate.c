@@ -0,0 +1,177 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snappy.h"
+#include "ylog.h"
+#include "ybin.h"
+#include "command.h"
+#include "protocol.h"
+#include "database.h"
+
+/** @define AGGREGATE_NUMBER_MAXLEN Maximum size of a value that could be a number. */
+#define AGGREGATE_NUMBER_MAXLEN	32
+
+/**
+ * @typedef	aggregate_t
+ *		Aggregated values of a range of keys.
+ * @field	encoding	Integer encoding of the values.
+ * @field	count		Number of keys.
+ * @field	size		Total size of the (uncompressed) values.
+ * @field	numbers		Number of values that are valid numbers.
+ * @field	sum		Sum of numeric values.
+ * @field	min		Minimum numeric value.
+ * @field	max		Maximum numeric value.
+ */
+typedef struct aggregate_s {
+	protocol_encoding_t encoding;
+	uint64_t count;
+	uint64_t size;
+	uint64_t numbers;
+	int64_t sum;
+	int64_t min;
+	int64_t max;
+} aggregate_t;
+
+/* private functions */
+static yerr_t _command_aggregate_loop(void *ptr, ybin_t key, ybin_t data);
+static ybool_t _command_aggregate_number(protocol_encoding_t encoding, const char *data,
+                                         size_t len, int64_t *value);
+
+/* Process an AGGREGATE command. */
+yerr_t command_aggregate(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	unsigned char *pencoding;
+	uint16_t *plen, start_len, end_len;
+	void *ptr, *start = NULL, *end = NULL;
+	ybin_t bin_start, bin_end;
+	aggregate_t aggr;
+	uint64_t result[6];
+
+	YLOG_ADD(YLOG_DEBUG, "AGGREGATE command");
+	memset(&aggr, 0, sizeof(aggr));
+	// read encoding
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR)
+		goto error;
+	pencoding = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pencoding > PROTO_ENC_INT64)
+		goto protocol_error;
+	aggr.encoding = (protocol_encoding_t)*pencoding;
+	// read start key
+	if (connection_read_data(thread, buff, sizeof(start_len)) != YENOERR)
+		goto error;
+	plen = ydynabin_forward(buff, sizeof(start_len));
+	start_len = ntohs(*plen);
+	if (start_len) {
+		if (connection_read_data(thread, buff, (size_t)start_len) != YENOERR)
+			goto error;
+		ptr = ydynabin_forward(buff, (size_t)start_len);
+		if ((start = YMALLOC((size_t)start_len)) == NULL)
+			goto error;
+		memcpy(start, ptr, (size_t)start_len);
+	}
+	// read end key
+	if (connection_read_data(thread, buff, sizeof(end_len)) != YENOERR)
+		goto error;
+	plen = ydynabin_forward(buff, sizeof(end_len));
+	end_len = ntohs(*plen);
+	if (end_len) {
+		if (connection_read_data(thread, buff, (size_t)end_len) != YENOERR)
+			goto error;
+		ptr = ydynabin_forward(buff, (size_t)end_len);
+		if ((end = YMALLOC((size_t)end_len)) == NULL)
+			goto error;
+		memcpy(end, ptr, (size_t)end_len);
+	}
+	// loop on the range
+	ybin_set(&bin_start, start, (size_t)start_len);
+	ybin_set(&bin_end, end, (size_t)end_len);
+	if (database_range(thread->finedb->database, thread->transaction, thread->dbname,
+	                   bin_start, bin_end, _command_aggregate_loop, &aggr) != YENOERR)
+		goto error;
+	YFREE(start);
+	YFREE(end);
+	// send the response to the client
+	result[0] = htobe64(aggr.count);
+	result[1] = htobe64(aggr.size);
+	result[2] = htobe64(aggr.numbers);
+	result[3] = htobe64((uint64_t)aggr.sum);
+	result[4] = htobe64((uint64_t)aggr.min);
+	result[5] = htobe64((uint64_t)aggr.max);
+	YLOG_ADD(YLOG_DEBUG, "AGGREGATE command OK");
+	return (connection_send_response(thread, RESP_OK, YFALSE, YFALSE, result, sizeof(result)));
+protocol_error:
+	YLOG_ADD(YLOG_DEBUG, "AGGREGATE bad encoding");
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+	return (YEPROTO);
+error:
+	YLOG_ADD(YLOG_WARN, "AGGREGATE error");
+	YFREE(start);
+	YFREE(end);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
+
+/* Aggregate one key/value pair. */
+static yerr_t _command_aggregate_loop(void *ptr, ybin_t key, ybin_t data) {
+	aggregate_t *aggr = (aggregate_t*)ptr;
+	char number[AGGREGATE_NUMBER_MAXLEN];
+	size_t len = 0;
+	int64_t value;
+
+	aggr->count++;
+	if (!data.len)
+		return (YENOERR);
+	// size of the uncompressed data (read from the snappy header)
+	if (!snappy_uncompressed_length(data.data, data.len, &len))
+		return (YENOERR);
+	aggr->size += len;
+	// numeric value
+	if (aggr->encoding == PROTO_ENC_NONE || !len || len > sizeof(number) ||
+	    snappy_uncompress(data.data, data.len, number) ||
+	    !_command_aggregate_number(aggr->encoding, number, len, &value))
+		return (YENOERR);
+	if (!aggr->numbers || value < aggr->min)
+		aggr->min = value;
+	if (!aggr->numbers || value > aggr->max)
+		aggr->max = value;
+	aggr->sum = (int64_t)((uint64_t)aggr->sum + (uint64_t)value);
+	aggr->numbers++;
+	return (YENOERR);
+}
+
+/**
+ * @function	_command_aggregate_number
+ *		Decode a numeric value.
+ * @param	encoding	Integer encoding.
+ * @param	data		Pointer to the uncompressed value.
+ * @param	len		Size of the value.
+ * @param	value		Pointer to the decoded number.
+ * @return	YTRUE if the value is a valid number.
+ */
+static ybool_t _command_aggregate_number(protocol_encoding_t encoding, const char *data,
+                                         size_t len, int64_t *value) {
+	if (encoding == PROTO_ENC_INT64) {
+		uint64_t n;
+
+		if (len != sizeof(n))
+			return (YFALSE);
+		memcpy(&n, data, sizeof(n));
+		*value = (int64_t)be64toh(n);
+		return (YTRUE);
+	}
+	if (encoding == PROTO_ENC_STRING) {
+		char str[AGGREGATE_NUMBER_MAXLEN + 1], *endptr = NULL;
+		long long n;
+
+		memcpy(str, data, len);
+		str[len] = '\0';
+		errno = 0;
+		n = strtoll(str, &endptr, 10);
+		if (errno || endptr == str || *endptr != '\0')
+			return (YFALSE);
+		*value = (int64_t)n;
+		return (YTRUE);
+	}
+	return (YFALSE);
+}
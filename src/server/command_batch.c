@@ -0,0 +1,202 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include "nanomsg/nn.h"
+#include "snappy.h"
+#include "ylog.h"
+#include "command.h"
+#include "protocol.h"
+#include "writer_thread.h"
+#include "database.h"
+
+/* private functions */
+static writer_msg_t *_command_batch_read_entry(tcp_thread_t *thread, ydynabin_t *buff, ybool_t compress,
+                                               struct snappy_env *zip_env);
+static void _command_batch_free(writer_msg_t *msg);
+
+/* Process a BATCH command. */
+yerr_t command_batch(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	uint32_t *pcount, count, i;
+	writer_msg_t *batch = NULL, *msg, **plast;
+	struct snappy_env zip_env;
+	MDB_txn *txn = thread->transaction;
+	unsigned int failed = 0;
+
+	YLOG_ADD(YLOG_DEBUG, "BATCH command");
+	// read the number of entries
+	if (connection_read_data(thread, buff, sizeof(count)) != YENOERR)
+		goto error;
+	pcount = ydynabin_forward(buff, sizeof(count));
+	count = ntohl(*pcount);
+	if (count > PROTO_BATCH_MAX_ENTRIES) {
+		YLOG_ADD(YLOG_DEBUG, "Too many entries (%u).", count);
+		CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+		return (YEPROTO);
+	}
+	// compression environment, used if data are not already compressed
+	memset(&zip_env, 0, sizeof(struct snappy_env));
+	if (!compress && snappy_init_env(&zip_env)) {
+		YLOG_ADD(YLOG_WARN, "Unable to create Snappy environment.");
+		goto error;
+	}
+	// creation of the batch message
+	if ((batch = YMALLOC(sizeof(writer_msg_t))) == NULL)
+		goto error;
+	batch->type = WRITE_BATCH;
+	// read entries
+	for (i = 0, plast = &batch->next; i < count; i++, plast = &msg->next) {
+		if ((msg = _command_batch_read_entry(thread, buff, compress, &zip_env)) == NULL)
+			goto error;
+		*plast = msg;
+	}
+	if (!compress)
+		snappy_free_env(&zip_env);
+	YLOG_ADD(YLOG_DEBUG, "BATCH of %u entries", count);
+	if (!sync) {
+		// not synchronized: immediate response, the writer thread applies the batch
+		CONNECTION_SEND_OK(thread);
+		if (connection_send_writer(thread, batch) != YENOERR) {
+			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
+			_command_batch_free(batch);
+			return (YEIO);
+		}
+		return (YENOERR);
+	}
+	// synchronized: all entries in one transaction
+	if (txn == NULL) {
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+		txn = database_transaction_start(thread->finedb->database, YFALSE);
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+		if (txn == NULL) {
+			YLOG_ADD(YLOG_WARN, "Unable to open transaction.");
+			_command_batch_free(batch);
+			return (CONNECTION_SEND_ERROR(thread, RESP_ERR_TRANSACTION));
+		}
+	}
+	for (msg = batch->next; msg; msg = msg->next) {
+		if ((msg->type == WRITE_PUT &&
+		     database_put(thread->finedb->database, txn, YFALSE, thread->dbname, msg->name,
+		                  msg->data, 0, NULL) != YENOERR) ||
+		    (msg->type == WRITE_DEL &&
+		     database_del(thread->finedb->database, txn, thread->dbname, msg->name, 0) != YENOERR))
+			failed++;
+	}
+	if (thread->transaction == NULL && database_transaction_commit(txn) != YENOERR) {
+		YLOG_ADD(YLOG_WARN, "Unable to commit transaction.");
+		_command_batch_free(batch);
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_TRANSACTION));
+	}
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
+	for (msg = batch->next; msg; msg = msg->next)
+		connection_written(thread, &msg->name);
+	_command_batch_free(batch);
+	YLOG_ADD(YLOG_DEBUG, "BATCH command done (%u failed)", failed);
+	return (connection_send_response(thread, (failed ? RESP_ERR_BAD_NAME : RESP_OK),
+	                                 YFALSE, YFALSE, NULL, 0));
+error:
+	YLOG_ADD(YLOG_WARN, "BATCH error");
+	if (!compress)
+		snappy_free_env(&zip_env);
+	_command_batch_free(batch);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_command_batch_read_entry
+ *		Read an entry of a BATCH request, and create the matching
+ *		writer message.
+ * @param	thread		Pointer to the thread's structure.
+ * @param	buff		Pointer to the dynamic buffer.
+ * @param	compress	YTRUE if the data are already compressed.
+ * @param	zip_env		Pointer to the Snappy environment.
+ * @return	A pointer to the message, or NULL if an error occurs.
+ */
+static writer_msg_t *_command_batch_read_entry(tcp_thread_t *thread, ydynabin_t *buff, ybool_t compress,
+                                               struct snappy_env *zip_env) {
+	unsigned char *pcode;
+	uint16_t *pname_len, name_len;
+	uint32_t *pdata_len, data_len;
+	void *ptr;
+	size_t zip_len;
+	writer_msg_t *msg;
+
+	if ((msg = YMALLOC(sizeof(writer_msg_t))) == NULL)
+		return (NULL);
+	// read the command
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR)
+		goto error;
+	pcode = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pcode == PROTO_PUT)
+		msg->type = WRITE_PUT;
+	else if (*pcode == PROTO_DEL)
+		msg->type = WRITE_DEL;
+	else {
+		YLOG_ADD(YLOG_DEBUG, "Bad batch entry '%x'", *pcode);
+		goto error;
+	}
+	msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
+	// read name
+	if (connection_read_data(thread, buff, sizeof(name_len)) != YENOERR)
+		goto error;
+	pname_len = ydynabin_forward(buff, sizeof(name_len));
+	name_len = ntohs(*pname_len);
+	if (connection_read_data(thread, buff, (size_t)name_len) != YENOERR)
+		goto error;
+	ptr = ydynabin_forward(buff, (size_t)name_len);
+	if ((msg->name.data = YMALLOC((size_t)name_len)) == NULL)
+		goto error;
+	memcpy(msg->name.data, ptr, (size_t)name_len);
+	msg->name.len = name_len;
+	hotkeys_add(thread->hotkeys, HOTKEYS_WRITE, thread->dbname, msg->name);
+	if (msg->type == WRITE_DEL)
+		return (msg);
+	// read data
+	if (connection_read_data(thread, buff, sizeof(data_len)) != YENOERR)
+		goto error;
+	pdata_len = ydynabin_forward(buff, sizeof(data_len));
+	data_len = ntohl(*pdata_len);
+	if (connection_read_data(thread, buff, (size_t)data_len) != YENOERR)
+		goto error;
+	ptr = ydynabin_forward(buff, (size_t)data_len);
+	if (compress) {
+		size_t raw_len;
+
+		if ((msg->data.data = YMALLOC(data_len ? (size_t)data_len : 1)) == NULL)
+			goto error;
+		memcpy(msg->data.data, ptr, (size_t)data_len);
+		msg->data.len = data_len;
+		if (data_len && snappy_uncompressed_length(ptr, (size_t)data_len, &raw_len))
+			stats_add_zip(thread->stats, raw_len, (size_t)data_len);
+		return (msg);
+	}
+	// data are not already compressed
+	if ((msg->data.data = YMALLOC(snappy_max_compressed_length(data_len))) == NULL ||
+	    snappy_compress(zip_env, ptr, data_len, msg->data.data, &zip_len)) {
+		YLOG_ADD(YLOG_WARN, "Unable to compress data.");
+		goto error;
+	}
+	msg->data.len = zip_len;
+	stats_add_zip(thread->stats, (size_t)data_len, zip_len);
+	return (msg);
+error:
+	_command_batch_free(msg);
+	return (NULL);
+}
+
+/**
+ * @function	_command_batch_free
+ *		Free a list of messages.
+ * @param	msg	Pointer to the first message.
+ */
+static void _command_batch_free(writer_msg_t *msg) {
+	writer_msg_t *next;
+
+	for (; msg; msg = next) {
+		next = msg->next;
+		YFREE(msg->data.data);
+		YFREE(msg->dbname);
+		YFREE(msg->name.data);
+		YFREE(msg);
+	}
+}
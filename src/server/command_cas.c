@@ -0,0 +1,149 @@
+#include <arpa/inet.h>
+#include <endian.h>
+#include <string.h>
+#include "nanomsg/nn.h"
+#include "snappy.h"
+#include "ylog.h"
+#include "command.h"
+#include "protocol.h"
+#include "writer_thread.h"
+#include "database.h"
+
+/* Process a CAS command. */
+yerr_t command_cas(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	unsigned char *pop;
+	protocol_cas_t op;
+	uint64_t *pversion, version, new_version = 0;
+	uint16_t *pname_len, name_len;
+	uint32_t *pdata_len, data_len;
+	void *ptr, *name = NULL, *data = NULL;
+	writer_msg_t *msg = NULL;
+	ybin_t bin_name, bin_data;
+	MDB_txn *txn;
+	yerr_t rc;
+
+	YLOG_ADD(YLOG_DEBUG, "CAS command");
+	// read operation
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR)
+		goto error;
+	pop = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pop > PROTO_CAS_DEL) {
+		YLOG_ADD(YLOG_DEBUG, "Bad CAS operation '%x'", *pop);
+		CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+		return (YEPROTO);
+	}
+	op = (protocol_cas_t)*pop;
+	// read expected version
+	if (connection_read_data(thread, buff, sizeof(version)) != YENOERR)
+		goto error;
+	pversion = ydynabin_forward(buff, sizeof(version));
+	memcpy(&version, pversion, sizeof(version));
+	version = be64toh(version);
+	// read name length
+	if (connection_read_data(thread, buff, sizeof(name_len)) != YENOERR)
+		goto error;
+	pname_len = ydynabin_forward(buff, sizeof(name_len));
+	name_len = ntohs(*pname_len);
+	// read name
+	if (connection_read_data(thread, buff, (size_t)name_len) != YENOERR)
+		goto error;
+	ptr = ydynabin_forward(buff, (size_t)name_len);
+	if ((name = YMALLOC((size_t)name_len)) == NULL)
+		goto error;
+	memcpy(name, ptr, (size_t)name_len);
+	ybin_set(&bin_name, name, name_len);
+	hotkeys_add(thread->hotkeys, HOTKEYS_WRITE, thread->dbname, bin_name);
+	ybin_set(&bin_data, NULL, 0);
+	if (op == PROTO_CAS_PUT) {
+		// read data length
+		if (connection_read_data(thread, buff, sizeof(data_len)) != YENOERR)
+			goto error;
+		pdata_len = ydynabin_forward(buff, sizeof(data_len));
+		data_len = ntohl(*pdata_len);
+		// read data
+		if (data_len > 0) {
+			if (connection_read_data(thread, buff, (size_t)data_len) != YENOERR)
+				goto error;
+			ptr = ydynabin_forward(buff, (size_t)data_len);
+			if (compress) {
+				if ((data = YMALLOC((size_t)data_len)) == NULL)
+					goto error;
+				memcpy(data, ptr, (size_t)data_len);
+			} else {
+				// data are not already compressed
+				struct snappy_env zip_env;
+				size_t zip_len;
+
+				SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+				memset(&zip_env, 0, sizeof(struct snappy_env));
+				if (snappy_init_env(&zip_env)) {
+					YLOG_ADD(YLOG_WARN, "Unable to create Snappy environment.");
+					goto error;
+				}
+				if ((data = YMALLOC(snappy_max_compressed_length(data_len))) == NULL ||
+				    snappy_compress(&zip_env, ptr, data_len, data, &zip_len)) {
+					YLOG_ADD(YLOG_WARN, "Unable to compress data.");
+					snappy_free_env(&zip_env);
+					goto error;
+				}
+				snappy_free_env(&zip_env);
+				data_len = (uint32_t)zip_len;
+				SLOWLOG_STAGE(&thread->timer, SLOWLOG_ZIP);
+			}
+		}
+		ybin_set(&bin_data, data, data_len);
+	}
+
+	if (!sync) {
+		// not synchronized: immediate response, the version is checked by the writer thread
+		CONNECTION_SEND_OK(thread);
+		if ((msg = YMALLOC(sizeof(writer_msg_t))) == NULL)
+			goto error;
+		msg->type = (op == PROTO_CAS_PUT) ? WRITE_PUT : WRITE_DEL;
+		msg->version = version;
+		msg->name = bin_name;
+		msg->data = bin_data;
+		msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
+		if (connection_send_writer(thread, msg) != YENOERR) {
+			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
+			goto error;
+		}
+		return (YENOERR);
+	}
+	// synchronized: check and write inside a write transaction
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	txn = database_transaction_start(thread->finedb->database, YFALSE);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+	if (txn == NULL)
+		goto error;
+	if (op == PROTO_CAS_PUT)
+		rc = database_put(thread->finedb->database, txn, YFALSE, thread->dbname, bin_name,
+		                  bin_data, version, &new_version);
+	else
+		rc = database_del(thread->finedb->database, txn, thread->dbname, bin_name, version);
+	if (rc != YENOERR) {
+		database_transaction_rollback(txn);
+		if (rc != YEAGAIN)
+			goto error;
+		YLOG_ADD(YLOG_DEBUG, "CAS version mismatch");
+		YFREE(name);
+		YFREE(data);
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_VERSION));
+	}
+	if (database_transaction_commit(txn) != YENOERR)
+		goto error;
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
+	connection_written(thread, &bin_name);
+	YFREE(name);
+	YFREE(data);
+	// send the new version
+	YLOG_ADD(YLOG_DEBUG, "CAS command OK");
+	return (connection_send_value(thread, YFALSE, YFALSE, new_version, NULL, 0));
+error:
+	YLOG_ADD(YLOG_WARN, "CAS error");
+	YFREE(name);
+	YFREE(data);
+	YFREE(msg);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
@@ -11,7 +11,9 @@
 yerr_t command_del(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
 	uint16_t *pkey_len, key_len;
 	void *ptr, *key = NULL;
+	ybin_t bin_key;
 	writer_msg_t *msg = NULL;
+	MDB_txn *txn = thread->transaction;
 	char answer;
 
 	YLOG_ADD(YLOG_DEBUG, "DEL command");
@@ -27,6 +29,8 @@ yerr_t command_del(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	if ((key = YMALLOC((size_t)key_len)) == NULL)
 		goto error;
 	memcpy(key, ptr, (size_t)key_len);
+	ybin_set(&bin_key, key, key_len);
+	hotkeys_add(thread->hotkeys, HOTKEYS_WRITE, thread->dbname, bin_key);
 
 	if (!sync) {
 		// send the response
@@ -41,20 +45,35 @@ yerr_t command_del(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	if (!sync) {
 		msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
 		// send the message to the writer thread
-		if (nn_send(thread->write_sock, &msg, sizeof(msg), 0) < 0) {
+		if (connection_send_writer(thread, msg) != YENOERR) {
 			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
 			goto error;
 		}
 		return (YENOERR);
 	}
-	// synchronized
-	if (database_del(thread->finedb->database, thread->transaction, thread->dbname, msg->name) == YENOERR) {
+	// synchronized: the write lock could be held by the writer thread
+	if (txn == NULL) {
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+		txn = database_transaction_start(thread->finedb->database, YFALSE);
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+		if (txn == NULL) {
+			YLOG_ADD(YLOG_WARN, "Unable to open transaction.");
+			goto error;
+		}
+	}
+	answer = (database_del(thread->finedb->database, txn, thread->dbname, msg->name, 0) == YENOERR) ? 1 : 0;
+	if (thread->transaction == NULL) {
+		if (!answer)
+			database_transaction_rollback(txn);
+		else if (database_transaction_commit(txn) != YENOERR)
+			answer = 0;
+	}
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
+	if (answer) {
 		YLOG_ADD(YLOG_DEBUG, "Deletion done on database.");
-		answer = 1;
-	} else {
+		connection_written(thread, &msg->name);
+	} else
 		YLOG_ADD(YLOG_WARN, "Unable to delete data on database.");
-		answer = 0;
-	}
 	YFREE(key);
 	YFREE(msg);
 	YLOG_ADD(YLOG_DEBUG, "DEL command %s", (answer ? "OK" : "failed"));
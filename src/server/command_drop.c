@@ -28,7 +28,7 @@ yerr_t command_drop(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_
 	if (!sync) {
 		// not synchronized, send the message to the writer thread
 		msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
-		if (nn_send(thread->write_sock, &msg, sizeof(msg), 0) < 0) {
+		if (connection_send_writer(thread, msg) != YENOERR) {
 			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
 			goto error;
 		}
@@ -37,6 +37,7 @@ yerr_t command_drop(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_
 	// synchronized
 	if (database_drop(thread->finedb->database, thread->transaction, thread->dbname) == YENOERR) {
 		YLOG_ADD(YLOG_DEBUG, "Database dropped.");
+		connection_written(thread, NULL);
 		answer = 1;
 	} else {
 		YLOG_ADD(YLOG_WARN, "Unable to drop database.");
@@ -12,7 +12,12 @@
 yerr_t command_get(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
 	uint16_t *pname_len, name_len;
 	void *ptr, *name = NULL;
-	ybin_t bin_key, bin_data;
+	ybin_t bin_key, bin_data, zip_data, plain_data;
+	char *unzip_data = NULL;
+	hotcache_t *hotcache;
+	singleflight_call_t *call = NULL;
+	ybool_t leader;
+	uint64_t version, generation = 0;
 	yerr_t result;
 
 	YLOG_ADD(YLOG_DEBUG, "GET command");
@@ -31,18 +36,62 @@ yerr_t command_get(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	// creation of the message
 	bin_key.len = (size_t)name_len;
 	bin_key.data = name;
+	hotkeys_add(thread->hotkeys, HOTKEYS_READ, thread->dbname, bin_key);
+	// the key is tracked before being read, so a concurrent write is notified
+	if (thread->tracker >= 0)
+		tracking_mark(thread->finedb->tracking, thread->tracker, thread->dbname, bin_key);
+	// hot value (not inside a transaction, which reads a snapshot)
+	hotcache = thread->transaction ? NULL : thread->finedb->hotcache;
+	if (hotcache) {
+		if (hotcache_get(hotcache, thread->dbname, bin_key, compress, &bin_data, &version) == YENOERR) {
+			YLOG_ADD(YLOG_DEBUG, "GET command OK (hot value)");
+			YFREE(name);
+			result = connection_send_value(thread, serialized, compress, version,
+			                               bin_data.data, bin_data.len);
+			YFREE(bin_data.data);
+			return (result);
+		}
+		generation = hotcache_generation(hotcache, thread->dbname, bin_key);
+	}
+	// concurrent reads of the same key share one lookup (not inside a transaction)
+	ybin_set(&bin_data, NULL, 0);
+	if (!thread->transaction &&
+	    (call = singleflight_join(thread->finedb->singleflight, thread->dbname, bin_key,
+	                              compress, &leader)) != NULL && !leader) {
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+		singleflight_wait(thread->finedb->singleflight, call);
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
+		YFREE(name);
+		if (call->result == YENODATA) {
+			singleflight_release(thread->finedb->singleflight, call);
+			goto no_data;
+		}
+		if (call->result != YENOERR) {
+			singleflight_release(thread->finedb->singleflight, call);
+			goto error;
+		}
+		YLOG_ADD(YLOG_DEBUG, "GET command OK (shared read)");
+		result = connection_send_value(thread, serialized, compress, call->version,
+		                               call->data.data, call->data.len);
+		singleflight_release(thread->finedb->singleflight, call);
+		return (result);
+	}
 	// get data
-	result = database_get(thread->finedb->database, thread->transaction, thread->dbname, bin_key, &bin_data);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	result = database_get(thread->finedb->database, thread->transaction, thread->dbname, bin_key,
+	                      &bin_data, &version);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
 	if (result == YENODATA)
 		goto no_data;
 	if (result != YENOERR)
 		goto error;
+	zip_data = bin_data;
 	if (bin_data.len && !compress) {
 		// uncompress data before sending them
 		size_t unzip_len;
-		char *unzip_data;
 
 		YLOG_ADD(YLOG_DEBUG, "Uncompress data.");
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
 		snappy_uncompressed_length(bin_data.data, bin_data.len, &unzip_len);
 		unzip_data = YMALLOC(unzip_len);
 		if (snappy_uncompress(bin_data.data, bin_data.len, unzip_data)) {
@@ -51,21 +100,45 @@ yerr_t command_get(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 		}
 		bin_data.data = unzip_data;
 		bin_data.len = unzip_len;
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_ZIP);
+	}
+	if (hotcache) {
+		// the uncompressed value is kept if it is known
+		if (compress)
+			ybin_set(&plain_data, NULL, 0);
+		else
+			ybin_set(&plain_data, (bin_data.data ? bin_data.data : ""), bin_data.len);
+		hotcache_set(hotcache, generation, thread->dbname, bin_key, zip_data, plain_data, version);
+	}
+	// give the value to the threads waiting for it
+	if (call) {
+		singleflight_done(thread->finedb->singleflight, call, YENOERR, bin_data, version);
+		singleflight_release(thread->finedb->singleflight, call);
 	}
-	// send the response to the client
+	// send the response to the client, with the version of the value
 	YLOG_ADD(YLOG_DEBUG, "GET command OK");
 	YFREE(name);
-	result = connection_send_response(thread, RESP_OK, serialized, compress,
-	                                  bin_data.data, bin_data.len);
+	result = connection_send_value(thread, serialized, compress, version,
+	                               bin_data.data, bin_data.len);
+	YFREE(unzip_data);
 	return (result);
 no_data:
 	YLOG_ADD(YLOG_DEBUG, "GET no data");
+	if (call && leader) {
+		singleflight_done(thread->finedb->singleflight, call, YENODATA, bin_data, 0);
+		singleflight_release(thread->finedb->singleflight, call);
+	}
 	YFREE(name);
 	CONNECTION_SEND_ERROR(thread, RESP_ERR_BAD_NAME);
 	return (YENOERR);
 error:
 	YLOG_ADD(YLOG_WARN, "GET error");
+	if (call && leader) {
+		singleflight_done(thread->finedb->singleflight, call, YEIO, bin_data, 0);
+		singleflight_release(thread->finedb->singleflight, call);
+	}
 	YFREE(name);
+	YFREE(unzip_data);
 	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
 	return (YEIO);
 }
@@ -0,0 +1,137 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include "nanomsg/nn.h"
+#include "snappy.h"
+#include "ylog.h"
+#include "command.h"
+#include "protocol.h"
+#include "writer_thread.h"
+#include "database.h"
+#include "merge.h"
+
+/* Process a MERGE command. */
+yerr_t command_merge(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	unsigned char *pop;
+	protocol_merge_t op;
+	uint16_t *pname_len, name_len;
+	uint32_t *pdata_len, data_len;
+	void *ptr, *name = NULL, *data = NULL;
+	writer_msg_t *msg = NULL;
+	ybin_t bin_name, bin_data, value;
+	struct snappy_env zip_env;
+	MDB_txn *txn;
+	yerr_t rc;
+
+	YLOG_ADD(YLOG_DEBUG, "MERGE command");
+	// read operator
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR)
+		goto error;
+	pop = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pop > PROTO_MERGE_OR) {
+		YLOG_ADD(YLOG_DEBUG, "Bad merge operator '%x'", *pop);
+		CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+		return (YEPROTO);
+	}
+	op = (protocol_merge_t)*pop;
+	// read name length
+	if (connection_read_data(thread, buff, sizeof(name_len)) != YENOERR)
+		goto error;
+	pname_len = ydynabin_forward(buff, sizeof(name_len));
+	name_len = ntohs(*pname_len);
+	// read name
+	if (connection_read_data(thread, buff, (size_t)name_len) != YENOERR)
+		goto error;
+	ptr = ydynabin_forward(buff, (size_t)name_len);
+	if ((name = YMALLOC((size_t)name_len)) == NULL)
+		goto error;
+	memcpy(name, ptr, (size_t)name_len);
+	// read operand length
+	if (connection_read_data(thread, buff, sizeof(data_len)) != YENOERR)
+		goto error;
+	pdata_len = ydynabin_forward(buff, sizeof(data_len));
+	data_len = ntohl(*pdata_len);
+	// read operand
+	if (data_len > 0) {
+		if (connection_read_data(thread, buff, (size_t)data_len) != YENOERR)
+			goto error;
+		ptr = ydynabin_forward(buff, (size_t)data_len);
+		if ((data = YMALLOC((size_t)data_len)) == NULL)
+			goto error;
+		memcpy(data, ptr, (size_t)data_len);
+	}
+	ybin_set(&bin_name, name, name_len);
+	hotkeys_add(thread->hotkeys, HOTKEYS_WRITE, thread->dbname, bin_name);
+	ybin_set(&bin_data, data, data_len);
+
+	if (!sync) {
+		// not synchronized: immediate response
+		CONNECTION_SEND_OK(thread);
+		// send the message to the writer thread
+		if ((msg = YMALLOC(sizeof(writer_msg_t))) == NULL)
+			goto error;
+		msg->type = WRITE_MERGE;
+		msg->merge_op = op;
+		msg->name = bin_name;
+		msg->data = bin_data;
+		msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
+		if (connection_send_writer(thread, msg) != YENOERR) {
+			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
+			goto error;
+		}
+		return (YENOERR);
+	}
+	// synchronized: read, merge and write inside a write transaction
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	txn = database_transaction_start(thread->finedb->database, YFALSE);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+	if (txn == NULL)
+		goto error;
+	if (merge_load(thread->finedb->database, txn, thread->dbname, bin_name, &value) != YENOERR) {
+		database_transaction_rollback(txn);
+		goto error;
+	}
+	if ((rc = merge_apply(op, &value, bin_data)) != YENOERR) {
+		database_transaction_rollback(txn);
+		YFREE(value.data);
+		if (rc != YEINVAL)
+			goto error;
+		YLOG_ADD(YLOG_DEBUG, "MERGE on incompatible value");
+		YFREE(name);
+		YFREE(data);
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_BAD_VALUE));
+	}
+	memset(&zip_env, 0, sizeof(struct snappy_env));
+	if (snappy_init_env(&zip_env)) {
+		YLOG_ADD(YLOG_WARN, "Unable to create Snappy environment.");
+		database_transaction_rollback(txn);
+		YFREE(value.data);
+		goto error;
+	}
+	rc = merge_store(thread->finedb->database, txn, &zip_env, thread->dbname, bin_name, value);
+	snappy_free_env(&zip_env);
+	if (rc != YENOERR) {
+		database_transaction_rollback(txn);
+		YFREE(value.data);
+		goto error;
+	}
+	if (database_transaction_commit(txn) != YENOERR) {
+		YFREE(value.data);
+		goto error;
+	}
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
+	connection_written(thread, &bin_name);
+	YFREE(name);
+	YFREE(data);
+	// send the new value
+	YLOG_ADD(YLOG_DEBUG, "MERGE command OK");
+	rc = connection_send_response(thread, RESP_OK, YFALSE, YFALSE, (value.data ? value.data : ""), value.len);
+	YFREE(value.data);
+	return (rc);
+error:
+	YLOG_ADD(YLOG_WARN, "MERGE error");
+	YFREE(name);
+	YFREE(data);
+	YFREE(msg);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
@@ -15,6 +15,7 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	uint16_t *pname_len, name_len;
 	uint32_t *pdata_len, data_len;
 	void *ptr, *name = NULL, *data = NULL;
+	ybin_t bin_name;
 	writer_msg_t *msg = NULL;
 	char answer;
 	size_t zip_len;
@@ -37,7 +38,9 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	if ((name = YMALLOC((size_t)name_len)) == NULL)
 		goto error;
 	memcpy(name, ptr, (size_t)name_len);
-	YLOG_ADD(YLOG_DEBUG, "NAME : '%s'.", name);
+	YLOG_ADD(YLOG_DEBUG, "NAME : '%.*s'.", (int)name_len, (char*)name);
+	ybin_set(&bin_name, name, name_len);
+	hotkeys_add(thread->hotkeys, HOTKEYS_WRITE, thread->dbname, bin_name);
 	// read data length
 	if (connection_read_data(thread, buff, sizeof(data_len)) != YENOERR)
 		goto error;
@@ -51,7 +54,7 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 		if ((data = YMALLOC((size_t)data_len)) == NULL)
 			goto error;
 		memcpy(data, ptr, (size_t)data_len);
-		YLOG_ADD(YLOG_DEBUG, "DATA : '%s'.", data);
+		YLOG_ADD(YLOG_DEBUG, "DATA : %u bytes.", data_len);
 	}
 
 	// not synchronized: immediate response
@@ -65,9 +68,15 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 	msg->create_only = create_only;
 	ybin_set(&msg->name, name, name_len);
 	if (compress) {
+		size_t raw_len;
+
 		ybin_set(&msg->data, data, data_len);
+		// uncompressed size, for the compression ratio
+		if (data_len && snappy_uncompressed_length(data, data_len, &raw_len))
+			stats_add_zip(thread->stats, raw_len, data_len);
 	} else {
 		// data are not already compressed
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
 		memset(&zip_env, 0, sizeof(struct snappy_env));
 		if (snappy_init_env(&zip_env)) {
 			YLOG_ADD(YLOG_WARN, "Unable to create Snappy environment.");
@@ -85,29 +94,36 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 		zip_data[zip_len] = '\0';
 		snappy_free_env(&zip_env);
 		ybin_set(&msg->data, zip_data, zip_len);
+		stats_add_zip(thread->stats, data_len, zip_len);
 		YFREE(data);
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_ZIP);
 	}
 	if (!sync && !update_only) {
 		// not synchronized, send the message to the writer thread
 		msg->dbname = thread->dbname ? strdup(thread->dbname) : NULL;
-		if (nn_send(thread->write_sock, &msg, sizeof(msg), 0) < 0) {
+		if (connection_send_writer(thread, msg) != YENOERR) {
 			YLOG_ADD(YLOG_WARN, "Unable to send message to writer thread.");
 			goto error;
 		}
 		return (YENOERR);
 	}
-	// synchronized
+	// synchronized: the write lock could be held by the writer thread
+	if (txn == NULL) {
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+		txn = database_transaction_start(thread->finedb->database, YFALSE);
+		SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+		if (txn == NULL) {
+			YLOG_ADD(YLOG_WARN, "Unable to open transaction.");
+			goto error;
+		}
+	}
 	if (update_only) {
-		// update only: open a transaction and check if the key already exists
+		// update only: check if the key already exists
 		ybin_t data;
 		int rc;
 
 		YLOG_ADD(YLOG_DEBUG, "Update only!");
-		if (txn == NULL && (txn = database_transaction_start(thread->finedb->database, YFALSE)) == NULL) {
-			YLOG_ADD(YLOG_WARN, "Unable to open transaction.");
-			goto error;
-		}
-		rc = database_get(thread->finedb->database, txn, thread->dbname, msg->name, &data);
+		rc = database_get(thread->finedb->database, txn, thread->dbname, msg->name, &data, NULL);
 		if (rc != YENOERR) {
 			if (thread->transaction == NULL)
 				database_transaction_rollback(txn);
@@ -121,20 +137,27 @@ yerr_t command_put(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t
 			}
 		}
 	}
-	if (database_put(thread->finedb->database, txn, create_only, thread->dbname, msg->name, msg->data) == YENOERR) {
+	if (database_put(thread->finedb->database, txn, create_only, thread->dbname, msg->name,
+	                 msg->data, 0, NULL) == YENOERR) {
 		YLOG_ADD(YLOG_DEBUG, "Data written to database.");
 		answer = 1;
 	} else {
 		YLOG_ADD(YLOG_WARN, "Unable to write data into database.");
 		answer = 0;
 	}
-	// if it was an update, the transaction is closed
-	if (update_only && thread->transaction == NULL &&
-	    database_transaction_commit(txn) != YENOERR) {
-		YLOG_ADD(YLOG_WARN, "Unable to commit transaction.");
-		goto error;
+	// the transaction is closed
+	if (thread->transaction == NULL) {
+		if (!answer)
+			database_transaction_rollback(txn);
+		else if (database_transaction_commit(txn) != YENOERR) {
+			YLOG_ADD(YLOG_WARN, "Unable to commit transaction.");
+			answer = 0;
+		}
 	}
+	if (answer)
+		connection_written(thread, &msg->name);
 end_of_process:
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_TXN);
 	YLOG_ADD(YLOG_DEBUG, "PUT command %s", (answer ? "OK" : "failed"));
 	return (connection_send_response(thread, (answer ? RESP_OK : RESP_ERR_BAD_NAME),
 	                                 YFALSE, YFALSE, NULL, 0));
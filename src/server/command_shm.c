@@ -0,0 +1,110 @@
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include "ylog.h"
+#include "yring.h"
+#include "command.h"
+#include "protocol.h"
+
+/* private functions */
+static yerr_t _command_shm_send_fd(int sock, int fd, uint32_t size);
+
+/* Process a SHM command. */
+yerr_t command_shm(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	uint32_t *psize, size;
+	size_t ring_size = 0;
+	void *mem = MAP_FAILED;
+	int fd = -1;
+
+	YLOG_ADD(YLOG_DEBUG, "SHM command");
+	// read rings size
+	if (connection_read_data(thread, buff, sizeof(size)) != YENOERR)
+		goto error;
+	psize = ydynabin_forward(buff, sizeof(size));
+	size = ntohl(*psize);
+	if (!size)
+		size = PROTO_SHM_DEFAULT_SIZE;
+	// check the size and the connection type (the client could use the socket anyway)
+	if (size < PROTO_SHM_MIN_SIZE || size > PROTO_SHM_MAX_SIZE || (size & (size - 1)) ||
+	    thread->shm || thread->transaction ||
+	    getsockname(thread->fd, (struct sockaddr*)&addr, &addr_len) || addr.ss_family != AF_UNIX) {
+		YLOG_ADD(YLOG_DEBUG, "Shared memory refused.");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL));
+	}
+	// create the shared memory segment (requests ring, then responses ring)
+	ring_size = yring_memsize(size);
+	if ((fd = memfd_create("finedb", MFD_CLOEXEC)) < 0 ||
+	    ftruncate(fd, (off_t)(2 * ring_size)) ||
+	    (mem = mmap(NULL, 2 * ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		YLOG_ADD(YLOG_WARN, "Unable to create shared memory.");
+		goto error;
+	}
+	yring_init(mem, size);
+	yring_init((char*)mem + ring_size, size);
+	// send the file descriptor
+	if (_command_shm_send_fd(thread->fd, fd, size) != YENOERR)
+		goto error;
+	close(fd);
+	thread->shm = mem;
+	thread->shm_size = 2 * ring_size;
+	thread->shm_in = (yring_t*)mem;
+	thread->shm_out = (yring_t*)((char*)mem + ring_size);
+	YLOG_ADD(YLOG_DEBUG, "SHM command OK");
+	return (YENOERR);
+error:
+	YLOG_ADD(YLOG_WARN, "SHM error");
+	if (mem != MAP_FAILED)
+		munmap(mem, 2 * ring_size);
+	if (fd >= 0)
+		close(fd);
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_command_shm_send_fd
+ *		Send an OK response, with the rings size, and a file descriptor
+ *		as ancillary data.
+ * @param	sock	Unix socket connected to the client.
+ * @param	fd	File descriptor of the shared memory segment.
+ * @param	size	Size of each ring.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _command_shm_send_fd(int sock, int fd, uint32_t size) {
+	unsigned char code_byte = RESP_OK;
+	uint32_t size_nbr = htonl(size);
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct iovec iov[2];
+	struct msghdr mh;
+
+	iov[0].iov_base = (caddr_t)&code_byte;
+	iov[0].iov_len = sizeof(code_byte);
+	iov[1].iov_base = (caddr_t)&size_nbr;
+	iov[1].iov_len = sizeof(size_nbr);
+	memset(&mh, 0, sizeof(mh));
+	memset(&control, 0, sizeof(control));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 2;
+	mh.msg_control = control.buf;
+	mh.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	if (sendmsg(sock, &mh, 0) != (ssize_t)(sizeof(code_byte) + sizeof(size_nbr))) {
+		YLOG_ADD(YLOG_WARN, "Unable to send the file descriptor.");
+		return (YEIO);
+	}
+	return (YENOERR);
+}
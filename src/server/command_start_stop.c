@@ -5,14 +5,22 @@
 
 /* Process a START command. */
 yerr_t command_start(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	MDB_envinfo info;
+	MDB_stat stat;
+
 	YLOG_ADD(YLOG_DEBUG, "START command");
 	// rollback previous transaction
 	if (thread->transaction != NULL)
 		database_transaction_rollback(thread->transaction);
+	__atomic_store_n(&thread->transaction_start, 0, __ATOMIC_RELAXED);
 	// open transaction
 	thread->transaction = database_transaction_start(thread->finedb->database, YTRUE);
 	if (thread->transaction == NULL)
 		goto error;
+	// the age of the transaction is given by the ADMIN LMDB command
+	if (database_info(thread->finedb->database, &info, &stat) == YENOERR)
+		thread->transaction_txnid = info.me_last_txnid;
+	__atomic_store_n(&thread->transaction_start, stats_now(), __ATOMIC_RELEASE);
 	CONNECTION_SEND_OK(thread);
 	return (YENOERR);
 error:
@@ -30,6 +38,7 @@ yerr_t command_stop(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_
 	// rollback transaction
 	database_transaction_rollback(thread->transaction);
 	thread->transaction = NULL;
+	__atomic_store_n(&thread->transaction_start, 0, __ATOMIC_RELAXED);
 	CONNECTION_SEND_OK(thread);
 	return (YENOERR);
 error:
@@ -0,0 +1,56 @@
+#include <string.h>
+#include "ylog.h"
+#include "command.h"
+#include "protocol.h"
+#include "tracking.h"
+
+/* Process a TRACK command. */
+yerr_t command_track(tcp_thread_t *thread, ybool_t sync, ybool_t compress, ybool_t serialized, ydynabin_t *buff) {
+	unsigned char *pop, *pid, id;
+	int tracker;
+
+	YLOG_ADD(YLOG_DEBUG, "TRACK command");
+	// read operation
+	if (connection_read_data(thread, buff, sizeof(unsigned char)) != YENOERR)
+		goto error;
+	pop = ydynabin_forward(buff, sizeof(unsigned char));
+	if (*pop == PROTO_TRACK_ATTACH) {
+		// keys read by this connection are tracked for the given ID
+		if (connection_read_data(thread, buff, sizeof(id)) != YENOERR)
+			goto error;
+		pid = ydynabin_forward(buff, sizeof(id));
+		if (*pid >= TRACKING_MAX_CLIENTS)
+			return (CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL));
+		thread->tracker = *pid;
+		return (CONNECTION_SEND_OK(thread));
+	} else if (*pop == PROTO_TRACK_DETACH) {
+		thread->tracker = -1;
+		return (CONNECTION_SEND_OK(thread));
+	} else if (*pop != PROTO_TRACK_SUBSCRIBE) {
+		YLOG_ADD(YLOG_DEBUG, "Bad TRACK operation '%x'", *pop);
+		CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL);
+		return (YEPROTO);
+	}
+	// invalidation connection: only on sockets
+	if (thread->shm || thread->transaction) {
+		YLOG_ADD(YLOG_DEBUG, "Invalidation connection refused.");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_PROTOCOL));
+	}
+	if ((tracker = tracking_subscribe(thread->finedb->tracking)) < 0) {
+		YLOG_ADD(YLOG_WARN, "Too many invalidation connections.");
+		return (CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER));
+	}
+	id = (unsigned char)tracker;
+	if (connection_send_response(thread, RESP_OK, YFALSE, YFALSE, &id, sizeof(id)) != YENOERR) {
+		YLOG_ADD(YLOG_WARN, "TRACK error");
+		return (YEIO);
+	}
+	// push invalidation records until the client disconnects
+	YLOG_ADD(YLOG_DEBUG, "Invalidation connection %d", tracker);
+	tracking_run(thread->finedb->tracking, tracker, thread->fd);
+	return (YECONNRESET);
+error:
+	YLOG_ADD(YLOG_WARN, "TRACK error");
+	CONNECTION_SEND_ERROR(thread, RESP_ERR_SERVER);
+	return (YEIO);
+}
@@ -1,7 +1,10 @@
 #include <unistd.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
+#include <endian.h>
 #include "nanomsg/nn.h"
 #include "nanomsg/pipeline.h"
 #include "ydefs.h"
@@ -11,6 +14,14 @@
 #include "database.h"
 #include "command.h"
 
+/* private functions */
+static yerr_t _connection_read_socket(tcp_thread_t *thread, ydynabin_t *container, size_t size);
+static yerr_t _connection_read_shm(tcp_thread_t *thread, ydynabin_t *container, size_t size);
+static protocol_stats_result_t _connection_result(protocol_response_t response, yerr_t rc);
+static yerr_t _connection_send(tcp_thread_t *thread, protocol_response_t code,
+                               ybool_t serialized, ybool_t compressed, const uint64_t *version,
+                               const void *data, size_t data_len);
+
 /* Array of command handlers. */
 static command_handler_t _commands[] = {
 	command_ping,
@@ -20,14 +31,14 @@ static command_handler_t _commands[] = {
 	command_setdb,
 	command_start,
 	command_stop,
+	command_aggregate,
+	command_merge,
+	command_cas,
+	command_shm,
+	command_batch,
+	command_track,
 	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL,
-	NULL, //command_admin,
+	command_admin,
 	NULL  //command_extra
 };
 
@@ -39,6 +50,12 @@ tcp_thread_t *connection_thread_new(finedb_t *finedb) {
 	thread = YMALLOC(sizeof(tcp_thread_t));
 	thread->fd = -1;
 	thread->finedb = finedb;
+	thread->shm = NULL;
+	thread->shm_in = thread->shm_out = NULL;
+	thread->tracker = -1;
+	thread->stats = stats_thread_new(finedb->stats);
+	thread->hotkeys = hotkeys_thread_new(finedb->hotkeys);
+	thread->capture = finedb->capture ? capture_thread_new(finedb->capture) : NULL;
 	// thread creation
 	if (pthread_create(&(thread->tid), 0, connection_thread_execution,
 	    thread)) {
@@ -57,9 +74,21 @@ void connection_thread_disconnect(tcp_thread_t *thread) {
 	if (thread->transaction) {
 		database_transaction_rollback(thread->transaction);
 		thread->transaction = NULL;
+		__atomic_store_n(&thread->transaction_start, 0, __ATOMIC_RELAXED);
+	}
+	if (thread->shm) {
+		// the client could be waiting on a ring
+		yring_close(thread->shm_in);
+		yring_close(thread->shm_out);
+		munmap(thread->shm, thread->shm_size);
+		thread->shm = NULL;
+		thread->shm_in = thread->shm_out = NULL;
 	}
 	shutdown(thread->fd, SHUT_RDWR);
+	close(thread->fd);
 	thread->fd = -1;
+	STATS_GAUGE_ADD(thread->finedb->stats->connections, -1);
+	thread->tracker = -1;
 	YFREE(thread->dbname);
 }
 
@@ -98,6 +127,9 @@ void *connection_thread_execution(void *param) {
 		    thread->fd < 0)
 			continue;
 		YLOG_ADD(YLOG_DEBUG, "Process an incoming connection.");
+		STATS_GAUGE_ADD(thread->finedb->stats->connections, 1);
+		STATS_GAUGE_ADD(thread->finedb->stats->accepted, 1);
+		capture_connect(thread->finedb->capture, thread->capture);
 		// create a dynamic buffer
 		buff = ydynabin_new(NULL, 0, YFALSE);
 		// loop on incoming requests
@@ -105,12 +137,16 @@ void *connection_thread_execution(void *param) {
 			unsigned char *request, command;
 			ybool_t sync, compress, serialized;
 			command_handler_t func;
+			uint64_t start;
+			yerr_t rc;
 
 			YLOG_ADD(YLOG_DEBUG, "Processing a new request.");
 			if (connection_read_data(thread, buff, 1) != YENOERR) {
 				YLOG_ADD(YLOG_DEBUG, "The socket was closed.");
 				goto end_of_connection;
 			}
+			// the request is timed from its first byte
+			slowlog_start(thread->finedb->slowlog, &thread->timer);
 			// read request
 			request = ydynabin_forward(buff, sizeof(unsigned char));
 			command = REQUEST_COMMAND(*request);
@@ -127,11 +163,21 @@ void *connection_thread_execution(void *param) {
 				goto end_of_connection;
 			}
 			YLOG_ADD(YLOG_DEBUG, "Command %x", command);
-			if (func(thread, sync, compress, serialized, buff) != YENOERR)
+			start = stats_now();
+			thread->response = RESP_ERR_UNDEFINED;
+			rc = func(thread, sync, compress, serialized, buff);
+			stats_add(thread->stats, command, sync, _connection_result(thread->response, rc),
+			          stats_now() - start);
+			slowlog_end(thread->finedb->slowlog, &thread->timer, command, sync, thread->response,
+			            STATS_GAUGE_GET(thread->finedb->stats->queued));
+			// the bytes that are still unread belong to the next requests
+			capture_frame(thread->finedb->capture, thread->capture, start, buff->len);
+			if (rc != YENOERR)
 				goto end_of_connection;
 		}
 end_of_connection:
 		YLOG_ADD(YLOG_DEBUG, "End of connection.");
+		capture_disconnect(thread->finedb->capture, thread->capture);
 		connection_thread_disconnect(thread);
 		ydynabin_delete(buff);
 	}
@@ -140,14 +186,84 @@ end_of_connection:
 
 /* Fill a dynamic buffer. */
 yerr_t connection_read_data(tcp_thread_t *thread, ydynabin_t *container, size_t size) {
-	char buff[8196];
-	ssize_t bufsz;
-	yerr_t dynaerr;
+	yerr_t rc;
 
 	if (thread->fd < 0)
 		return (YECONNRESET);
 	if (container->len >= size)
 		return (YENOERR);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	if (thread->shm_in)
+		rc = _connection_read_shm(thread, container, size);
+	else
+		rc = _connection_read_socket(thread, container, size);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_RECV);
+	return (rc);
+}
+
+/* Send a response. */
+yerr_t connection_send_response(tcp_thread_t *thread, protocol_response_t code,
+                                ybool_t serialized, ybool_t compressed,
+                                const void *data, size_t data_len) {
+	yerr_t rc;
+
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	rc = _connection_send(thread, code, serialized, compressed, NULL, data, data_len);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_SEND);
+	return (rc);
+}
+
+/* Send a value and its version. */
+yerr_t connection_send_value(tcp_thread_t *thread, ybool_t serialized, ybool_t compressed,
+                             uint64_t version, const void *data, size_t data_len) {
+	yerr_t rc;
+
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	rc = _connection_send(thread, RESP_OK, serialized, compressed, &version,
+	                      (data ? data : ""), data_len);
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_SEND);
+	return (rc);
+}
+
+/* Send a message to the writer thread. */
+yerr_t connection_send_writer(tcp_thread_t *thread, writer_msg_t *msg) {
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_PARSE);
+	// counted before sending, the writer could commit it at once
+	STATS_GAUGE_ADD(thread->finedb->stats->queued, 1);
+	if (nn_send(thread->write_sock, &msg, sizeof(msg), 0) < 0) {
+		STATS_GAUGE_ADD(thread->finedb->stats->queued, -1);
+		return (YEIO);
+	}
+	SLOWLOG_STAGE(&thread->timer, SLOWLOG_QUEUE);
+	return (YENOERR);
+}
+
+/* Forget a written key. */
+void connection_written(tcp_thread_t *thread, ybin_t *key) {
+	// writes are not possible inside a transaction
+	if (thread->transaction)
+		return;
+	if (thread->finedb->hotcache)
+		hotcache_remove(thread->finedb->hotcache, thread->dbname, key);
+	singleflight_forget(thread->finedb->singleflight, thread->dbname, key);
+	if (TRACKING_ACTIVE(thread->finedb->tracking))
+		tracking_invalidate_key(thread->finedb->tracking, thread->dbname, key);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_connection_read_socket
+ *		Fill a dynamic buffer from the socket.
+ * @param	thread		Pointer to the thread structure.
+ * @param	container	Pointer to ydynabin_t structure.
+ * @param	size		Minimal size of the buffer.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _connection_read_socket(tcp_thread_t *thread, ydynabin_t *container, size_t size) {
+	char buff[8196];
+	ssize_t bufsz;
+	yerr_t dynaerr;
+
 	while (container->len < size) {
 		// define timeout on the socket
 		struct timeval tv;
@@ -170,6 +286,7 @@ yerr_t connection_read_data(tcp_thread_t *thread, ydynabin_t *container, size_t
 		tv.tv_sec = 0;
 		if (setsockopt(thread->fd, SOL_SOCKET, SO_RCVTIMEO, (void*)&tv, sizeof(tv)) < 0)
 			YLOG_ADD(YLOG_WARN, "Unable to remove RCVTIMEO from socket.");
+		capture_received(thread->capture, buff, (size_t)bufsz);
 		// expand the buffer
 		if ((dynaerr = ydynabin_expand(container, buff, (size_t)bufsz)) != YENOERR)
 			return (dynaerr);
@@ -177,18 +294,96 @@ yerr_t connection_read_data(tcp_thread_t *thread, ydynabin_t *container, size_t
 	return (YENOERR);
 }
 
-/* Send a response. */
-yerr_t connection_send_response(tcp_thread_t *thread, protocol_response_t code,
-                                ybool_t serialized, ybool_t compressed,
-                                const void *data, size_t data_len) {
+/**
+ * @function	_connection_read_shm
+ *		Fill a dynamic buffer from the shared-memory ring. The socket
+ *		is checked from time to time, to detect a dead client.
+ * @param	thread		Pointer to the thread structure.
+ * @param	container	Pointer to ydynabin_t structure.
+ * @param	size		Minimal size of the buffer.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _connection_read_shm(tcp_thread_t *thread, ydynabin_t *container, size_t size) {
+	char buff[8196];
+	unsigned int waited = 0;
+	ssize_t bufsz;
+	yerr_t dynaerr;
+
+	while (container->len < size) {
+		bufsz = yring_read(thread->shm_in, buff, sizeof(buff), CONNECTION_SHM_POLL_MS);
+		if (bufsz == YETIMEDOUT) {
+			struct pollfd pfd;
+
+			// check if the client closed its socket
+			pfd.fd = thread->fd;
+			pfd.events = POLLRDHUP;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+				YLOG_ADD(YLOG_DEBUG, "Socket closed");
+				return (YECONNRESET);
+			}
+			waited += CONNECTION_SHM_POLL_MS;
+			if (thread->finedb->timeout && waited >= thread->finedb->timeout * 1000U) {
+				YLOG_ADD(YLOG_DEBUG, "Ring timeout");
+				return (YEACCESS);
+			}
+			continue;
+		}
+		if (bufsz <= 0) {
+			YLOG_ADD(YLOG_DEBUG, "Ring closed");
+			return (YECONNRESET);
+		}
+		waited = 0;
+		capture_received(thread->capture, buff, (size_t)bufsz);
+		if ((dynaerr = ydynabin_expand(container, buff, (size_t)bufsz)) != YENOERR)
+			return (dynaerr);
+	}
+	return (YENOERR);
+}
+
+/**
+ * @function	_connection_result
+ *		Return the result of a request, for the statistics.
+ * @param	response	Code of the last response sent (RESP_ERR_UNDEFINED
+ *				if no response was sent).
+ * @param	rc		Return value of the command handler.
+ * @return	The result.
+ */
+static protocol_stats_result_t _connection_result(protocol_response_t response, yerr_t rc) {
+	// asynchronous requests get no response
+	if (response == RESP_OK || (response == RESP_ERR_UNDEFINED && rc == YENOERR))
+		return (PROTO_STATS_HIT);
+	if (response == RESP_ERR_BAD_NAME || response == RESP_ERR_VERSION)
+		return (PROTO_STATS_MISS);
+	return (PROTO_STATS_ERROR);
+}
+
+/**
+ * @function	_connection_send
+ *		Send a response to the client.
+ * @param	thread		Pointer to the thread structure.
+ * @param	code		Response code.
+ * @param	serialized	YTRUE if the data is serialized.
+ * @param	compressed	YTRUE if the data is compressed.
+ * @param	version		Pointer to the version of the value, sent
+ *				before the data. NULL if there is no version.
+ * @param	data		Pointer to the data to send, or NULL if there is no data.
+ * @param	data_len	Date size. Unused if data is NULL.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _connection_send(tcp_thread_t *thread, protocol_response_t code,
+                               ybool_t serialized, ybool_t compressed, const uint64_t *version,
+                               const void *data, size_t data_len) {
 	unsigned char code_byte;
-	struct iovec iov[3];
+	struct iovec iov[4];
 	struct msghdr mh;
 	ssize_t expected = 1, rc;
 	uint32_t data_nlen;
+	uint64_t version_nbr;
 	struct timeval tv;
 
 	YLOG_ADD(YLOG_DEBUG, "Send response (%d).", code);
+	thread->response = code;
 	mh.msg_name = NULL;
 	mh.msg_namelen = 0;
 	mh.msg_iov = iov;
@@ -204,16 +399,33 @@ yerr_t connection_send_response(tcp_thread_t *thread, protocol_response_t code,
 		code_byte = RESPONSE_ADD_COMPRESSED(code_byte);
 	iov[0].iov_base = (caddr_t)&code_byte;
 	iov[0].iov_len = sizeof(code_byte);
+	// version
+	if (version != NULL) {
+		version_nbr = htobe64(*version);
+		iov[mh.msg_iovlen].iov_base = (caddr_t)&version_nbr;
+		iov[mh.msg_iovlen].iov_len = sizeof(uint64_t);
+		mh.msg_iovlen++;
+		expected += sizeof(uint64_t);
+	}
 	// data
 	if (data != NULL) {
 		data_nlen = htonl((uint32_t)data_len);
-		iov[1].iov_base = (caddr_t)&data_nlen;
-		iov[1].iov_len = sizeof(uint32_t);
-		iov[2].iov_base = (caddr_t)data;
-		iov[2].iov_len = data_len;
-		mh.msg_iovlen = 3;
+		iov[mh.msg_iovlen].iov_base = (caddr_t)&data_nlen;
+		iov[mh.msg_iovlen].iov_len = sizeof(uint32_t);
+		iov[mh.msg_iovlen + 1].iov_base = (caddr_t)data;
+		iov[mh.msg_iovlen + 1].iov_len = data_len;
+		mh.msg_iovlen += 2;
 		expected += sizeof(unsigned int) + data_len;
 	}
+	// shared memory: write the response into the ring
+	if (thread->shm_out) {
+		if (yring_writev(thread->shm_out, iov, (int)mh.msg_iovlen,
+		                 (thread->finedb->timeout ? thread->finedb->timeout * 1000 : -1)) != YENOERR) {
+			YLOG_ADD(YLOG_WARN, "Unable to write response into the ring.");
+			return (YEIO);
+		}
+		return (YENOERR);
+	}
 	// define timeout on the socket
 	tv.tv_sec = thread->finedb->timeout;
 	tv.tv_usec = 0;
@@ -236,6 +448,6 @@ yerr_t connection_send_response(tcp_thread_t *thread, protocol_response_t code,
 	if (setsockopt(thread->fd, SOL_SOCKET, SO_SNDTIMEO, (void*)&tv, sizeof(tv)) < 0)
 		YLOG_ADD(YLOG_WARN, "Unable to remove SNDTIMEO from socket.");
 	// return
-	YLOG_ADD(YLOG_DEBUG, "Sent %d bytes '%s'.", rc, data);
+	YLOG_ADD(YLOG_DEBUG, "Sent %d bytes.", rc);
 	return (YENOERR);
 }
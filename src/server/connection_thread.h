@@ -1,13 +1,20 @@
 #ifndef __CONNECTION_THREAD_H__
 #define __CONNECTION_THREAD_H__
 
+#include <stdint.h>
 #include <pthread.h>
 #include <time.h>
 #include "ydefs.h"
 #include "yerror.h"
 #include "ydynabin.h"
+#include "yring.h"
 #include "finedb.h"
 #include "protocol.h"
+#include "stats.h"
+#include "slowlog.h"
+#include "hotkeys.h"
+#include "capture.h"
+#include "writer_thread.h"
 
 /**
  * @typedef	tcp_thread_t
@@ -19,6 +26,24 @@
  * @field	write_sock	Nanomsg socket to send data to the writer thread.
  * @field	dbname		Name of the selected database (NULL = default).
  * @field	transaction	Pointer to the running transaction. Default to NULL.
+ * @field	transaction_start	Start time of the running transaction
+ *				(nanoseconds), 0 if none. Read by other threads.
+ * @field	transaction_txnid	ID of the last committed transaction when
+ *				the running transaction started.
+ * @field	shm		Pointer to the shared memory mapping, used instead
+ *				of the socket after a SHM command. NULL otherwise.
+ * @field	shm_size	Size of the shared memory mapping.
+ * @field	shm_in		Ring used to receive requests.
+ * @field	shm_out		Ring used to send responses.
+ * @field	tracker		Tracking ID of the keys read by the client, -1
+ *				if the client doesn't cache any value.
+ * @field	stats		Latency statistics of the thread's requests.
+ * @field	hotkeys		Count of the keys accessed by the thread.
+ * @field	capture		Ring of the captured requests. NULL if the
+ *				capture is disabled.
+ * @field	timer		Timing of the running request, for the
+ *				slow-request log.
+ * @field	response	Code of the last response sent.
  */
 typedef struct tcp_thread_s {
 	pthread_t tid;
@@ -27,6 +52,18 @@ typedef struct tcp_thread_s {
 	int write_sock;
 	char *dbname;
 	MDB_txn *transaction;
+	uint64_t transaction_start;
+	size_t transaction_txnid;
+	void *shm;
+	size_t shm_size;
+	yring_t *shm_in;
+	yring_t *shm_out;
+	int tracker;
+	stats_thread_t *stats;
+	hotkeys_thread_t *hotkeys;
+	capture_thread_t *capture;
+	slowlog_timer_t timer;
+	protocol_response_t response;
 } tcp_thread_t;
 
 /**
@@ -44,6 +81,9 @@ typedef enum tcp_state_e {
 	STATE_FILENAME
 } tcp_state_t;
 
+/** @define CONNECTION_SHM_POLL_MS Time between two checks of a shared-memory client's socket. */
+#define CONNECTION_SHM_POLL_MS	1000
+
 /** @define CONNECTION_SEND_OK Send a simple OK response to the client. */
 #define CONNECTION_SEND_OK(thread)	connection_send_response(thread, RESP_OK, YFALSE, YFALSE, NULL, 0)
 
@@ -85,7 +125,8 @@ void *connection_thread_execution(void *param);
 /**
  * @function	connection_read_data
  *		Ensures that a dynamic binary buffer contains the given number
- *		of characters. If not, the needed data is read from socket.
+ *		of characters. If not, the needed data is read from socket (or
+ *		from the shared-memory ring).
  * @param	thread		Pointer to the thread structure.
  * @param	container	Pointer to ydynabin_t structure.
  * @param	size		Minimal size of the buffer.
@@ -108,4 +149,38 @@ yerr_t connection_send_response(tcp_thread_t *thread, protocol_response_t code,
                                 ybool_t serialized, ybool_t compressed,
                                 const void *data, size_t data_len);
 
+/**
+ * @function	connection_send_value
+ *		Send an OK response with a value and its version.
+ * @param	thread		Pointer to the thread structure.
+ * @param	serialized	YTRUE if the data is serialized.
+ * @param	compressed	YTRUE if the data is compressed.
+ * @param	version		Version of the value.
+ * @param	data		Pointer to the data to send.
+ * @param	data_len	Date size.
+ * @return	YENOERR if OK.
+ */
+yerr_t connection_send_value(tcp_thread_t *thread, ybool_t serialized, ybool_t compressed,
+                             uint64_t version, const void *data, size_t data_len);
+
+/**
+ * @function	connection_send_writer
+ *		Send a message to the writer thread.
+ * @param	thread	Pointer to the thread structure.
+ * @param	msg	Pointer to the message.
+ * @return	YENOERR if OK.
+ */
+yerr_t connection_send_writer(tcp_thread_t *thread, writer_msg_t *msg);
+
+/**
+ * @function	connection_written
+ *		Remove a key written by a synchronous request from the
+ *		hot-value cache, and send invalidation records to the clients
+ *		that cache it. Must be called after the commit.
+ * @param	thread	Pointer to the thread structure.
+ * @param	key	Pointer to the key. NULL if the whole database was
+ *			modified.
+ */
+void connection_written(tcp_thread_t *thread, ybin_t *key);
+
 #endif /* __CONNECTION_THREAD_H__ */
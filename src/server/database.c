@@ -1,5 +1,10 @@
+#include <endian.h>
+#include <string.h>
 #include "database.h"
 
+/* private functions */
+static uint64_t _database_version(MDB_val *db_data);
+
 /* Open a LMDB database. */
 MDB_env *database_open(const char *path, size_t mapsize, unsigned int nbr_readers, unsigned int nbr_dbs) {
 	MDB_env *env;
@@ -86,17 +91,19 @@ void database_transaction_rollback(MDB_txn *transaction) {
 }
 
 /* Add or update a key in database. */
-yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, const char *name, ybin_t key, ybin_t data) {
+yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, const char *name, ybin_t key,
+                    ybin_t data, uint64_t version, uint64_t *new_version) {
 	MDB_dbi dbi;
 	MDB_txn *txn = transaction;
 	MDB_val db_key, db_data;
 	int rc;
-	unsigned int flags = 0;
+	unsigned int flags = MDB_RESERVE;
+	uint64_t current, nversion;
 	yerr_t retval = YENOERR;
 
 	// create only mode
 	if (create_only)
-		flags = MDB_NOOVERWRITE;
+		flags |= MDB_NOOVERWRITE;
 	// transaction init
 	if (txn == NULL && (txn = database_transaction_start(env, YFALSE)) == NULL)
 		return (YEACCESS);
@@ -107,19 +114,38 @@ yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, con
 		retval = YEACCESS;
 		goto end_of_process;
 	}
-	// key and data init
+	// key init
 	db_key.mv_size = key.len;
 	db_key.mv_data = key.data;
-	db_data.mv_size = data.len;
-	db_data.mv_data = data.data;
-	// put data
+	// get the current version
+	rc = mdb_get(txn, dbi, &db_key, &db_data);
+	if (rc && rc != MDB_NOTFOUND) {
+		YLOG_ADD(YLOG_WARN, "Unable to read data in database (%s).", mdb_strerror(rc));
+		retval = YEACCESS;
+		goto end_of_process;
+	}
+	current = rc ? 0 : _database_version(&db_data);
+	if (version && version != current) {
+		YLOG_ADD(YLOG_DEBUG, "Version mismatch (%llu / %llu).", (unsigned long long)version,
+		         (unsigned long long)current);
+		retval = YEAGAIN;
+		goto end_of_process;
+	}
+	// put data (the space is reserved, then the version and the data are copied)
+	db_data.mv_size = DATABASE_VERSION_SIZE + data.len;
+	db_data.mv_data = NULL;
 	rc = mdb_put(txn, dbi, &db_key, &db_data, flags);
 	if (rc) {
 		YLOG_ADD(YLOG_WARN, "Unable to write data in database (%s).", mdb_strerror(rc));
 		retval = YEACCESS;
+		goto end_of_process;
 	}
-	// close database
-	mdb_dbi_close(env, dbi);
+	nversion = htobe64(current + 1);
+	memcpy(db_data.mv_data, &nversion, DATABASE_VERSION_SIZE);
+	if (data.len)
+		memcpy((char*)db_data.mv_data + DATABASE_VERSION_SIZE, data.data, data.len);
+	if (new_version)
+		*new_version = current + 1;
 end_of_process:
 	// transaction commit
 	if (retval == YENOERR && transaction == NULL &&
@@ -131,10 +157,10 @@ end_of_process:
 }
 
 /* Remove a key from database. */
-yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key) {
+yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, uint64_t version) {
 	MDB_dbi dbi;
 	MDB_txn *txn = transaction;
-	MDB_val db_key;
+	MDB_val db_key, db_data;
 	int rc;
 	yerr_t retval = YENOERR;
 
@@ -151,14 +177,21 @@ yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t
 	// key and data init
 	db_key.mv_size = key.len;
 	db_key.mv_data = key.data;
+	// check the version
+	if (version) {
+		rc = mdb_get(txn, dbi, &db_key, &db_data);
+		if (rc || _database_version(&db_data) != version) {
+			YLOG_ADD(YLOG_DEBUG, "Version mismatch.");
+			retval = YEAGAIN;
+			goto end_of_process;
+		}
+	}
 	// put data
 	rc = mdb_del(txn, dbi, &db_key, NULL);
 	if (rc) {
 		YLOG_ADD(YLOG_WARN, "Unable to write data in database (%s).", mdb_strerror(rc));
 		retval = YEACCESS;
 	}
-	// close database
-	mdb_dbi_close(env, dbi);
 end_of_process:
 	// transaction commit
 	if (retval == YENOERR && transaction == NULL &&
@@ -170,22 +203,32 @@ end_of_process:
 }
 
 /* Get a key from database. */
-yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *data) {
+yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *data,
+                    uint64_t *version) {
 	MDB_dbi dbi;
 	MDB_txn *txn = transaction;
 	MDB_val db_key, db_data;
 	int rc;
-	yerr_t retval = YENOERR;
 
+	data->len = 0;
+	data->data = NULL;
+	if (version)
+		*version = 0;
 	// transaction init
 	if (txn == NULL && (txn = database_transaction_start(env, YTRUE)) == NULL)
 		return (YEACCESS);
-	// open database in read-write mode
+	// open database in read-only mode
 	rc = mdb_dbi_open(txn, name, 0, &dbi);
-	if (rc) {
+	if (rc == MDB_NOTFOUND) {
+		// a database that doesn't exist doesn't contain any key
+		if (transaction == NULL)
+			database_transaction_rollback(txn);
+		return (YENODATA);
+	} else if (rc) {
 		YLOG_ADD(YLOG_WARN, "Unable to open database handle (%s).", mdb_strerror(rc));
-		retval = YEACCESS;
-		goto end_of_process;
+		if (transaction == NULL)
+			database_transaction_rollback(txn);
+		return (YEACCESS);
 	}
 	// key and data init
 	db_key.mv_size = key.len;
@@ -195,21 +238,18 @@ yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t
 	// end of transaction
 	if (transaction == NULL)
 		database_transaction_rollback(txn);
-end_of_process:
-	// close database
-	mdb_dbi_close(env, dbi);
 	// return
 	if (!rc) {
-		// OK
-		data->len = db_data.mv_size;
-		data->data = db_data.mv_data;
+		// OK: skip the version stamp
+		if (version)
+			*version = _database_version(&db_data);
+		if (db_data.mv_size > DATABASE_VERSION_SIZE) {
+			data->len = db_data.mv_size - DATABASE_VERSION_SIZE;
+			data->data = (char*)db_data.mv_data + DATABASE_VERSION_SIZE;
+		}
 		return (YENOERR);
 	}
 	// KO
-	data->len = 0;
-	data->data = NULL;
-	if (retval != YENOERR)
-		return (retval);
 	if (rc == MDB_NOTFOUND) {
 		YLOG_ADD(YLOG_DEBUG, "No data (%s).", mdb_strerror(rc));
 		return (YENODATA);
@@ -220,19 +260,32 @@ end_of_process:
 
 /* Open a cursor on a database, and send every key/value pair to a callback. */
 yerr_t database_list(MDB_env *env, MDB_txn *transaction, const char *name, database_callback cb, void *cb_data) {
+	ybin_t empty;
+
+	ybin_set(&empty, NULL, 0);
+	return (database_range(env, transaction, name, empty, empty, cb, cb_data));
+}
+
+/* Open a cursor on a range of keys, and send every key/value pair to a callback. */
+yerr_t database_range(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t start, ybin_t end,
+                      database_callback cb, void *cb_data) {
 	MDB_dbi dbi;
 	MDB_txn *txn = transaction;
 	MDB_cursor *cursor;
-	MDB_val db_key, db_data;
+	MDB_val db_key, db_data, db_end;
+	MDB_cursor_op op = MDB_FIRST;
 	int rc;
 	yerr_t retval = YENOERR;
 
 	// transaction init
 	if (txn == NULL && (txn = database_transaction_start(env, YTRUE)) == NULL)
 		return (YEACCESS);
-	// open database in read-write mode
+	// open database in read-only mode
 	rc = mdb_dbi_open(txn, name, 0, &dbi);
-	if (rc) {
+	if (rc == MDB_NOTFOUND) {
+		// a database that doesn't exist doesn't contain any key
+		goto failure;
+	} else if (rc) {
 		YLOG_ADD(YLOG_WARN, "Unable to open database handle (%s).", mdb_strerror(rc));
 		retval = YEACCESS;
 		goto failure;
@@ -242,22 +295,34 @@ yerr_t database_list(MDB_env *env, MDB_txn *transaction, const char *name, datab
 	if (rc) {
 		YLOG_ADD(YLOG_WARN, "Unable to open cursor on database (%s).", mdb_strerror(rc));
 		retval = YEACCESS;
-		goto end_of_process;
+		goto failure;
 	}
+	// range boundaries
+	if (start.len) {
+		db_key.mv_size = start.len;
+		db_key.mv_data = start.data;
+		op = MDB_SET_RANGE;
+	}
+	db_end.mv_size = end.len;
+	db_end.mv_data = end.data;
 	// loop on cursor
-	while ((rc = mdb_cursor_get(cursor, &db_key, &db_data, MDB_NEXT)) == 0) {
+	while ((rc = mdb_cursor_get(cursor, &db_key, &db_data, op)) == 0) {
 		ybin_t key, data;
 
+		op = MDB_NEXT;
+		if (end.len && mdb_cmp(txn, dbi, &db_key, &db_end) >= 0)
+			break;
 		ybin_set(&key, db_key.mv_data, db_key.mv_size);
-		ybin_set(&data, db_data.mv_data, db_data.mv_size);
+		if (db_data.mv_size > DATABASE_VERSION_SIZE)
+			ybin_set(&data, (char*)db_data.mv_data + DATABASE_VERSION_SIZE,
+			         db_data.mv_size - DATABASE_VERSION_SIZE);
+		else
+			ybin_set(&data, NULL, 0);
 		if (cb(cb_data, key, data) != YENOERR)
 			break;
 	}
 	// close cursor
 	mdb_cursor_close(cursor);
-end_of_process:
-	// close database
-	mdb_dbi_close(env, dbi);
 failure:
 	// end of transaction
 	if (transaction == NULL)
@@ -299,3 +364,95 @@ end_of_process:
 		database_transaction_rollback(txn);
 	return (retval);
 }
+
+/* Get information about the environment. */
+yerr_t database_info(MDB_env *env, MDB_envinfo *info, MDB_stat *stat) {
+	int rc;
+
+	if ((rc = mdb_env_info(env, info)) || (rc = mdb_env_stat(env, stat))) {
+		YLOG_ADD(YLOG_WARN, "Unable to get environment information (%s).", mdb_strerror(rc));
+		return (YEACCESS);
+	}
+	return (YENOERR);
+}
+
+/* Get the statistics of every database, and the size of the free-list. */
+yerr_t database_stats(MDB_env *env, size_t *free_pages, database_stat_callback cb, void *cb_data) {
+	MDB_txn *txn;
+	MDB_cursor *cursor;
+	MDB_val db_key, db_data;
+	MDB_stat stat;
+	MDB_dbi dbi;
+	yerr_t retval = YENOERR;
+	size_t count;
+	char *name;
+	int rc;
+
+	*free_pages = 0;
+	if ((txn = database_transaction_start(env, YTRUE)) == NULL)
+		return (YEACCESS);
+	// free-list (opening the main database sets its comparison function)
+	if ((rc = mdb_dbi_open(txn, NULL, 0, &dbi)) || (rc = mdb_cursor_open(txn, 0, &cursor))) {
+		YLOG_ADD(YLOG_WARN, "Unable to open cursor (%s).", mdb_strerror(rc));
+		database_transaction_rollback(txn);
+		return (YEACCESS);
+	}
+	// each record is a list of page numbers, preceded by its size
+	while (!mdb_cursor_get(cursor, &db_key, &db_data, MDB_NEXT)) {
+		if (db_data.mv_size < sizeof(count))
+			continue;
+		memcpy(&count, db_data.mv_data, sizeof(count));
+		*free_pages += count;
+	}
+	mdb_cursor_close(cursor);
+	// main database
+	if ((rc = mdb_stat(txn, dbi, &stat)) || (rc = mdb_cursor_open(txn, dbi, &cursor))) {
+		YLOG_ADD(YLOG_WARN, "Unable to read database statistics (%s).", mdb_strerror(rc));
+		database_transaction_rollback(txn);
+		return (YEACCESS);
+	}
+	if ((retval = cb(cb_data, NULL, &stat)) != YENOERR)
+		goto end_of_process;
+	// named databases
+	while (!mdb_cursor_get(cursor, &db_key, &db_data, MDB_NEXT)) {
+		if (!db_key.mv_size || memchr(db_key.mv_data, '\0', db_key.mv_size))
+			continue;
+		if ((name = YMALLOC(db_key.mv_size + 1)) == NULL) {
+			retval = YENOMEM;
+			break;
+		}
+		memcpy(name, db_key.mv_data, db_key.mv_size);
+		rc = mdb_dbi_open(txn, name, 0, &dbi);
+		if (rc == MDB_DBS_FULL) {
+			// named databases are disabled, or all handles are used
+			YFREE(name);
+			break;
+		}
+		// keys that are not databases are skipped
+		if (!rc && !mdb_stat(txn, dbi, &stat))
+			retval = cb(cb_data, name, &stat);
+		YFREE(name);
+		if (retval != YENOERR)
+			break;
+	}
+end_of_process:
+	mdb_cursor_close(cursor);
+	database_transaction_rollback(txn);
+	return (retval);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_database_version
+ *		Read the version stamp of a stored value.
+ * @param	db_data	Pointer to the stored value.
+ * @return	The version, or 0 if the value is too short.
+ */
+static uint64_t _database_version(MDB_val *db_data) {
+	uint64_t version;
+
+	if (db_data->mv_size < DATABASE_VERSION_SIZE)
+		return (0);
+	memcpy(&version, db_data->mv_data, DATABASE_VERSION_SIZE);
+	return (be64toh(version));
+}
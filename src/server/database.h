@@ -1,15 +1,27 @@
 #ifndef __DATABASE_H__
 #define __DATABASE_H__
 
+#include <stdint.h>
 #include "lmdb.h"
 #include "ydefs.h"
 #include "ybin.h"
 #include "yerror.h"
 #include "ylog.h"
 
+/**
+ * @define	DATABASE_VERSION_SIZE
+ *		Size of the version stamp stored before each value. It is a
+ *		64 bits big-endian integer, incremented on every write of the
+ *		key (the first version of a key is 1).
+ */
+#define DATABASE_VERSION_SIZE	sizeof(uint64_t)
+
 /** Callback function for DB list. */
 typedef yerr_t (*database_callback)(void *ptr, ybin_t key, ybin_t data);
 
+/** Callback function for DB statistics. */
+typedef yerr_t (*database_stat_callback)(void *ptr, const char *name, MDB_stat *stat);
+
 /**
  * Open a LMDB database.
  * @param	path		Path to the database data directory.
@@ -55,9 +67,13 @@ void database_transaction_rollback(MDB_txn *transaction);
  * @param	name		Database name. NULL for the default DB.
  * @param	key		Key binary data.
  * @param	data		Binary data.
- * @return	YENOERR 	if OK.
+ * @param	version		Expected current version of the key. 0 to write
+ *				without condition.
+ * @param	new_version	Pointer to the new version of the key. Could be NULL.
+ * @return	YENOERR 	if OK, YEAGAIN if the version doesn't match.
  */
-yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, const char *name, ybin_t key, ybin_t data);
+yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, const char *name, ybin_t key,
+                    ybin_t data, uint64_t version, uint64_t *new_version);
 
 /**
  * Remove a key from database.
@@ -65,9 +81,11 @@ yerr_t database_put(MDB_env *env, MDB_txn *transaction, ybool_t create_only, con
  * @param	transaction	Pointer to the transaction. NULL for standalone transaction.
  * @param	name		Database name. NULL for the default DB.
  * @param	key		Key binary data.
- * @return	YENOERR if OK.
+ * @param	version		Expected current version of the key. 0 to remove
+ *				without condition.
+ * @return	YENOERR if OK, YEAGAIN if the version doesn't match.
  */
-yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key);
+yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, uint64_t version);
 
 /**
  * Get a key from database.
@@ -76,9 +94,11 @@ yerr_t database_del(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t
  * @param	name		Database name. NULL for the default DB.
  * @param	key		Key binary data.
  * @param	data		Pointer to an allocated data space.
+ * @param	version		Pointer to the version of the key. Could be NULL.
  * @return	YENOERR if OK, YENODATA if the key doesn't exists. YEACCESS if an error occurs.
  */
-yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *data);
+yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *data,
+                    uint64_t *version);
 
 /**
  * Loop through the key/value pairs of a database.
@@ -91,6 +111,22 @@ yerr_t database_get(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t
  */
 yerr_t database_list(MDB_env *env, MDB_txn *transaction, const char *name, database_callback cb, void *cb_data);
 
+/**
+ * Loop through the key/value pairs of a range of keys.
+ * @param	env		Database environment.
+ * @param	transaction	Pointer to the transaction. NULL for standalone transaction.
+ * @param	name		Database name. NULL for the default DB.
+ * @param	start		First key of the range (included). Empty to start
+ *				from the first key of the database.
+ * @param	end		Last key of the range (excluded). Empty to go to
+ *				the last key of the database.
+ * @param	cb		Callback function, used on every key/value.
+ * @param	cb_data		Pointer to private data for the callback function.
+ * @return	YENOERR if OK.
+ */
+yerr_t database_range(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t start, ybin_t end,
+                      database_callback cb, void *cb_data);
+
 /**
  * Remove a database and its keys.
  * @param	env		Database environment.
@@ -100,4 +136,26 @@ yerr_t database_list(MDB_env *env, MDB_txn *transaction, const char *name, datab
  */
 yerr_t database_drop(MDB_env *env, MDB_txn *transaction, const char *name);
 
+/**
+ * Get information about the environment and its main database.
+ * @param	env	Database environment.
+ * @param	info	Pointer to the environment information.
+ * @param	stat	Pointer to the statistics of the main database.
+ * @return	YENOERR if OK.
+ */
+yerr_t database_info(MDB_env *env, MDB_envinfo *info, MDB_stat *stat);
+
+/**
+ * Get the statistics of every database, and the size of the free-list.
+ * Named databases are found by scanning the keys of the main database,
+ * which stops when no other database handle could be opened.
+ * @param	env		Database environment.
+ * @param	free_pages	Pointer to the number of free pages.
+ * @param	cb		Callback function, used on every database (the
+ *				name of the main database is NULL).
+ * @param	cb_data		Pointer to private data for the callback function.
+ * @return	YENOERR if OK.
+ */
+yerr_t database_stats(MDB_env *env, size_t *free_pages, database_stat_callback cb, void *cb_data);
+
 #endif /* __DATABASE_H__ */
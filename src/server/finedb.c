@@ -1,18 +1,22 @@
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "nanomsg/nn.h"
 #include "nanomsg/pipeline.h"
 #include "server.h"
 #include "connection_thread.h"
 #include "writer_thread.h"
 #include "database.h"
+#include "metrics.h"
 #include "self_path.h"
 #include "finedb.h"
 
 /* Initialize a finedb structure. */
-finedb_t *finedb_init(char *db_path, unsigned short port,
+finedb_t *finedb_init(char *db_path, unsigned short port, char *unix_path,
                       unsigned short nbr_threads, size_t mapsize,
-                      unsigned int nbr_dbs, unsigned short timeout) {
+                      unsigned int nbr_dbs, unsigned short timeout, size_t hotcache_size,
+                      unsigned short metrics_port, unsigned int slowlog_threshold,
+                      char *capture_path) {
 	finedb_t *finedb = NULL;
 	unsigned short i;
 
@@ -21,6 +25,9 @@ finedb_t *finedb_init(char *db_path, unsigned short port,
 	finedb->run = YTRUE;
 	//finedb->database = NULL;
 	finedb->socket = -1;
+	finedb->unix_socket = -1;
+	finedb->unix_path = unix_path;
+	finedb->metrics_socket = -1;
 	finedb->threads_socket = -1;
 	//finedb->writer_tid = 0;
 	finedb->tcp_threads = yv_create(YVECT_SIZE_MEDIUM);
@@ -45,6 +52,48 @@ finedb_t *finedb_init(char *db_path, unsigned short port,
 		database_close(finedb->database);
 		exit(2);
 	}
+	// create the tracking table of cached keys
+	if ((finedb->tracking = tracking_new()) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create tracking table.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// create the hot-value cache
+	if (hotcache_size && (finedb->hotcache = hotcache_new(hotcache_size)) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create hot-value cache.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// create the table of running reads
+	if ((finedb->singleflight = singleflight_new()) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create table of running reads.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// create the statistics
+	if ((finedb->stats = stats_new()) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create statistics.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// create the detection of the most accessed keys
+	if ((finedb->hotkeys = hotkeys_new()) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create hot keys detection.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// create the slow-request log
+	if (slowlog_threshold && (finedb->slowlog = slowlog_new(slowlog_threshold)) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create slow-request log.");
+		database_close(finedb->database);
+		exit(2);
+	}
+	// start the capture of the incoming requests
+	if (capture_path && (finedb->capture = capture_new(capture_path)) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to start the capture.");
+		database_close(finedb->database);
+		exit(2);
+	}
 	// create the writer thread
 	if (pthread_create(&finedb->writer_tid, NULL, writer_loop, finedb)) {
 		YLOG_ADD(YLOG_ERR, "Unable to create writer thread.");
@@ -63,6 +112,16 @@ finedb_t *finedb_init(char *db_path, unsigned short port,
 		YLOG_ADD(YLOG_CRIT, "Aborting.");
 		exit(4);
 	}
+	// create the Unix socket
+	if (unix_path && server_create_unix_socket(&finedb->unix_socket, unix_path) != YENOERR) {
+		YLOG_ADD(YLOG_CRIT, "Aborting.");
+		exit(4);
+	}
+	// start the metrics listener
+	if (metrics_port && metrics_start(finedb, metrics_port) != YENOERR) {
+		YLOG_ADD(YLOG_CRIT, "Aborting.");
+		exit(4);
+	}
 
 	return (finedb);
 }
@@ -70,11 +129,15 @@ finedb_t *finedb_init(char *db_path, unsigned short port,
 /* Starts a finedb run. */
 void finedb_start(finedb_t *finedb) {
 	// main server loop
-	server_loop(&finedb->run, finedb->socket, finedb->threads_socket);
+	server_loop(&finedb->run, finedb->socket, finedb->unix_socket, finedb->threads_socket);
 }
 
 /* Ends a finedb run. */
 void finedb_stop(finedb_t *finedb) {
 	finedb->run = YFALSE;
+	if (finedb->capture)
+		capture_stop(finedb->capture);
 	database_close(finedb->database);
+	if (finedb->unix_path)
+		unlink(finedb->unix_path);
 }
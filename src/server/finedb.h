@@ -11,6 +11,13 @@
 #include "lmdb.h"
 #include "ydefs.h"
 #include "yvect.h"
+#include "tracking.h"
+#include "hotcache.h"
+#include "singleflight.h"
+#include "stats.h"
+#include "slowlog.h"
+#include "hotkeys.h"
+#include "capture.h"
 
 /** @const DEFAULT_NBR_THREADS Default number of connection threads. */
 #define DEFAULT_NBR_THREADS	15
@@ -22,6 +29,8 @@
 #define DEFAULT_MAPSIZE		10485760
 /** @const DEFAULT_TIMEOUT Default connection timeout (30 seconds). */
 #define DEFAULT_TIMEOUT		30
+/** @const DEFAULT_HOTCACHE_SIZE Default size of the hot-value cache (disabled). */
+#define DEFAULT_HOTCACHE_SIZE	0
 
 /** @const ENDPOINT_THREADS_SOCKET Threads' connection endpoint. */
 #define ENDPOINT_THREADS_SOCKET	"inproc://threads_socket"
@@ -33,34 +42,67 @@
  * @field	run		YTRUE while the server must be running.
  * @field	database	Pointer to the database environment.
  * @field	socket		Socket descriptor for incoming connections.
+ * @field	unix_socket	Socket descriptor for local connections. -1 if unused.
+ * @field	unix_path	Path to the Unix socket file. NULL if unused.
+ * @field	metrics_socket	Socket descriptor of the metrics listener. -1 if unused.
  * @field	threads_socket	Nanomsg socket for threads communication.
  * @field	writer_tid	ID of the writer thread.
  * @field	tcp_threads	List of connection threads.
  * @field	timeout		Time before a connection should be ended.
+ * @field	tracking	Table of the keys cached by clients.
+ * @field	hotcache	Cache of the most read values. NULL if disabled.
+ * @field	singleflight	Table of the running reads, shared by identical GETs.
+ * @field	stats		Latency statistics of the requests.
+ * @field	hotkeys		Detection of the most accessed keys.
+ * @field	slowlog		Ring of the slowest requests. NULL if disabled.
+ * @field	capture		Capture of the incoming requests. NULL if disabled.
  */
 typedef struct finedb_s {
 	ybool_t run;
 	MDB_env *database;
 	int socket;
+	int unix_socket;
+	char *unix_path;
+	int metrics_socket;
 	int threads_socket;
 	pthread_t writer_tid;
 	yvect_t tcp_threads;
 	unsigned short timeout;
+	tracking_t *tracking;
+	hotcache_t *hotcache;
+	singleflight_t *singleflight;
+	stats_t *stats;
+	hotkeys_t *hotkeys;
+	slowlog_t *slowlog;
+	capture_t *capture;
 } finedb_t;
 
 /**
  * Initialize a finedb structure.
  * @param	db_path		Path to the database directory.
  * @param	port		Port number to listen to.
+ * @param	unix_path	Path to the Unix socket to listen to. NULL to
+ *				listen only on TCP.
  * @param	nbr_threads	Number of connection threads.
  * @param	mapsize		Maximum size of the database.
  * @param	nbr_dbs		Maximum number of opened databases.
  * @param	timeout		Time before a connection should be ended.
+ * @param	hotcache_size	Size of the hot-value cache (bytes). 0 to
+ *				disable it.
+ * @param	metrics_port	Port number of the metrics HTTP listener. 0 to
+ *				disable it.
+ * @param	slowlog_threshold	Duration above which a request is kept
+ *				in the slow-request log (milliseconds). 0 to
+ *				disable it.
+ * @param	capture_path	Path to the trace file where the incoming
+ *				requests are recorded. NULL to disable it.
  * @return	A pointer to the allocated structure.
  */
-finedb_t *finedb_init(char *db_path, unsigned short port,
+finedb_t *finedb_init(char *db_path, unsigned short port, char *unix_path,
                       unsigned short nbr_threads, size_t mapsize,
-                      unsigned int nbr_dbs, unsigned short timeout);
+                      unsigned int nbr_dbs, unsigned short timeout, size_t hotcache_size,
+                      unsigned short metrics_port, unsigned int slowlog_threshold,
+                      char *capture_path);
 
 /**
  * Starts a finedb run.
@@ -0,0 +1,273 @@
+#include <string.h>
+#include "hotcache.h"
+
+/* private functions */
+static uint32_t _hotcache_hash(const char *dbname, ybin_t key);
+static hotcache_entry_t *_hotcache_find(hotcache_shard_t *shard, uint32_t hash, const char *dbname,
+                                        ybin_t key);
+static ybool_t _hotcache_same_db(const char *dbname1, const char *dbname2);
+static void _hotcache_unlink(hotcache_shard_t *shard, hotcache_entry_t *entry);
+static void _hotcache_evict(hotcache_t *hotcache, hotcache_shard_t *shard, size_t needed);
+
+/** @define HOTCACHE_SHARD Return the shard of a hash. */
+#define HOTCACHE_SHARD(hotcache, hash)	(&(hotcache)->shards[(hash) & (HOTCACHE_SHARDS - 1)])
+/** @define HOTCACHE_BUCKET Return the bucket number of a hash. */
+#define HOTCACHE_BUCKET(hash)		(((hash) / HOTCACHE_SHARDS) & (HOTCACHE_BUCKETS - 1))
+
+/* Create a hot-value cache. */
+hotcache_t *hotcache_new(size_t size) {
+	hotcache_t *hotcache;
+	int i;
+
+	if ((hotcache = YMALLOC(sizeof(hotcache_t))) == NULL)
+		return (NULL);
+	hotcache->shard_max = size / HOTCACHE_SHARDS;
+	for (i = 0; i < HOTCACHE_SHARDS; i++)
+		pthread_mutex_init(&hotcache->shards[i].mutex, NULL);
+	return (hotcache);
+}
+
+/* Return the generation of the shard of a key. */
+uint64_t hotcache_generation(hotcache_t *hotcache, const char *dbname, ybin_t key) {
+	hotcache_shard_t *shard = HOTCACHE_SHARD(hotcache, _hotcache_hash(dbname, key));
+
+	return (__atomic_load_n(&shard->generation, __ATOMIC_ACQUIRE));
+}
+
+/* Copy a cached value. */
+yerr_t hotcache_get(hotcache_t *hotcache, const char *dbname, ybin_t key, ybool_t compress,
+                    ybin_t *data, uint64_t *version) {
+	uint32_t hash = _hotcache_hash(dbname, key);
+	hotcache_shard_t *shard = HOTCACHE_SHARD(hotcache, hash);
+	hotcache_entry_t *entry;
+	ybin_t *value;
+
+	pthread_mutex_lock(&shard->mutex);
+	if ((entry = _hotcache_find(shard, hash, dbname, key)) == NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		return (YENODATA);
+	}
+	value = compress ? &entry->zip : &entry->plain;
+	// the uncompressed value is unknown: the caller uncompresses it
+	if (!compress && entry->plain.data == NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		return (YENODATA);
+	}
+	if ((data->data = YMALLOC(value->len + 1)) == NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		return (YENOMEM);
+	}
+	memcpy(data->data, value->data, value->len);
+	data->len = value->len;
+	*version = entry->version;
+	entry->referenced = YTRUE;
+	pthread_mutex_unlock(&shard->mutex);
+	return (YENOERR);
+}
+
+/* Add a value read from the database. */
+void hotcache_set(hotcache_t *hotcache, uint64_t generation, const char *dbname, ybin_t key,
+                  ybin_t zip, ybin_t plain, uint64_t version) {
+	uint32_t hash = _hotcache_hash(dbname, key);
+	hotcache_shard_t *shard = HOTCACHE_SHARD(hotcache, hash);
+	hotcache_entry_t *entry, **bucket;
+	size_t size, dbname_len;
+	char *pt;
+
+	dbname_len = dbname ? strlen(dbname) + 1 : 0;
+	size = sizeof(hotcache_entry_t) + dbname_len + key.len + zip.len + plain.len;
+	if (size > hotcache->shard_max / HOTCACHE_MAX_RATIO)
+		return;
+	// a single allocation for the names and values, filled outside of the lock
+	if ((entry = YMALLOC(size)) == NULL)
+		return;
+	pt = (char*)(entry + 1);
+	if (dbname) {
+		entry->dbname = pt;
+		memcpy(pt, dbname, dbname_len);
+		pt += dbname_len;
+	}
+	ybin_set(&entry->key, pt, key.len);
+	if (key.len)
+		memcpy(pt, key.data, key.len);
+	pt += key.len;
+	ybin_set(&entry->zip, pt, zip.len);
+	if (zip.len)
+		memcpy(pt, zip.data, zip.len);
+	pt += zip.len;
+	ybin_set(&entry->plain, (plain.data ? pt : NULL), plain.len);
+	if (plain.len)
+		memcpy(pt, plain.data, plain.len);
+	entry->hash = hash;
+	entry->version = version;
+	entry->size = size;
+	pthread_mutex_lock(&shard->mutex);
+	if (shard->generation != generation) {
+		// the key could have been modified after the read
+		pthread_mutex_unlock(&shard->mutex);
+		YFREE(entry);
+		return;
+	}
+	{
+		hotcache_entry_t *old;
+
+		if ((old = _hotcache_find(shard, hash, dbname, key)) != NULL) {
+			entry->referenced = old->referenced;
+			_hotcache_unlink(shard, old);
+		}
+	}
+	_hotcache_evict(hotcache, shard, size);
+	// add the entry in its bucket, and behind the clock hand
+	bucket = &shard->buckets[HOTCACHE_BUCKET(hash)];
+	entry->bucket_next = *bucket;
+	*bucket = entry;
+	if (shard->hand == NULL) {
+		entry->clock_prev = entry->clock_next = entry;
+		shard->hand = entry;
+	} else {
+		entry->clock_next = shard->hand;
+		entry->clock_prev = shard->hand->clock_prev;
+		entry->clock_prev->clock_next = entry;
+		shard->hand->clock_prev = entry;
+	}
+	shard->size += size;
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/* Remove a modified key from the cache. */
+void hotcache_remove(hotcache_t *hotcache, const char *dbname, ybin_t *key) {
+	hotcache_shard_t *shard;
+	hotcache_entry_t *entry, *next;
+	uint32_t hash;
+	int i, j;
+
+	if (key) {
+		hash = _hotcache_hash(dbname, *key);
+		shard = HOTCACHE_SHARD(hotcache, hash);
+		pthread_mutex_lock(&shard->mutex);
+		__atomic_add_fetch(&shard->generation, 1, __ATOMIC_RELEASE);
+		if ((entry = _hotcache_find(shard, hash, dbname, *key)) != NULL)
+			_hotcache_unlink(shard, entry);
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+	// the whole database was modified
+	for (i = 0; i < HOTCACHE_SHARDS; i++) {
+		shard = &hotcache->shards[i];
+		pthread_mutex_lock(&shard->mutex);
+		__atomic_add_fetch(&shard->generation, 1, __ATOMIC_RELEASE);
+		for (j = 0; j < HOTCACHE_BUCKETS; j++) {
+			for (entry = shard->buckets[j]; entry; entry = next) {
+				next = entry->bucket_next;
+				if (_hotcache_same_db(entry->dbname, dbname))
+					_hotcache_unlink(shard, entry);
+			}
+		}
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_hotcache_hash
+ *		Compute the hash of a key (FNV-1a hash of the database name
+ *		and the key).
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	The hash value.
+ */
+static uint32_t _hotcache_hash(const char *dbname, ybin_t key) {
+	uint32_t hash = 2166136261U;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 16777619U;
+	hash = (hash ^ 0xff) * 16777619U;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 16777619U;
+	return (hash);
+}
+
+/**
+ * @function	_hotcache_find
+ *		Search an entry in a shard. The shard must be locked.
+ * @param	shard	Pointer to the shard.
+ * @param	hash	Hash of the key.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	A pointer to the entry, or NULL.
+ */
+static hotcache_entry_t *_hotcache_find(hotcache_shard_t *shard, uint32_t hash, const char *dbname,
+                                        ybin_t key) {
+	hotcache_entry_t *entry;
+
+	for (entry = shard->buckets[HOTCACHE_BUCKET(hash)]; entry; entry = entry->bucket_next) {
+		if (entry->hash == hash && entry->key.len == key.len &&
+		    !memcmp(entry->key.data, key.data, key.len) &&
+		    _hotcache_same_db(entry->dbname, dbname))
+			return (entry);
+	}
+	return (NULL);
+}
+
+/**
+ * @function	_hotcache_same_db
+ *		Tell if two database names are the same.
+ * @param	dbname1	First name. NULL for the default DB.
+ * @param	dbname2	Second name. NULL for the default DB.
+ * @return	YTRUE if the names are equal.
+ */
+static ybool_t _hotcache_same_db(const char *dbname1, const char *dbname2) {
+	if (dbname1 == NULL || dbname2 == NULL)
+		return ((dbname1 == dbname2) ? YTRUE : YFALSE);
+	return (strcmp(dbname1, dbname2) ? YFALSE : YTRUE);
+}
+
+/**
+ * @function	_hotcache_unlink
+ *		Remove an entry from a shard, and free it. The shard must be
+ *		locked.
+ * @param	shard	Pointer to the shard.
+ * @param	entry	Pointer to the entry.
+ */
+static void _hotcache_unlink(hotcache_shard_t *shard, hotcache_entry_t *entry) {
+	hotcache_entry_t **pentry;
+
+	for (pentry = &shard->buckets[HOTCACHE_BUCKET(entry->hash)]; *pentry != entry;
+	     pentry = &(*pentry)->bucket_next)
+		;
+	*pentry = entry->bucket_next;
+	if (entry->clock_next == entry) {
+		shard->hand = NULL;
+	} else {
+		entry->clock_prev->clock_next = entry->clock_next;
+		entry->clock_next->clock_prev = entry->clock_prev;
+		if (shard->hand == entry)
+			shard->hand = entry->clock_next;
+	}
+	shard->size -= entry->size;
+	YFREE(entry);
+}
+
+/**
+ * @function	_hotcache_evict
+ *		Remove entries from a shard until a new entry fits in it. The
+ *		hand goes around the clock: a referenced entry loses its mark,
+ *		an unreferenced one is removed. The shard must be locked.
+ * @param	hotcache	Pointer to the cache.
+ * @param	shard		Pointer to the shard.
+ * @param	needed		Size of the new entry.
+ */
+static void _hotcache_evict(hotcache_t *hotcache, hotcache_shard_t *shard, size_t needed) {
+	hotcache_entry_t *entry;
+
+	while (shard->hand && shard->size + needed > hotcache->shard_max) {
+		entry = shard->hand;
+		if (entry->referenced) {
+			entry->referenced = YFALSE;
+			shard->hand = entry->clock_next;
+		} else
+			_hotcache_unlink(shard, entry);
+	}
+}
@@ -0,0 +1,146 @@
+#ifndef __HOTCACHE_H__
+#define __HOTCACHE_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "yerror.h"
+#include "ybin.h"
+
+/** @const HOTCACHE_SHARDS Number of shards of the hot-value cache (power of 2). */
+#define HOTCACHE_SHARDS		64
+/** @const HOTCACHE_BUCKETS Number of hash buckets per shard (power of 2). */
+#define HOTCACHE_BUCKETS	4096
+/** @const HOTCACHE_MAX_RATIO Maximum part of a shard that could be used by one value. */
+#define HOTCACHE_MAX_RATIO	8
+
+/**
+ * @typedef	hotcache_entry_t
+ *		Value kept in the hot-value cache.
+ * @field	hash		Hash of the database name and the key.
+ * @field	dbname		Name of the database. NULL for the default DB.
+ * @field	key		Key.
+ * @field	zip		Value, as stored in the database (compressed).
+ * @field	plain		Uncompressed value. Its data are NULL if it is
+ *				not known yet.
+ * @field	version		Version of the value.
+ * @field	size		Memory used by the entry.
+ * @field	referenced	YTRUE if the entry was read since the last pass
+ *				of the clock hand.
+ * @field	bucket_next	Next entry of the same hash bucket.
+ * @field	clock_prev	Previous entry on the clock.
+ * @field	clock_next	Next entry on the clock.
+ */
+typedef struct hotcache_entry_s {
+	uint32_t hash;
+	char *dbname;
+	ybin_t key;
+	ybin_t zip;
+	ybin_t plain;
+	uint64_t version;
+	size_t size;
+	ybool_t referenced;
+	struct hotcache_entry_s *bucket_next;
+	struct hotcache_entry_s *clock_prev;
+	struct hotcache_entry_s *clock_next;
+} hotcache_entry_t;
+
+/**
+ * @typedef	hotcache_shard_t
+ *		Shard of the hot-value cache.
+ * @field	mutex		Mutex protecting the shard.
+ * @field	generation	Incremented each time an entry is invalidated.
+ * @field	size		Memory used by the entries.
+ * @field	hand		Clock hand (next entry to check for eviction).
+ * @field	buckets		Hash buckets.
+ */
+typedef struct hotcache_shard_s {
+	pthread_mutex_t mutex;
+	volatile uint64_t generation;
+	size_t size;
+	hotcache_entry_t *hand;
+	hotcache_entry_t *buckets[HOTCACHE_BUCKETS];
+} hotcache_shard_t;
+
+/**
+ * @typedef	hotcache_t
+ *		Cache of the most read values, shared by connection threads.
+ *		Values are spread over shards by the hash of their database
+ *		name and key; each shard is bounded in size, and evicts its
+ *		entries with the CLOCK algorithm (an entry read since the last
+ *		pass of the hand gets a second chance).
+ *		A reader takes the generation of the key's shard before
+ *		reading the database, and the value is added only if no entry
+ *		of the shard was invalidated since: a value read just before a
+ *		concurrent commit is never cached.
+ * @field	shard_max	Maximum memory used by a shard.
+ * @field	shards		Shards.
+ */
+typedef struct hotcache_s {
+	size_t shard_max;
+	hotcache_shard_t shards[HOTCACHE_SHARDS];
+} hotcache_t;
+
+/**
+ * @function	hotcache_new
+ *		Create a hot-value cache.
+ * @param	size	Maximum memory used by the cache.
+ * @return	A pointer to the allocated cache, or NULL.
+ */
+hotcache_t *hotcache_new(size_t size);
+
+/**
+ * @function	hotcache_generation
+ *		Return the generation of the shard of a key. Must be called
+ *		before the key is read from the database.
+ * @param	hotcache	Pointer to the cache.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ * @return	The generation.
+ */
+uint64_t hotcache_generation(hotcache_t *hotcache, const char *dbname, ybin_t key);
+
+/**
+ * @function	hotcache_get
+ *		Copy a cached value.
+ * @param	hotcache	Pointer to the cache.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ * @param	compress	YTRUE to get the compressed value, YFALSE to get
+ *				the uncompressed one.
+ * @param	data		Pointer to the returned data, allocated by the
+ *				function (must be freed).
+ * @param	version		Pointer to the returned version.
+ * @return	YENOERR if the value was found, YENODATA otherwise (or if
+ *		the uncompressed value was asked and is not known).
+ */
+yerr_t hotcache_get(hotcache_t *hotcache, const char *dbname, ybin_t key, ybool_t compress,
+                    ybin_t *data, uint64_t *version);
+
+/**
+ * @function	hotcache_set
+ *		Add a value read from the database. Nothing is done if an entry
+ *		of the shard was invalidated since the given generation.
+ * @param	hotcache	Pointer to the cache.
+ * @param	generation	Generation taken before the read.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ * @param	zip		Compressed value.
+ * @param	plain		Uncompressed value. Its data are NULL if unknown.
+ * @param	version		Version of the value.
+ */
+void hotcache_set(hotcache_t *hotcache, uint64_t generation, const char *dbname, ybin_t key,
+                  ybin_t zip, ybin_t plain, uint64_t version);
+
+/**
+ * @function	hotcache_remove
+ *		Remove a modified key from the cache. Must be called after the
+ *		commit.
+ * @param	hotcache	Pointer to the cache.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Pointer to the key. NULL to remove all keys of the
+ *				database.
+ */
+void hotcache_remove(hotcache_t *hotcache, const char *dbname, ybin_t *key);
+
+#endif /* __HOTCACHE_H__ */
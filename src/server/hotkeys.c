@@ -0,0 +1,213 @@
+#include <string.h>
+#include <stdlib.h>
+#include "hotkeys.h"
+
+/* private functions */
+static uint64_t _hotkeys_hash(const char *dbname, ybin_t key);
+static void _hotkeys_top(hotkeys_thread_t *thread_hotkeys, hotkeys_sketch_t *sketch, uint64_t hash,
+                         const char *dbname, ybin_t key, uint64_t count);
+static void _hotkeys_decay(hotkeys_sketch_t *sketch);
+static int _hotkeys_compare(const void *p1, const void *p2);
+
+/** @define HOTKEYS_COLUMN Return the column of a hash in a row of a sketch (double hashing). */
+#define HOTKEYS_COLUMN(hash, row)	(((uint32_t)(hash) + (row) * ((uint32_t)((hash) >> 32) | 1)) & \
+					 (HOTKEYS_WIDTH - 1))
+/** @define HOTKEYS_STORE Write a counter written by a single thread, readable by the others. */
+#define HOTKEYS_STORE(counter, n)	__atomic_store_n(&(counter), (n), __ATOMIC_RELAXED)
+/** @define HOTKEYS_LOAD Read a counter written by another thread. */
+#define HOTKEYS_LOAD(counter)		__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/* Create the heavy hitters detection. */
+hotkeys_t *hotkeys_new() {
+	hotkeys_t *hotkeys;
+
+	if ((hotkeys = YMALLOC(sizeof(hotkeys_t))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&hotkeys->mutex, NULL);
+	return (hotkeys);
+}
+
+/* Create the sketches of a thread. */
+hotkeys_thread_t *hotkeys_thread_new(hotkeys_t *hotkeys) {
+	hotkeys_thread_t *thread_hotkeys;
+
+	if ((thread_hotkeys = YMALLOC(sizeof(hotkeys_thread_t))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&thread_hotkeys->mutex, NULL);
+	pthread_mutex_lock(&hotkeys->mutex);
+	thread_hotkeys->next = hotkeys->threads;
+	hotkeys->threads = thread_hotkeys;
+	pthread_mutex_unlock(&hotkeys->mutex);
+	return (thread_hotkeys);
+}
+
+/* Count an access to a key. */
+void hotkeys_add(hotkeys_thread_t *thread_hotkeys, hotkeys_type_t type, const char *dbname, ybin_t key) {
+	hotkeys_sketch_t *sketch;
+	uint32_t *counter, min = UINT32_MAX;
+	uint64_t hash;
+	unsigned int row;
+
+	if (thread_hotkeys == NULL)
+		return;
+	sketch = &thread_hotkeys->sketches[type];
+	hash = _hotkeys_hash(dbname, key);
+	// the estimate is the smallest counter of the key
+	for (row = 0; row < HOTKEYS_DEPTH; row++) {
+		counter = &sketch->counters[row][HOTKEYS_COLUMN(hash, row)];
+		HOTKEYS_STORE(*counter, *counter + 1);
+		if (*counter < min)
+			min = *counter;
+	}
+	HOTKEYS_STORE(sketch->total, sketch->total + 1);
+	_hotkeys_top(thread_hotkeys, sketch, hash, dbname, key, min);
+	// old accesses weigh less and less
+	if (++sketch->decay >= HOTKEYS_DECAY)
+		_hotkeys_decay(sketch);
+}
+
+/* Merge the sketches of all threads. */
+size_t hotkeys_merge(hotkeys_t *hotkeys, hotkeys_type_t type, hotkeys_key_t *top, uint64_t *total) {
+	hotkeys_thread_t *thread_hotkeys;
+	hotkeys_sketch_t *sketch;
+	hotkeys_key_t *candidates = NULL;
+	size_t nbr_threads = 0, nbr = 0, i, j;
+	unsigned int row, k;
+	uint64_t sum, min;
+
+	*total = 0;
+	pthread_mutex_lock(&hotkeys->mutex);
+	for (thread_hotkeys = hotkeys->threads; thread_hotkeys; thread_hotkeys = thread_hotkeys->next)
+		nbr_threads++;
+	if (!nbr_threads ||
+	    (candidates = YMALLOC(nbr_threads * HOTKEYS_TOP * sizeof(hotkeys_key_t))) == NULL) {
+		pthread_mutex_unlock(&hotkeys->mutex);
+		return (0);
+	}
+	// heavy hitters of all threads, without duplicates
+	for (thread_hotkeys = hotkeys->threads; thread_hotkeys; thread_hotkeys = thread_hotkeys->next) {
+		sketch = &thread_hotkeys->sketches[type];
+		*total += HOTKEYS_LOAD(sketch->total);
+		pthread_mutex_lock(&thread_hotkeys->mutex);
+		for (k = 0; k < sketch->nbr_top; k++) {
+			for (j = 0; j < nbr && candidates[j].hash != sketch->top[k].hash; j++)
+				;
+			if (j == nbr)
+				memcpy(&candidates[nbr++], &sketch->top[k], sizeof(hotkeys_key_t));
+		}
+		pthread_mutex_unlock(&thread_hotkeys->mutex);
+	}
+	// estimate of each candidate on the sum of the sketches
+	for (i = 0; i < nbr; i++) {
+		for (row = 0, min = UINT64_MAX; row < HOTKEYS_DEPTH; row++) {
+			sum = 0;
+			for (thread_hotkeys = hotkeys->threads; thread_hotkeys; thread_hotkeys = thread_hotkeys->next) {
+				sketch = &thread_hotkeys->sketches[type];
+				sum += HOTKEYS_LOAD(sketch->counters[row][HOTKEYS_COLUMN(candidates[i].hash, row)]);
+			}
+			if (sum < min)
+				min = sum;
+		}
+		candidates[i].count = min;
+	}
+	pthread_mutex_unlock(&hotkeys->mutex);
+	qsort(candidates, nbr, sizeof(hotkeys_key_t), _hotkeys_compare);
+	if (nbr > HOTKEYS_TOP)
+		nbr = HOTKEYS_TOP;
+	memcpy(top, candidates, nbr * sizeof(hotkeys_key_t));
+	YFREE(candidates);
+	return (nbr);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_hotkeys_hash
+ *		Compute the 64 bits FNV-1a hash of a database name and a key.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	The hash.
+ */
+static uint64_t _hotkeys_hash(const char *dbname, ybin_t key) {
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 1099511628211ULL;
+	hash = (hash ^ 0xff) * 1099511628211ULL;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 1099511628211ULL;
+	return (hash);
+}
+
+/**
+ * @function	_hotkeys_top
+ *		Update the heavy hitters of a sketch after an access. The key
+ *		replaces the least accessed heavy hitter if it was accessed
+ *		more. Keys are compared by their 64 bits hash.
+ * @param	thread_hotkeys	Pointer to the thread's sketches.
+ * @param	sketch		Pointer to the sketch.
+ * @param	hash		Hash of the key.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ * @param	count		Estimated number of accesses of the key.
+ */
+static void _hotkeys_top(hotkeys_thread_t *thread_hotkeys, hotkeys_sketch_t *sketch, uint64_t hash,
+                         const char *dbname, ybin_t key, uint64_t count) {
+	hotkeys_key_t *entry;
+	unsigned int i, min = 0;
+	size_t name_len;
+
+	for (i = 0; i < sketch->nbr_top; i++) {
+		if (sketch->top[i].hash == hash) {
+			sketch->top[i].count = count;
+			return;
+		}
+		if (sketch->top[i].count < sketch->top[min].count)
+			min = i;
+	}
+	if (sketch->nbr_top == HOTKEYS_TOP && count <= sketch->top[min].count)
+		return;
+	name_len = dbname ? strlen(dbname) : 0;
+	pthread_mutex_lock(&thread_hotkeys->mutex);
+	entry = (sketch->nbr_top < HOTKEYS_TOP) ? &sketch->top[sketch->nbr_top++] : &sketch->top[min];
+	entry->hash = hash;
+	entry->count = count;
+	entry->name_len = (unsigned char)(name_len < HOTKEYS_NAME_MAX ? name_len : HOTKEYS_NAME_MAX);
+	memcpy(entry->name, dbname ? dbname : "", entry->name_len);
+	entry->key_len = (uint16_t)(key.len < HOTKEYS_KEY_MAX ? key.len : HOTKEYS_KEY_MAX);
+	memcpy(entry->key, key.data, entry->key_len);
+	pthread_mutex_unlock(&thread_hotkeys->mutex);
+}
+
+/**
+ * @function	_hotkeys_decay
+ *		Halve the counters of a sketch.
+ * @param	sketch	Pointer to the sketch.
+ */
+static void _hotkeys_decay(hotkeys_sketch_t *sketch) {
+	unsigned int row, col, i;
+
+	for (row = 0; row < HOTKEYS_DEPTH; row++)
+		for (col = 0; col < HOTKEYS_WIDTH; col++)
+			HOTKEYS_STORE(sketch->counters[row][col], sketch->counters[row][col] / 2);
+	HOTKEYS_STORE(sketch->total, sketch->total / 2);
+	for (i = 0; i < sketch->nbr_top; i++)
+		sketch->top[i].count /= 2;
+	sketch->decay = 0;
+}
+
+/**
+ * @function	_hotkeys_compare
+ *		Compare two keys by decreasing number of accesses (for qsort).
+ * @param	p1	Pointer to the first key.
+ * @param	p2	Pointer to the second key.
+ * @return	The comparison result.
+ */
+static int _hotkeys_compare(const void *p1, const void *p2) {
+	const hotkeys_key_t *k1 = p1, *k2 = p2;
+
+	if (k1->count == k2->count)
+		return (0);
+	return ((k1->count < k2->count) ? 1 : -1);
+}
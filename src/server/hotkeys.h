@@ -0,0 +1,139 @@
+#ifndef __HOTKEYS_H__
+#define __HOTKEYS_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "ybin.h"
+
+/** @const HOTKEYS_DEPTH Number of rows of a count-min sketch. */
+#define HOTKEYS_DEPTH		4
+/** @const HOTKEYS_WIDTH Number of counters per row of a count-min sketch (power of 2). */
+#define HOTKEYS_WIDTH		2048
+/** @const HOTKEYS_TOP Number of heavy hitters kept by each thread, and returned by a merge. */
+#define HOTKEYS_TOP		16
+/** @const HOTKEYS_KEY_MAX Maximum size of a kept key (longer keys are truncated). */
+#define HOTKEYS_KEY_MAX		128
+/** @const HOTKEYS_NAME_MAX Maximum size of a kept database name. */
+#define HOTKEYS_NAME_MAX	64
+/** @const HOTKEYS_DECAY Number of accesses after which the counters of a sketch are halved. */
+#define HOTKEYS_DECAY		1048576
+
+/**
+ * @typedef	hotkeys_type_t
+ *		Types of key accesses, tracked separately.
+ * @constant	HOTKEYS_READ	Keys read by GET.
+ * @constant	HOTKEYS_WRITE	Keys written or deleted (PUT, DEL, CAS, MERGE
+ *				and BATCH).
+ */
+typedef enum hotkeys_type_e {
+	HOTKEYS_READ = 0,
+	HOTKEYS_WRITE,
+	HOTKEYS_TYPES
+} hotkeys_type_t;
+
+/**
+ * @typedef	hotkeys_key_t
+ *		A heavy hitter.
+ * @field	hash		Hash of the database name and the key.
+ * @field	count		Estimated number of accesses.
+ * @field	name_len	Size of the database name (0 for the default DB).
+ * @field	key_len		Size of the key (truncated to HOTKEYS_KEY_MAX).
+ * @field	name		Database name.
+ * @field	key		Key.
+ */
+typedef struct hotkeys_key_s {
+	uint64_t hash;
+	uint64_t count;
+	unsigned char name_len;
+	uint16_t key_len;
+	char name[HOTKEYS_NAME_MAX];
+	unsigned char key[HOTKEYS_KEY_MAX];
+} hotkeys_key_t;
+
+/**
+ * @typedef	hotkeys_sketch_t
+ *		Count-min sketch of a type of accesses, and its heavy hitters.
+ * @field	total		Number of accesses (halved with the counters).
+ * @field	decay		Number of accesses since the last halving.
+ * @field	nbr_top		Number of heavy hitters.
+ * @field	top		Heavy hitters, unordered.
+ * @field	counters	Counters, one row per hash function.
+ */
+typedef struct hotkeys_sketch_s {
+	uint64_t total;
+	uint32_t decay;
+	unsigned int nbr_top;
+	hotkeys_key_t top[HOTKEYS_TOP];
+	uint32_t counters[HOTKEYS_DEPTH][HOTKEYS_WIDTH];
+} hotkeys_sketch_t;
+
+/**
+ * @typedef	hotkeys_thread_t
+ *		Sketches of a connection thread. They are written only by their
+ *		thread; the counters are read without lock by the merge, the
+ *		heavy hitters are protected by the mutex.
+ * @field	mutex		Mutex protecting the heavy hitters.
+ * @field	sketches	Sketches, per type of access.
+ * @field	next		Next thread.
+ */
+typedef struct hotkeys_thread_s {
+	pthread_mutex_t mutex;
+	hotkeys_sketch_t sketches[HOTKEYS_TYPES];
+	struct hotkeys_thread_s *next;
+} hotkeys_thread_t;
+
+/**
+ * @typedef	hotkeys_t
+ *		Detection of the heavy hitters. Each thread counts its accesses
+ *		in its own sketches, and keeps its own heavy hitters; the
+ *		candidates of all threads are estimated again on the sum of the
+ *		sketches when they are merged.
+ * @field	mutex		Mutex protecting the list of threads.
+ * @field	threads		List of the threads' sketches.
+ */
+typedef struct hotkeys_s {
+	pthread_mutex_t mutex;
+	hotkeys_thread_t *threads;
+} hotkeys_t;
+
+/**
+ * @function	hotkeys_new
+ *		Create the heavy hitters detection.
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+hotkeys_t *hotkeys_new(void);
+
+/**
+ * @function	hotkeys_thread_new
+ *		Create the sketches of a thread.
+ * @param	hotkeys	Pointer to the heavy hitters detection.
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+hotkeys_thread_t *hotkeys_thread_new(hotkeys_t *hotkeys);
+
+/**
+ * @function	hotkeys_add
+ *		Count an access to a key. Must be called only by the thread
+ *		itself.
+ * @param	thread_hotkeys	Pointer to the thread's sketches.
+ * @param	type		Type of access.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ */
+void hotkeys_add(hotkeys_thread_t *thread_hotkeys, hotkeys_type_t type, const char *dbname, ybin_t key);
+
+/**
+ * @function	hotkeys_merge
+ *		Merge the sketches of all threads, and return the heavy hitters
+ *		of a type of access.
+ * @param	hotkeys	Pointer to the heavy hitters detection.
+ * @param	type	Type of access.
+ * @param	top	Array of at least HOTKEYS_TOP keys, sorted by
+ *			decreasing number of accesses.
+ * @param	total	Pointer to the number of accesses of all threads.
+ * @return	The number of keys.
+ */
+size_t hotkeys_merge(hotkeys_t *hotkeys, hotkeys_type_t type, hotkeys_key_t *top, uint64_t *total);
+
+#endif /* __HOTKEYS_H__ */
@@ -25,13 +25,18 @@ static void signal_handler(int signal);
 
 /** Usage function. */
 static void usage() {
-	printf("Usage: finedb [-t number] [-n number] [-s number] [-p port] [-f path] [-i seconds] [-h] [-d]\n"
+	printf("Usage: finedb [-t number] [-n number] [-s number] [-p port] [-u path] [-f path] [-i seconds] [-c megabytes] [-m port] [-l ms] [-r path] [-h] [-d]\n"
 	       "\t-t number    Set the number of connection threads.\n"
 	       "\t-n number    Set the maximum number of opened databases.\n"
 	       "\t-s number    Set the database map size (maximum size on disk).\n"
 	       "\t-p port      Listening port number.\n"
+	       "\t-u path      Path to a Unix socket, for local connections.\n"
 	       "\t-f path      Path to the database directory.\n"
 	       "\t-i seconds   NUmber of seconds before considering a connection is timing out.\n"
+	       "\t-c megabytes Size of the cache of most read values (0 to disable it).\n"
+	       "\t-m port      Port number of the metrics HTTP listener (OpenMetrics format).\n"
+	       "\t-l ms        Log the requests slower than this duration (0 to disable it).\n"
+	       "\t-r path      Record the incoming requests into a trace file (see finedb-replay).\n"
 	       "\t-h           Shows this help and exits.\n"
 	       "\t-d           Debug mode. Error messages are more verbose.\n"
 	       "\n");
@@ -51,14 +56,19 @@ static void signal_handler(int sig) {
  * Main function of the program.
  */
 int main(int argc, char *argv[]) {
-	char *optstr = "dht:n:s:f:p:i:";
+	char *optstr = "dht:n:s:f:p:u:i:c:m:l:r:";
 	int i;
 	unsigned int nbr_dbs = 1;
 	size_t mapsize = DEFAULT_MAPSIZE;
 	unsigned short nbr_threads = DEFAULT_NBR_THREADS;
 	unsigned short port = DEFAULT_PORT;
 	unsigned short timeout = DEFAULT_TIMEOUT;
+	size_t hotcache_size = DEFAULT_HOTCACHE_SIZE;
+	unsigned short metrics_port = 0;
+	unsigned int slowlog_threshold = 0;
 	char *db_path = NULL;
+	char *unix_path = NULL;
+	char *capture_path = NULL;
 	finedb_t *finedb;
 
 	// signal handlers
@@ -81,12 +91,27 @@ int main(int argc, char *argv[]) {
 		case 'p':
 			port = (unsigned short)atoi(optarg);
 			break;
+		case 'u':
+			unix_path = strdup(optarg);
+			break;
 		case 'f':
 			db_path = strdup(optarg);
 			break;
 		case 'i':
 			timeout = atoi(optarg);
 			break;
+		case 'c':
+			hotcache_size = (size_t)atoi(optarg) * 1048576;
+			break;
+		case 'm':
+			metrics_port = (unsigned short)atoi(optarg);
+			break;
+		case 'l':
+			slowlog_threshold = (unsigned int)atoi(optarg);
+			break;
+		case 'r':
+			capture_path = strdup(optarg);
+			break;
 		case 'd':
 			YLOG_SET_DEBUG();
 			break;
@@ -95,12 +120,16 @@ int main(int argc, char *argv[]) {
 			exit(0);
 		}
 	}
+	// logs are written by a background thread
+	YLOG_ASYNC();
 	YLOG_ADD(YLOG_DEBUG, "Configuration\n\t# threads: %d\n"
 	         "\t# dbs: %d\n\tMap size: %d\n\tPort number: %d\n"
-	         "\tDatabase path: %s\n\tTimeout: %d\n", nbr_threads, nbr_dbs,
-	         mapsize, port, db_path, timeout);
+	         "\tUnix socket: %s\n\tDatabase path: %s\n\tTimeout: %d\n\tHot-value cache: %zu\n\tMetrics port: %d\n\tSlow requests: %u ms\n\tTrace file: %s\n",
+	         nbr_threads, nbr_dbs, mapsize, port, unix_path, db_path, timeout, hotcache_size, metrics_port,
+	         slowlog_threshold, capture_path);
 	// FineDB structure init
-	finedb = finedb_init(db_path, port, nbr_threads, mapsize, nbr_dbs, timeout);
+	finedb = finedb_init(db_path, port, unix_path, nbr_threads, mapsize, nbr_dbs, timeout, hotcache_size,
+	                     metrics_port, slowlog_threshold, capture_path);
 	finedb_g = finedb;
 	// FineDB run
 	finedb_start(finedb);
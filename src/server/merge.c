@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ylog.h"
+#include "database.h"
+#include "merge.h"
+
+/** @define MERGE_NUMBER_MAXLEN Maximum size of a decimal number. */
+#define MERGE_NUMBER_MAXLEN	24
+
+/* private functions */
+static yerr_t _merge_number(ybin_t bin, long long *number);
+static yerr_t _merge_set_number(ybin_t *value, long long number);
+
+/* Apply a merge operator on a value. */
+yerr_t merge_apply(protocol_merge_t op, ybin_t *value, ybin_t operand) {
+	long long current, delta;
+	char *data;
+	size_t i, len;
+
+	switch (op) {
+	case PROTO_MERGE_INC:
+	case PROTO_MERGE_DEC:
+		if (_merge_number(*value, &current) != YENOERR ||
+		    _merge_number(operand, &delta) != YENOERR)
+			return (YEINVAL);
+		// unsigned arithmetic: overflows wrap around
+		if (op == PROTO_MERGE_INC)
+			current = (long long)((unsigned long long)current + (unsigned long long)delta);
+		else
+			current = (long long)((unsigned long long)current - (unsigned long long)delta);
+		return (_merge_set_number(value, current));
+	case PROTO_MERGE_MAX:
+	case PROTO_MERGE_MIN:
+		if (_merge_number(*value, &current) != YENOERR ||
+		    _merge_number(operand, &delta) != YENOERR)
+			return (YEINVAL);
+		if (!value->len || (op == PROTO_MERGE_MAX && delta > current) ||
+		    (op == PROTO_MERGE_MIN && delta < current))
+			current = delta;
+		return (_merge_set_number(value, current));
+	case PROTO_MERGE_APPEND:
+		len = value->len + operand.len;
+		if ((data = YMALLOC(len ? len : 1)) == NULL)
+			return (YENOMEM);
+		if (value->len)
+			memcpy(data, value->data, value->len);
+		if (operand.len)
+			memcpy(data + value->len, operand.data, operand.len);
+		break;
+	case PROTO_MERGE_OR:
+		len = (value->len > operand.len) ? value->len : operand.len;
+		if ((data = YMALLOC(len ? len : 1)) == NULL)
+			return (YENOMEM);
+		if (value->len)
+			memcpy(data, value->data, value->len);
+		for (i = 0; i < operand.len; i++)
+			data[i] |= ((char*)operand.data)[i];
+		break;
+	default:
+		return (YEINVAL);
+	}
+	YFREE(value->data);
+	ybin_set(value, data, len);
+	return (YENOERR);
+}
+
+/* Read a value from database and uncompress it. */
+yerr_t merge_load(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *value) {
+	ybin_t zip;
+	size_t len;
+	char *data;
+	yerr_t rc;
+
+	ybin_set(value, NULL, 0);
+	rc = database_get(env, transaction, name, key, &zip, NULL);
+	if (rc == YENODATA)
+		return (YENOERR);
+	if (rc != YENOERR)
+		return (rc);
+	if (!zip.len)
+		return (YENOERR);
+	if (!snappy_uncompressed_length(zip.data, zip.len, &len)) {
+		YLOG_ADD(YLOG_WARN, "Bad compressed data.");
+		return (YEINVAL);
+	}
+	if ((data = YMALLOC(len ? len : 1)) == NULL)
+		return (YENOMEM);
+	if (snappy_uncompress(zip.data, zip.len, data)) {
+		YLOG_ADD(YLOG_WARN, "Unable to uncompress data.");
+		YFREE(data);
+		return (YEINVAL);
+	}
+	ybin_set(value, data, len);
+	return (YENOERR);
+}
+
+/* Compress a value and write it into database. */
+yerr_t merge_store(MDB_env *env, MDB_txn *transaction, struct snappy_env *zip_env,
+                   const char *name, ybin_t key, ybin_t value) {
+	char *zip_data;
+	size_t zip_len;
+	ybin_t zip;
+	yerr_t rc;
+
+	if ((zip_data = YMALLOC(snappy_max_compressed_length(value.len))) == NULL)
+		return (YENOMEM);
+	if (snappy_compress(zip_env, value.data, value.len, zip_data, &zip_len)) {
+		YLOG_ADD(YLOG_WARN, "Unable to compress data.");
+		YFREE(zip_data);
+		return (YEINVAL);
+	}
+	ybin_set(&zip, zip_data, zip_len);
+	rc = database_put(env, transaction, YFALSE, name, key, zip, 0, NULL);
+	YFREE(zip_data);
+	return (rc);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_merge_number
+ *		Decode a decimal number. An empty value is equal to 0.
+ * @param	bin	Binary data.
+ * @param	number	Pointer to the decoded number.
+ * @return	YENOERR if OK, YEINVAL if the data is not a number.
+ */
+static yerr_t _merge_number(ybin_t bin, long long *number) {
+	char str[MERGE_NUMBER_MAXLEN], *end = NULL;
+
+	*number = 0;
+	if (!bin.len)
+		return (YENOERR);
+	if (bin.len >= sizeof(str))
+		return (YEINVAL);
+	memcpy(str, bin.data, bin.len);
+	str[bin.len] = '\0';
+	errno = 0;
+	*number = strtoll(str, &end, 10);
+	if (errno || end == str || *end != '\0')
+		return (YEINVAL);
+	return (YENOERR);
+}
+
+/**
+ * @function	_merge_set_number
+ *		Replace a value by a decimal number.
+ * @param	value	Pointer to the value.
+ * @param	number	The number.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _merge_set_number(ybin_t *value, long long number) {
+	char *data;
+	int len;
+
+	if ((data = YMALLOC(MERGE_NUMBER_MAXLEN)) == NULL)
+		return (YENOMEM);
+	len = snprintf(data, MERGE_NUMBER_MAXLEN, "%lld", number);
+	YFREE(value->data);
+	ybin_set(value, data, (size_t)len);
+	return (YENOERR);
+}
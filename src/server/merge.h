@@ -0,0 +1,51 @@
+#ifndef __MERGE_H__
+#define __MERGE_H__
+
+#include "lmdb.h"
+#include "snappy.h"
+#include "ydefs.h"
+#include "ybin.h"
+#include "yerror.h"
+#include "protocol.h"
+
+/**
+ * @function	merge_apply
+ *		Apply a merge operator on a value. The value's data is replaced
+ *		by a newly allocated buffer; the previous one is freed.
+ * @param	op		Merge operator.
+ * @param	value		Pointer to the current (uncompressed) value.
+ *				Empty if the key doesn't exist.
+ * @param	operand		Operand.
+ * @return	YENOERR if OK, YEINVAL if the value or the operand is not
+ *		compatible with the operator.
+ */
+yerr_t merge_apply(protocol_merge_t op, ybin_t *value, ybin_t operand);
+
+/**
+ * @function	merge_load
+ *		Read a value from database and uncompress it.
+ * @param	env		Database environment.
+ * @param	transaction	Pointer to the transaction.
+ * @param	name		Database name. NULL for the default DB.
+ * @param	key		Key binary data.
+ * @param	value		Pointer to the (allocated) uncompressed value.
+ *				Set to empty if the key doesn't exist.
+ * @return	YENOERR if OK.
+ */
+yerr_t merge_load(MDB_env *env, MDB_txn *transaction, const char *name, ybin_t key, ybin_t *value);
+
+/**
+ * @function	merge_store
+ *		Compress a value and write it into database.
+ * @param	env		Database environment.
+ * @param	transaction	Pointer to the transaction.
+ * @param	zip_env		Pointer to a Snappy environment.
+ * @param	name		Database name. NULL for the default DB.
+ * @param	key		Key binary data.
+ * @param	value		Uncompressed value.
+ * @return	YENOERR if OK.
+ */
+yerr_t merge_store(MDB_env *env, MDB_txn *transaction, struct snappy_env *zip_env,
+                   const char *name, ybin_t key, ybin_t value);
+
+#endif /* __MERGE_H__ */
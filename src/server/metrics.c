@@ -0,0 +1,305 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "ylog.h"
+#include "ystr.h"
+#include "lmdb.h"
+#include "server.h"
+#include "database.h"
+#include "stats.h"
+#include "metrics.h"
+
+/* private functions */
+static void _metrics_process(finedb_t *finedb, int fd);
+static ystr_t _metrics_generate(finedb_t *finedb);
+static void _metrics_family(ystr_t *out, const char *name, const char *type, const char *unit,
+                            const char *help);
+static void _metrics_summary(ystr_t *out, const char *name, const char *labels,
+                             stats_histogram_t *histogram, double scale);
+static void _metrics_printf(ystr_t *out, const char *format, ...);
+static yerr_t _metrics_write(int fd, const char *data, size_t len);
+
+/** @var _metrics_commands Names of the commands, used as labels. */
+static const char *_metrics_commands[STATS_COMMANDS] = {
+	"ping", "get", "del", "put", "setdb", "start", "stop", "aggregate",
+	"merge", "cas", "shm", "batch", "track", "0xd", "admin", "extra"
+};
+/** @var _metrics_results Names of the request results, used as labels. */
+static const char *_metrics_results[STATS_RESULTS] = {
+	"hit", "miss", "error"
+};
+
+/* Create the listening socket of the metrics listener, and start its thread. */
+yerr_t metrics_start(finedb_t *finedb, unsigned short port) {
+	pthread_t tid;
+
+	if (server_create_listening_socket(&finedb->metrics_socket, port) != YENOERR) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create metrics socket.");
+		return (YEIO);
+	}
+	if (pthread_create(&tid, NULL, metrics_loop, finedb)) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create metrics thread.");
+		close(finedb->metrics_socket);
+		finedb->metrics_socket = -1;
+		return (YEIO);
+	}
+	pthread_detach(tid);
+	return (YENOERR);
+}
+
+/* Main loop of the metrics thread. */
+void *metrics_loop(void *param) {
+	finedb_t *finedb = (finedb_t*)param;
+	struct timeval tv;
+	int fd;
+
+	tv.tv_sec = METRICS_TIMEOUT;
+	tv.tv_usec = 0;
+	while (finedb->run) {
+		if ((fd = accept(finedb->metrics_socket, NULL, NULL)) < 0) {
+			YLOG_ADD(YLOG_WARN, "Metrics accept error.");
+			continue;
+		}
+		// a slow client must not block the listener
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void*)&tv, sizeof(tv)) < 0 ||
+		    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (void*)&tv, sizeof(tv)) < 0)
+			YLOG_ADD(YLOG_WARN, "setsockopt(SO_RCVTIMEO) failed");
+		_metrics_process(finedb, fd);
+		close(fd);
+	}
+	return (NULL);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_metrics_process
+ *		Read an HTTP request and send its response.
+ * @param	finedb	Pointer to the main FineDB structure.
+ * @param	fd	Socket descriptor of the client.
+ */
+static void _metrics_process(finedb_t *finedb, int fd) {
+	char request[METRICS_REQUEST_SIZE], header[256];
+	size_t len = 0;
+	ssize_t rc;
+	ystr_t body;
+	int header_len;
+
+	// read the request line and the headers
+	while (len < sizeof(request) - 1) {
+		if ((rc = read(fd, request + len, sizeof(request) - 1 - len)) <= 0)
+			return;
+		len += (size_t)rc;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+			break;
+	}
+	if (strncmp(request, "GET /metrics ", 13) && strncmp(request, "GET /metrics?", 13)) {
+		YLOG_ADD(YLOG_DEBUG, "Bad metrics request.");
+		header_len = snprintf(header, sizeof(header),
+		                      "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n"
+		                      "Content-Length: 10\r\nConnection: close\r\n\r\nNot Found\n");
+		_metrics_write(fd, header, (size_t)header_len);
+		return;
+	}
+	if ((body = _metrics_generate(finedb)) == NULL) {
+		YLOG_ADD(YLOG_WARN, "Unable to generate metrics.");
+		header_len = snprintf(header, sizeof(header),
+		                      "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\n"
+		                      "Connection: close\r\n\r\n");
+		_metrics_write(fd, header, (size_t)header_len);
+		return;
+	}
+	header_len = snprintf(header, sizeof(header),
+	                      "HTTP/1.0 200 OK\r\nContent-Type: " METRICS_CONTENT_TYPE "\r\n"
+	                      "Content-Length: %u\r\nConnection: close\r\n\r\n", ys_len(body));
+	if (_metrics_write(fd, header, (size_t)header_len) == YENOERR)
+		_metrics_write(fd, body, ys_len(body));
+	ys_free(body);
+}
+
+/**
+ * @function	_metrics_generate
+ *		Write all the metrics of the server in the OpenMetrics text format.
+ * @param	finedb	Pointer to the main FineDB structure.
+ * @return	The generated text, or NULL.
+ */
+static ystr_t _metrics_generate(finedb_t *finedb) {
+	stats_t *stats = finedb->stats;
+	stats_histogram_t *histogram;
+	unsigned int command, mode, result;
+	uint64_t raw, stored;
+	MDB_envinfo info;
+	MDB_stat stat;
+	char labels[128];
+	ystr_t out;
+
+	if ((histogram = YMALLOC(sizeof(stats_histogram_t))) == NULL)
+		return (NULL);
+	if ((out = ys_new("")) == NULL) {
+		YFREE(histogram);
+		return (NULL);
+	}
+	_metrics_family(&out, "finedb_uptime_seconds", "gauge", "seconds", "Time since the server started.");
+	_metrics_printf(&out, "finedb_uptime_seconds %.3f\n", (double)(stats_now() - stats->start) / 1e9);
+	// requests
+	_metrics_family(&out, "finedb_request_latency_seconds", "summary", "seconds",
+	                "Latency of the requests. The _count samples give the request rates.");
+	for (command = 0; command < STATS_COMMANDS; command++) {
+		for (mode = 0; mode < STATS_MODES; mode++) {
+			for (result = 0; result < STATS_RESULTS; result++) {
+				if (stats_merge(stats, (unsigned char)command, (mode ? YFALSE : YTRUE),
+				                (protocol_stats_result_t)result, histogram) != YENOERR)
+					continue;
+				snprintf(labels, sizeof(labels), "command=\"%s\",mode=\"%s\",result=\"%s\"",
+				         _metrics_commands[command], (mode ? "async" : "sync"),
+				         _metrics_results[result]);
+				_metrics_summary(&out, "finedb_request_latency_seconds", labels, histogram, 1e-9);
+			}
+		}
+	}
+	// writer thread
+	_metrics_family(&out, "finedb_writer_queue_depth", "gauge", NULL,
+	                "Number of messages sent to the writer thread and not committed yet.");
+	_metrics_printf(&out, "finedb_writer_queue_depth %lld\n", (long long)STATS_GAUGE_GET(stats->queued));
+	_metrics_family(&out, "finedb_writer_batch_size", "summary", NULL,
+	                "Number of messages written by the writer thread in one transaction.");
+	stats_merge_metric(stats, STATS_BATCH, histogram);
+	_metrics_summary(&out, "finedb_writer_batch_size", NULL, histogram, 1.0);
+	_metrics_family(&out, "finedb_writer_commit_seconds", "summary", "seconds",
+	                "Duration of the writer thread's commits.");
+	stats_merge_metric(stats, STATS_COMMIT, histogram);
+	_metrics_summary(&out, "finedb_writer_commit_seconds", NULL, histogram, 1e-9);
+	YFREE(histogram);
+	// compression
+	stats_merge_zip(stats, &raw, &stored);
+	_metrics_family(&out, "finedb_written_raw_bytes", "counter", "bytes",
+	                "Size of the written values, uncompressed.");
+	_metrics_printf(&out, "finedb_written_raw_bytes_total %llu\n", (unsigned long long)raw);
+	_metrics_family(&out, "finedb_written_stored_bytes", "counter", "bytes",
+	                "Size of the written values, compressed.");
+	_metrics_printf(&out, "finedb_written_stored_bytes_total %llu\n", (unsigned long long)stored);
+	_metrics_family(&out, "finedb_compression_ratio", "gauge", NULL,
+	                "Ratio between the uncompressed and compressed sizes of the written values.");
+	_metrics_printf(&out, "finedb_compression_ratio %.4f\n", (stored ? (double)raw / (double)stored : 1.0));
+	// connections
+	_metrics_family(&out, "finedb_connections", "gauge", NULL, "Number of open connections.");
+	_metrics_printf(&out, "finedb_connections %lld\n", (long long)STATS_GAUGE_GET(stats->connections));
+	_metrics_family(&out, "finedb_connections_accepted", "counter", NULL, "Number of accepted connections.");
+	_metrics_printf(&out, "finedb_connections_accepted_total %llu\n",
+	                (unsigned long long)STATS_GAUGE_GET(stats->accepted));
+	// LMDB environment
+	if (database_info(finedb->database, &info, &stat) == YENOERR) {
+		_metrics_family(&out, "finedb_lmdb_map_size_bytes", "gauge", "bytes", "Size of the LMDB map.");
+		_metrics_printf(&out, "finedb_lmdb_map_size_bytes %zu\n", info.me_mapsize);
+		_metrics_family(&out, "finedb_lmdb_used_bytes", "gauge", "bytes", "Size of the used pages of the map.");
+		_metrics_printf(&out, "finedb_lmdb_used_bytes %zu\n", (info.me_last_pgno + 1) * (size_t)stat.ms_psize);
+		_metrics_family(&out, "finedb_lmdb_last_txn_id", "gauge", NULL, "ID of the last committed transaction.");
+		_metrics_printf(&out, "finedb_lmdb_last_txn_id %zu\n", info.me_last_txnid);
+		_metrics_family(&out, "finedb_lmdb_readers", "gauge", NULL, "Number of used reader slots.");
+		_metrics_printf(&out, "finedb_lmdb_readers %u\n", info.me_numreaders);
+		_metrics_family(&out, "finedb_lmdb_max_readers", "gauge", NULL, "Number of reader slots.");
+		_metrics_printf(&out, "finedb_lmdb_max_readers %u\n", info.me_maxreaders);
+		_metrics_family(&out, "finedb_lmdb_page_size_bytes", "gauge", "bytes", "Size of a database page.");
+		_metrics_printf(&out, "finedb_lmdb_page_size_bytes %u\n", stat.ms_psize);
+		_metrics_family(&out, "finedb_lmdb_depth", "gauge", NULL, "Depth of the main B-tree.");
+		_metrics_printf(&out, "finedb_lmdb_depth %u\n", stat.ms_depth);
+		_metrics_family(&out, "finedb_lmdb_pages", "gauge", NULL, "Number of pages of the main B-tree.");
+		_metrics_printf(&out, "finedb_lmdb_pages{type=\"branch\"} %zu\n", stat.ms_branch_pages);
+		_metrics_printf(&out, "finedb_lmdb_pages{type=\"leaf\"} %zu\n", stat.ms_leaf_pages);
+		_metrics_printf(&out, "finedb_lmdb_pages{type=\"overflow\"} %zu\n", stat.ms_overflow_pages);
+		_metrics_family(&out, "finedb_lmdb_entries", "gauge", NULL, "Number of entries of the main B-tree.");
+		_metrics_printf(&out, "finedb_lmdb_entries %zu\n", stat.ms_entries);
+	}
+	ys_cat(&out, "# EOF\n");
+	return (out);
+}
+
+/**
+ * @function	_metrics_family
+ *		Write the metadata of a metric family.
+ * @param	out	Pointer to the output string.
+ * @param	name	Name of the family.
+ * @param	type	Type of the family (counter, gauge, summary).
+ * @param	unit	Unit of the family. NULL if none.
+ * @param	help	Description of the family.
+ */
+static void _metrics_family(ystr_t *out, const char *name, const char *type, const char *unit,
+                            const char *help) {
+	_metrics_printf(out, "# TYPE %s %s\n", name, type);
+	if (unit)
+		_metrics_printf(out, "# UNIT %s %s\n", name, unit);
+	_metrics_printf(out, "# HELP %s %s\n", name, help);
+}
+
+/**
+ * @function	_metrics_summary
+ *		Write the samples of a summary (quantiles, sum and count).
+ * @param	out		Pointer to the output string.
+ * @param	name		Name of the family.
+ * @param	labels		Labels of the samples. NULL if none.
+ * @param	histogram	Pointer to the histogram.
+ * @param	scale		Factor applied to the values (nanoseconds to
+ *				seconds for latencies).
+ */
+static void _metrics_summary(ystr_t *out, const char *name, const char *labels,
+                             stats_histogram_t *histogram, double scale) {
+	const char *sep = labels ? "," : "";
+	char set[160];
+
+	if (labels == NULL)
+		labels = "";
+	_metrics_printf(out, "%s{%s%squantile=\"0.5\"} %.9g\n", name, labels, sep,
+	                (double)stats_percentile(histogram, 50.0) * scale);
+	_metrics_printf(out, "%s{%s%squantile=\"0.99\"} %.9g\n", name, labels, sep,
+	                (double)stats_percentile(histogram, 99.0) * scale);
+	_metrics_printf(out, "%s{%s%squantile=\"0.999\"} %.9g\n", name, labels, sep,
+	                (double)stats_percentile(histogram, 99.9) * scale);
+	// no empty label set on the other samples
+	if (*labels)
+		snprintf(set, sizeof(set), "{%s}", labels);
+	else
+		*set = '\0';
+	_metrics_printf(out, "%s_sum%s %.9g\n", name, set, (double)histogram->sum * scale);
+	_metrics_printf(out, "%s_count%s %llu\n", name, set, (unsigned long long)histogram->count);
+}
+
+/**
+ * @function	_metrics_printf
+ *		Add formatted text at the end of a string.
+ * @param	out	Pointer to the output string.
+ * @param	format	Format string (like in printf()).
+ * @param	...	Variable argument list.
+ */
+static void _metrics_printf(ystr_t *out, const char *format, ...) {
+	char line[512];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	ys_cat(out, line);
+}
+
+/**
+ * @function	_metrics_write
+ *		Write data on a socket.
+ * @param	fd	Socket descriptor.
+ * @param	data	Pointer to the data.
+ * @param	len	Size of the data.
+ * @return	YENOERR if OK.
+ */
+static yerr_t _metrics_write(int fd, const char *data, size_t len) {
+	ssize_t rc;
+
+	while (len) {
+		if ((rc = write(fd, data, len)) <= 0)
+			return (YEIO);
+		data += rc;
+		len -= (size_t)rc;
+	}
+	return (YENOERR);
+}
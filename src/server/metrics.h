@@ -0,0 +1,34 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "yerror.h"
+#include "finedb.h"
+
+/** @const METRICS_REQUEST_SIZE Maximum size of an HTTP request to the metrics listener. */
+#define METRICS_REQUEST_SIZE	4096
+/** @const METRICS_TIMEOUT Time given to a client to send its HTTP request (seconds). */
+#define METRICS_TIMEOUT		5
+/** @const METRICS_CONTENT_TYPE Content type of the OpenMetrics text format. */
+#define METRICS_CONTENT_TYPE	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/**
+ * @function	metrics_start
+ *		Create the listening socket of the metrics HTTP listener, and
+ *		start its thread.
+ * @param	finedb	Pointer to the main FineDB structure.
+ * @param	port	Port number to listen to.
+ * @return	YENOERR if OK.
+ */
+yerr_t metrics_start(finedb_t *finedb, unsigned short port);
+
+/**
+ * @function	metrics_loop
+ *		Main loop of the metrics thread. Serves the counters and
+ *		histograms of the server in the OpenMetrics text format on
+ *		"GET /metrics", one connection at a time.
+ * @param	param	Pointer to the main FineDB structure.
+ * @return	Always NULL.
+ */
+void *metrics_loop(void *param);
+
+#endif /* __METRICS_H__ */
@@ -47,7 +47,7 @@
 /* **************** RESPONSE READING *************** */
 
 /** @define RESPONSE_STATUS Extract the status of a response. */
-#define RESPONSE_STATUS(c)		(c & 1)
+#define RESPONSE_STATUS(c)		(c & 0x1f)	// 0b00011111
 
 /** @define RESPONSE_ERROR Extract the error code from a response. */
 #define RESPONSE_ERROR(c)		(c & 0x1e)	// 0b00011110
@@ -62,6 +62,12 @@
  * @constant	PROTO_SETDB	SETDB command.
  * @constant	PROTO_START	START command.
  * @constant	PROTO_STOP	STOP command.
+ * @constant	PROTO_AGGREGATE	AGGREGATE command.
+ * @constant	PROTO_MERGE	MERGE command.
+ * @constant	PROTO_CAS	CAS (compare-and-swap) command.
+ * @constant	PROTO_SHM	SHM command (switch to shared-memory rings).
+ * @constant	PROTO_BATCH	BATCH command (several PUT and DEL in one frame).
+ * @constant	PROTO_TRACK	TRACK command (invalidation of client-side caches).
  * @constant	PROTO_ADMIN	ADMIN command.
  * @constant	PROTO_EXTRA	EXTRA command.
  */
@@ -73,6 +79,12 @@ typedef enum protocol_command_e {
 	PROTO_SETDB	= 0x4,
 	PROTO_START	= 0x5,
 	PROTO_STOP	= 0x6,
+	PROTO_AGGREGATE	= 0x7,
+	PROTO_MERGE	= 0x8,
+	PROTO_CAS	= 0x9,
+	PROTO_SHM	= 0xa,
+	PROTO_BATCH	= 0xb,
+	PROTO_TRACK	= 0xc,
 	PROTO_ADMIN	= 0xe,
 	PROTO_EXTRA	= 0xf,
 } protocol_command_t;
@@ -104,6 +116,10 @@ typedef enum protocol_option_e {
  * @constant	RESP_ERR_BAD_NAME	Bad name (dbname for SETDB request,
  *					key for GET or DEL request).
  * @constant	RESP_ERR_TRANSACTION	Transaction error.
+ * @constant	RESP_ERR_BAD_VALUE	The stored value is not compatible with
+ *					the requested operation.
+ * @constant	RESP_ERR_VERSION	The version of the key doesn't match the
+ *					expected one.
  */
 typedef enum protocol_response_e {
 	RESP_ERR_UNDEFINED	= 0,
@@ -113,7 +129,229 @@ typedef enum protocol_response_e {
 	RESP_ERR_FULL_DB	= 4,
 	RESP_ERR_TOO_MANY_DB	= 5,
 	RESP_ERR_BAD_NAME	= 6,
-	RESP_ERR_TRANSACTION	= 7
+	RESP_ERR_TRANSACTION	= 7,
+	RESP_ERR_BAD_VALUE	= 8,
+	RESP_ERR_VERSION	= 9
 } protocol_response_t;
 
+/**
+ * @typedef	protocol_encoding_t
+ *		Integer encodings of values, used by the AGGREGATE command.
+ * @constant	PROTO_ENC_NONE		Values are not numbers. Only count and
+ *					size are computed.
+ * @constant	PROTO_ENC_STRING	Values are decimal strings.
+ * @constant	PROTO_ENC_INT64		Values are 64 bits big-endian signed integers.
+ */
+typedef enum protocol_encoding_e {
+	PROTO_ENC_NONE		= 0,
+	PROTO_ENC_STRING	= 1,
+	PROTO_ENC_INT64		= 2
+} protocol_encoding_t;
+
+/**
+ * @typedef	protocol_merge_t
+ *		List of merge operators, used by the MERGE command. Numeric
+ *		operators work on decimal strings; a missing key is equal to 0.
+ * @constant	PROTO_MERGE_INC		Add the operand to the value.
+ * @constant	PROTO_MERGE_DEC		Subtract the operand from the value.
+ * @constant	PROTO_MERGE_APPEND	Append the operand to the value.
+ * @constant	PROTO_MERGE_MAX		Keep the greatest of the value and the operand.
+ * @constant	PROTO_MERGE_MIN		Keep the lowest of the value and the operand.
+ * @constant	PROTO_MERGE_OR		Bitwise OR, byte per byte.
+ */
+typedef enum protocol_merge_e {
+	PROTO_MERGE_INC		= 0,
+	PROTO_MERGE_DEC		= 1,
+	PROTO_MERGE_APPEND	= 2,
+	PROTO_MERGE_MAX		= 3,
+	PROTO_MERGE_MIN		= 4,
+	PROTO_MERGE_OR		= 5
+} protocol_merge_t;
+
+/**
+ * @typedef	protocol_cas_t
+ *		List of conditional writes, used by the CAS command.
+ * @constant	PROTO_CAS_PUT	Write the value if the version matches.
+ * @constant	PROTO_CAS_DEL	Remove the key if the version matches.
+ */
+typedef enum protocol_cas_e {
+	PROTO_CAS_PUT	= 0,
+	PROTO_CAS_DEL	= 1
+} protocol_cas_t;
+
+/**
+ * @define	PROTO_AGGREGATE_RESULT_SIZE
+ *		Size of the AGGREGATE response data. It is made of six 64 bits
+ *		big-endian integers: number of keys, total size of values,
+ *		number of numeric values, sum, minimum and maximum.
+ */
+#define PROTO_AGGREGATE_RESULT_SIZE	(6 * sizeof(uint64_t))
+
+/** @define PROTO_SHM_DEFAULT_SIZE Default size of shared-memory rings (1 MB). */
+#define PROTO_SHM_DEFAULT_SIZE		1048576
+/** @define PROTO_SHM_MIN_SIZE Minimum size of shared-memory rings (4 KB). */
+#define PROTO_SHM_MIN_SIZE		4096
+/** @define PROTO_SHM_MAX_SIZE Maximum size of shared-memory rings (64 MB). */
+#define PROTO_SHM_MAX_SIZE		67108864
+
+/**
+ * @define	PROTO_BATCH_MAX_ENTRIES
+ *		Maximum number of entries in a BATCH request. Each entry is
+ *		made of a command byte (PROTO_PUT or PROTO_DEL), a 16 bits key
+ *		length, the key, and for PUT a 32 bits data length and the data.
+ */
+#define PROTO_BATCH_MAX_ENTRIES		65536
+
+/**
+ * @typedef	protocol_track_t
+ *		Operations of the TRACK command.
+ * @constant	PROTO_TRACK_SUBSCRIBE	The connection becomes an invalidation
+ *					connection. The response carries its
+ *					tracking ID (1 byte); invalidation
+ *					records are then pushed on it.
+ * @constant	PROTO_TRACK_ATTACH	Keys read by the connection are
+ *					tracked for the given tracking ID (1
+ *					byte after the operation).
+ * @constant	PROTO_TRACK_DETACH	Stop tracking the keys read by the
+ *					connection.
+ */
+typedef enum protocol_track_e {
+	PROTO_TRACK_SUBSCRIBE	= 0,
+	PROTO_TRACK_ATTACH	= 1,
+	PROTO_TRACK_DETACH	= 2
+} protocol_track_t;
+
+/**
+ * @typedef	protocol_invalidation_t
+ *		Types of invalidation records, pushed on invalidation
+ *		connections. A record is made of the type (1 byte), the length
+ *		of the database name (1 byte), the name, the length of the key
+ *		(16 bits) and the key. Names and keys are empty for
+ *		PROTO_INVALIDATE_ALL.
+ * @constant	PROTO_INVALIDATE_KEY	A key was modified. All cached keys
+ *					of the same slot must be forgotten.
+ * @constant	PROTO_INVALIDATE_ALL	All cached keys must be forgotten.
+ */
+typedef enum protocol_invalidation_e {
+	PROTO_INVALIDATE_KEY	= 0,
+	PROTO_INVALIDATE_ALL	= 1
+} protocol_invalidation_t;
+
+/**
+ * @define	PROTO_TRACK_SLOTS
+ *		Number of slots of tracked keys (power of 2). The slot of a key
+ *		is the FNV-1a hash (32 bits) of the database name, a 0xff byte
+ *		and the key, modulo the number of slots.
+ */
+#define PROTO_TRACK_SLOTS		65536
+
+/**
+ * @typedef	protocol_admin_t
+ *		Operations of the ADMIN command (1 byte after the command).
+ * @constant	PROTO_ADMIN_STATS	Latency statistics of the requests.
+ *					The response data are made of the
+ *					uptime of the server (64 bits, in
+ *					milliseconds), followed by entries of
+ *					PROTO_STATS_ENTRY_SIZE bytes.
+ * @constant	PROTO_ADMIN_LMDB	Internals of the LMDB environment.
+ *					The response data are made of
+ *					PROTO_LMDB_INFO_SIZE bytes, followed
+ *					by an entry per database (see
+ *					PROTO_LMDB_DB_SIZE).
+ * @constant	PROTO_ADMIN_SLOWLOG	Slowest requests. The response data are
+ *					made of the threshold of the log (64
+ *					bits, in nanoseconds, 0 if the log is
+ *					disabled), followed by entries of
+ *					PROTO_SLOWLOG_ENTRY_SIZE bytes, from
+ *					the most recent one.
+ * @constant	PROTO_ADMIN_HOTKEYS	Most accessed keys. The response data
+ *					are made of the numbers of reads and
+ *					writes counted by the server (two 64
+ *					bits integers, halved as the counts
+ *					age), followed by an entry per key (see
+ *					PROTO_HOTKEYS_ENTRY_SIZE): the most
+ *					read keys, then the most written ones.
+ */
+typedef enum protocol_admin_e {
+	PROTO_ADMIN_STATS	= 0,
+	PROTO_ADMIN_LMDB	= 1,
+	PROTO_ADMIN_SLOWLOG	= 2,
+	PROTO_ADMIN_HOTKEYS	= 3
+} protocol_admin_t;
+
+/**
+ * @typedef	protocol_stats_result_t
+ *		Results of requests, as counted by the statistics.
+ * @constant	PROTO_STATS_HIT		The request was successful.
+ * @constant	PROTO_STATS_MISS	The key was not found, or its version
+ *					didn't match.
+ * @constant	PROTO_STATS_ERROR	Any other error.
+ */
+typedef enum protocol_stats_result_e {
+	PROTO_STATS_HIT		= 0,
+	PROTO_STATS_MISS	= 1,
+	PROTO_STATS_ERROR	= 2
+} protocol_stats_result_t;
+
+/**
+ * @define	PROTO_STATS_ENTRY_SIZE
+ *		Size of an entry of the ADMIN STATS response. It is made of the
+ *		command number, the mode (0 for synchronous requests, 1 for
+ *		asynchronous ones) and the result (1 byte each), followed by
+ *		seven 64 bits big-endian integers: number of requests,
+ *		throughput (requests per second since the start of the server),
+ *		mean, median, 99th percentile, 99.9th percentile and maximum
+ *		latencies (nanoseconds).
+ */
+#define PROTO_STATS_ENTRY_SIZE		(3 + 7 * sizeof(uint64_t))
+
+/**
+ * @define	PROTO_LMDB_INFO_SIZE
+ *		Size of the header of the ADMIN LMDB response. It is made of
+ *		eleven 64 bits big-endian integers: map size (bytes), last used
+ *		page number, last committed transaction ID, number of reader
+ *		slots, number of used reader slots, page size (bytes), number of
+ *		pages in the free-list, age of the oldest transaction opened by
+ *		a client (milliseconds, 0 if none), number of transactions
+ *		committed since it started, and the numbers of major and minor
+ *		page faults of the server process.
+ */
+#define PROTO_LMDB_INFO_SIZE		(11 * sizeof(uint64_t))
+
+/**
+ * @define	PROTO_LMDB_DB_SIZE
+ *		Size of an entry of the ADMIN LMDB response, without its name.
+ *		It is made of the size of the database name (1 byte, 0 for the
+ *		default database) followed by the name itself and five 64 bits
+ *		big-endian integers: B-tree depth, numbers of branch, leaf and
+ *		overflow pages, and number of entries.
+ */
+#define PROTO_LMDB_DB_SIZE		(1 + 5 * sizeof(uint64_t))
+
+/**
+ * @define	PROTO_SLOWLOG_ENTRY_SIZE
+ *		Size of an entry of the ADMIN SLOWLOG response. It is made of
+ *		the command number, the mode (0 for synchronous requests, 1 for
+ *		asynchronous ones) and the response code (1 byte each), followed
+ *		by ten 64 bits big-endian integers: sequence number, date (Unix
+ *		time, milliseconds), total duration, time spent receiving the
+ *		request, processing it, waiting for the writer thread, in LMDB,
+ *		in compression and sending the response (nanoseconds), and
+ *		number of messages waiting for the writer thread at the end of
+ *		the request.
+ */
+#define PROTO_SLOWLOG_ENTRY_SIZE	(3 + 10 * sizeof(uint64_t))
+
+/**
+ * @define	PROTO_HOTKEYS_ENTRY_SIZE
+ *		Size of an entry of the ADMIN HOTKEYS response, without its
+ *		database name and its key. It is made of the type of access (1
+ *		byte, 0 for reads and 1 for writes), the estimated number of
+ *		accesses (64 bits big-endian integer), the size of the database
+ *		name (1 byte, 0 for the default database) followed by the name,
+ *		and the size of the key (16 bits big-endian integer, the key
+ *		could be truncated) followed by the key.
+ */
+#define PROTO_HOTKEYS_ENTRY_SIZE	(1 + sizeof(uint64_t) + 1 + sizeof(uint16_t))
+
 #endif /* __PROTOCOL_H__ */
@@ -2,8 +2,11 @@
 #include <unistd.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <string.h>
 #include <stdio.h>
 #include "nanomsg/nn.h"
@@ -14,12 +17,14 @@
 
 /* Create the socket for incoming connections. */
 yerr_t server_create_listening_socket(int *psock, unsigned short port) {
+	struct sockaddr_in6 addr6;
 	struct sockaddr_in addr;
-	unsigned int addr_size;
-	const int on = 1;
+	const int on = 1, off = 0;
+	int rc;
 
-	// create the socket
-	if ((*psock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+	// create the socket (IPv6 with IPv4-mapped addresses, or IPv4 only)
+	if ((*psock = socket(AF_INET6, SOCK_STREAM, 0)) < 0 &&
+	    (*psock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
 		YLOG_ADD(YLOG_CRIT, "Socket error");
 		return (YEIO);
 	}
@@ -31,12 +36,20 @@ yerr_t server_create_listening_socket(int *psock, unsigned short port) {
 	               sizeof(on)) < 0)
 		YLOG_ADD(YLOG_WARN, "setsockopt(SO_KEEPALIVE) failed");
 	// binding to any interface
-	addr_size = sizeof(addr);
-	memset(&addr, 0, addr_size);
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(port);
-	if (bind(*psock, (struct sockaddr*)&addr, addr_size) < 0) {
+	if (setsockopt(*psock, IPPROTO_IPV6, IPV6_V6ONLY, (void*)&off, sizeof(off)) == 0) {
+		memset(&addr6, 0, sizeof(addr6));
+		addr6.sin6_family = AF_INET6;
+		addr6.sin6_addr = in6addr_any;
+		addr6.sin6_port = htons(port);
+		rc = bind(*psock, (struct sockaddr*)&addr6, sizeof(addr6));
+	} else {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		rc = bind(*psock, (struct sockaddr*)&addr, sizeof(addr));
+	}
+	if (rc < 0) {
 		YLOG_ADD(YLOG_CRIT, "Bind error");
 		return (YEBADF);
 	}
@@ -47,26 +60,73 @@ yerr_t server_create_listening_socket(int *psock, unsigned short port) {
 	return (YENOERR);
 }
 
+/* Create the Unix socket for local connections. */
+yerr_t server_create_unix_socket(int *psock, const char *path) {
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		YLOG_ADD(YLOG_CRIT, "Unix socket path too long");
+		return (YENAMETOOLONG);
+	}
+	// create the socket
+	if ((*psock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		YLOG_ADD(YLOG_CRIT, "Socket error");
+		return (YEIO);
+	}
+	// remove a socket file left by a previous run
+	unlink(path);
+	// binding to the path
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (bind(*psock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		YLOG_ADD(YLOG_CRIT, "Bind error on '%s'", path);
+		return (YEBADF);
+	}
+	if (listen(*psock, SOMAXCONN)) {
+		YLOG_ADD(YLOG_CRIT, "Listen error");
+		return (YEBADF);
+	}
+	return (YENOERR);
+}
+
 /* Main FineDB server loop. */
-void server_loop(ybool_t *run, int socket, int threads_socket) {
+void server_loop(ybool_t *run, int socket, int unix_socket, int threads_socket) {
+	struct pollfd fds[2];
+	nfds_t nfds = 1;
 	int fd;
-	struct sockaddr_in addr;
-	unsigned int addr_size;
 	const int on = 1;
 
-	addr_size = sizeof(addr);
-	memset(&addr, 0, addr_size);
+	fds[0].fd = socket;
+	fds[0].events = POLLIN;
+	if (unix_socket >= 0) {
+		fds[1].fd = unix_socket;
+		fds[1].events = POLLIN;
+		nfds = 2;
+	}
 	while (*run) {
-		// accept a new connection
-		if ((fd = accept(socket, (struct sockaddr*)&addr,
-		                 &addr_size)) < 0)
-			continue ;
-		if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void*)&on,
-		               sizeof(on)) < 0)
-			YLOG_ADD(YLOG_WARN, "setsockopt(KEEPALIVE) failed");
-		// write the file descriptor number into the threads communication socket
-		connection_thread_push_socket(threads_socket, fd);
+		// wait for incoming connections
+		if (poll(fds, nfds, -1) <= 0)
+			continue;
+		// accept a new TCP connection
+		if ((fds[0].revents & POLLIN) &&
+		    (fd = accept(socket, NULL, NULL)) >= 0) {
+			if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void*)&on,
+			               sizeof(on)) < 0)
+				YLOG_ADD(YLOG_WARN, "setsockopt(KEEPALIVE) failed");
+			// responses are written in several parts, don't wait for ACKs
+			if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void*)&on,
+			               sizeof(on)) < 0)
+				YLOG_ADD(YLOG_WARN, "setsockopt(TCP_NODELAY) failed");
+			// write the file descriptor number into the threads communication socket
+			connection_thread_push_socket(threads_socket, fd);
+		}
+		// accept a new local connection
+		if (nfds > 1 && (fds[1].revents & POLLIN) &&
+		    (fd = accept(unix_socket, NULL, NULL)) >= 0)
+			connection_thread_push_socket(threads_socket, fd);
 	}
 	close(socket);
+	if (unix_socket >= 0)
+		close(unix_socket);
 }
-
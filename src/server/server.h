@@ -5,19 +5,28 @@
 #include "yerror.h"
 
 /**
- * Create a listening socket.
+ * Create a listening socket, on all IPv6 and IPv4 interfaces.
  * @param	psock	Pointer to the socket.
  * @param	port	Port number to bind to.
  * @return	YENOERR if OK.
  */
 yerr_t server_create_listening_socket(int *psock, unsigned short port);
 
+/**
+ * Create a listening Unix domain socket, used by local clients.
+ * @param	psock	Pointer to the socket.
+ * @param	path	Path to the socket file. An existing file is removed.
+ * @return	YENOERR if OK.
+ */
+yerr_t server_create_unix_socket(int *psock, const char *path);
+
 /**
  * Main FineDB server loop.
  * @param	prun		Pointer to the run boolean.
- * @param	socket		Socket to listen to.
+ * @param	socket		TCP socket to listen to.
+ * @param	unix_socket	Unix socket to listen to. -1 if not used.
  * @param	threads_socket	Socket used to communicate with threads.
  */
-void server_loop(ybool_t *run, int socket, int threads_socket);
+void server_loop(ybool_t *run, int socket, int unix_socket, int threads_socket);
 
 #endif /* __SERVER_H__ */
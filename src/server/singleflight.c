@@ -0,0 +1,194 @@
+#include <string.h>
+#include "singleflight.h"
+
+/* private functions */
+static uint32_t _singleflight_hash(const char *dbname, ybin_t key);
+static ybool_t _singleflight_same_db(const char *dbname1, const char *dbname2);
+static void _singleflight_unlink(singleflight_shard_t *shard, singleflight_call_t *call);
+
+/** @define SINGLEFLIGHT_SHARD Return the shard of a hash. */
+#define SINGLEFLIGHT_SHARD(singleflight, hash)	(&(singleflight)->shards[(hash) & (SINGLEFLIGHT_SHARDS - 1)])
+
+/* Create a table of running reads. */
+singleflight_t *singleflight_new() {
+	singleflight_t *singleflight;
+	int i;
+
+	if ((singleflight = YMALLOC(sizeof(singleflight_t))) == NULL)
+		return (NULL);
+	for (i = 0; i < SINGLEFLIGHT_SHARDS; i++) {
+		pthread_mutex_init(&singleflight->shards[i].mutex, NULL);
+		pthread_cond_init(&singleflight->shards[i].cond, NULL);
+	}
+	return (singleflight);
+}
+
+/* Join the running read of a key, or start a new one. */
+singleflight_call_t *singleflight_join(singleflight_t *singleflight, const char *dbname, ybin_t key,
+                                       ybool_t compress, ybool_t *leader) {
+	uint32_t hash = _singleflight_hash(dbname, key);
+	singleflight_shard_t *shard = SINGLEFLIGHT_SHARD(singleflight, hash);
+	singleflight_call_t *call;
+
+	pthread_mutex_lock(&shard->mutex);
+	for (call = shard->calls; call; call = call->next) {
+		if (call->hash == hash && call->compress == compress && call->key.len == key.len &&
+		    !memcmp(call->key.data, key.data, key.len) &&
+		    _singleflight_same_db(call->dbname, dbname)) {
+			call->refs++;
+			pthread_mutex_unlock(&shard->mutex);
+			*leader = YFALSE;
+			return (call);
+		}
+	}
+	if ((call = YMALLOC(sizeof(singleflight_call_t))) == NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		return (NULL);
+	}
+	call->hash = hash;
+	call->dbname = dbname;
+	call->key = key;
+	call->compress = compress;
+	call->refs = 1;
+	call->linked = YTRUE;
+	call->next = shard->calls;
+	shard->calls = call;
+	pthread_mutex_unlock(&shard->mutex);
+	*leader = YTRUE;
+	return (call);
+}
+
+/* Wait for the result of a call. */
+void singleflight_wait(singleflight_t *singleflight, singleflight_call_t *call) {
+	singleflight_shard_t *shard = SINGLEFLIGHT_SHARD(singleflight, call->hash);
+
+	pthread_mutex_lock(&shard->mutex);
+	while (!call->done)
+		pthread_cond_wait(&shard->cond, &shard->mutex);
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/* Give the result of a call, and wake up its waiters. */
+void singleflight_done(singleflight_t *singleflight, singleflight_call_t *call, yerr_t result,
+                       ybin_t data, uint64_t version) {
+	singleflight_shard_t *shard = SINGLEFLIGHT_SHARD(singleflight, call->hash);
+
+	pthread_mutex_lock(&shard->mutex);
+	// no other thread could join the call anymore
+	if (call->linked)
+		_singleflight_unlink(shard, call);
+	call->result = result;
+	call->version = version;
+	// the data are copied only if some threads are waiting for them
+	if (result == YENOERR && call->refs > 1) {
+		if ((call->data.data = YMALLOC(data.len + 1)) == NULL)
+			call->result = YENOMEM;
+		else if (data.len) {
+			memcpy(call->data.data, data.data, data.len);
+			call->data.len = data.len;
+		}
+	}
+	call->done = YTRUE;
+	if (call->refs > 1)
+		pthread_cond_broadcast(&shard->cond);
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/* Release a call. */
+void singleflight_release(singleflight_t *singleflight, singleflight_call_t *call) {
+	singleflight_shard_t *shard = SINGLEFLIGHT_SHARD(singleflight, call->hash);
+	unsigned int refs;
+
+	pthread_mutex_lock(&shard->mutex);
+	refs = --call->refs;
+	pthread_mutex_unlock(&shard->mutex);
+	if (refs)
+		return;
+	YFREE(call->data.data);
+	YFREE(call);
+}
+
+/* Remove the running reads of a modified key from the table. */
+void singleflight_forget(singleflight_t *singleflight, const char *dbname, ybin_t *key) {
+	singleflight_shard_t *shard;
+	singleflight_call_t *call, *next;
+	uint32_t hash;
+	int i;
+
+	if (key) {
+		hash = _singleflight_hash(dbname, *key);
+		shard = SINGLEFLIGHT_SHARD(singleflight, hash);
+		pthread_mutex_lock(&shard->mutex);
+		for (call = shard->calls; call; call = next) {
+			next = call->next;
+			if (call->hash == hash && call->key.len == key->len &&
+			    !memcmp(call->key.data, key->data, key->len) &&
+			    _singleflight_same_db(call->dbname, dbname))
+				_singleflight_unlink(shard, call);
+		}
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+	// the whole database was modified
+	for (i = 0; i < SINGLEFLIGHT_SHARDS; i++) {
+		shard = &singleflight->shards[i];
+		pthread_mutex_lock(&shard->mutex);
+		for (call = shard->calls; call; call = next) {
+			next = call->next;
+			if (_singleflight_same_db(call->dbname, dbname))
+				_singleflight_unlink(shard, call);
+		}
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_singleflight_hash
+ *		Compute the hash of a key (FNV-1a hash of the database name
+ *		and the key).
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	The hash value.
+ */
+static uint32_t _singleflight_hash(const char *dbname, ybin_t key) {
+	uint32_t hash = 2166136261U;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 16777619U;
+	hash = (hash ^ 0xff) * 16777619U;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 16777619U;
+	return (hash);
+}
+
+/**
+ * @function	_singleflight_same_db
+ *		Tell if two database names are the same.
+ * @param	dbname1	First name. NULL for the default DB.
+ * @param	dbname2	Second name. NULL for the default DB.
+ * @return	YTRUE if the names are equal.
+ */
+static ybool_t _singleflight_same_db(const char *dbname1, const char *dbname2) {
+	if (dbname1 == NULL || dbname2 == NULL)
+		return ((dbname1 == dbname2) ? YTRUE : YFALSE);
+	return (strcmp(dbname1, dbname2) ? YFALSE : YTRUE);
+}
+
+/**
+ * @function	_singleflight_unlink
+ *		Remove a call from the table. Its waiters still get its result.
+ *		The shard must be locked.
+ * @param	shard	Pointer to the shard.
+ * @param	call	Pointer to the call.
+ */
+static void _singleflight_unlink(singleflight_shard_t *shard, singleflight_call_t *call) {
+	singleflight_call_t **pcall;
+
+	for (pcall = &shard->calls; *pcall != call; pcall = &(*pcall)->next)
+		;
+	*pcall = call->next;
+	call->linked = YFALSE;
+}
@@ -0,0 +1,134 @@
+#ifndef __SINGLEFLIGHT_H__
+#define __SINGLEFLIGHT_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "yerror.h"
+#include "ybin.h"
+
+/** @const SINGLEFLIGHT_SHARDS Number of shards of the table of running reads (power of 2). */
+#define SINGLEFLIGHT_SHARDS	64
+
+/**
+ * @typedef	singleflight_call_t
+ *		Read of a key, shared by the connection threads which asked
+ *		for it at the same time. The first thread (the leader) reads
+ *		the database; the others wait for its result.
+ * @field	hash		Hash of the database name and the key.
+ * @field	dbname		Name of the database (leader's copy). NULL for
+ *				the default DB.
+ * @field	key		Key (leader's copy). Only used while the call
+ *				is in the table.
+ * @field	compress	YTRUE if the compressed value is read.
+ * @field	refs		Number of threads using the call.
+ * @field	done		YTRUE when the result is available.
+ * @field	linked		YTRUE while the call is in the table (new
+ *				readers could join it).
+ * @field	result		Result of the read (YENOERR, YENODATA or error).
+ * @field	data		Value read, shared by all waiters.
+ * @field	version		Version of the value.
+ * @field	next		Next call of the same shard.
+ */
+typedef struct singleflight_call_s {
+	uint32_t hash;
+	const char *dbname;
+	ybin_t key;
+	ybool_t compress;
+	unsigned int refs;
+	ybool_t done;
+	ybool_t linked;
+	yerr_t result;
+	ybin_t data;
+	uint64_t version;
+	struct singleflight_call_s *next;
+} singleflight_call_t;
+
+/**
+ * @typedef	singleflight_shard_t
+ *		Shard of the table of running reads.
+ * @field	mutex	Mutex protecting the shard.
+ * @field	cond	Condition signaled when a result is available.
+ * @field	calls	List of running reads.
+ */
+typedef struct singleflight_shard_s {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	singleflight_call_t *calls;
+} singleflight_shard_t;
+
+/**
+ * @typedef	singleflight_t
+ *		Table of running reads. Concurrent GETs of the same key share
+ *		one database lookup and decompression.
+ * @field	shards	Shards, selected by the hash of the key.
+ */
+typedef struct singleflight_s {
+	singleflight_shard_t shards[SINGLEFLIGHT_SHARDS];
+} singleflight_t;
+
+/**
+ * @function	singleflight_new
+ *		Create a table of running reads.
+ * @return	A pointer to the allocated table, or NULL.
+ */
+singleflight_t *singleflight_new(void);
+
+/**
+ * @function	singleflight_join
+ *		Join the running read of a key, or start a new one.
+ * @param	singleflight	Pointer to the table.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ *				Must stay valid until singleflight_done().
+ * @param	key		Key. Must stay valid until singleflight_done().
+ * @param	compress	YTRUE if the compressed value is read.
+ * @param	leader		Pointer to a boolean, set to YTRUE if the caller
+ *				must read the database and call
+ *				singleflight_done().
+ * @return	A pointer to the call, or NULL on memory error.
+ */
+singleflight_call_t *singleflight_join(singleflight_t *singleflight, const char *dbname, ybin_t key,
+                                       ybool_t compress, ybool_t *leader);
+
+/**
+ * @function	singleflight_wait
+ *		Wait for the result of a call.
+ * @param	singleflight	Pointer to the table.
+ * @param	call		Pointer to the call.
+ */
+void singleflight_wait(singleflight_t *singleflight, singleflight_call_t *call);
+
+/**
+ * @function	singleflight_done
+ *		Give the result of a call, and wake up its waiters. The data
+ *		are copied only if some threads wait for them.
+ * @param	singleflight	Pointer to the table.
+ * @param	call		Pointer to the call.
+ * @param	result		Result of the read.
+ * @param	data		Value read.
+ * @param	version		Version of the value.
+ */
+void singleflight_done(singleflight_t *singleflight, singleflight_call_t *call, yerr_t result,
+                       ybin_t data, uint64_t version);
+
+/**
+ * @function	singleflight_release
+ *		Release a call. It is freed when unused.
+ * @param	singleflight	Pointer to the table.
+ * @param	call		Pointer to the call.
+ */
+void singleflight_release(singleflight_t *singleflight, singleflight_call_t *call);
+
+/**
+ * @function	singleflight_forget
+ *		Remove the running reads of a modified key from the table,
+ *		so the following GETs read the new value. Must be called after
+ *		the commit.
+ * @param	singleflight	Pointer to the table.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Pointer to the key. NULL for all keys of the
+ *				database.
+ */
+void singleflight_forget(singleflight_t *singleflight, const char *dbname, ybin_t *key);
+
+#endif /* __SINGLEFLIGHT_H__ */
@@ -0,0 +1,71 @@
+#include <string.h>
+#include <sys/time.h>
+#include "slowlog.h"
+
+/* Create the ring of slow requests. */
+slowlog_t *slowlog_new(unsigned int threshold) {
+	slowlog_t *slowlog;
+
+	if ((slowlog = YMALLOC(sizeof(slowlog_t))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&slowlog->mutex, NULL);
+	slowlog->threshold = (uint64_t)threshold * 1000000;
+	return (slowlog);
+}
+
+/* Start the timing of a request. */
+void slowlog_start(slowlog_t *slowlog, slowlog_timer_t *timer) {
+	if (slowlog == NULL)
+		return;
+	memset(timer, 0, sizeof(slowlog_timer_t));
+	timer->start = timer->last = stats_now();
+}
+
+/* Give the time elapsed since the last mark to a stage. */
+void slowlog_stage(slowlog_timer_t *timer, slowlog_stage_t stage) {
+	uint64_t now = stats_now();
+
+	timer->stages[stage] += now - timer->last;
+	timer->last = now;
+}
+
+/* End the timing of a request. */
+void slowlog_end(slowlog_t *slowlog, slowlog_timer_t *timer, unsigned char command, ybool_t sync,
+                 protocol_response_t response, int64_t queued) {
+	slowlog_entry_t *entry;
+	struct timeval tv;
+	uint64_t duration;
+
+	if (slowlog == NULL || !timer->start)
+		return;
+	// the time since the last mark is the end of the processing
+	slowlog_stage(timer, SLOWLOG_PARSE);
+	duration = timer->last - timer->start;
+	timer->start = 0;
+	if (duration < slowlog->threshold)
+		return;
+	gettimeofday(&tv, NULL);
+	pthread_mutex_lock(&slowlog->mutex);
+	entry = &slowlog->entries[slowlog->next_id % SLOWLOG_SIZE];
+	entry->id = slowlog->next_id++;
+	entry->time = (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+	entry->command = command;
+	entry->sync = sync;
+	entry->response = response;
+	entry->duration = duration;
+	memcpy(entry->stages, timer->stages, sizeof(entry->stages));
+	entry->queued = queued;
+	pthread_mutex_unlock(&slowlog->mutex);
+}
+
+/* Copy the entries of the ring. */
+size_t slowlog_get(slowlog_t *slowlog, slowlog_entry_t *entries) {
+	uint64_t id;
+	size_t nbr = 0;
+
+	pthread_mutex_lock(&slowlog->mutex);
+	for (id = slowlog->next_id; id > 0 && nbr < SLOWLOG_SIZE; id--)
+		entries[nbr++] = slowlog->entries[(id - 1) % SLOWLOG_SIZE];
+	pthread_mutex_unlock(&slowlog->mutex);
+	return (nbr);
+}
@@ -0,0 +1,145 @@
+#ifndef __SLOWLOG_H__
+#define __SLOWLOG_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "protocol.h"
+#include "stats.h"
+
+/** @const SLOWLOG_SIZE Number of slow requests kept in the ring. */
+#define SLOWLOG_SIZE		128
+
+/**
+ * @typedef	slowlog_stage_t
+ *		Stages of a request. The time between two stage marks is given
+ *		to the second one.
+ * @constant	SLOWLOG_RECV	Reception of the request from the client.
+ * @constant	SLOWLOG_PARSE	Processing done by the connection thread
+ *				(everything not measured by another stage).
+ * @constant	SLOWLOG_QUEUE	Sending to the writer thread, or waiting for
+ *				the write lock (held by the writer's commits).
+ * @constant	SLOWLOG_TXN	LMDB reads, writes and commits.
+ * @constant	SLOWLOG_ZIP	Compression and decompression.
+ * @constant	SLOWLOG_SEND	Sending of the response.
+ */
+typedef enum slowlog_stage_e {
+	SLOWLOG_RECV = 0,
+	SLOWLOG_PARSE,
+	SLOWLOG_QUEUE,
+	SLOWLOG_TXN,
+	SLOWLOG_ZIP,
+	SLOWLOG_SEND,
+	SLOWLOG_STAGES
+} slowlog_stage_t;
+
+/**
+ * @typedef	slowlog_timer_t
+ *		Timing of the running request of a connection thread.
+ * @field	start	Start time of the request (nanoseconds), 0 if the
+ *			request is not timed.
+ * @field	last	Time of the last stage mark.
+ * @field	stages	Time spent in each stage.
+ */
+typedef struct slowlog_timer_s {
+	uint64_t start;
+	uint64_t last;
+	uint64_t stages[SLOWLOG_STAGES];
+} slowlog_timer_t;
+
+/**
+ * @typedef	slowlog_entry_t
+ *		A slow request.
+ * @field	id		Sequence number of the entry.
+ * @field	time		Date of the request (Unix time, milliseconds).
+ * @field	command		Command number.
+ * @field	sync		YTRUE if the request was synchronous.
+ * @field	response	Response code sent to the client.
+ * @field	duration	Total duration of the request (nanoseconds).
+ * @field	stages		Time spent in each stage (nanoseconds).
+ * @field	queued		Number of messages waiting for the writer
+ *				thread at the end of the request.
+ */
+typedef struct slowlog_entry_s {
+	uint64_t id;
+	uint64_t time;
+	unsigned char command;
+	ybool_t sync;
+	protocol_response_t response;
+	uint64_t duration;
+	uint64_t stages[SLOWLOG_STAGES];
+	int64_t queued;
+} slowlog_entry_t;
+
+/**
+ * @typedef	slowlog_t
+ *		Ring of the slowest requests.
+ * @field	mutex		Mutex protecting the ring.
+ * @field	threshold	Duration above which a request is logged
+ *				(nanoseconds).
+ * @field	next_id		Sequence number of the next entry.
+ * @field	entries		Ring of entries.
+ */
+typedef struct slowlog_s {
+	pthread_mutex_t mutex;
+	uint64_t threshold;
+	uint64_t next_id;
+	slowlog_entry_t entries[SLOWLOG_SIZE];
+} slowlog_t;
+
+/** @define SLOWLOG_STAGE Mark the end of a stage, if the request is timed. */
+#define SLOWLOG_STAGE(timer, stage)	do { \
+						if ((timer)->start) \
+							slowlog_stage(timer, stage); \
+					} while (0)
+
+/**
+ * @function	slowlog_new
+ *		Create the ring of slow requests.
+ * @param	threshold	Duration above which a request is logged
+ *				(milliseconds).
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+slowlog_t *slowlog_new(unsigned int threshold);
+
+/**
+ * @function	slowlog_start
+ *		Start the timing of a request. Does nothing if the slow-request
+ *		log is disabled.
+ * @param	slowlog	Pointer to the slow-request log. NULL if disabled.
+ * @param	timer	Pointer to the timer of the connection thread.
+ */
+void slowlog_start(slowlog_t *slowlog, slowlog_timer_t *timer);
+
+/**
+ * @function	slowlog_stage
+ *		Give the time elapsed since the last mark to a stage.
+ * @param	timer	Pointer to the timer of the connection thread.
+ * @param	stage	The stage.
+ */
+void slowlog_stage(slowlog_timer_t *timer, slowlog_stage_t stage);
+
+/**
+ * @function	slowlog_end
+ *		End the timing of a request, and add it to the ring if it was
+ *		slower than the threshold.
+ * @param	slowlog		Pointer to the slow-request log. NULL if disabled.
+ * @param	timer		Pointer to the timer of the connection thread.
+ * @param	command		Command number.
+ * @param	sync		YTRUE if the request was synchronous.
+ * @param	response	Response code sent to the client.
+ * @param	queued		Number of messages waiting for the writer thread.
+ */
+void slowlog_end(slowlog_t *slowlog, slowlog_timer_t *timer, unsigned char command, ybool_t sync,
+                 protocol_response_t response, int64_t queued);
+
+/**
+ * @function	slowlog_get
+ *		Copy the entries of the ring, from the most recent one.
+ * @param	slowlog	Pointer to the slow-request log.
+ * @param	entries	Array of at least SLOWLOG_SIZE entries.
+ * @return	The number of copied entries.
+ */
+size_t slowlog_get(slowlog_t *slowlog, slowlog_entry_t *entries);
+
+#endif /* __SLOWLOG_H__ */
@@ -0,0 +1,211 @@
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/* private functions */
+static void _stats_histogram_add(stats_histogram_t **phistogram, uint64_t value);
+static void _stats_histogram_merge(stats_histogram_t *histogram, stats_histogram_t **psrc);
+static unsigned int _stats_bucket(uint64_t value);
+static uint64_t _stats_bucket_max(unsigned int bucket);
+
+/** @define STATS_INCR Add to a counter written by a single thread, readable by the others. */
+#define STATS_INCR(counter, n)	__atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+/** @define STATS_READ Read a counter written by another thread. */
+#define STATS_READ(counter)	__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/* Create the statistics of the server. */
+stats_t *stats_new() {
+	stats_t *stats;
+
+	if ((stats = YMALLOC(sizeof(stats_t))) == NULL)
+		return (NULL);
+	pthread_mutex_init(&stats->mutex, NULL);
+	stats->start = stats_now();
+	return (stats);
+}
+
+/* Create the statistics of a thread. */
+stats_thread_t *stats_thread_new(stats_t *stats) {
+	stats_thread_t *thread_stats;
+
+	if ((thread_stats = YMALLOC(sizeof(stats_thread_t))) == NULL)
+		return (NULL);
+	pthread_mutex_lock(&stats->mutex);
+	thread_stats->next = stats->threads;
+	stats->threads = thread_stats;
+	pthread_mutex_unlock(&stats->mutex);
+	return (thread_stats);
+}
+
+/* Return the current time of a monotonic clock. */
+uint64_t stats_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+/* Add the latency of a request. */
+void stats_add(stats_thread_t *thread_stats, unsigned char command, ybool_t sync,
+               protocol_stats_result_t result, uint64_t latency) {
+	if (thread_stats == NULL)
+		return;
+	_stats_histogram_add(&thread_stats->histograms[command & (STATS_COMMANDS - 1)][sync ? 0 : 1][result],
+	                     latency);
+}
+
+/* Add a measure to the statistics of a thread. */
+void stats_add_metric(stats_thread_t *thread_stats, stats_metric_t metric, uint64_t value) {
+	if (thread_stats == NULL)
+		return;
+	_stats_histogram_add(&thread_stats->metrics[metric], value);
+}
+
+/* Add the size of a written value. */
+void stats_add_zip(stats_thread_t *thread_stats, size_t raw, size_t stored) {
+	if (thread_stats == NULL)
+		return;
+	STATS_INCR(thread_stats->raw_bytes, raw);
+	STATS_INCR(thread_stats->stored_bytes, stored);
+}
+
+/* Merge the histograms of all threads. */
+yerr_t stats_merge(stats_t *stats, unsigned char command, ybool_t sync,
+                   protocol_stats_result_t result, stats_histogram_t *histogram) {
+	stats_thread_t *thread_stats;
+
+	memset(histogram, 0, sizeof(stats_histogram_t));
+	pthread_mutex_lock(&stats->mutex);
+	for (thread_stats = stats->threads; thread_stats; thread_stats = thread_stats->next)
+		_stats_histogram_merge(histogram,
+		                       &thread_stats->histograms[command & (STATS_COMMANDS - 1)][sync ? 0 : 1][result]);
+	pthread_mutex_unlock(&stats->mutex);
+	return (histogram->count ? YENOERR : YENODATA);
+}
+
+/* Merge the histograms of all threads for a type of measure. */
+yerr_t stats_merge_metric(stats_t *stats, stats_metric_t metric, stats_histogram_t *histogram) {
+	stats_thread_t *thread_stats;
+
+	memset(histogram, 0, sizeof(stats_histogram_t));
+	pthread_mutex_lock(&stats->mutex);
+	for (thread_stats = stats->threads; thread_stats; thread_stats = thread_stats->next)
+		_stats_histogram_merge(histogram, &thread_stats->metrics[metric]);
+	pthread_mutex_unlock(&stats->mutex);
+	return (histogram->count ? YENOERR : YENODATA);
+}
+
+/* Sum the sizes of the written values of all threads. */
+void stats_merge_zip(stats_t *stats, uint64_t *raw, uint64_t *stored) {
+	stats_thread_t *thread_stats;
+
+	*raw = *stored = 0;
+	pthread_mutex_lock(&stats->mutex);
+	for (thread_stats = stats->threads; thread_stats; thread_stats = thread_stats->next) {
+		*raw += STATS_READ(thread_stats->raw_bytes);
+		*stored += STATS_READ(thread_stats->stored_bytes);
+	}
+	pthread_mutex_unlock(&stats->mutex);
+}
+
+/* Compute a percentile of a histogram. */
+uint64_t stats_percentile(stats_histogram_t *histogram, double percentile) {
+	uint64_t rank, seen = 0, value;
+	unsigned int i;
+
+	if (!histogram->count)
+		return (0);
+	rank = (uint64_t)((percentile / 100.0) * (double)histogram->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	value = _stats_bucket_max(i < STATS_BUCKETS ? i : STATS_BUCKETS - 1);
+	return ((value > histogram->max && histogram->max) ? histogram->max : value);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_stats_histogram_add
+ *		Add a value to a histogram of the current thread. The histogram
+ *		is allocated if needed.
+ * @param	phistogram	Pointer to the histogram pointer.
+ * @param	value		The value.
+ */
+static void _stats_histogram_add(stats_histogram_t **phistogram, uint64_t value) {
+	stats_histogram_t *histogram;
+
+	if ((histogram = *phistogram) == NULL) {
+		if ((histogram = YMALLOC(sizeof(stats_histogram_t))) == NULL)
+			return;
+		__atomic_store_n(phistogram, histogram, __ATOMIC_RELEASE);
+	}
+	STATS_INCR(histogram->buckets[_stats_bucket(value)], 1);
+	STATS_INCR(histogram->sum, value);
+	if (value > histogram->max)
+		__atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+	STATS_INCR(histogram->count, 1);
+}
+
+/**
+ * @function	_stats_histogram_merge
+ *		Add a histogram of another thread to a merged histogram. The
+ *		count is computed from the buckets, to stay consistent with them.
+ * @param	histogram	Pointer to the merged histogram.
+ * @param	psrc		Pointer to the added histogram pointer.
+ */
+static void _stats_histogram_merge(stats_histogram_t *histogram, stats_histogram_t **psrc) {
+	stats_histogram_t *src;
+	uint64_t value;
+	unsigned int i;
+
+	if ((src = __atomic_load_n(psrc, __ATOMIC_ACQUIRE)) == NULL)
+		return;
+	histogram->sum += STATS_READ(src->sum);
+	if ((value = STATS_READ(src->max)) > histogram->max)
+		histogram->max = value;
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		value = STATS_READ(src->buckets[i]);
+		histogram->buckets[i] += value;
+		histogram->count += value;
+	}
+}
+
+/**
+ * @function	_stats_bucket
+ *		Return the bucket of a value.
+ * @param	value	The value.
+ * @return	The bucket number.
+ */
+static unsigned int _stats_bucket(uint64_t value) {
+	unsigned int msb, shift;
+
+	if (value < STATS_SUB_BUCKETS)
+		return ((unsigned int)value);
+	if (value >= (1ULL << STATS_MAX_BITS))
+		return (STATS_BUCKETS - 1);
+	msb = 63 - (unsigned int)__builtin_clzll(value);
+	shift = msb - STATS_SUB_BITS;
+	// the bits following the most significant one give the sub-bucket
+	return ((shift + 1) * STATS_SUB_BUCKETS + (unsigned int)((value >> shift) & (STATS_SUB_BUCKETS - 1)));
+}
+
+/**
+ * @function	_stats_bucket_max
+ *		Return the greatest value of a bucket.
+ * @param	bucket	The bucket number.
+ * @return	The value.
+ */
+static uint64_t _stats_bucket_max(unsigned int bucket) {
+	unsigned int shift;
+	uint64_t sub;
+
+	if (bucket < STATS_SUB_BUCKETS)
+		return (bucket);
+	shift = bucket / STATS_SUB_BUCKETS - 1;
+	sub = bucket % STATS_SUB_BUCKETS;
+	return (((STATS_SUB_BUCKETS + sub + 1) << shift) - 1);
+}
@@ -0,0 +1,198 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "yerror.h"
+#include "protocol.h"
+
+/** @const STATS_COMMANDS Number of commands (see REQUEST_COMMAND). */
+#define STATS_COMMANDS		16
+/** @const STATS_MODES Number of request modes (synchronous or not). */
+#define STATS_MODES		2
+/** @const STATS_RESULTS Number of request results (see protocol_stats_result_t). */
+#define STATS_RESULTS		3
+/** @const STATS_SUB_BITS Number of bits of the sub-buckets (precision of 1/32). */
+#define STATS_SUB_BITS		5
+/** @const STATS_SUB_BUCKETS Number of buckets between two powers of 2. */
+#define STATS_SUB_BUCKETS	(1 << STATS_SUB_BITS)
+/** @const STATS_MAX_BITS Number of bits of the greatest latency (about 18 minutes). */
+#define STATS_MAX_BITS		40
+/** @const STATS_BUCKETS Number of buckets of a histogram. */
+#define STATS_BUCKETS		((STATS_MAX_BITS - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+/**
+ * @typedef	stats_histogram_t
+ *		Latency histogram (in nanoseconds). Values lower than
+ *		STATS_SUB_BUCKETS have their own bucket; above, each power of 2
+ *		is split in STATS_SUB_BUCKETS buckets, so the relative error
+ *		stays under 1/STATS_SUB_BUCKETS.
+ * @field	count	Number of values.
+ * @field	sum	Sum of the values.
+ * @field	max	Greatest value.
+ * @field	buckets	Number of values per bucket.
+ */
+typedef struct stats_histogram_s {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[STATS_BUCKETS];
+} stats_histogram_t;
+
+/**
+ * @typedef	stats_metric_t
+ *		Other measures, kept in histograms.
+ * @constant	STATS_COMMIT	Duration of the writer's commits (nanoseconds).
+ * @constant	STATS_BATCH	Number of messages written by the writer in
+ *				one transaction.
+ */
+typedef enum stats_metric_e {
+	STATS_COMMIT = 0,
+	STATS_BATCH,
+	STATS_METRICS
+} stats_metric_t;
+
+/**
+ * @typedef	stats_thread_t
+ *		Statistics of a thread (connection threads and writer thread).
+ *		They are written only by their thread, without lock; other
+ *		threads could read them at any time. Histograms are allocated
+ *		on first use.
+ * @field	histograms	Histograms, per command, mode and result.
+ * @field	metrics		Histograms of the other measures.
+ * @field	raw_bytes	Size of the written values, uncompressed.
+ * @field	stored_bytes	Size of the written values, compressed.
+ * @field	next		Next thread.
+ */
+typedef struct stats_thread_s {
+	stats_histogram_t *histograms[STATS_COMMANDS][STATS_MODES][STATS_RESULTS];
+	stats_histogram_t *metrics[STATS_METRICS];
+	uint64_t raw_bytes;
+	uint64_t stored_bytes;
+	struct stats_thread_s *next;
+} stats_thread_t;
+
+/**
+ * @typedef	stats_t
+ *		Statistics of the server.
+ * @field	mutex		Mutex protecting the list of threads.
+ * @field	start		Start time of the server (nanoseconds).
+ * @field	queued		Number of messages sent to the writer thread
+ *				and not committed yet.
+ * @field	connections	Number of open connections.
+ * @field	accepted	Number of accepted connections.
+ * @field	threads		List of the threads' statistics.
+ */
+typedef struct stats_s {
+	pthread_mutex_t mutex;
+	uint64_t start;
+	int64_t queued;
+	int64_t connections;
+	uint64_t accepted;
+	stats_thread_t *threads;
+} stats_t;
+
+/** @define STATS_GAUGE_ADD Add to a counter shared by several threads. */
+#define STATS_GAUGE_ADD(counter, n)	__atomic_add_fetch(&(counter), (n), __ATOMIC_RELAXED)
+/** @define STATS_GAUGE_GET Read a counter shared by several threads. */
+#define STATS_GAUGE_GET(counter)	__atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/**
+ * @function	stats_new
+ *		Create the statistics of the server.
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+stats_t *stats_new(void);
+
+/**
+ * @function	stats_thread_new
+ *		Create the statistics of a thread.
+ * @param	stats	Pointer to the server's statistics.
+ * @return	A pointer to the allocated structure, or NULL.
+ */
+stats_thread_t *stats_thread_new(stats_t *stats);
+
+/**
+ * @function	stats_now
+ *		Return the current time of a monotonic clock.
+ * @return	The time in nanoseconds.
+ */
+uint64_t stats_now(void);
+
+/**
+ * @function	stats_add
+ *		Add the latency of a request to the statistics of its thread.
+ *		Must be called only by the thread itself.
+ * @param	thread_stats	Pointer to the thread's statistics.
+ * @param	command		Command number.
+ * @param	sync		YTRUE if the request was synchronous.
+ * @param	result		Result of the request.
+ * @param	latency		Latency of the request (nanoseconds).
+ */
+void stats_add(stats_thread_t *thread_stats, unsigned char command, ybool_t sync,
+               protocol_stats_result_t result, uint64_t latency);
+
+/**
+ * @function	stats_add_metric
+ *		Add a measure to the statistics of a thread. Must be called
+ *		only by the thread itself.
+ * @param	thread_stats	Pointer to the thread's statistics.
+ * @param	metric		Type of measure.
+ * @param	value		Measured value.
+ */
+void stats_add_metric(stats_thread_t *thread_stats, stats_metric_t metric, uint64_t value);
+
+/**
+ * @function	stats_add_zip
+ *		Add the size of a written value to the statistics of a thread.
+ *		Must be called only by the thread itself.
+ * @param	thread_stats	Pointer to the thread's statistics.
+ * @param	raw		Uncompressed size.
+ * @param	stored		Compressed size.
+ */
+void stats_add_zip(stats_thread_t *thread_stats, size_t raw, size_t stored);
+
+/**
+ * @function	stats_merge
+ *		Merge the histograms of all threads for a command, mode and
+ *		result.
+ * @param	stats		Pointer to the server's statistics.
+ * @param	command		Command number.
+ * @param	sync		YTRUE for synchronous requests.
+ * @param	result		Result of the requests.
+ * @param	histogram	Pointer to the merged histogram.
+ * @return	YENOERR if some requests were found, YENODATA otherwise.
+ */
+yerr_t stats_merge(stats_t *stats, unsigned char command, ybool_t sync,
+                   protocol_stats_result_t result, stats_histogram_t *histogram);
+
+/**
+ * @function	stats_merge_metric
+ *		Merge the histograms of all threads for a type of measure.
+ * @param	stats		Pointer to the server's statistics.
+ * @param	metric		Type of measure.
+ * @param	histogram	Pointer to the merged histogram.
+ * @return	YENOERR if some values were found, YENODATA otherwise.
+ */
+yerr_t stats_merge_metric(stats_t *stats, stats_metric_t metric, stats_histogram_t *histogram);
+
+/**
+ * @function	stats_merge_zip
+ *		Sum the sizes of the written values of all threads.
+ * @param	stats	Pointer to the server's statistics.
+ * @param	raw	Pointer to the uncompressed size.
+ * @param	stored	Pointer to the compressed size.
+ */
+void stats_merge_zip(stats_t *stats, uint64_t *raw, uint64_t *stored);
+
+/**
+ * @function	stats_percentile
+ *		Compute a percentile of a histogram.
+ * @param	histogram	Pointer to the histogram.
+ * @param	percentile	Percentile (between 0 and 100).
+ * @return	The upper bound of the percentile's bucket.
+ */
+uint64_t stats_percentile(stats_histogram_t *histogram, double percentile);
+
+#endif /* __STATS_H__ */
@@ -0,0 +1,268 @@
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "ylog.h"
+#include "protocol.h"
+#include "tracking.h"
+
+/* private functions */
+static uint32_t _tracking_slot(const char *dbname, ybin_t key);
+static void _tracking_unsubscribe(tracking_t *tracking, int id);
+static void _tracking_push(tracking_t *tracking, int id, const char *dbname, ybin_t *key);
+
+/* Create a tracking table. */
+tracking_t *tracking_new(void) {
+	tracking_t *tracking;
+	int i;
+
+	if ((tracking = YMALLOC(sizeof(tracking_t))) == NULL)
+		return (NULL);
+	if ((tracking->slots = YMALLOC(TRACKING_SLOTS * sizeof(uint64_t))) == NULL) {
+		YFREE(tracking);
+		return (NULL);
+	}
+	pthread_mutex_init(&tracking->mutex, NULL);
+	for (i = 0; i < TRACKING_MAX_CLIENTS; i++) {
+		pthread_mutex_init(&tracking->clients[i].mutex, NULL);
+		tracking->clients[i].wake[0] = tracking->clients[i].wake[1] = -1;
+	}
+	return (tracking);
+}
+
+/* Register an invalidation connection. */
+int tracking_subscribe(tracking_t *tracking) {
+	tracking_client_t *client;
+	uint64_t bit;
+	uint32_t slot;
+	int id;
+
+	pthread_mutex_lock(&tracking->mutex);
+	for (id = 0; id < TRACKING_MAX_CLIENTS; id++)
+		if (!(tracking->active & (1ULL << id)))
+			break;
+	if (id == TRACKING_MAX_CLIENTS) {
+		pthread_mutex_unlock(&tracking->mutex);
+		return (-1);
+	}
+	client = &tracking->clients[id];
+	bit = 1ULL << id;
+	if (pipe2(client->wake, O_NONBLOCK | O_CLOEXEC)) {
+		pthread_mutex_unlock(&tracking->mutex);
+		return (-1);
+	}
+	pthread_mutex_lock(&client->mutex);
+	client->out = ydynabin_new(NULL, 0, YFALSE);
+	client->overflow = YFALSE;
+	pthread_mutex_unlock(&client->mutex);
+	// forget the keys read by the previous client with the same ID
+	for (slot = 0; slot < TRACKING_SLOTS; slot++)
+		__atomic_and_fetch(&tracking->slots[slot], ~bit, __ATOMIC_RELAXED);
+	__atomic_or_fetch(&tracking->active, bit, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tracking->mutex);
+	return (id);
+}
+
+/* Send invalidation records to a client. */
+void tracking_run(tracking_t *tracking, int id, int fd) {
+	tracking_client_t *client = &tracking->clients[id];
+	unsigned char all[1 + 1 + sizeof(uint16_t)];
+	ydynabin_t *sending, *tmp;
+	struct pollfd fds[2];
+	char buff[256];
+	ssize_t rc;
+
+	if ((sending = ydynabin_new(NULL, 0, YFALSE)) == NULL) {
+		_tracking_unsubscribe(tracking, id);
+		return;
+	}
+	memset(all, 0, sizeof(all));
+	all[0] = PROTO_INVALIDATE_ALL;
+	for (; ; ) {
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = client->wake[0];
+		fds[1].events = POLLIN;
+		fds[0].revents = fds[1].revents = 0;
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		// the client doesn't send anything: data or end of connection
+		if (fds[0].revents) {
+			rc = recv(fd, buff, sizeof(buff), MSG_DONTWAIT);
+			if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EINTR)) {
+				YLOG_ADD(YLOG_DEBUG, "Invalidation connection closed.");
+				break;
+			}
+		}
+		if (!fds[1].revents)
+			continue;
+		// take the waiting records
+		while (read(client->wake[0], buff, sizeof(buff)) > 0)
+			;
+		pthread_mutex_lock(&client->mutex);
+		tmp = client->out;
+		client->out = sending;
+		sending = tmp;
+		if (client->overflow) {
+			// records were dropped, the client must forget everything
+			ydynabin_forward(sending, sending->len);
+			ydynabin_expand(sending, all, sizeof(all));
+			client->overflow = YFALSE;
+		}
+		pthread_mutex_unlock(&client->mutex);
+		// send them
+		while (sending->len) {
+			if ((rc = send(fd, sending->data, sending->len, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+			ydynabin_forward(sending, (size_t)rc);
+		}
+		if (sending->len) {
+			YLOG_ADD(YLOG_WARN, "Unable to send invalidation records.");
+			break;
+		}
+	}
+	_tracking_unsubscribe(tracking, id);
+	ydynabin_delete(sending);
+}
+
+/* Remember that a client reads a key. */
+void tracking_mark(tracking_t *tracking, int id, const char *dbname, ybin_t key) {
+	uint64_t bit = 1ULL << id;
+
+	if (!(__atomic_load_n(&tracking->active, __ATOMIC_ACQUIRE) & bit))
+		return;
+	// the mark is visible before the read transaction starts
+	__atomic_or_fetch(&tracking->slots[_tracking_slot(dbname, key)], bit, __ATOMIC_SEQ_CST);
+}
+
+/* Add an invalidation record to a list. */
+yerr_t tracking_record(ydynabin_t *records, const char *dbname, ybin_t *key) {
+	unsigned char header[2];
+	uint16_t key_nlen = 0;
+	yerr_t rc;
+
+	header[0] = key ? PROTO_INVALIDATE_KEY : PROTO_INVALIDATE_ALL;
+	header[1] = (key && dbname) ? (unsigned char)strlen(dbname) : 0;
+	if (key)
+		key_nlen = htons((uint16_t)key->len);
+	if ((rc = ydynabin_expand(records, header, sizeof(header))) != YENOERR ||
+	    (rc = ydynabin_expand(records, (void*)dbname, header[1])) != YENOERR ||
+	    (rc = ydynabin_expand(records, &key_nlen, sizeof(key_nlen))) != YENOERR ||
+	    (key && (rc = ydynabin_expand(records, key->data, key->len)) != YENOERR))
+		return (rc);
+	return (YENOERR);
+}
+
+/* Read the first record of a list. */
+size_t tracking_record_read(ydynabin_t *records, char *dbname, ybin_t *key) {
+	unsigned char *pt, dbname_len;
+	uint16_t key_len;
+
+	if (records->len < 1 + 1 + sizeof(uint16_t))
+		return (0);
+	pt = records->data;
+	dbname_len = pt[1];
+	memcpy(dbname, pt + 2, dbname_len);
+	dbname[dbname_len] = '\0';
+	memcpy(&key_len, pt + 2 + dbname_len, sizeof(key_len));
+	key_len = ntohs(key_len);
+	if (pt[0] == PROTO_INVALIDATE_KEY)
+		ybin_set(key, pt + 2 + dbname_len + sizeof(key_len), key_len);
+	else
+		ybin_set(key, NULL, 0);
+	return (2 + dbname_len + sizeof(key_len) + key_len);
+}
+
+/* Send an invalidation record to the clients that read a key. */
+void tracking_invalidate_key(tracking_t *tracking, const char *dbname, ybin_t *key) {
+	uint64_t bits;
+	int id;
+
+	if (key)
+		bits = __atomic_exchange_n(&tracking->slots[_tracking_slot(dbname, *key)], 0, __ATOMIC_SEQ_CST);
+	else
+		bits = __atomic_load_n(&tracking->active, __ATOMIC_ACQUIRE);
+	for (id = 0; bits; id++, bits >>= 1)
+		if (bits & 1)
+			_tracking_push(tracking, id, dbname, key);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_tracking_slot
+ *		Compute the slot of a key, as defined by the protocol (FNV-1a
+ *		hash of the database name and the key).
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	The slot number.
+ */
+static uint32_t _tracking_slot(const char *dbname, ybin_t key) {
+	uint32_t hash = 2166136261U;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 16777619U;
+	hash = (hash ^ 0xff) * 16777619U;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 16777619U;
+	return (hash & (TRACKING_SLOTS - 1));
+}
+
+/**
+ * @function	_tracking_unsubscribe
+ *		Remove the subscription of an invalidation connection.
+ * @param	tracking	Pointer to the tracking table.
+ * @param	id		Tracking ID.
+ */
+static void _tracking_unsubscribe(tracking_t *tracking, int id) {
+	tracking_client_t *client = &tracking->clients[id];
+
+	pthread_mutex_lock(&tracking->mutex);
+	__atomic_and_fetch(&tracking->active, ~(1ULL << id), __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&client->mutex);
+	ydynabin_delete(client->out);
+	client->out = NULL;
+	close(client->wake[0]);
+	close(client->wake[1]);
+	client->wake[0] = client->wake[1] = -1;
+	pthread_mutex_unlock(&client->mutex);
+	pthread_mutex_unlock(&tracking->mutex);
+}
+
+/**
+ * @function	_tracking_push
+ *		Add an invalidation record to the buffer of a client, and wake
+ *		up its connection thread.
+ * @param	tracking	Pointer to the tracking table.
+ * @param	id		Tracking ID.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Pointer to the key. NULL to invalidate all keys.
+ */
+static void _tracking_push(tracking_t *tracking, int id, const char *dbname, ybin_t *key) {
+	tracking_client_t *client = &tracking->clients[id];
+
+	pthread_mutex_lock(&client->mutex);
+	if (client->out == NULL || client->overflow) {
+		pthread_mutex_unlock(&client->mutex);
+		return;
+	}
+	if (client->out->len > TRACKING_BUFFER_MAX ||
+	    tracking_record(client->out, dbname, key) != YENOERR) {
+		// too many waiting records: the client will forget everything
+		ydynabin_forward(client->out, client->out->len);
+		client->overflow = YTRUE;
+	}
+	if (write(client->wake[1], "", 1) < 0 && errno != EAGAIN)
+		YLOG_ADD(YLOG_WARN, "Unable to wake up invalidation connection.");
+	pthread_mutex_unlock(&client->mutex);
+}
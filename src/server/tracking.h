@@ -0,0 +1,127 @@
+#ifndef __TRACKING_H__
+#define __TRACKING_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ydefs.h"
+#include "yerror.h"
+#include "ybin.h"
+#include "ydynabin.h"
+#include "protocol.h"
+
+/** @const TRACKING_SLOTS Number of slots of the tracking table. */
+#define TRACKING_SLOTS		PROTO_TRACK_SLOTS
+/** @const TRACKING_MAX_CLIENTS Maximum number of invalidation connections. */
+#define TRACKING_MAX_CLIENTS	64
+/** @const TRACKING_BUFFER_MAX Size of waiting records over which a client is asked to forget everything. */
+#define TRACKING_BUFFER_MAX	1048576
+
+/**
+ * @typedef	tracking_client_t
+ *		Invalidation connection of a client.
+ * @field	mutex		Mutex protecting the buffer.
+ * @field	wake		Pipe used to wake up the connection thread.
+ * @field	out		Invalidation records waiting to be sent. NULL if
+ *				the client is not subscribed.
+ * @field	overflow	YTRUE if records were dropped; the client must
+ *				then forget all its keys.
+ */
+typedef struct tracking_client_s {
+	pthread_mutex_t mutex;
+	int wake[2];
+	ydynabin_t *out;
+	ybool_t overflow;
+} tracking_client_t;
+
+/**
+ * @typedef	tracking_t
+ *		Table of the keys cached by clients. Keys are hashed into
+ *		slots; each slot has a bitmap of the clients that read one of
+ *		its keys. When a key is modified, the bitmap of its slot is
+ *		reset and an invalidation record is sent to each of these
+ *		clients, which forget all their keys of the slot.
+ * @field	mutex	Mutex protecting subscriptions.
+ * @field	active	Bitmap of subscribed clients.
+ * @field	slots	Bitmaps of clients, per slot.
+ * @field	clients	Invalidation connections.
+ */
+typedef struct tracking_s {
+	pthread_mutex_t mutex;
+	volatile uint64_t active;
+	volatile uint64_t *slots;
+	tracking_client_t clients[TRACKING_MAX_CLIENTS];
+} tracking_t;
+
+/** @define TRACKING_ACTIVE Tell if some clients are subscribed. */
+#define TRACKING_ACTIVE(tracking)	(__atomic_load_n(&(tracking)->active, __ATOMIC_ACQUIRE) != 0)
+
+/**
+ * @function	tracking_new
+ *		Create a tracking table.
+ * @return	A pointer to the allocated table, or NULL.
+ */
+tracking_t *tracking_new(void);
+
+/**
+ * @function	tracking_subscribe
+ *		Register an invalidation connection.
+ * @param	tracking	Pointer to the tracking table.
+ * @return	The tracking ID, or -1 if too many clients are subscribed.
+ */
+int tracking_subscribe(tracking_t *tracking);
+
+/**
+ * @function	tracking_run
+ *		Send invalidation records to a subscribed client, until it
+ *		closes its connection. The subscription is then removed.
+ * @param	tracking	Pointer to the tracking table.
+ * @param	id		Tracking ID.
+ * @param	fd		Socket of the invalidation connection.
+ */
+void tracking_run(tracking_t *tracking, int id, int fd);
+
+/**
+ * @function	tracking_mark
+ *		Remember that a client reads a key. Must be called before the
+ *		key is read from the database.
+ * @param	tracking	Pointer to the tracking table.
+ * @param	id		Tracking ID.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Key.
+ */
+void tracking_mark(tracking_t *tracking, int id, const char *dbname, ybin_t key);
+
+/**
+ * @function	tracking_record
+ *		Add an invalidation record to a list, to be processed once the
+ *		write transaction is committed.
+ * @param	records		Pointer to the list of records.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Pointer to the key. NULL to invalidate all keys.
+ * @return	YENOERR if OK.
+ */
+yerr_t tracking_record(ydynabin_t *records, const char *dbname, ybin_t *key);
+
+/**
+ * @function	tracking_record_read
+ *		Read the first record of a list. The record is not removed.
+ * @param	records		Pointer to the list of records.
+ * @param	dbname		Buffer of 256 characters, filled with the name
+ *				of the database (empty for the default DB).
+ * @param	key		Pointer to the key, filled with the record's
+ *				key. Its data are NULL if all keys are modified.
+ * @return	The size of the record, or 0 if the list is empty.
+ */
+size_t tracking_record_read(ydynabin_t *records, char *dbname, ybin_t *key);
+
+/**
+ * @function	tracking_invalidate_key
+ *		Send an invalidation record to the clients that read a key.
+ *		Must be called after the commit.
+ * @param	tracking	Pointer to the tracking table.
+ * @param	dbname		Name of the database. NULL for the default DB.
+ * @param	key		Pointer to the key. NULL to invalidate all keys.
+ */
+void tracking_invalidate_key(tracking_t *tracking, const char *dbname, ybin_t *key);
+
+#endif /* __TRACKING_H__ */
@@ -1,14 +1,57 @@
+#include <stdint.h>
+#include <string.h>
 #include "nanomsg/nn.h"
 #include "nanomsg/pipeline.h"
 #include "lmdb.h"
+#include "snappy.h"
 #include "ylog.h"
 #include "writer_thread.h"
 #include "finedb.h"
 #include "database.h"
+#include "merge.h"
+
+/** @const WRITER_MERGE_BUCKETS Number of buckets of the merge table. */
+#define WRITER_MERGE_BUCKETS	256
+
+/**
+ * @typedef	writer_merge_t
+ *		Value modified by merges during a batch.
+ * @field	hash	Hash of the database name and the key.
+ * @field	dbname	Name of the database. NULL for the default DB.
+ * @field	key	Key.
+ * @field	value	Current uncompressed value.
+ * @field	next	Pointer to the next element of the bucket.
+ */
+typedef struct writer_merge_s {
+	uint32_t hash;
+	char *dbname;
+	ybin_t key;
+	ybin_t value;
+	struct writer_merge_s *next;
+} writer_merge_t;
+
+/* private functions */
+static void _writer_process(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                            writer_merge_t **merges, ydynabin_t *records, writer_msg_t *msg);
+static void _writer_msg_free(writer_msg_t *msg);
+static void _writer_invalidate(finedb_t *finedb, ydynabin_t *records);
+static uint32_t _writer_hash(const char *dbname, ybin_t key);
+static ybool_t _writer_same_key(writer_merge_t *merge, uint32_t hash, const char *dbname, ybin_t key);
+static writer_merge_t *_writer_merge_get(finedb_t *finedb, MDB_txn *txn, writer_merge_t **merges,
+                                         const char *dbname, ybin_t key);
+static void _writer_merge_forget(writer_merge_t **merges, const char *dbname, ybin_t *key);
+static void _writer_merge_release(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                                  writer_merge_t **merges, writer_msg_t *msg);
+static void _writer_merge_flush(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                                writer_merge_t **merges);
 
 /* Callback function executed by the writer thread. */
 void *writer_loop(void *param) {
 	finedb_t *finedb = (finedb_t*)param;
+	writer_merge_t *merges[WRITER_MERGE_BUCKETS];
+	struct snappy_env zip_env;
+	ydynabin_t *records;
+	stats_thread_t *stats;
 	int socket;
 
 	// create the nanomsg socket for threads communication
@@ -17,34 +60,331 @@ void *writer_loop(void *param) {
 		YLOG_ADD(YLOG_CRIT, "Unable to create socket in writer thread.");
 		exit(6);
 	}
-	// loop to process new connections
+	// create the compression environment used for merged values
+	memset(&zip_env, 0, sizeof(struct snappy_env));
+	if (snappy_init_env(&zip_env)) {
+		YLOG_ADD(YLOG_CRIT, "Unable to create Snappy environment in writer thread.");
+		exit(6);
+	}
+	memset(merges, 0, sizeof(merges));
+	// create the list of invalidation records
+	if ((records = ydynabin_new(NULL, 0, YFALSE)) == NULL) {
+		YLOG_ADD(YLOG_CRIT, "Unable to allocate memory in writer thread.");
+		exit(6);
+	}
+	stats = stats_thread_new(finedb->stats);
+	// loop to process new messages
 	for (; ; ) {
 		writer_msg_t *msg;
+		MDB_txn *txn;
+		unsigned int nbr = 0;
+		uint64_t start;
 
-		// waiting for a new connection to handle
+		// waiting for a new message to handle
 		if (nn_recv(socket, &msg, sizeof(writer_msg_t*), 0) < 0)
 			continue;
-		if (msg->type == WRITE_PUT) {
-			// add data in database
-			YLOG_ADD(YLOG_DEBUG, "WRITE '%s' => '%s'", msg->name.data, msg->data.data);
-			if (database_put(finedb->database, NULL, msg->create_only, msg->dbname, msg->name, msg->data) == YENOERR)
-				YLOG_ADD(YLOG_DEBUG, "Data written to database.");
-			else
-				YLOG_ADD(YLOG_WARN, "Unable to write data into database.");
-			YFREE(msg->data.data);
-		} else if (msg->type == WRITE_DEL) {
-			// remove data from database
-			YLOG_ADD(YLOG_DEBUG, "DELETE '%s'", msg->name.data);
-			if (database_del(finedb->database, NULL, msg->dbname, msg->name) == YENOERR)
-				YLOG_ADD(YLOG_DEBUG, "Data removed from database.");
-			else
-				YLOG_ADD(YLOG_WARN, "Unable to delete data into database.");
+		// open the transaction of the batch
+		if ((txn = database_transaction_start(finedb->database, YFALSE)) == NULL) {
+			YLOG_ADD(YLOG_WARN, "Unable to open transaction. Message dropped.");
+			_writer_msg_free(msg);
+			STATS_GAUGE_ADD(finedb->stats->queued, -1);
+			continue;
+		}
+		// process all the waiting messages
+		do {
+			_writer_process(finedb, txn, &zip_env, merges, records, msg);
+		} while (++nbr < WRITER_BATCH_SIZE &&
+		         nn_recv(socket, &msg, sizeof(writer_msg_t*), NN_DONTWAIT) >= 0);
+		// write merged values
+		_writer_merge_flush(finedb, txn, &zip_env, merges);
+		// commit the batch
+		start = stats_now();
+		if (database_transaction_commit(txn) == YENOERR)
+			YLOG_ADD(YLOG_DEBUG, "Batch of %d messages written.", nbr);
+		else
+			YLOG_ADD(YLOG_WARN, "Unable to commit a batch of %d messages.", nbr);
+		stats_add_metric(stats, STATS_COMMIT, stats_now() - start);
+		stats_add_metric(stats, STATS_BATCH, nbr);
+		STATS_GAUGE_ADD(finedb->stats->queued, -(int64_t)nbr);
+		// forget the modified keys, in the hot-value cache and in clients' caches
+		_writer_invalidate(finedb, records);
+	}
+	ydynabin_delete(records);
+	snappy_free_env(&zip_env);
+        return (NULL);
+}
+
+/* ********************* PRIVATE FUNCTIONS **************** */
+/**
+ * @function	_writer_process
+ *		Process a message inside the batch's transaction, and free it.
+ * @param	finedb	Pointer to the FineDB structure.
+ * @param	txn	Pointer to the batch's transaction.
+ * @param	zip_env	Pointer to the Snappy environment.
+ * @param	merges	Table of merged values.
+ * @param	records	List of invalidation records, sent after the commit.
+ * @param	msg	Pointer to the message.
+ */
+static void _writer_process(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                            writer_merge_t **merges, ydynabin_t *records, writer_msg_t *msg) {
+	writer_merge_t *merge;
+	writer_msg_t *sub;
+	yerr_t rc;
+
+	// modified keys are forgotten after the commit, by the hot-value cache and clients' caches
+	if (msg->type != WRITE_BATCH &&
+	    tracking_record(records, msg->dbname, (msg->type == WRITE_DROP ? NULL : &msg->name)) != YENOERR)
+		YLOG_ADD(YLOG_WARN, "Unable to record written key.");
+
+	if (msg->type == WRITE_PUT) {
+		// add data in database
+		YLOG_ADD(YLOG_DEBUG, "WRITE '%.*s' (%d bytes)", (int)msg->name.len,
+		         (char*)msg->name.data, msg->data.len);
+		_writer_merge_release(finedb, txn, zip_env, merges, msg);
+		rc = database_put(finedb->database, txn, msg->create_only, msg->dbname, msg->name,
+		                  msg->data, msg->version, NULL);
+		if (rc == YENOERR)
+			YLOG_ADD(YLOG_DEBUG, "Data written to database.");
+		else if (rc == YEAGAIN)
+			YLOG_ADD(YLOG_DEBUG, "Version mismatch, data not written.");
+		else
+			YLOG_ADD(YLOG_WARN, "Unable to write data into database.");
+	} else if (msg->type == WRITE_DEL) {
+		// remove data from database
+		YLOG_ADD(YLOG_DEBUG, "DELETE '%.*s'", (int)msg->name.len, (char*)msg->name.data);
+		_writer_merge_release(finedb, txn, zip_env, merges, msg);
+		rc = database_del(finedb->database, txn, msg->dbname, msg->name, msg->version);
+		if (rc == YENOERR)
+			YLOG_ADD(YLOG_DEBUG, "Data removed from database.");
+		else if (rc == YEAGAIN)
+			YLOG_ADD(YLOG_DEBUG, "Version mismatch, data not removed.");
+		else
+			YLOG_ADD(YLOG_WARN, "Unable to delete data into database.");
+	} else if (msg->type == WRITE_DROP) {
+		// remove a whole database
+		YLOG_ADD(YLOG_DEBUG, "DROP '%s'", msg->dbname);
+		_writer_merge_forget(merges, msg->dbname, NULL);
+		if (database_drop(finedb->database, txn, msg->dbname) == YENOERR)
+			YLOG_ADD(YLOG_DEBUG, "Database dropped.");
+		else
+			YLOG_ADD(YLOG_WARN, "Unable to drop database.");
+	} else if (msg->type == WRITE_BATCH) {
+		// list of messages from a BATCH request
+		YLOG_ADD(YLOG_DEBUG, "BATCH");
+		while ((sub = msg->next) != NULL) {
+			msg->next = sub->next;
+			sub->next = NULL;
+			_writer_process(finedb, txn, zip_env, merges, records, sub);
 		}
-		// free data
+	} else if (msg->type == WRITE_MERGE) {
+		// merge in memory, the value will be written at the end of the batch
+		YLOG_ADD(YLOG_DEBUG, "MERGE '%.*s'", (int)msg->name.len, (char*)msg->name.data);
+		if ((merge = _writer_merge_get(finedb, txn, merges, msg->dbname, msg->name)) == NULL ||
+		    merge_apply(msg->merge_op, &merge->value, msg->data) != YENOERR)
+			YLOG_ADD(YLOG_WARN, "Unable to merge data.");
+	}
+	// free data
+	_writer_msg_free(msg);
+}
+
+/**
+ * @function	_writer_invalidate
+ *		Remove the modified keys from the hot-value cache, and send
+ *		invalidation records to the clients that cache them. Called
+ *		after the commit. The list of records is emptied.
+ * @param	finedb	Pointer to the FineDB structure.
+ * @param	records	List of records of the modified keys.
+ */
+static void _writer_invalidate(finedb_t *finedb, ydynabin_t *records) {
+	ybool_t tracking = TRACKING_ACTIVE(finedb->tracking);
+	char dbname[256];
+	ybin_t key;
+	size_t len;
+
+	while ((len = tracking_record_read(records, dbname, &key)) > 0) {
+		if (finedb->hotcache)
+			hotcache_remove(finedb->hotcache, (*dbname ? dbname : NULL), (key.data ? &key : NULL));
+		singleflight_forget(finedb->singleflight, (*dbname ? dbname : NULL), (key.data ? &key : NULL));
+		if (tracking)
+			tracking_invalidate_key(finedb->tracking, (*dbname ? dbname : NULL),
+			                        (key.data ? &key : NULL));
+		ydynabin_forward(records, len);
+	}
+}
+
+/**
+ * @function	_writer_msg_free
+ *		Free a message, and the messages of its batch if any.
+ * @param	msg	Pointer to the message.
+ */
+static void _writer_msg_free(writer_msg_t *msg) {
+	writer_msg_t *next;
+
+	for (; msg; msg = next) {
+		next = msg->next;
+		YFREE(msg->data.data);
 		YFREE(msg->dbname);
 		YFREE(msg->name.data);
 		YFREE(msg);
 	}
-        return (NULL);
 }
 
+/**
+ * @function	_writer_hash
+ *		Compute the hash (FNV-1a) of a database name and a key.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	The hash value.
+ */
+static uint32_t _writer_hash(const char *dbname, ybin_t key) {
+	uint32_t hash = 2166136261U;
+	const unsigned char *pt;
+	size_t i;
+
+	for (pt = (const unsigned char*)dbname; pt && *pt; pt++)
+		hash = (hash ^ *pt) * 16777619U;
+	hash = (hash ^ 0xff) * 16777619U;
+	for (i = 0, pt = key.data; i < key.len; i++)
+		hash = (hash ^ pt[i]) * 16777619U;
+	return (hash);
+}
+
+/**
+ * @function	_writer_same_key
+ *		Tell if a merged value is related to the given database and key.
+ * @param	merge	Pointer to the merged value.
+ * @param	hash	Hash of the database name and the key.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	YTRUE if the database and the key are the same.
+ */
+static ybool_t _writer_same_key(writer_merge_t *merge, uint32_t hash, const char *dbname, ybin_t key) {
+	if (merge->hash != hash || merge->key.len != key.len)
+		return (YFALSE);
+	if ((merge->dbname == NULL) != (dbname == NULL) ||
+	    (dbname && strcmp(merge->dbname, dbname)))
+		return (YFALSE);
+	return (memcmp(merge->key.data, key.data, key.len) ? YFALSE : YTRUE);
+}
+
+/**
+ * @function	_writer_merge_get
+ *		Find a merged value. If it doesn't exist, it is read from the
+ *		database and added to the table.
+ * @param	finedb	Pointer to the FineDB structure.
+ * @param	txn	Pointer to the batch's transaction.
+ * @param	merges	Table of merged values.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Key.
+ * @return	A pointer to the merged value, or NULL if an error occurs.
+ */
+static writer_merge_t *_writer_merge_get(finedb_t *finedb, MDB_txn *txn, writer_merge_t **merges,
+                                         const char *dbname, ybin_t key) {
+	writer_merge_t *merge;
+	uint32_t hash;
+
+	hash = _writer_hash(dbname, key);
+	for (merge = merges[hash % WRITER_MERGE_BUCKETS]; merge; merge = merge->next)
+		if (_writer_same_key(merge, hash, dbname, key))
+			return (merge);
+	// not found: read the current value
+	if ((merge = YMALLOC(sizeof(writer_merge_t))) == NULL)
+		return (NULL);
+	if (merge_load(finedb->database, txn, dbname, key, &merge->value) != YENOERR ||
+	    (merge->key.data = YMALLOC(key.len ? key.len : 1)) == NULL) {
+		YFREE(merge->value.data);
+		YFREE(merge);
+		return (NULL);
+	}
+	memcpy(merge->key.data, key.data, key.len);
+	merge->key.len = key.len;
+	merge->dbname = dbname ? strdup(dbname) : NULL;
+	merge->hash = hash;
+	merge->next = merges[hash % WRITER_MERGE_BUCKETS];
+	merges[hash % WRITER_MERGE_BUCKETS] = merge;
+	return (merge);
+}
+
+/**
+ * @function	_writer_merge_forget
+ *		Remove merged values, because their keys were overwritten.
+ * @param	merges	Table of merged values.
+ * @param	dbname	Name of the database. NULL for the default DB.
+ * @param	key	Pointer to the key. NULL to remove all the values of
+ *			the database.
+ */
+static void _writer_merge_forget(writer_merge_t **merges, const char *dbname, ybin_t *key) {
+	writer_merge_t **pmerge, *merge;
+	uint32_t hash = 0;
+	unsigned int i;
+
+	if (key)
+		hash = _writer_hash(dbname, *key);
+	for (i = 0; i < WRITER_MERGE_BUCKETS; i++) {
+		if (key)
+			i = hash % WRITER_MERGE_BUCKETS;
+		for (pmerge = &merges[i]; (merge = *pmerge) != NULL; ) {
+			if ((key && !_writer_same_key(merge, hash, dbname, *key)) ||
+			    (!key && ((merge->dbname == NULL) != (dbname == NULL) ||
+			              (dbname && strcmp(merge->dbname, dbname))))) {
+				pmerge = &merge->next;
+				continue;
+			}
+			*pmerge = merge->next;
+			YFREE(merge->dbname);
+			YFREE(merge->key.data);
+			YFREE(merge->value.data);
+			YFREE(merge);
+		}
+		if (key)
+			break;
+	}
+}
+
+/**
+ * @function	_writer_merge_release
+ *		Release the merged value of a key before a PUT or a DEL. If the
+ *		write is unconditional, the value is just forgotten; otherwise
+ *		merged values are written first, so the version check is done
+ *		on the up-to-date value.
+ * @param	finedb	Pointer to the FineDB structure.
+ * @param	txn	Pointer to the batch's transaction.
+ * @param	zip_env	Pointer to the Snappy environment.
+ * @param	merges	Table of merged values.
+ * @param	msg	Pointer to the PUT or DEL message.
+ */
+static void _writer_merge_release(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                                  writer_merge_t **merges, writer_msg_t *msg) {
+	if (msg->version)
+		_writer_merge_flush(finedb, txn, zip_env, merges);
+	else
+		_writer_merge_forget(merges, msg->dbname, &msg->name);
+}
+
+/**
+ * @function	_writer_merge_flush
+ *		Write all merged values into database, and empty the table.
+ * @param	finedb	Pointer to the FineDB structure.
+ * @param	txn	Pointer to the batch's transaction.
+ * @param	zip_env	Pointer to the Snappy environment.
+ * @param	merges	Table of merged values.
+ */
+static void _writer_merge_flush(finedb_t *finedb, MDB_txn *txn, struct snappy_env *zip_env,
+                                writer_merge_t **merges) {
+	writer_merge_t *merge, *next;
+	unsigned int i;
+
+	for (i = 0; i < WRITER_MERGE_BUCKETS; i++) {
+		for (merge = merges[i]; merge; merge = next) {
+			next = merge->next;
+			if (merge_store(finedb->database, txn, zip_env, merge->dbname,
+			                merge->key, merge->value) != YENOERR)
+				YLOG_ADD(YLOG_WARN, "Unable to write merged data into database.");
+			YFREE(merge->dbname);
+			YFREE(merge->key.data);
+			YFREE(merge->value.data);
+			YFREE(merge);
+		}
+		merges[i] = NULL;
+	}
+}
@@ -1,7 +1,12 @@
 #ifndef __WRITER_THREAD_H__
 #define __WRITER_THREAD_H__
 
+#include <stdint.h>
 #include "ybin.h"
+#include "protocol.h"
+
+/** @const WRITER_BATCH_SIZE Maximum number of messages written in one transaction. */
+#define WRITER_BATCH_SIZE	1024
 
 /**
  * typedef	writer_action_t
@@ -9,21 +14,31 @@
  * @const	WRITE_PUT	Add or update a key in database.
  * @const	WRITE_DEL	Remove a key from database.
  * @const	WRITE_DROP	Remove a database and its keys.
+ * @const	WRITE_MERGE	Apply a merge operator on a key.
+ * @const	WRITE_BATCH	Apply a list of PUT and DEL messages.
  */
 typedef enum writer_action_e {
 	WRITE_PUT = 0,
 	WRITE_DEL,
-	WRITE_DROP
+	WRITE_DROP,
+	WRITE_MERGE,
+	WRITE_BATCH
 } writer_action_t;
 
 /**
  * @typedef	writer_msg_t
  *		Structure used to transfer data to the writer thread.
- * @field	type		Type of action (WRITE_PUT, WRITE_DEL).
+ * @field	type		Type of action (WRITE_PUT, WRITE_DEL, WRITE_DROP,
+ *				WRITE_MERGE, WRITE_BATCH).
  * @field	dbname		Name of the database. NULL by default.
  * @field	name		Key.
- * @field	data		Data.
+ * @field	data		Data (or operand of a merge).
  * @field	create_only	YTRUE if the key must not exist already.
+ * @field	merge_op	Merge operator (for WRITE_MERGE).
+ * @field	version		Expected version of the key (for WRITE_PUT and
+ *				WRITE_DEL). 0 to write without condition.
+ * @field	next		Next message of a batch (for WRITE_BATCH, the
+ *				first message of the batch).
  */
 typedef struct writer_msg_s {
 	writer_action_t type;
@@ -31,11 +46,18 @@ typedef struct writer_msg_s {
 	ybin_t name;
 	ybin_t data;
 	ybool_t create_only;
+	protocol_merge_t merge_op;
+	uint64_t version;
+	struct writer_msg_s *next;
 } writer_msg_t;
 
 /**
  * @function	writer_loop
- *		Callback function executed by the writer thread.
+ *		Callback function executed by the writer thread. Waiting
+ *		messages are processed by batches, each batch in one
+ *		transaction (the messages of a BATCH request are always
+ *		written in the same transaction). Merges on the same key are combined in memory
+ *		and written once per batch.
  * @param	param	Pointer to the main FineDB structure.
  * @return	Always NULL.
  */
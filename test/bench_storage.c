@@ -0,0 +1,450 @@
+/**
+ * bench_storage
+ * Microbenchmarks of the storage layer: LMDB accesses through the server's
+ * database functions, compression of values and dynamic buffers.
+ *
+ * @author	Amaury Bouchard <amaury@amaury.net>
+ * @copyright	© 2013, Amaury Bouchard
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lmdb.h"
+#include "snappy.h"
+#include "ydefs.h"
+#include "yerror.h"
+#include "ybin.h"
+#include "ydynabin.h"
+#include "database.h"
+
+/** @define BENCH_MAPSIZE Map size of the benchmark database. */
+#define BENCH_MAPSIZE		((size_t)2048 * 1048576)
+/** @define BENCH_DBNAME Name of the database used by the benchmarks. */
+#define BENCH_DBNAME		"bench"
+/** @define BENCH_KEYS Default maximum number of keys per size class. */
+#define BENCH_KEYS		100000
+/** @define BENCH_BYTES Maximum volume of data written per size class. */
+#define BENCH_BYTES		((size_t)64 * 1048576)
+/** @define BENCH_TXN_KEYS Maximum number of keys written with one transaction each. */
+#define BENCH_TXN_KEYS		1000
+/** @define BENCH_BATCH Number of writes per transaction in batch mode (like the writer thread). */
+#define BENCH_BATCH		1000
+/** @define BENCH_LOOPS Number of loops of the short operations. */
+#define BENCH_LOOPS		100000
+
+/* Sizes of keys. */
+static const size_t key_sizes[] = { 16, 64, 255 };
+/* Sizes of values. */
+static const size_t value_sizes[] = { 16, 256, 4096, 65536 };
+/* Sizes of compressed values. */
+static const size_t zip_sizes[] = { 64, 512, 4096, 65536, 1048576 };
+/* Sizes of the chunks added to dynamic buffers. */
+static const size_t chunk_sizes[] = { 16, 1024, 65536 };
+
+/* *** function declarations *** */
+static void usage(void);
+static uint64_t now(void);
+static void result(const char *name, const char *params, uint64_t ops, uint64_t bytes, uint64_t duration);
+static ybin_t make_key(char *buffer, size_t size, size_t index);
+static size_t *shuffle(size_t nbr);
+static void bench_kv(MDB_env *env, size_t max_keys);
+static void bench_dbi(MDB_env *env);
+static void bench_txn(MDB_env *env);
+static void bench_zip(void);
+static void bench_dynabin(void);
+static yerr_t list_callback(void *ptr, ybin_t key, ybin_t data);
+
+/** Usage function. */
+static void usage() {
+	printf("Usage: bench_storage [-f path] [-n number]\n"
+	       "\t-f path      Path to the database directory (default: temporary directory).\n"
+	       "\t-n number    Maximum number of keys per size class (default: %d).\n"
+	       "\n", BENCH_KEYS);
+}
+
+/**
+ * Main function of the program.
+ */
+int main(int argc, char *argv[]) {
+	char tmp_path[] = "/tmp/finedb-bench-XXXXXX";
+	char file[4096];
+	char *db_path = NULL;
+	size_t max_keys = BENCH_KEYS;
+	MDB_env *env;
+	int i;
+
+	while ((i = getopt(argc, argv, "hf:n:")) != -1) {
+		switch (i) {
+		case 'f':
+			db_path = optarg;
+			break;
+		case 'n':
+			max_keys = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			exit(i == 'h' ? 0 : 1);
+		}
+	}
+	if (db_path == NULL && (db_path = mkdtemp(tmp_path)) == NULL) {
+		fprintf(stderr, "Unable to create a temporary directory.\n");
+		exit(1);
+	}
+	if ((env = database_open(db_path, BENCH_MAPSIZE, 0, 4)) == NULL) {
+		fprintf(stderr, "Unable to open the database in '%s'.\n", db_path);
+		exit(1);
+	}
+	printf("%-24s %-32s %10s %12s %10s %10s\n", "benchmark", "parameters", "ops", "ops/s", "ns/op", "MB/s");
+	bench_kv(env, max_keys);
+	bench_dbi(env);
+	bench_txn(env);
+	database_close(env);
+	bench_zip();
+	bench_dynabin();
+	// the temporary directory is removed
+	if (db_path == tmp_path) {
+		snprintf(file, sizeof(file), "%s/data.mdb", db_path);
+		unlink(file);
+		snprintf(file, sizeof(file), "%s/lock.mdb", db_path);
+		unlink(file);
+		rmdir(db_path);
+	}
+	return (0);
+}
+
+/**
+ * Return the current time of a monotonic clock.
+ * @return	The time in nanoseconds.
+ */
+static uint64_t now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+/**
+ * Print the result of a benchmark.
+ * @param	name		Name of the benchmark.
+ * @param	params		Parameters of the benchmark.
+ * @param	ops		Number of operations.
+ * @param	bytes		Number of processed bytes (0 if not relevant).
+ * @param	duration	Duration (nanoseconds).
+ */
+static void result(const char *name, const char *params, uint64_t ops, uint64_t bytes, uint64_t duration) {
+	double seconds = (duration ? duration : 1) / 1e9;
+
+	printf("%-24s %-32s %10llu %12.0f %10.1f", name, params, (unsigned long long)ops, ops / seconds,
+	       (ops ? (double)duration / ops : 0.0));
+	if (bytes)
+		printf(" %10.1f", bytes / seconds / 1048576.0);
+	printf("\n");
+}
+
+/**
+ * Write a key: the zero-padded index.
+ * @param	buffer	Buffer of at least size + 1 bytes.
+ * @param	size	Size of the key.
+ * @param	index	Index of the key.
+ * @return	The key.
+ */
+static ybin_t make_key(char *buffer, size_t size, size_t index) {
+	ybin_t key;
+
+	snprintf(buffer, size + 1, "%0*zu", (int)size, index);
+	ybin_set(&key, buffer, size);
+	return (key);
+}
+
+/**
+ * Create a random permutation of indexes (always the same).
+ * @param	nbr	Number of indexes.
+ * @return	The array of indexes (must be freed), or NULL.
+ */
+static size_t *shuffle(size_t nbr) {
+	unsigned int seed = 1;
+	size_t *order, i, j, tmp;
+
+	if ((order = YMALLOC(nbr * sizeof(size_t))) == NULL)
+		return (NULL);
+	for (i = 0; i < nbr; i++)
+		order[i] = i;
+	for (i = nbr - 1; i > 0; i--) {
+		j = (size_t)rand_r(&seed) % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	return (order);
+}
+
+/**
+ * Benchmark of the key/value operations, for every key and value size. Keys
+ * are accessed in random order. Values are read in place, so only the writes
+ * give a throughput.
+ * @param	env		Database environment.
+ * @param	max_keys	Maximum number of keys per size class.
+ */
+static void bench_kv(MDB_env *env, size_t max_keys) {
+	char key_buffer[256], params[64];
+	unsigned int k, v;
+	size_t nbr_keys, i, *order, count;
+	uint64_t start;
+	MDB_txn *txn = NULL;
+	ybin_t key, value, data;
+	char *value_buffer;
+
+	for (k = 0; k < sizeof(key_sizes) / sizeof(size_t); k++) {
+		for (v = 0; v < sizeof(value_sizes) / sizeof(size_t); v++) {
+			nbr_keys = BENCH_BYTES / (key_sizes[k] + value_sizes[v]);
+			if (nbr_keys > max_keys)
+				nbr_keys = max_keys;
+			if (!nbr_keys || (order = shuffle(nbr_keys)) == NULL ||
+			    (value_buffer = YMALLOC(value_sizes[v])) == NULL)
+				return;
+			memset(value_buffer, 'v', value_sizes[v]);
+			ybin_set(&value, value_buffer, value_sizes[v]);
+			snprintf(params, sizeof(params), "key %zu, value %zu", key_sizes[k], value_sizes[v]);
+			// inserts, committed by batches (like the writer thread)
+			start = now();
+			for (i = 0; i < nbr_keys; i++) {
+				if (!(i % BENCH_BATCH)) {
+					if (txn)
+						database_transaction_commit(txn);
+					txn = database_transaction_start(env, YFALSE);
+				}
+				key = make_key(key_buffer, key_sizes[k], order[i]);
+				database_put(env, txn, YFALSE, BENCH_DBNAME, key, value, 0, NULL);
+			}
+			database_transaction_commit(txn);
+			txn = NULL;
+			result("put/batch", params, nbr_keys, nbr_keys * value_sizes[v], now() - start);
+			// updates, one transaction each (like synchronous PUTs)
+			count = (nbr_keys < BENCH_TXN_KEYS) ? nbr_keys : BENCH_TXN_KEYS;
+			start = now();
+			for (i = 0; i < count; i++) {
+				key = make_key(key_buffer, key_sizes[k], order[i]);
+				database_put(env, NULL, YFALSE, BENCH_DBNAME, key, value, 0, NULL);
+			}
+			result("put/txn", params, count, count * value_sizes[v], now() - start);
+			// reads, one transaction each
+			start = now();
+			for (i = 0; i < nbr_keys; i++) {
+				key = make_key(key_buffer, key_sizes[k], order[nbr_keys - 1 - i]);
+				database_get(env, NULL, BENCH_DBNAME, key, &data, NULL);
+			}
+			result("get/txn", params, nbr_keys, 0, now() - start);
+			// reads, in a shared transaction
+			start = now();
+			txn = database_transaction_start(env, YTRUE);
+			for (i = 0; i < nbr_keys; i++) {
+				key = make_key(key_buffer, key_sizes[k], order[nbr_keys - 1 - i]);
+				database_get(env, txn, BENCH_DBNAME, key, &data, NULL);
+			}
+			database_transaction_rollback(txn);
+			txn = NULL;
+			result("get/shared", params, nbr_keys, 0, now() - start);
+			// full scan
+			count = 0;
+			start = now();
+			database_list(env, NULL, BENCH_DBNAME, list_callback, &count);
+			result("list", params, count, 0, now() - start);
+			// deletions, committed by batches
+			start = now();
+			for (i = 0; i < nbr_keys; i++) {
+				if (!(i % BENCH_BATCH)) {
+					if (txn)
+						database_transaction_commit(txn);
+					txn = database_transaction_start(env, YFALSE);
+				}
+				key = make_key(key_buffer, key_sizes[k], order[i]);
+				database_del(env, txn, BENCH_DBNAME, key, 0);
+			}
+			database_transaction_commit(txn);
+			txn = NULL;
+			result("del/batch", params, nbr_keys, 0, now() - start);
+			database_drop(env, NULL, BENCH_DBNAME);
+			YFREE(order);
+			YFREE(value_buffer);
+		}
+	}
+}
+
+/**
+ * Benchmark of the opening of database handles, done by every database
+ * function.
+ * @param	env	Database environment.
+ */
+static void bench_dbi(MDB_env *env) {
+	MDB_txn *txn;
+	MDB_dbi dbi;
+	ybin_t key;
+	uint64_t start;
+	int i;
+
+	// the named database must exist
+	ybin_set(&key, "key", 3);
+	database_put(env, NULL, YFALSE, BENCH_DBNAME, key, key, 0, NULL);
+	txn = database_transaction_start(env, YTRUE);
+	start = now();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		mdb_dbi_open(txn, NULL, 0, &dbi);
+	result("dbi open", "default database", BENCH_LOOPS, 0, now() - start);
+	start = now();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		mdb_dbi_open(txn, BENCH_DBNAME, 0, &dbi);
+	result("dbi open", "named database", BENCH_LOOPS, 0, now() - start);
+	database_transaction_rollback(txn);
+	database_drop(env, NULL, BENCH_DBNAME);
+}
+
+/**
+ * Benchmark of the transactions.
+ * @param	env	Database environment.
+ */
+static void bench_txn(MDB_env *env) {
+	MDB_txn *txn;
+	uint64_t start;
+	int i;
+
+	start = now();
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		txn = database_transaction_start(env, YTRUE);
+		database_transaction_rollback(txn);
+	}
+	result("txn begin+abort", "read-only", BENCH_LOOPS, 0, now() - start);
+	start = now();
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		txn = database_transaction_start(env, YFALSE);
+		database_transaction_rollback(txn);
+	}
+	result("txn begin+abort", "read-write", BENCH_LOOPS, 0, now() - start);
+	start = now();
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		txn = database_transaction_start(env, YFALSE);
+		database_transaction_commit(txn);
+	}
+	result("txn begin+commit", "read-write, empty", BENCH_LOOPS, 0, now() - start);
+}
+
+/**
+ * Benchmark of the compression of values, for every size class, with
+ * compressible (text) and random data.
+ */
+static void bench_zip() {
+	static const char *words[] = { "finedb ", "key ", "value ", "lmdb ", "snappy ", "server ", "data " };
+	struct snappy_env zip_env;
+	char *raw, *zip, *unzip, params[64];
+	size_t zip_len, len, max_size, loops, i, j;
+	unsigned int seed = 1, s, random_data;
+	uint64_t start;
+
+	max_size = zip_sizes[sizeof(zip_sizes) / sizeof(size_t) - 1];
+	memset(&zip_env, 0, sizeof(zip_env));
+	if (snappy_init_env(&zip_env) ||
+	    (raw = YMALLOC(max_size)) == NULL ||
+	    (zip = YMALLOC(snappy_max_compressed_length(max_size))) == NULL ||
+	    (unzip = YMALLOC(max_size)) == NULL)
+		return;
+	for (random_data = 0; random_data < 2; random_data++) {
+		// text made of words, or random bytes
+		for (i = 0; i < max_size; ) {
+			if (random_data) {
+				raw[i++] = (char)rand_r(&seed);
+				continue;
+			}
+			for (j = 0, s = (unsigned int)rand_r(&seed) % 7; words[s][j] && i < max_size; j++)
+				raw[i++] = words[s][j];
+		}
+		for (s = 0; s < sizeof(zip_sizes) / sizeof(size_t); s++) {
+			len = zip_sizes[s];
+			loops = (BENCH_BYTES / len < 10) ? 10 : BENCH_BYTES / len;
+			snappy_compress(&zip_env, raw, len, zip, &zip_len);
+			snprintf(params, sizeof(params), "%s %zu (%.0f%%)", (random_data ? "random" : "text"), len,
+			         100.0 * zip_len / len);
+			start = now();
+			for (i = 0; i < loops; i++)
+				snappy_compress(&zip_env, raw, len, zip, &zip_len);
+			result("compress", params, loops, loops * len, now() - start);
+			start = now();
+			for (i = 0; i < loops; i++)
+				snappy_uncompress(zip, zip_len, unzip);
+			result("uncompress", params, loops, loops * len, now() - start);
+		}
+	}
+	snappy_free_env(&zip_env);
+	YFREE(raw);
+	YFREE(zip);
+	YFREE(unzip);
+}
+
+/**
+ * Benchmark of the dynamic buffers: growth of a buffer filled by chunks, and
+ * a reception loop where each chunk is consumed after being added (like the
+ * connection threads).
+ */
+static void bench_dynabin() {
+	ydynabin_t *buffer;
+	char *chunk, params[64];
+	size_t c, i, loops, reallocs;
+	void *data;
+	uint64_t start;
+
+	if ((chunk = YMALLOC(chunk_sizes[sizeof(chunk_sizes) / sizeof(size_t) - 1])) == NULL)
+		return;
+	for (c = 0; c < sizeof(chunk_sizes) / sizeof(size_t); c++) {
+		loops = BENCH_BYTES / chunk_sizes[c];
+		// growth up to BENCH_BYTES
+		if ((buffer = ydynabin_new(NULL, 0, YFALSE)) == NULL)
+			break;
+		reallocs = 0;
+		data = NULL;
+		start = now();
+		for (i = 0; i < loops; i++) {
+			ydynabin_expand(buffer, chunk, chunk_sizes[c]);
+			if (buffer->data != data) {
+				reallocs++;
+				data = buffer->data;
+			}
+		}
+		start = now() - start;
+		snprintf(params, sizeof(params), "chunk %zu, %zu allocs, %.0f%% free", chunk_sizes[c], reallocs,
+		         100.0 * buffer->free / (buffer->len + buffer->free));
+		result("ydynabin grow", params, loops, loops * chunk_sizes[c], start);
+		ydynabin_delete(buffer);
+		// reception loop
+		if ((buffer = ydynabin_new(NULL, 0, YFALSE)) == NULL)
+			break;
+		reallocs = 0;
+		data = NULL;
+		start = now();
+		for (i = 0; i < loops; i++) {
+			ydynabin_expand(buffer, chunk, chunk_sizes[c]);
+			if ((char*)buffer->data - buffer->offset != data) {
+				reallocs++;
+				data = (char*)buffer->data - buffer->offset;
+			}
+			ydynabin_forward(buffer, chunk_sizes[c]);
+		}
+		snprintf(params, sizeof(params), "chunk %zu, %zu allocs", chunk_sizes[c], reallocs);
+		result("ydynabin expand+forward", params, loops, loops * chunk_sizes[c], now() - start);
+		ydynabin_delete(buffer);
+	}
+	YFREE(chunk);
+}
+
+/**
+ * Callback of the full scan: count the keys.
+ * @param	ptr	Pointer to the counter.
+ * @param	key	Key.
+ * @param	data	Value.
+ * @return	YENOERR.
+ */
+static yerr_t list_callback(void *ptr, ybin_t key, ybin_t data) {
+	size_t *count = ptr;
+
+	(*count)++;
+	return (YENOERR);
+}